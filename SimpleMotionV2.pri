@@ -16,20 +16,24 @@ DEFINES += SIMPLEMOTIONV2_LIBRARY
 #define ENABLE_DEBUG_PRINTS to enable SM debug printing (enabling it may slow down & grow binary significantly especially on MCU systems)
 #DEFINES += ENABLE_DEBUG_PRINTS
 
-SOURCES += $$PWD/sm_consts.c $$PWD/simplemotion.c $$PWD/busdevice.c \
-    $$PWD/bufferedmotion.c $$PWD/devicedeployment.c $$PWD/utils/crc.c
+SOURCES += $$PWD/sm_consts.c $$PWD/simplemotion.c $$PWD/smcrc.c $$PWD/busdevice.c $$PWD/handletable.c \
+    $$PWD/bufferedmotion.c $$PWD/devicedeployment.c $$PWD/buscapture.c $$PWD/nodediscovery.c $$PWD/transactiontemplate.c $$PWD/telemetry.c $$PWD/sharedtelemetry.c $$PWD/busserver.c $$PWD/busscheduler.c $$PWD/readcombiner.c $$PWD/utils/crc.c \
+    $$PWD/drivers/simulator/smsimulator.c
 
 HEADERS += $$PWD/simplemotion_private.h\
     $$PWD/busdevice.h  $$PWD/simplemotion.h $$PWD/sm485.h $$PWD/simplemotion_defs.h \
-    $$PWD/bufferedmotion.h $$PWD/devicedeployment.h \
+    $$PWD/bufferedmotion.h $$PWD/devicedeployment.h $$PWD/buscapture.h $$PWD/handletable.h $$PWD/nodediscovery.h $$PWD/transactiontemplate.h $$PWD/telemetry.h $$PWD/sharedtelemetry.h $$PWD/busserver.h $$PWD/busscheduler.h $$PWD/readcombiner.h \
     $$PWD/user_options.h \
     $$PWD/simplemotion_types.h \
-    $$PWD/user_options.h $$PWD/utils/crc.h
+    $$PWD/user_options.h $$PWD/utils/crc.h \
+    $$PWD/drivers/simulator/smsimulator.h
+
+unix:LIBS += -lpthread #needed for capture file background writer and bus server
 
 
 greaterThan(INCLUDE_BUILT_IN_DRIVERS, 0+)  {
-    SOURCES += $$PWD/drivers/serial/pcserialport.c $$PWD/drivers/tcpip/tcpclient.c
-    HEADERS += $$PWD/drivers/serial/pcserialport.h $$PWD/drivers/tcpip/tcpclient.h
+    SOURCES += $$PWD/drivers/serial/pcserialport.c $$PWD/drivers/tcpip/tcpclient.c $$PWD/drivers/uring/smuring.c $$PWD/drivers/replay/smreplay.c $$PWD/drivers/busclient/smbusclient.c
+    HEADERS += $$PWD/drivers/serial/pcserialport.h $$PWD/drivers/tcpip/tcpclient.h $$PWD/drivers/uring/smuring.h $$PWD/drivers/replay/smreplay.h $$PWD/drivers/busclient/smbusclient.h
     DEFINES += ENABLE_BUILT_IN_DRIVERS
     win32 {
         LIBS+=-lws2_32 #needed for tcp ip API
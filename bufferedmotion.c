@@ -2,15 +2,13 @@
 #include "user_options.h"
 #include "simplemotion_private.h"
 #include "bufferedmotion.h"
+#include "transactiontemplate.h"
 #include "sm485.h"
+#include <stddef.h>
+#include <stdlib.h>
 
-/** initialize buffered motion for one axis with address and samplerate (Hz) */
-SM_STATUS smBufferedInit(BufferedMotionAxis *newAxis, smbus handle, smaddr deviceAddress, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength )
+static void smBufferedInitAxisState( BufferedMotionAxis *newAxis, smbus handle, smaddr deviceAddress, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength )
 {
-    //value out of range
-    if(sampleRate<1 || sampleRate>2500)
-        return recordStatus(handle,SM_ERR_PARAMETER);
-
     newAxis->initialized=smfalse;
     newAxis->bushandle=handle;
     newAxis->samplerate=sampleRate;
@@ -25,51 +23,114 @@ SM_STATUS smBufferedInit(BufferedMotionAxis *newAxis, smbus handle, smaddr devic
     newAxis->driveFlagsModifiedAtInit=smfalse;
     newAxis->deviceCapabilityFlags1=0;
     newAxis->deviceCapabilityFlags2=0;
+}
 
-    //discard any existing data in buffer, and to get correct reading of device buffer size
-    smSetParameter( newAxis->bushandle, newAxis->deviceAddress, SMP_SYSTEM_CONTROL,SMP_SYSTEM_CONTROL_ABORTBUFFERED);
-
-    //after abort, we can read the maximum size of data in device buffer
-    smRead2Parameters(newAxis->bushandle,newAxis->deviceAddress,SMP_BUFFER_FREE_BYTES,&newAxis->bufferLength,SMP_SM_VERSION,&newAxis->smProtocolVersion);
-    newAxis->bufferFreeBytes=newAxis->bufferLength;
-
-    if(smRead1Parameter(handle,deviceAddress,SMP_DRIVE_FLAGS,&newAxis->driveFlagsBeforeInit)!=SM_OK)
-        return getCumulativeStatus(handle);//if error happens in read, avoid altering the flag (later)
+//first init transaction: aborts buffered motion and reads the values that are needed for setup and restored at deinit.
+//the same template is executed on every axis
+static void smBufferedInitReadTemplate( SM_TRANSACTION_TEMPLATE *tpl )
+{
+    smTemplateInit(tpl);
+    //discard any existing data in buffer, and to get correct reading of device buffer size. commands of queue are executed
+    //in order so buffer free bytes are read after abort
+    smTemplateAppendSetParam(tpl,SMP_SYSTEM_CONTROL,SMP_SYSTEM_CONTROL_ABORTBUFFERED);
+    smTemplateAppendGetParam(tpl,SMP_BUFFER_FREE_BYTES,offsetof(BufferedMotionAxis,bufferLength));
+    smTemplateAppendGetParam(tpl,SMP_DRIVE_FLAGS,offsetof(BufferedMotionAxis,driveFlagsBeforeInit));
+    smTemplateAppendGetParam(tpl,SMP_TRAJ_PLANNER_ACCEL,offsetof(BufferedMotionAxis,driveAccelerationBeforeInit));//store original for restoration
+}
 
-    if(newAxis->smProtocolVersion>=28)//V28 and later support device capability flags, so read them
-    {
-        smRead2Parameters(newAxis->bushandle,newAxis->deviceAddress,SMP_DEVICE_CAPABILITIES1,&newAxis->deviceCapabilityFlags1,SMP_DEVICE_CAPABILITIES2,&newAxis->deviceCapabilityFlags2);
-    }
+//second init transaction: sets up buffered motion of axis from the values that were read
+static void smBufferedInitWriteTemplate( SM_TRANSACTION_TEMPLATE *tpl, BufferedMotionAxis *newAxis )
+{
+    smTemplateInit(tpl);
 
     //set linear interpolation mode if supported
     if(newAxis->deviceCapabilityFlags1&DEVICE_CAPABILITY1_BUFFERED_MOTION_LINEAR_INTERPOLATION)
     {
-        smSetParameter(handle,deviceAddress,SMP_BUFFERED_MODE,BUFFERED_INTERPOLATION_MODE_LINEAR);//enable interpolation of buffered setpoints
+        smTemplateAppendSetParam(tpl,SMP_BUFFERED_MODE,BUFFERED_INTERPOLATION_MODE_LINEAR);//enable interpolation of buffered setpoints
     }
     else//use traditional nearest neighbor setpoint mode
     {
         //set input smoothing filter on [CIS] if samplerate is not maximum. with filter samplerates 250,500,750,1000,1250 etc run smooth. needed only for old nearest neighbor setpoint "interpolation" mode
-        if(sampleRate<2500)
+        if(newAxis->samplerate<2500)
         {
-            smSetParameter(handle,deviceAddress,SMP_DRIVE_FLAGS,newAxis->driveFlagsBeforeInit|FLAG_USE_INPUT_LP_FILTER);
+            smTemplateAppendSetParam(tpl,SMP_DRIVE_FLAGS,newAxis->driveFlagsBeforeInit|FLAG_USE_INPUT_LP_FILTER);
             newAxis->driveFlagsModifiedAtInit=smtrue;
         }
     }
 
-    //set buffer execution rate to max so init commands go fast
-    smSetParameter(handle,deviceAddress,SMP_BUFFERED_CMD_PERIOD,10000/2500);
-
     //set acceleration to "infinite" to avoid modification of user supplied trajectory inside drive
-    smRead1Parameter(handle,deviceAddress,SMP_TRAJ_PLANNER_ACCEL,&newAxis->driveAccelerationBeforeInit);//store original for restoration
-    smSetParameter(handle,deviceAddress,SMP_TRAJ_PLANNER_ACCEL,32767);
-
+    smTemplateAppendSetParam(tpl,SMP_TRAJ_PLANNER_ACCEL,32767);
     //set buffer execution rate
-    smSetParameter(handle,deviceAddress,SMP_BUFFERED_CMD_PERIOD,10000/sampleRate);
+    smTemplateAppendSetParam(tpl,SMP_BUFFERED_CMD_PERIOD,10000/newAxis->samplerate);
+}
 
-    //FIXME can cause unnecessary initialized=false status if there was error flags in cumulative status before calling this func
-    if(getCumulativeStatus(handle)==SM_OK)
-        newAxis->initialized=smtrue;
+/** initialize buffered motion for one axis with address and samplerate (Hz) */
+SM_STATUS smBufferedInit(BufferedMotionAxis *newAxis, smbus handle, smaddr deviceAddress, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength )
+{
+    return smBufferedInitMultiple(newAxis,1,handle,&deviceAddress,sampleRate,readParamAddr,readDataLength);
+}
 
+SM_STATUS smBufferedInitMultiple( BufferedMotionAxis *newAxes, int numAxes, smbus handle, const smaddr *deviceAddresses, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength )
+{
+    SM_TRANSACTION_TEMPLATE readTemplate, *writeTemplates;
+    SM_TEMPLATE_TRANSACTION *transactions;
+    SM_NODE_INFO info;
+    int i;
+
+    //value out of range
+    if(sampleRate<1 || sampleRate>2500 || numAxes<1 || newAxes==NULL || deviceAddresses==NULL)
+        return recordStatus(handle,SM_ERR_PARAMETER);
+
+    for(i=0;i<numAxes;i++)
+    {
+        smBufferedInitAxisState(&newAxes[i],handle,deviceAddresses[i],sampleRate,readParamAddr,readDataLength);
+
+        //version and capability flags (V28 and later) come from node info cache
+        if(smGetNodeInfo(handle,deviceAddresses[i],&info)!=SM_OK)
+            return getCumulativeStatus(handle);
+        newAxes[i].smProtocolVersion=info.smVersion;
+        newAxes[i].deviceCapabilityFlags1=info.capabilities1;
+        newAxes[i].deviceCapabilityFlags2=info.capabilities2;
+    }
+
+    transactions=(SM_TEMPLATE_TRANSACTION*)malloc(numAxes*sizeof(SM_TEMPLATE_TRANSACTION));
+    writeTemplates=(SM_TRANSACTION_TEMPLATE*)malloc(numAxes*sizeof(SM_TRANSACTION_TEMPLATE));
+    if(transactions==NULL || writeTemplates==NULL)
+    {
+        free(transactions);
+        free(writeTemplates);
+        return recordStatus(handle,SM_ERR_BUS);//out of memory
+    }
+
+    //transactions of all axes are sent as one pipelined batch, see smSetPipelineWindow
+    smBufferedInitReadTemplate(&readTemplate);
+    for(i=0;i<numAxes;i++)
+    {
+        transactions[i].nodeAddress=deviceAddresses[i];
+        transactions[i].tpl=&readTemplate;
+        transactions[i].results=&newAxes[i];
+    }
+
+    //setup is written only if everything was read successfully, otherwise flags could be altered based on invalid values
+    if(smTemplateExecuteBatch(handle,transactions,numAxes)==SM_OK)
+    {
+        for(i=0;i<numAxes;i++)
+        {
+            newAxes[i].bufferFreeBytes=newAxes[i].bufferLength;
+            smBufferedInitWriteTemplate(&writeTemplates[i],&newAxes[i]);
+            transactions[i].tpl=&writeTemplates[i];
+            transactions[i].results=NULL;
+        }
+        smTemplateExecuteBatch(handle,transactions,numAxes);
+
+        //FIXME can cause unnecessary initialized=false status if there was error flags in cumulative status before calling this func
+        if(getCumulativeStatus(handle)==SM_OK)
+            for(i=0;i<numAxes;i++)
+                newAxes[i].initialized=smtrue;
+    }
+
+    free(transactions);
+    free(writeTemplates);
     return getCumulativeStatus(handle);
 }
 
@@ -142,6 +203,20 @@ smint32 smBufferedGetBytesConsumed(BufferedMotionAxis *axis, smint32 numFillPoin
 }
 
 
+//return data works like FIFO for all sent commands (each sent stream command will produce return data packet),
+//first ones are return packets of stream initialization that are discarded. returns number of values stored to receivedPoints
+static smint32 smBufferedStoreReturnData( BufferedMotionAxis *axis, const smint32 *values, smint32 numValues, smint32 *receivedPoints )
+{
+    smint32 discarded=numValues<axis->numberOfDiscardableReturnDataPackets ? numValues : axis->numberOfDiscardableReturnDataPackets;
+    smint32 i;
+
+    axis->numberOfDiscardableReturnDataPackets-=discarded;
+    for(i=discarded;i<numValues;i++)
+        receivedPoints[i-discarded]=values[i];
+    axis->numberOfPendingReadPackets-=numValues-discarded;
+    return numValues-discarded;
+}
+
 SM_STATUS smBufferedFillAndReceive(BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, smint32 *numReceivedPoints, smint32 *receivedPoints, smint32 *bytesFilled )
 {
     smint32 bytesUsed=0;
@@ -199,28 +274,21 @@ SM_STATUS smBufferedFillAndReceive(BufferedMotionAxis *axis, smint32 numFillPoin
     //read all available return data from stream (commands that have been axecuted in drive so far)
     //return data works like FIFO for all sent commands (each sent stream command will produce return data packet that we fetch here)
     {
-        smint32 bufferedReturnBytesReceived,readval;
-        int n=0;
+        smint32 values[SM_BUFFERED_MAX_POINTS_PER_RECEIVE], bufferedReturnBytesReceived, maxValues, numValues, n=0;
 
         //read return data buffer
         smBytesReceived(axis->bushandle,&bufferedReturnBytesReceived);//get amount of data available
-        //qDebug()<<axis<<"return data bytes"<<bufferedReturnBytesReceived;
         while(bufferedReturnBytesReceived>1)//loop until we have read it all
         {
-            smGetQueuedSMCommandReturnValue(axis->bushandle, &readval);
+            //values are at most 4 bytes, so at least 2 bytes are left before each decoded value like when reading them
+            //one by one. the trailing 1 byte return value is left in queue
+            maxValues=(bufferedReturnBytesReceived-2)/4+1;
+            if(maxValues>SM_BUFFERED_MAX_POINTS_PER_RECEIVE)
+                maxValues=SM_BUFFERED_MAX_POINTS_PER_RECEIVE;
+            if(smGetQueuedSMCommandReturnValues(axis->bushandle,values,NULL,maxValues,&numValues)!=SM_OK || numValues==0)
+                break;
+            n+=smBufferedStoreReturnData(axis,values,numValues,&receivedPoints[n]);
             smBytesReceived(axis->bushandle,&bufferedReturnBytesReceived);
-
-            if(axis->numberOfDiscardableReturnDataPackets>0)
-            {
-                //discard this return data as it's intialization return packets
-                axis->numberOfDiscardableReturnDataPackets--;
-            }
-            else//its read data that user expects
-            {
-                receivedPoints[n]=readval;
-                n++;
-                axis->numberOfPendingReadPackets--;
-            }
         }
         *numReceivedPoints=n;
     }
@@ -229,6 +297,36 @@ SM_STATUS smBufferedFillAndReceive(BufferedMotionAxis *axis, smint32 numFillPoin
     return getCumulativeStatus(axis->bushandle);
 }
 
+SM_STATUS smBufferedReceive( BufferedMotionAxis *axis, smint32 maxPoints, smint32 *numReceivedPoints, smint32 *receivedPoints )
+{
+    SM_STATUS stat;
+    smint16 len;
+    smint32 n=0;
+
+    *numReceivedPoints=0;
+    if(maxPoints<SM_BUFFERED_MAX_POINTS_PER_RECEIVE) return recordStatus(axis->bushandle,SM_ERR_PARAMETER);
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(axis->bushandle)==smfalse) return SM_ERR_NODEVICE;
+
+    //device returns as much return data as fits in one frame, repeat until it has no more or receivedPoints might not have room for the next reply
+    do
+    {
+        const smuint8 *payload;
+        smint32 values[SM_BUFFERED_MAX_POINTS_PER_RECEIVE];
+        int numValues;
+
+        stat=smTransmitReceiveFrame(axis->bushandle,axis->deviceAddress,SMCMD_BUFFERED_RETURN_DATA,0,NULL);
+        if(stat!=SM_OK) break;
+
+        len=smGetReceivedPayload(axis->bushandle,&payload);
+        smDecodeReturnValues(payload,len,values,NULL,SM_BUFFERED_MAX_POINTS_PER_RECEIVE,&numValues);
+        n+=smBufferedStoreReturnData(axis,values,numValues,&receivedPoints[n]);
+    } while(len>SM485_MAX_PAYLOAD_BYTES-4 && maxPoints-n>=SM_BUFFERED_MAX_POINTS_PER_RECEIVE);
+
+    *numReceivedPoints=n;
+    return recordStatus(axis->bushandle,stat);
+}
+
 /** this will stop executing buffered motion immediately and discard rest of already filled buffer on a given axis. May cause drive fault state such as tracking error if done at high speed because stop happens without deceleration.*/
 SM_STATUS smBufferedAbort(BufferedMotionAxis *axis)
 {
@@ -49,6 +49,14 @@ numFillPoints must be equal or below 30 for 32B, 40 for 24B and 60 for 16B.
 */
 LIB SM_STATUS smBufferedInit( BufferedMotionAxis *newAxis, smbus handle, smaddr deviceAddress, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength  );
 
+/** Same as smBufferedInit but initializes numAxes axes of the same bus, newAxes[i] is initialized for device deviceAddresses[i].
+ * Every axis takes two transactions (plus two if its info is not in node info cache, see smGetNodeInfo). Transactions of
+ * all axes are sent as two pipelined batches, so on buses with send window (see smSetPipelineWindow) the axes don't wait
+ * for each other's replies. Node info that is not cached yet is read one axis at a time.
+ * Setup is written to devices only after reading from all of them has succeeded.
+ */
+LIB SM_STATUS smBufferedInitMultiple( BufferedMotionAxis *newAxes, int numAxes, smbus handle, const smaddr *deviceAddresses, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength );
+
 /** uninitialize axis from buffered motion, recommended to call this before closing bus so drive's adjusted parameters are restored to originals*/
 LIB SM_STATUS smBufferedDeinit( BufferedMotionAxis *axis );
 
@@ -58,6 +66,19 @@ LIB SM_STATUS smBufferedGetFree(BufferedMotionAxis *axis, smint32 *numBytesFree
 LIB smint32 smBufferedGetMaxFillSize(BufferedMotionAxis *axis, smint32 numBytesFree );
 LIB smint32 smBufferedGetBytesConsumed(BufferedMotionAxis *axis, smint32 numFillPoints );
 LIB SM_STATUS smBufferedFillAndReceive( BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, smint32 *numReceivedPoints, smint32 *receivedPoints, smint32 *bytesFilled );
+
+//max number of values returned by device in one frame (one byte each if all are status returns)
+#define SM_BUFFERED_MAX_POINTS_PER_RECEIVE 120
+
+/** Read return data of already executed buffered commands without sending fill data (SMCMD_BUFFERED_RETURN_DATA).
+ * Data is requested repeatedly until device has no more of it, so return data can be collected at a different rate than
+ * buffer is filled, and the rest of pending data (numberOfPendingReadPackets) can be read after the last fill.
+ * Return values are stored in the same order and format as in smBufferedFillAndReceive.
+ * -maxPoints: size of receivedPoints, must be at least SM_BUFFERED_MAX_POINTS_PER_RECEIVE. Reading stops when the next
+ *  reply might not fit, the rest is returned by the next call.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smBufferedReceive( BufferedMotionAxis *axis, smint32 maxPoints, smint32 *numReceivedPoints, smint32 *receivedPoints );
 /** This will stop executing buffered motion immediately and discard rest of already filled buffer on a given axis. May cause drive fault state such as tracking error if done at high speed because stop happens without deceleration.
 Note: this will not stop motion, but just stop executing the sent buffered commands. The last executed motion point will be still followed by drive. So this is bad function
 for quick stopping stopping, for stop to the actual place consider using disable drive instead (prefferably phsyical input disable).
@@ -0,0 +1,281 @@
+//Raw bus traffic capture to binary file
+//Copyright (c) Granite Devices Oy
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "buscapture.h"
+#include "simplemotion_private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+//file is written from background thread. on other platforms file is written synchronously when buffer fills up
+#define SM_CAPTURE_BACKGROUND_WRITER
+#endif
+
+struct _SMCapture
+{
+    FILE *file;
+    smuint64 startTime;
+
+    smuint8 *buffer[2];
+    smint32 bufferUsed[2];
+    int activeBuffer;//index of buffer where new records are appended
+    int flushBuffer;//index of buffer that is being written to file, -1 if none
+    smuint32 droppedRecords;
+
+    //RX burst that is being received. only used by the thread that records traffic, so bytes are collected without
+    //locking and the burst is appended to buffer as one record
+    smuint8 rxBurst[SM_CAPTURE_RX_BURST_BYTES];
+    smint32 rxBurstUsed;
+    smuint64 rxBurstStart, rxBurstLast;//timestamps of first and last byte
+
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t writer;
+    smbool stopWriter;
+#endif
+};
+
+static void put16le( smuint8 *buf, smuint16 val )
+{
+    buf[0]=val&0xff;
+    buf[1]=val>>8;
+}
+
+static void put32le( smuint8 *buf, smuint32 val )
+{
+    put16le(buf,val&0xffff);
+    put16le(buf+2,val>>16);
+}
+
+static void put64le( smuint8 *buf, smuint64 val )
+{
+    put32le(buf,(smuint32)(val&0xffffffff));
+    put32le(buf+4,(smuint32)(val>>32));
+}
+
+//start writing active buffer to file and continue appending to the other one. must be called with lock held.
+//returns smfalse if previous buffer is still being written
+static smbool captureSwapBuffers( SMCapture *c )
+{
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+    if(c->flushBuffer>=0)
+        return smfalse;
+
+    c->flushBuffer=c->activeBuffer;
+    c->activeBuffer^=1;
+    c->bufferUsed[c->activeBuffer]=0;
+    pthread_cond_signal(&c->wake);
+    return smtrue;
+#else
+    fwrite(c->buffer[c->activeBuffer],1,c->bufferUsed[c->activeBuffer],c->file);
+    c->bufferUsed[c->activeBuffer]=0;
+    return smtrue;
+#endif
+}
+
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+static void *captureWriterThread( void *arg )
+{
+    SMCapture *c=(SMCapture*)arg;
+
+    pthread_mutex_lock(&c->lock);
+    for(;;)
+    {
+        while(c->flushBuffer<0 && c->stopWriter==smfalse)
+        {
+            smuint64 deadlineNs=smGetMonotonicTimeNs()+SM_CAPTURE_FLUSH_INTERVAL_MS*1000000ULL;
+
+            //flush periodically so that file is up to date also on low traffic
+            if(smCondWaitUntilNs(&c->wake,&c->lock,deadlineNs)!=0 && c->bufferUsed[c->activeBuffer]>0)
+                captureSwapBuffers(c);
+        }
+
+        if(c->flushBuffer<0)
+            break;//stop requested and nothing left to write, rest of active buffer is written by smCaptureClose
+
+        {
+            int idx=c->flushBuffer;
+            pthread_mutex_unlock(&c->lock);
+            fwrite(c->buffer[idx],1,c->bufferUsed[idx],c->file);
+            fflush(c->file);
+            pthread_mutex_lock(&c->lock);
+            c->flushBuffer=-1;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+#endif
+
+SMCapture *smCaptureOpen( const char *filename, const char *busname )
+{
+    SMCapture *c;
+    smuint8 header[SM_CAPTURE_FILE_HEADER_LEN];
+    size_t namelen=strlen(busname);
+
+    c=(SMCapture*)calloc(1,sizeof(SMCapture));
+    if(c==NULL)
+        return NULL;
+
+    c->buffer[0]=(smuint8*)malloc(SM_CAPTURE_BUFFER_SIZE);
+    c->buffer[1]=(smuint8*)malloc(SM_CAPTURE_BUFFER_SIZE);
+    c->file=fopen(filename,"wb");
+    if(c->buffer[0]==NULL || c->buffer[1]==NULL || c->file==NULL)
+    {
+        smDebug(-1,SMDebugLow,"Capture: unable to open file '%s'\n",filename);
+        if(c->file!=NULL)
+            fclose(c->file);
+        free(c->buffer[0]);
+        free(c->buffer[1]);
+        free(c);
+        return NULL;
+    }
+
+    if(namelen>0xffff)
+        namelen=0xffff;
+    memcpy(header,SM_CAPTURE_FILE_MAGIC,4);
+    put16le(header+4,SM_CAPTURE_FILE_VERSION);
+    put16le(header+6,(smuint16)namelen);
+    fwrite(header,1,sizeof(header),c->file);
+    fwrite(busname,1,namelen,c->file);
+
+    c->activeBuffer=0;
+    c->flushBuffer=-1;
+    c->startTime=smGetMonotonicTimeNs();
+
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+    pthread_mutex_init(&c->lock,NULL);
+    smCondInit(&c->wake);
+    c->stopWriter=smfalse;
+    if(pthread_create(&c->writer,NULL,captureWriterThread,c)!=0)
+    {
+        smDebug(-1,SMDebugLow,"Capture: unable to start writer thread\n");
+        pthread_cond_destroy(&c->wake);
+        pthread_mutex_destroy(&c->lock);
+        fclose(c->file);
+        free(c->buffer[0]);
+        free(c->buffer[1]);
+        free(c);
+        return NULL;
+    }
+#endif
+
+    return c;
+}
+
+//append record to active buffer. timestamps are from smGetMonotonicTimeNs
+static void captureAppend( SMCapture *c, smuint8 type, const smuint8 *data, smint32 length, smuint64 start, smuint64 end )
+{
+    smuint64 duration=end-start;
+    smuint8 *buf;
+    smint32 used;
+
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+    pthread_mutex_lock(&c->lock);
+#endif
+
+    if(c->bufferUsed[c->activeBuffer]+SM_CAPTURE_RECORD_HEADER_LEN+length>SM_CAPTURE_BUFFER_SIZE && captureSwapBuffers(c)==smfalse)
+    {
+        //writer can't keep up, drop record rather than block the bus
+        c->droppedRecords++;
+    }
+    else
+    {
+        buf=c->buffer[c->activeBuffer];
+        used=c->bufferUsed[c->activeBuffer];
+        if(duration>0xffffffffUL)
+            duration=0xffffffffUL;
+
+        buf[used]=type;
+        buf[used+1]=0;
+        put16le(buf+used+2,(smuint16)length);
+        put64le(buf+used+4,start-c->startTime);
+        put32le(buf+used+12,(smuint32)duration);
+        memcpy(buf+used+SM_CAPTURE_RECORD_HEADER_LEN,data,length);
+        c->bufferUsed[c->activeBuffer]=used+SM_CAPTURE_RECORD_HEADER_LEN+length;
+    }
+
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+    pthread_mutex_unlock(&c->lock);
+#endif
+}
+
+void smCaptureEndRx( SMCapture *c )
+{
+    if(c->rxBurstUsed==0)
+        return;
+    captureAppend(c,SM_CAPTURE_RX,c->rxBurst,c->rxBurstUsed,c->rxBurstStart,c->rxBurstLast);
+    c->rxBurstUsed=0;
+}
+
+void smCaptureRecord( SMCapture *c, smuint8 type, const smuint8 *data, smint32 length )
+{
+    smuint64 now=smGetMonotonicTimeNs();
+
+    if(length<=0 || length>SM_CAPTURE_RECORD_MAX_DATA)
+        return;
+
+    if(type!=SM_CAPTURE_RX)
+    {
+        smCaptureEndRx(c);
+        captureAppend(c,type,data,length,now,now);
+        return;
+    }
+
+    while(length>0)
+    {
+        smint32 n=SM_CAPTURE_RX_BURST_BYTES-c->rxBurstUsed;
+        if(n>length)
+            n=length;
+        if(c->rxBurstUsed==0)
+            c->rxBurstStart=now;
+        memcpy(c->rxBurst+c->rxBurstUsed,data,n);
+        c->rxBurstUsed+=n;
+        c->rxBurstLast=now;
+        data+=n;
+        length-=n;
+
+        //long burst continues in the next record
+        if(c->rxBurstUsed==SM_CAPTURE_RX_BURST_BYTES)
+            smCaptureEndRx(c);
+    }
+}
+
+smuint32 smCaptureClose( SMCapture *c )
+{
+    smuint32 dropped;
+
+    smCaptureEndRx(c);
+
+#ifdef SM_CAPTURE_BACKGROUND_WRITER
+    pthread_mutex_lock(&c->lock);
+    c->stopWriter=smtrue;
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->writer,NULL);
+    pthread_cond_destroy(&c->wake);
+    pthread_mutex_destroy(&c->lock);
+#endif
+
+    //write rest
+    fwrite(c->buffer[c->activeBuffer],1,c->bufferUsed[c->activeBuffer],c->file);
+    fclose(c->file);
+
+    dropped=c->droppedRecords;
+    if(dropped>0)
+        smDebug(-1,SMDebugLow,"Capture: %u records dropped because file writing was too slow\n",(unsigned int)dropped);
+
+    free(c->buffer[0]);
+    free(c->buffer[1]);
+    free(c);
+
+    return dropped;
+}
@@ -0,0 +1,72 @@
+//Raw bus traffic capture to binary file
+//Copyright (c) Granite Devices Oy
+
+#ifndef BUSCAPTURE_H
+#define BUSCAPTURE_H
+
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Capture file format. All multi-byte values are stored in little endian byte order.
+ *
+ * File header:
+ *  4 bytes  magic "SMCP"
+ *  u16      file format version (SM_CAPTURE_FILE_VERSION)
+ *  u16      N = length of bus name
+ *  N bytes  bus device name, i.e. "/dev/ttyUSB0" (not null terminated)
+ *
+ * Followed by any number of records:
+ *  u8       record type, SM_CAPTURE_TX or SM_CAPTURE_RX
+ *  u8       reserved, 0
+ *  u16      L = number of data bytes
+ *  u64      monotonic timestamp in nanoseconds since start of capture (first byte of record)
+ *  u32      duration of record in nanoseconds (time between first and last byte of RX burst, 0 for TX)
+ *  L bytes  raw bus data
+ *
+ * TX record is written for every transmitted frame (one smBDTransmit call). RX record contains a burst of
+ * consecutively received bytes, it ends at the next TX or when reading times out. Bursts longer than
+ * SM_CAPTURE_RX_BURST_BYTES are split to several records.
+ */
+#define SM_CAPTURE_FILE_MAGIC "SMCP"
+#define SM_CAPTURE_FILE_VERSION 1
+#define SM_CAPTURE_FILE_HEADER_LEN 8
+#define SM_CAPTURE_RECORD_HEADER_LEN 16
+#define SM_CAPTURE_RECORD_MAX_DATA 0xffff
+
+//record types
+#define SM_CAPTURE_TX 1
+#define SM_CAPTURE_RX 2
+
+//size of one of two in-memory capture buffers. capture data is flushed to file by background writer when buffer fills or periodically
+#define SM_CAPTURE_BUFFER_SIZE 65536
+//max bytes of RX record. bytes of a burst are collected before they are added to capture buffer
+#define SM_CAPTURE_RX_BURST_BYTES 1024
+//how often background writer flushes buffered records to file even if buffer is not full
+#define SM_CAPTURE_FLUSH_INTERVAL_MS 200
+
+typedef struct _SMCapture SMCapture;
+
+/* Internal capture writer functions used by busdevice.c and bus drivers. For application use,
+ * see smCaptureStart and smCaptureStop in simplemotion.h */
+
+//create capture file and start background writer. returns NULL on failure
+SMCapture *smCaptureOpen( const char *filename, const char *busname );
+
+//append data to capture. never blocks on file I/O, if writer can't keep up, records are dropped and counted.
+//RX data is collected to a burst that is added as one record by smCaptureEndRx or the next TX. must not be called
+//from several threads at the same time
+void smCaptureRecord( SMCapture *capture, smuint8 type, const smuint8 *data, smint32 length );
+
+//end RX burst collected by smCaptureRecord, called when reading times out
+void smCaptureEndRx( SMCapture *capture );
+
+//flush pending records, stop writer and close file. returns number of records dropped during capture
+smuint32 smCaptureClose( SMCapture *capture );
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BUSCAPTURE_H
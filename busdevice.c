@@ -1,13 +1,27 @@
 #include "busdevice.h"
 #include "user_options.h"
+#include "buscapture.h"
+#include "handletable.h"
 
 #include "drivers/serial/pcserialport.h"
 #include "drivers/tcpip/tcpclient.h"
 #include "drivers/ftdi_d2xx/sm_d2xx.h"
+#include "drivers/replay/smreplay.h"
+#include "drivers/busclient/smbusclient.h"
 
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+//serializes capture start and stop calls of different threads
+static pthread_mutex_t captureLock=PTHREAD_MUTEX_INITIALIZER;
+#define CAPTURE_LOCK() pthread_mutex_lock(&captureLock)
+#define CAPTURE_UNLOCK() pthread_mutex_unlock(&captureLock)
+#else
+#define CAPTURE_LOCK()
+#define CAPTURE_UNLOCK()
+#endif
 
 
 //how much bytes available in transmit buffer
@@ -33,24 +47,51 @@ typedef struct _SMBusDevice
     BusdeviceWriteBuffer busWriteCallback;
     BusdeviceMiscOperation busMiscOperationCallback;
     BusdeviceClose busCloseCallback;
+
+    //non-NULL if traffic is being recorded, see smBDCaptureStart. captureInUse is set while the thread that uses the
+    //bus records to it, so that capture can be replaced from other threads without locking every received byte
+    SMCapture * volatile capture;
+    volatile smbool captureInUse;
 } SMBusDevice;
 
-//init on first open
-smbool bdInitialized=smfalse;
-SMBusDevice BusDevice[SM_MAX_BUSES];
+//bus devices are allocated at open and indexed by smbusdevicehandle
+static SMHandleTable BusDeviceTable;
+#define BusDevice(handle) (*(SMBusDevice*)SM_HANDLE_TABLE_ITEM(BusDeviceTable,handle))
+
+
+//get capture for recording traffic, NULL if not capturing. smBDCaptureLeave must be called after recording
+static SMCapture *smBDCaptureEnter( SMBusDevice *device )
+{
+    SMCapture *capture;
+
+    if(device->capture==NULL)
+        return NULL;
+
+    device->captureInUse=smtrue;
+    SM_MEMORY_BARRIER();//pairs with barrier of smBDCaptureReplace
+    capture=device->capture;
+    if(capture==NULL)
+        device->captureInUse=smfalse;
+    return capture;
+}
 
-//init device struct table
-void smBDinit()
+static void smBDCaptureLeave( SMBusDevice *device )
 {
-	int i;
-	for(i=0;i<SM_MAX_BUSES;i++)
-	{
-		BusDevice[i].opened=smfalse;
-        BusDevice[i].txBufferUsed=0;
-	}
-	bdInitialized=smtrue;
+    SM_MEMORY_BARRIER();
+    device->captureInUse=smfalse;
 }
 
+//publish new capture (or NULL) and return the previous one after the thread using the bus is done with it
+static SMCapture *smBDCaptureReplace( SMBusDevice *device, SMCapture *capture )
+{
+    SMCapture *previous=device->capture;
+
+    device->capture=capture;
+    SM_MEMORY_BARRIER();
+    while(device->captureInUse==smtrue)
+        SM_CPU_RELAX();
+    return previous;
+}
 
 //ie "COM1" "VSD2USB"
 //return -1 if fails, otherwise handle number
@@ -60,10 +101,16 @@ smbusdevicehandle smBDOpen( const char *devicename )
     smbusdevicehandle h;
 
     //try opening with all drivers:
+    h=smBDOpenWithCallbacks( devicename, replayPortOpen, replayPortClose, replayPortRead, replayPortWrite, replayPortMiscOperation );
+    if(h>=0) return h;//was success
+    h=smBDOpenWithCallbacks( devicename, recorderPortOpen, recorderPortClose, recorderPortRead, recorderPortWrite, recorderPortMiscOperation );
+    if(h>=0) return h;//was success
     h=smBDOpenWithCallbacks( devicename, serialPortOpen, serialPortClose, serialPortRead, serialPortWrite, serialPortMiscOperation );
     if(h>=0) return h;//was success
     h=smBDOpenWithCallbacks( devicename, tcpipPortOpen, tcpipPortClose, tcpipPortRead, tcpipPortWrite, tcpipMiscOperation );
     if(h>=0) return h;//was success
+    h=smBDOpenWithCallbacks( devicename, busclientPortOpen, busclientPortClose, busclientPortRead, busclientPortWrite, busclientPortMiscOperation );
+    if(h>=0) return h;//was success
 #ifdef FTDI_D2XX_SUPPORT
     h=smBDOpenWithCallbacks( devicename, d2xxPortOpen, d2xxPortClose, d2xxPortRead, d2xxPortWrite, d2xxPortMiscOperation );
     if(h>=0) return h;//was success
@@ -81,39 +128,41 @@ smbusdevicehandle smBDOpen( const char *devicename )
 
 smbusdevicehandle smBDOpenWithCallbacks(const char *devicename, BusdeviceOpen busOpenCallback, BusdeviceClose busCloseCallback , BusdeviceReadBuffer busReadCallback, BusdeviceWriteBuffer busWriteCallback, BusdeviceMiscOperation busMiscOperationCallback )
 {
-    int handle;
+    SMBusDevice *device;
+    int handle=-1;
     smbool success;
 
-    //true on first call
-    if(bdInitialized==smfalse)
-        smBDinit();
-
-    //find free handle
-    for(handle=0;handle<SM_MAX_BUSES;handle++)
+    device=(SMBusDevice*)calloc(1,sizeof(SMBusDevice));
+    if(device!=NULL)
+        handle=smHandleTableAdd(&BusDeviceTable,device);
+    //all handles in use or out of memory
+    if(handle<0)
     {
-        if(BusDevice[handle].opened==smfalse) break;//choose this
+        free(device);
+        return -1;
     }
 
-    //all handles in use
-    if(handle>=SM_MAX_BUSES) return -1;
-
     //setup callbacks
-    BusDevice[handle].busOpenCallback=busOpenCallback;
-    BusDevice[handle].busWriteCallback=busWriteCallback;
-    BusDevice[handle].busReadCallback=busReadCallback;
-    BusDevice[handle].busMiscOperationCallback=busMiscOperationCallback;
-    BusDevice[handle].busCloseCallback=busCloseCallback;
+    BusDevice(handle).busOpenCallback=busOpenCallback;
+    BusDevice(handle).busWriteCallback=busWriteCallback;
+    BusDevice(handle).busReadCallback=busReadCallback;
+    BusDevice(handle).busMiscOperationCallback=busMiscOperationCallback;
+    BusDevice(handle).busCloseCallback=busCloseCallback;
 
     //try opening
-    BusDevice[handle].busDevicePointer=BusDevice[handle].busOpenCallback( devicename, SMBusBaudrate, &success );
+    BusDevice(handle).busDevicePointer=BusDevice(handle).busOpenCallback( devicename, SMBusBaudrate, &success );
     if( success==smfalse )
     {
+        smHandleTableRemove(&BusDeviceTable,handle);
+        free(device);
         return -1; //failed to open
     }
 
-    BusDevice[handle].opened=smtrue;
-    BusDevice[handle].txBufferUsed=0;
-    BusDevice[handle].cumulativeSmStatus=0;
+    BusDevice(handle).opened=smtrue;
+    BusDevice(handle).txBufferUsed=0;
+    BusDevice(handle).cumulativeSmStatus=0;
+    BusDevice(handle).capture=NULL;
+    BusDevice(handle).captureInUse=smfalse;
 
     //purge
     if(smBDMiscOperation(handle,MiscOperationPurgeRX)==smfalse)
@@ -128,20 +177,51 @@ smbusdevicehandle smBDOpenWithCallbacks(const char *devicename, BusdeviceOpen bu
 
 smbool smIsBDHandleOpen( const smbusdevicehandle handle )
 {
-	if(handle<0) return smfalse;
-	if(handle>=SM_MAX_BUSES) return smfalse;
-	return BusDevice[handle].opened;
+    SMBusDevice *device=(SMBusDevice*)smHandleTableGet(&BusDeviceTable,handle);
+    return device!=NULL && device->opened;
 }
 
-//return true if ok
+//return true if ok. handle is released also if device was left closed by failed smBDReopen, but then smfalse is returned
 smbool smBDClose( const smbusdevicehandle handle )
 {
-	//check if handle valid & open
-	if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
+    SMBusDevice *device=(SMBusDevice*)smHandleTableGet(&BusDeviceTable,handle);
+    smbool wasOpen;
 
-    BusDevice[handle].busCloseCallback(BusDevice[handle].busDevicePointer );
-    BusDevice[handle].opened=smfalse;
-    return smtrue;
+    if(device==NULL) return smfalse;
+
+    wasOpen=device->opened;
+    if(wasOpen)
+    {
+        smBDCaptureStop(handle);
+        device->busCloseCallback(device->busDevicePointer );
+        device->opened=smfalse;
+    }
+
+    smHandleTableRemove(&BusDeviceTable,handle);
+    free(device);
+    return wasOpen;
+}
+
+//close and open port again with the same driver at different baudrate. capture continues uninterrupted.
+//if opening fails, bus device is left closed. returns true if sucessfully
+smbool smBDReopen( const smbusdevicehandle handle, const char *devicename, unsigned long baudrate )
+{
+    smbool success;
+
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
+
+    BusDevice(handle).busCloseCallback(BusDevice(handle).busDevicePointer);
+    BusDevice(handle).busDevicePointer=BusDevice(handle).busOpenCallback( devicename, baudrate, &success );
+    BusDevice(handle).txBufferUsed=0;
+    if( success==smfalse )
+    {
+        smBDCaptureStop(handle);
+        BusDevice(handle).opened=smfalse;
+        return smfalse;
+    }
+
+    return smBDMiscOperation(handle,MiscOperationPurgeRX);
 }
 
 
@@ -154,11 +234,11 @@ smbool smBDWrite(const smbusdevicehandle handle, const smuint8 byte )
 	//check if handle valid & open
 	if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
 
-    if(BusDevice[handle].txBufferUsed<TANSMIT_BUFFER_LENGTH)
+    if(BusDevice(handle).txBufferUsed<TANSMIT_BUFFER_LENGTH)
     {
         //append to buffer
-        BusDevice[handle].txBuffer[BusDevice[handle].txBufferUsed]=byte;
-        BusDevice[handle].txBufferUsed++;
+        BusDevice(handle).txBuffer[BusDevice(handle).txBufferUsed]=byte;
+        BusDevice(handle).txBufferUsed++;
         smDebug(handle, SMDebugTrace, "  Sending byte %02x\n",byte);
         return smtrue;
     }
@@ -169,17 +249,26 @@ smbool smBDWrite(const smbusdevicehandle handle, const smuint8 byte )
 
 smbool smBDTransmit(const smbusdevicehandle handle)
 {
+    SMCapture *capture;
+
     //check if handle valid & open
     if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
 
-    if(BusDevice[handle].busWriteCallback(BusDevice[handle].busDevicePointer,BusDevice[handle].txBuffer, BusDevice[handle].txBufferUsed)==BusDevice[handle].txBufferUsed)
+    capture=smBDCaptureEnter(&BusDevice(handle));
+    if(capture!=NULL)
+    {
+        smCaptureRecord(capture,SM_CAPTURE_TX,BusDevice(handle).txBuffer,BusDevice(handle).txBufferUsed);
+        smBDCaptureLeave(&BusDevice(handle));
+    }
+
+    if(BusDevice(handle).busWriteCallback(BusDevice(handle).busDevicePointer,BusDevice(handle).txBuffer, BusDevice(handle).txBufferUsed)==BusDevice(handle).txBufferUsed)
     {
-        BusDevice[handle].txBufferUsed=0;
+        BusDevice(handle).txBufferUsed=0;
         return smtrue;
     }
     else
     {
-        BusDevice[handle].txBufferUsed=0;
+        BusDevice(handle).txBufferUsed=0;
         return smfalse;
     }
 }
@@ -192,7 +281,18 @@ smbool smBDRead( const smbusdevicehandle handle, smuint8 *byte )
 	if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
 
     int n;
-    n=BusDevice[handle].busReadCallback(BusDevice[handle].busDevicePointer, byte, 1);
+    SMCapture *capture;
+    n=BusDevice(handle).busReadCallback(BusDevice(handle).busDevicePointer, byte, 1);
+    capture=smBDCaptureEnter(&BusDevice(handle));
+    if(capture!=NULL)
+    {
+        //timeout ends RX burst
+        if(n==1)
+            smCaptureRecord(capture,SM_CAPTURE_RX,byte,1);
+        else
+            smCaptureEndRx(capture);
+        smBDCaptureLeave(&BusDevice(handle));
+    }
     if( n!=1 )
     {
         smDebug(handle, SMDebugMid, "  Reading a byte from bus failed\n");
@@ -211,9 +311,49 @@ smbool smBDMiscOperation(const smbusdevicehandle handle , BusDeviceMiscOperation
     //check if handle valid & open
     if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
 
-    BusDevice[handle].txBufferUsed=0;
+    BusDevice(handle).txBufferUsed=0;
+
+    return BusDevice(handle).busMiscOperationCallback(BusDevice(handle).busDevicePointer,operation);
+}
+
+//start recording bus traffic into capture file, replaces possible earlier capture
+//returns true if sucessfully
+smbool smBDCaptureStart( const smbusdevicehandle handle, const char *filename, const char *busname )
+{
+    SMCapture *capture;
+
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
+
+    capture=smCaptureOpen(filename,busname);
+    if(capture==NULL)
+        return smfalse;
+
+    CAPTURE_LOCK();
+    capture=smBDCaptureReplace(&BusDevice(handle),capture);
+    CAPTURE_UNLOCK();
+    if(capture!=NULL)
+        smCaptureClose(capture);
+    return smtrue;
+}
+
+//stop recording bus traffic and close capture file
+//returns true if capture was running
+smbool smBDCaptureStop( const smbusdevicehandle handle )
+{
+    SMCapture *capture;
+
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
+
+    CAPTURE_LOCK();
+    capture=smBDCaptureReplace(&BusDevice(handle),NULL);
+    CAPTURE_UNLOCK();
+    if(capture==NULL)
+        return smfalse;
 
-    return BusDevice[handle].busMiscOperationCallback(BusDevice[handle].busDevicePointer,operation);
+    smCaptureClose(capture);
+    return smtrue;
 }
 
 
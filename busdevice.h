@@ -19,6 +19,10 @@ smbusdevicehandle smBDOpenWithCallbacks(const char *devicename, BusdeviceOpen bu
 //return true if ok
 smbool smBDClose( const smbusdevicehandle handle );
 
+//close and open port again at different baudrate, used for changing bus speed. if opening fails, device is left closed.
+//return true if ok
+smbool smBDReopen( const smbusdevicehandle handle, const char *devicename, unsigned long baudrate );
+
 //write one byte to trasmit buffer. send data with smBDTransmit()
 //returns smtrue on success. smfalse could mean buffer full error if forgot to call smBDTransmit
 smbool smBDWrite( const smbusdevicehandle handle , const smuint8 byte );
@@ -35,6 +39,14 @@ smbool smBDRead( const smbusdevicehandle handle , smuint8 *byte );
 //returns true if sucessfully
 smbool smBDMiscOperation( const smbusdevicehandle handle, BusDeviceMiscOperationType operation );
 
+//start recording all TX frames and RX bytes of the bus device into a capture file (see buscapture.h). busname is stored in file header.
+//capture may be started and stopped also from other threads than the one that uses the bus device.
+//returns true if sucessfully
+smbool smBDCaptureStart( const smbusdevicehandle handle, const char *filename, const char *busname );
+
+//stop recording and flush capture file. returns true if capture was running
+smbool smBDCaptureStop( const smbusdevicehandle handle );
+
 //BUS DEVICE INFO FETCH FUNCTIONS:
 
 // Return number of bus devices found. details of each device may be consequently fetched by smBDGetBusDeviceDetails()
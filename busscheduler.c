@@ -0,0 +1,270 @@
+//Priority scheduling of transactions of threads that share a bus, see busscheduler.h
+//Copyright (c) Granite Devices Oy
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "busscheduler.h"
+#include "simplemotion_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+//threads wait for their turn. on other platforms transactions are granted immediately
+#define SM_SCHEDULER_THREADS
+#endif
+
+//result of checking whether a transaction may start now
+typedef enum
+{
+    SMSchedulerGrant,
+    SMSchedulerWaitBus,//bus is in use or others are before in queue
+    SMSchedulerWaitGap//doesn't fit before the next cyclic transaction or in budget of class
+} SMSchedulerDecision;
+
+struct _SMBusScheduler
+{
+    smbus handle;
+    smbool attached;//bus was open at create, see smAttachBusUser
+    smuint64 periodNs;
+    smuint32 budgetUs[SM_SCHEDULER_NUM_CLASSES];//0=unlimited
+    smuint64 usedUs[SM_SCHEDULER_NUM_CLASSES];//estimated time granted during current cycle
+
+    smuint64 cycleStartNs;//start of current cycle, moved by cyclic transactions
+    smuint64 lastCyclicNs;//grant time of latest cyclic transaction, 0 if none yet
+    smuint64 lastCyclicEndNs;
+    smuint64 lastCyclicDurationNs;
+
+    smbool busy;
+    SM_SCHEDULER_CLASS activeClass;
+    smuint64 grantNs;
+
+    //each class is served in order of arrival
+    smuint32 nextTicket[SM_SCHEDULER_NUM_CLASSES];
+    smuint32 servingTicket[SM_SCHEDULER_NUM_CLASSES];
+    int waiting[SM_SCHEDULER_NUM_CLASSES];
+
+    SM_SCHEDULER_STATS stats[SM_SCHEDULER_NUM_CLASSES];
+
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+#endif
+};
+
+LIB SMBusScheduler *smSchedulerCreate( const smbus handle, smuint32 cyclePeriodUs )
+{
+    SMBusScheduler *scheduler;
+
+    if(cyclePeriodUs==0) return NULL;
+    scheduler=(SMBusScheduler*)calloc(1,sizeof(SMBusScheduler));
+    if(scheduler==NULL) return NULL;
+
+    scheduler->handle=handle;
+    scheduler->attached=smAttachBusUser(handle)==SM_OK ? smtrue : smfalse;
+    scheduler->periodNs=(smuint64)cyclePeriodUs*1000;
+    scheduler->cycleStartNs=smGetMonotonicTimeNs();
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_init(&scheduler->lock,NULL);
+    smCondInit(&scheduler->wake);
+#endif
+    return scheduler;
+}
+
+LIB void smSchedulerDestroy( SMBusScheduler *scheduler )
+{
+    if(scheduler==NULL) return;
+#ifdef SM_SCHEDULER_THREADS
+    pthread_cond_destroy(&scheduler->wake);
+    pthread_mutex_destroy(&scheduler->lock);
+#endif
+    if(scheduler->attached==smtrue)
+        smDetachBusUser(scheduler->handle);
+    free(scheduler);
+}
+
+LIB SM_STATUS smSchedulerSetBudget( SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, smuint32 budgetUs )
+{
+    if(schedulingClass<=SM_SCHEDULER_CYCLIC || schedulingClass>=SM_SCHEDULER_NUM_CLASSES) return SM_ERR_PARAMETER;
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_lock(&scheduler->lock);
+#endif
+    scheduler->budgetUs[schedulingClass]=budgetUs;
+#ifdef SM_SCHEDULER_THREADS
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->lock);
+#endif
+    return SM_OK;
+}
+
+LIB smuint32 smSchedulerEstimateUs( const SMBusScheduler *scheduler, const smaddr nodeAddress, int txBytes, int rxBytes )
+{
+    return smEstimateTransactionUs(scheduler->handle,nodeAddress,txBytes,rxBytes);
+}
+
+static smbool smSchedulerCyclicActive( const SMBusScheduler *scheduler, smuint64 now )
+{
+    return scheduler->lastCyclicNs!=0 && now<scheduler->lastCyclicNs+2*scheduler->periodNs ? smtrue : smfalse;
+}
+
+//without cyclic traffic, cycles (and budgets) follow the clock
+static void smSchedulerAdvanceCycle( SMBusScheduler *scheduler, smuint64 now )
+{
+    if(smSchedulerCyclicActive(scheduler,now)==smtrue || now<scheduler->cycleStartNs+scheduler->periodNs)
+        return;
+
+    scheduler->cycleStartNs+=(now-scheduler->cycleStartNs)/scheduler->periodNs*scheduler->periodNs;
+    memset(scheduler->usedUs,0,sizeof(scheduler->usedUs));
+}
+
+//decide whether transaction with ticket may start now. waitUntilNs is set to the time when decision may change by itself
+static SMSchedulerDecision smSchedulerDecide( const SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, smuint32 ticket, smuint32 estimatedUs, smuint64 now, smuint64 *waitUntilNs )
+{
+    smuint64 estimatedNs=(smuint64)estimatedUs*1000;
+    int i;
+
+    *waitUntilNs=0;
+    if(scheduler->busy==smtrue || ticket!=scheduler->servingTicket[schedulingClass])
+        return SMSchedulerWaitBus;
+    if(schedulingClass==SM_SCHEDULER_CYCLIC)
+        return SMSchedulerGrant;
+    for(i=0;i<(int)schedulingClass;i++)
+        if(scheduler->waiting[i]>0)
+            return SMSchedulerWaitBus;
+
+    if(scheduler->budgetUs[schedulingClass]!=0 && scheduler->usedUs[schedulingClass]>0
+            && scheduler->usedUs[schedulingClass]+estimatedUs>scheduler->budgetUs[schedulingClass])
+    {
+        *waitUntilNs=scheduler->cycleStartNs+scheduler->periodNs;
+        return SMSchedulerWaitGap;
+    }
+
+    if(smSchedulerCyclicActive(scheduler,now)==smtrue && now+estimatedNs>scheduler->cycleStartNs+scheduler->periodNs)
+    {
+        //transaction that doesn't fit in any gap is placed right after cyclic one
+        if(estimatedNs+scheduler->lastCyclicDurationNs>=scheduler->periodNs && scheduler->lastCyclicEndNs>=scheduler->lastCyclicNs
+                && now<scheduler->cycleStartNs+scheduler->periodNs)
+            return SMSchedulerGrant;
+
+        //cyclic transaction ends the wait, or stopping of cyclic traffic
+        *waitUntilNs=scheduler->lastCyclicNs+2*scheduler->periodNs;
+        return SMSchedulerWaitGap;
+    }
+
+    return SMSchedulerGrant;
+}
+
+#ifdef SM_SCHEDULER_THREADS
+static void smSchedulerWait( SMBusScheduler *scheduler, smuint64 now, smuint64 waitUntilNs )
+{
+    if(waitUntilNs==0)
+    {
+        pthread_cond_wait(&scheduler->wake,&scheduler->lock);
+        return;
+    }
+    if(waitUntilNs<=now)
+        return;
+    smCondWaitUntilNs(&scheduler->wake,&scheduler->lock,waitUntilNs);
+}
+#endif
+
+LIB SM_STATUS smSchedulerBegin( SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, smuint32 estimatedUs )
+{
+    SM_SCHEDULER_STATS *stats;
+    smbool deferred=smfalse;
+    smuint64 start, now, waitUs;
+    smuint32 ticket;
+
+    if(schedulingClass<SM_SCHEDULER_CYCLIC || schedulingClass>=SM_SCHEDULER_NUM_CLASSES) return SM_ERR_PARAMETER;
+
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_lock(&scheduler->lock);
+#endif
+    ticket=scheduler->nextTicket[schedulingClass]++;
+    scheduler->waiting[schedulingClass]++;
+    start=now=smGetMonotonicTimeNs();
+
+#ifdef SM_SCHEDULER_THREADS
+    for(;;)
+    {
+        smuint64 waitUntilNs;
+        SMSchedulerDecision decision;
+
+        smSchedulerAdvanceCycle(scheduler,now);
+        decision=smSchedulerDecide(scheduler,schedulingClass,ticket,estimatedUs,now,&waitUntilNs);
+        if(decision==SMSchedulerGrant)
+            break;
+        if(decision==SMSchedulerWaitGap)
+            deferred=smtrue;
+
+        smSchedulerWait(scheduler,now,waitUntilNs);
+        now=smGetMonotonicTimeNs();
+    }
+#else
+    smSchedulerAdvanceCycle(scheduler,now);
+#endif
+
+    scheduler->waiting[schedulingClass]--;
+    scheduler->servingTicket[schedulingClass]++;
+    scheduler->busy=smtrue;
+    scheduler->activeClass=schedulingClass;
+    scheduler->grantNs=now;
+
+    if(schedulingClass==SM_SCHEDULER_CYCLIC)
+    {
+        scheduler->cycleStartNs=now;
+        scheduler->lastCyclicNs=now;
+        memset(scheduler->usedUs,0,sizeof(scheduler->usedUs));
+    }
+    scheduler->usedUs[schedulingClass]+=estimatedUs;
+
+    stats=&scheduler->stats[schedulingClass];
+    stats->granted++;
+    stats->usedUs+=estimatedUs;
+    if(deferred==smtrue)
+        stats->deferred++;
+    waitUs=(now-start)/1000;
+    if(waitUs>stats->maxWaitUs)
+        stats->maxWaitUs=(smuint32)waitUs;
+
+#ifdef SM_SCHEDULER_THREADS
+    //next one of the same class may now wait for its turn
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->lock);
+#endif
+    return SM_OK;
+}
+
+LIB void smSchedulerEnd( SMBusScheduler *scheduler )
+{
+    smuint64 now=smGetMonotonicTimeNs();
+
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_lock(&scheduler->lock);
+#endif
+    if(scheduler->busy==smtrue && scheduler->activeClass==SM_SCHEDULER_CYCLIC)
+    {
+        scheduler->lastCyclicEndNs=now;
+        scheduler->lastCyclicDurationNs=now-scheduler->grantNs;
+    }
+    scheduler->busy=smfalse;
+#ifdef SM_SCHEDULER_THREADS
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->lock);
+#endif
+}
+
+LIB SM_STATUS smSchedulerGetStats( SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, SM_SCHEDULER_STATS *stats )
+{
+    if(schedulingClass<SM_SCHEDULER_CYCLIC || schedulingClass>=SM_SCHEDULER_NUM_CLASSES) return SM_ERR_PARAMETER;
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_lock(&scheduler->lock);
+#endif
+    *stats=scheduler->stats[schedulingClass];
+#ifdef SM_SCHEDULER_THREADS
+    pthread_mutex_unlock(&scheduler->lock);
+#endif
+    return SM_OK;
+}
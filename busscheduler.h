@@ -0,0 +1,100 @@
+//Priority scheduling of transactions of threads that share a bus
+//Copyright (c) Granite Devices Oy
+
+#ifndef BUSSCHEDULER_H
+#define BUSSCHEDULER_H
+
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Scheduler arbitrates access to one bus between threads, i.e. a control loop thread that runs smFastUpdateCycle or
+ * buffered motion at a fixed cycle and other threads that read or write parameters. Each thread wraps its transaction
+ * between smSchedulerBegin and smSchedulerEnd and tells the class of the transaction and its expected duration (see
+ * smSchedulerEstimateUs).
+ *
+ * -SM_SCHEDULER_CYCLIC transactions are deadline critical and always go first. Granting one starts a new cycle.
+ * -SM_SCHEDULER_ACYCLIC and SM_SCHEDULER_BACKGROUND transactions (in this order) are granted only if they are expected
+ *  to end before the next cyclic transaction is due, so they never delay the cyclic traffic. A transaction that is
+ *  longer than the whole gap between cyclic transactions is granted right after a cyclic one has ended. Optionally
+ *  time used by a class can be limited to a budget per cycle with smSchedulerSetBudget.
+ *
+ * If no cyclic transaction has been made for two cycle periods, other classes are granted whenever the bus is free.
+ *
+ * I.e. in control loop thread:
+ *  smSchedulerBegin(scheduler,SM_SCHEDULER_CYCLIC,cycleUs);
+ *  smFastUpdateCycle(handle,1,setpoint,0,&read1,&read2);
+ *  smSchedulerEnd(scheduler);
+ *
+ * and in other threads:
+ *  smSchedulerBegin(scheduler,SM_SCHEDULER_ACYCLIC,smSchedulerEstimateUs(scheduler,1,SM_SCHEDULER_READ_TX_BYTES,SM_SCHEDULER_READ_RX_BYTES));
+ *  smRead1Parameter(handle,1,SMP_ACTUAL_POSITION_FB,&position);
+ *  smSchedulerEnd(scheduler);
+ *
+ * Waiting for the turn requires threads, on platforms other than Linux and macOS smSchedulerBegin grants immediately.
+ */
+
+typedef enum
+{
+    SM_SCHEDULER_CYCLIC=0,
+    SM_SCHEDULER_ACYCLIC,
+    SM_SCHEDULER_BACKGROUND,
+    SM_SCHEDULER_NUM_CLASSES
+} SM_SCHEDULER_CLASS;
+
+//frame sizes of smRead1Parameter and smSetParameter for smSchedulerEstimateUs: 5 bytes of frame overhead plus subpackets,
+//replies are counted with 4 bytes per subpacket
+#define SM_SCHEDULER_READ_TX_BYTES (5+10)
+#define SM_SCHEDULER_READ_RX_BYTES (5+4*4)
+#define SM_SCHEDULER_WRITE_TX_BYTES (5+6)
+#define SM_SCHEDULER_WRITE_RX_BYTES (5+2*4)
+
+typedef struct
+{
+    smuint32 granted;//number of transactions
+    smuint32 deferred;//number of transactions that had to wait for a gap or budget, not just for the bus to be free
+    smuint32 maxWaitUs;//longest time from smSchedulerBegin to grant
+    smuint64 usedUs;//sum of estimated durations of granted transactions
+} SM_SCHEDULER_STATS;
+
+typedef struct _SMBusScheduler SMBusScheduler;
+
+/** Create scheduler for an opened bus. cyclePeriodUs is the interval of cyclic transactions. Bus can't be closed
+ * until scheduler is destroyed. Without an open bus, scheduler only arbitrates and estimates are 0.
+  -return value: scheduler, NULL if out of memory or cyclePeriodUs is 0
+*/
+LIB SMBusScheduler *smSchedulerCreate( const smbus handle, smuint32 cyclePeriodUs );
+
+/** Free scheduler. No thread may be waiting in or between smSchedulerBegin and smSchedulerEnd. */
+LIB void smSchedulerDestroy( SMBusScheduler *scheduler );
+
+/** Limit estimated time of transactions of a non-cyclic class per cycle, 0 means no limit (default). At least one
+ * transaction is granted per cycle even if its estimate exceeds the budget.
+  -return value: SM_OK or SM_ERR_PARAMETER if class is SM_SCHEDULER_CYCLIC or invalid
+*/
+LIB SM_STATUS smSchedulerSetBudget( SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, smuint32 budgetUs );
+
+/** Expected duration of a transaction with given frame sizes: wire time of bytes at bus baudrate plus reply latency
+ * of node measured by adaptive timeouts (see smSetAdaptiveTimeout), if it's enabled */
+LIB smuint32 smSchedulerEstimateUs( const SMBusScheduler *scheduler, const smaddr nodeAddress, int txBytes, int rxBytes );
+
+/** Wait until transaction of given class and estimated duration may use the bus. Must be followed by smSchedulerEnd.
+  -return value: SM_OK or SM_ERR_PARAMETER if class is invalid
+*/
+LIB SM_STATUS smSchedulerBegin( SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, smuint32 estimatedUs );
+
+/** Release bus after transaction started with smSchedulerBegin */
+LIB void smSchedulerEnd( SMBusScheduler *scheduler );
+
+/** Get statistics of class since creation
+  -return value: SM_OK or SM_ERR_PARAMETER if class is invalid
+*/
+LIB SM_STATUS smSchedulerGetStats( SMBusScheduler *scheduler, SM_SCHEDULER_CLASS schedulingClass, SM_SCHEDULER_STATS *stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUSSCHEDULER_H
@@ -0,0 +1,482 @@
+//Sharing one bus with multiple processes through a local socket, see busserver.h
+//Copyright (c) Granite Devices Oy
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "busserver.h"
+#include "busdevice.h"
+#include "simplemotion_private.h"
+#include "sm485.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#define SM_BUS_SERVER_SUPPORTED
+#endif
+
+#ifdef SM_BUS_SERVER_SUPPORTED
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 //SO_NOSIGPIPE is set instead
+#endif
+
+//largest SM frame: cmd, size, address, payload, crc
+#define SM_BUS_SERVER_MAX_FRAME (SM485_MAX_PAYLOAD_BYTES+5)
+//bytes buffered from one client, server stops reading client when full
+#define SM_BUS_SERVER_CLIENT_BUFSIZE (4*SM_BUS_SERVER_MAX_FRAME)
+
+typedef struct
+{
+    int fd;//-1 if slot is free
+    smbool priorityReceived;//first byte from client is its priority
+    int priority;
+    int skipped;//frames of other clients served while this one had a frame waiting
+    smuint8 buf[SM_BUS_SERVER_CLIENT_BUFSIZE];
+    int len;
+} SMBusServerClient;
+
+struct _SMBusServer
+{
+    smbusdevicehandle bdHandle;
+    char socketPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    smbool tcp;//listening at TCP port instead of Unix domain socket
+    int listenFd;
+    int wakePipe[2];//written by smBusServerClose to stop the thread
+    pthread_t thread;
+    SMBusServerClient clients[SM_BUS_SERVER_MAX_CLIENTS];
+    int lastServed;
+    volatile smuint32 framesForwarded;
+};
+
+//length of SM frame from its first bytes. returns 0 if more bytes are needed to know the length, -1 if frame is invalid
+static int smBusServerFrameLength( const smuint8 *buf, int len )
+{
+    if(len<1) return 0;
+
+    //fast update cycle doesn't follow the size bits of command id
+    if(buf[0]==SMCMD_FAST_UPDATE_CYCLE) return 7;
+    if(buf[0]==SMCMD_FAST_UPDATE_CYCLE_RET) return 6;
+
+    switch(buf[0]&SMCMD_MASK_PARAMS_BITS)
+    {
+    case SMCMD_MASK_0_PARAMS: return 4;
+    case SMCMD_MASK_2_PARAMS: return 6;
+    case SMCMD_MASK_N_PARAMS:
+        if(len<2) return 0;
+        if(buf[1]>SM485_MAX_PAYLOAD_BYTES) return -1;
+        return 5+buf[1];
+    default:
+        return -1;
+    }
+}
+
+//returns smtrue if a device replies to the frame
+static smbool smBusServerExpectsReply( const smuint8 *frame )
+{
+    smuint8 address;
+
+    if(frame[0]==SMCMD_ECHO) return smfalse;
+    if((frame[0]&SMCMD_MASK_PARAMS_BITS)==SMCMD_MASK_N_PARAMS)
+        address=frame[2];
+    else
+        address=frame[1];
+    return address!=SM_BROADCAST_ADDR ? smtrue : smfalse;
+}
+
+static void smBusServerDisconnect( SMBusServer *server, int index )
+{
+    SMBusServerClient *client=&server->clients[index];
+    close(client->fd);
+    client->fd=-1;
+}
+
+//returns smfalse when there are no more pending connections
+static smbool smBusServerAccept( SMBusServer *server )
+{
+    int fd, i;
+
+    fd=accept(server->listenFd,NULL,NULL);
+    if(fd<0) return smfalse;
+
+    for(i=0;i<SM_BUS_SERVER_MAX_CLIENTS;i++)
+    {
+        SMBusServerClient *client=&server->clients[i];
+        if(client->fd>=0)
+            continue;
+
+        fcntl(fd,F_SETFL,fcntl(fd,F_GETFL,0)|O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        {
+            int one=1;
+            setsockopt(fd,SOL_SOCKET,SO_NOSIGPIPE,&one,sizeof(one));
+        }
+#endif
+        //TCP clients are like clients of a gateway, no priority byte and frames are sent right away
+        if(server->tcp==smtrue)
+        {
+            int one=1;
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+        }
+        client->fd=fd;
+        client->priorityReceived=server->tcp;
+        client->priority=0;
+        client->skipped=0;
+        client->len=0;
+        return smtrue;
+    }
+
+    smDebug(-1,SMDebugLow,"Bus server: too many clients, connection refused\n");
+    close(fd);
+    return smtrue;
+}
+
+static void smBusServerReceive( SMBusServer *server, int index )
+{
+    SMBusServerClient *client=&server->clients[index];
+    int n, length;
+
+    n=(int)recv(client->fd,client->buf+client->len,SM_BUS_SERVER_CLIENT_BUFSIZE-client->len,0);
+    if(n==0 || (n<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR))
+    {
+        smBusServerDisconnect(server,index);
+        return;
+    }
+    if(n<0) return;
+    client->len+=n;
+
+    if(client->priorityReceived==smfalse)
+    {
+        client->priority=client->buf[0]>SM_BUS_SERVER_MAX_PRIORITY ? SM_BUS_SERVER_MAX_PRIORITY : client->buf[0];
+        client->priorityReceived=smtrue;
+        client->len--;
+        memmove(client->buf,client->buf+1,client->len);
+    }
+
+    //garbage from client would be forwarded to the bus forever
+    length=smBusServerFrameLength(client->buf,client->len);
+    if(length<0)
+    {
+        smDebug(-1,SMDebugLow,"Bus server: invalid frame from client, disconnecting\n");
+        smBusServerDisconnect(server,index);
+    }
+}
+
+//forward frame of client to the bus and its reply to the client
+static void smBusServerTransact( SMBusServer *server, int index, int frameLength )
+{
+    SMBusServerClient *client=&server->clients[index];
+    smuint8 reply[SM_BUS_SERVER_MAX_FRAME];
+    int i, received=0;
+
+    for(i=0;i<frameLength;i++)
+        smBDWrite(server->bdHandle,client->buf[i]);
+    if(smBDTransmit(server->bdHandle)!=smtrue)
+        smDebug(-1,SMDebugLow,"Bus server: writing to bus failed\n");
+    server->framesForwarded++;
+
+    if(smBusServerExpectsReply(client->buf)==smtrue)
+    {
+        for(;;)
+        {
+            int length=smBusServerFrameLength(reply,received);
+            if(length<0 || (length>0 && received>=length))
+                break;
+            if(smBDRead(server->bdHandle,&reply[received])!=smtrue)
+            {
+                //leftovers of late reply would be taken as reply to the next frame
+                smBDMiscOperation(server->bdHandle,MiscOperationPurgeRX);
+                break;
+            }
+            received++;
+        }
+
+        //incomplete reply is forwarded too, client library handles it like on a direct connection
+        if(received>0 && send(client->fd,reply,received,MSG_NOSIGNAL)!=received)
+            smBusServerDisconnect(server,index);
+    }
+
+    if(client->fd>=0)
+    {
+        client->len-=frameLength;
+        memmove(client->buf,client->buf+frameLength,client->len);
+    }
+}
+
+//serve one waiting frame. returns smtrue if a frame was served
+static smbool smBusServerServeOne( SMBusServer *server )
+{
+    int i, best=-1, bestPriority=-1;
+
+    //clients are scanned starting after the last served one, so equal priorities take turns
+    for(i=1;i<=SM_BUS_SERVER_MAX_CLIENTS;i++)
+    {
+        int index=(server->lastServed+i)%SM_BUS_SERVER_MAX_CLIENTS;
+        SMBusServerClient *client=&server->clients[index];
+        int length, priority;
+
+        if(client->fd<0 || client->priorityReceived==smfalse)
+            continue;
+        length=smBusServerFrameLength(client->buf,client->len);
+        if(length<=0 || length>client->len)
+            continue;
+
+        priority=client->priority+client->skipped/SM_BUS_SERVER_AGING_FRAMES;
+        if(priority>bestPriority)
+        {
+            best=index;
+            bestPriority=priority;
+        }
+    }
+    if(best<0)
+        return smfalse;
+
+    for(i=0;i<SM_BUS_SERVER_MAX_CLIENTS;i++)
+    {
+        SMBusServerClient *client=&server->clients[i];
+        int length;
+
+        if(i==best || client->fd<0)
+            continue;
+        length=smBusServerFrameLength(client->buf,client->len);
+        if(length>0 && length<=client->len)
+            client->skipped++;
+    }
+    server->clients[best].skipped=0;
+    server->lastServed=best;
+
+    smBusServerTransact(server,best,smBusServerFrameLength(server->clients[best].buf,server->clients[best].len));
+    return smtrue;
+}
+
+static void *smBusServerThread( void *arg )
+{
+    SMBusServer *server=(SMBusServer*)arg;
+    struct pollfd fds[2+SM_BUS_SERVER_MAX_CLIENTS];
+    int clientOfFd[2+SM_BUS_SERVER_MAX_CLIENTS];
+    smbool served=smfalse;
+
+    for(;;)
+    {
+        int i, numFds=2;
+
+        fds[0].fd=server->wakePipe[0];
+        fds[0].events=POLLIN;
+        fds[1].fd=server->listenFd;
+        fds[1].events=POLLIN;
+        for(i=0;i<SM_BUS_SERVER_MAX_CLIENTS;i++)
+        {
+            if(server->clients[i].fd<0)
+                continue;
+            fds[numFds].fd=server->clients[i].fd;
+            fds[numFds].events=server->clients[i].len<SM_BUS_SERVER_CLIENT_BUFSIZE ? POLLIN : 0;
+            clientOfFd[numFds++]=i;
+        }
+
+        //after serving a frame only check for new data, more frames may be waiting
+        if(poll(fds,numFds,served==smtrue ? 0 : -1)<0)
+        {
+            if(errno==EINTR)
+                continue;
+            smDebug(-1,SMDebugLow,"Bus server: poll failed\n");
+            break;
+        }
+        if(fds[0].revents!=0)
+            break;
+        if(fds[1].revents&POLLIN)
+            while(smBusServerAccept(server)==smtrue);
+        for(i=2;i<numFds;i++)
+        {
+            if(fds[i].revents&(POLLIN|POLLHUP|POLLERR))
+                smBusServerReceive(server,clientOfFd[i]);
+        }
+
+        served=smBusServerServeOne(server);
+    }
+
+    return NULL;
+}
+
+//parse "tcp:<ip>:<port>" to addr. returns smfalse if socketPath is not a TCP address
+static smbool smBusServerParseTcpAddress( const char *socketPath, struct sockaddr_in *addr )
+{
+    char ip[INET_ADDRSTRLEN];
+    const char *colon;
+    int port;
+
+    if(strncmp(socketPath,"tcp:",4)!=0) return smfalse;
+    socketPath+=4;
+    colon=strrchr(socketPath,':');
+    if(colon==NULL || colon-socketPath>=(int)sizeof(ip)) return smfalse;
+    memcpy(ip,socketPath,colon-socketPath);
+    ip[colon-socketPath]=0;
+    port=atoi(colon+1);
+    if(port<1 || port>65535) return smfalse;
+
+    memset(addr,0,sizeof(struct sockaddr_in));
+    addr->sin_family=AF_INET;
+    addr->sin_port=htons((unsigned short)port);
+    return inet_pton(AF_INET,ip,&addr->sin_addr)==1 ? smtrue : smfalse;
+}
+
+static SMBusServer *smBusServerStart( smbusdevicehandle bdHandle, const char *socketPath )
+{
+    SMBusServer *server;
+    struct sockaddr_un addr;
+    struct sockaddr_in tcpAddr;
+    struct sockaddr *bindAddr=(struct sockaddr*)&addr;
+    socklen_t bindAddrLen=sizeof(addr);
+    int i;
+
+    if(bdHandle<0) return NULL;
+    if(socketPath==NULL || strlen(socketPath)>=sizeof(addr.sun_path))
+    {
+        smBDClose(bdHandle);
+        return NULL;
+    }
+
+    server=(SMBusServer*)calloc(1,sizeof(SMBusServer));
+    if(server==NULL)
+    {
+        smBDClose(bdHandle);
+        return NULL;
+    }
+    server->bdHandle=bdHandle;
+    server->wakePipe[0]=server->wakePipe[1]=-1;
+    strcpy(server->socketPath,socketPath);
+    for(i=0;i<SM_BUS_SERVER_MAX_CLIENTS;i++)
+        server->clients[i].fd=-1;
+
+    if(strncmp(socketPath,"tcp:",4)==0)
+    {
+        int one=1;
+
+        server->tcp=smtrue;
+        if(smBusServerParseTcpAddress(socketPath,&tcpAddr)==smfalse)
+        {
+            smDebug(-1,SMDebugLow,"Bus server: invalid TCP address %s\n",socketPath);
+            server->listenFd=-1;
+            goto fail;
+        }
+        server->listenFd=socket(AF_INET,SOCK_STREAM,0);
+        if(server->listenFd>=0)
+            setsockopt(server->listenFd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+        bindAddr=(struct sockaddr*)&tcpAddr;
+        bindAddrLen=sizeof(tcpAddr);
+    }
+    else
+    {
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family=AF_UNIX;
+        strcpy(addr.sun_path,socketPath);
+        unlink(socketPath);
+        server->listenFd=socket(AF_UNIX,SOCK_STREAM,0);
+    }
+
+    if(server->listenFd<0 || bind(server->listenFd,bindAddr,bindAddrLen)!=0
+            || listen(server->listenFd,SM_BUS_SERVER_MAX_CLIENTS)!=0 || pipe(server->wakePipe)!=0)
+    {
+        smDebug(-1,SMDebugLow,"Bus server: unable to listen at %s (sys error: %s)\n",socketPath,strerror(errno));
+        goto fail;
+    }
+    fcntl(server->listenFd,F_SETFL,fcntl(server->listenFd,F_GETFL,0)|O_NONBLOCK);
+
+    if(pthread_create(&server->thread,NULL,smBusServerThread,server)!=0)
+    {
+        smDebug(-1,SMDebugLow,"Bus server: unable to start thread\n");
+        goto fail;
+    }
+    return server;
+
+fail:
+    if(server->listenFd>=0)
+    {
+        close(server->listenFd);
+        if(server->tcp==smfalse)
+            unlink(socketPath);
+    }
+    if(server->wakePipe[0]>=0)
+    {
+        close(server->wakePipe[0]);
+        close(server->wakePipe[1]);
+    }
+    smBDClose(bdHandle);
+    free(server);
+    return NULL;
+}
+
+#endif //SM_BUS_SERVER_SUPPORTED
+
+LIB SMBusServer *smBusServerOpen( const char *devicename, const char *socketPath )
+{
+#ifdef SM_BUS_SERVER_SUPPORTED
+    return smBusServerStart(smBDOpen(devicename),socketPath);
+#else
+    (void)devicename;
+    (void)socketPath;
+    return NULL;
+#endif
+}
+
+LIB SMBusServer *smBusServerOpenWithCallbacks( const char *devicename, const char *socketPath, BusdeviceOpen busOpenCallback, BusdeviceClose busCloseCallback, BusdeviceReadBuffer busReadCallback, BusdeviceWriteBuffer busWriteCallback, BusdeviceMiscOperation busMiscOperationCallback )
+{
+#ifdef SM_BUS_SERVER_SUPPORTED
+    return smBusServerStart(smBDOpenWithCallbacks(devicename,busOpenCallback,busCloseCallback,busReadCallback,busWriteCallback,busMiscOperationCallback),socketPath);
+#else
+    (void)devicename;
+    (void)socketPath;
+    (void)busOpenCallback;
+    (void)busCloseCallback;
+    (void)busReadCallback;
+    (void)busWriteCallback;
+    (void)busMiscOperationCallback;
+    return NULL;
+#endif
+}
+
+LIB void smBusServerClose( SMBusServer *server )
+{
+#ifdef SM_BUS_SERVER_SUPPORTED
+    int i;
+
+    if(server==NULL) return;
+
+    if(write(server->wakePipe[1],"",1)!=1)
+        smDebug(-1,SMDebugLow,"Bus server: unable to wake thread\n");
+    pthread_join(server->thread,NULL);
+
+    for(i=0;i<SM_BUS_SERVER_MAX_CLIENTS;i++)
+        if(server->clients[i].fd>=0)
+            close(server->clients[i].fd);
+    close(server->listenFd);
+    if(server->tcp==smfalse)
+        unlink(server->socketPath);
+    close(server->wakePipe[0]);
+    close(server->wakePipe[1]);
+    smBDClose(server->bdHandle);
+    free(server);
+#else
+    (void)server;
+#endif
+}
+
+LIB smuint32 smBusServerFramesForwarded( const SMBusServer *server )
+{
+#ifdef SM_BUS_SERVER_SUPPORTED
+    return server->framesForwarded;
+#else
+    (void)server;
+    return 0;
+#endif
+}
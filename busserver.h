@@ -0,0 +1,68 @@
+//Sharing one bus with multiple processes through a local socket
+//Copyright (c) Granite Devices Oy
+
+#ifndef BUSSERVER_H
+#define BUSSERVER_H
+
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Bus server owns a bus device and forwards SM frames of multiple clients to it, so that i.e. tuning and logging tools
+ * can access devices while the production process keeps running. Clients connect to a Unix domain socket, either with
+ * the bus client driver (smOpenBus("unix:/run/smbus.sock")) or with any program that speaks the same protocol.
+ *
+ * I.e. in the process that owns the bus:
+ *  SMBusServer *server=smBusServerOpen("/dev/ttyUSB0","/run/smbus.sock");
+ *
+ * and in any other process:
+ *  smbus handle=smOpenBus("unix:/run/smbus.sock?priority=2");
+ *  smSetParameter(handle,1,SMP_ABSOLUTE_SETPOINT,1000);
+ *
+ * Protocol: after connecting, client sends one byte that is its priority (0-SM_BUS_SERVER_MAX_PRIORITY). After that
+ * the client sends SM frames exactly as they would be written to the bus and receives reply frames exactly as the bus
+ * device returns them. Server forwards each complete frame to the bus unmodified and waits for its reply (unless it
+ * was sent to broadcast address), so transactions of clients never interleave on the bus.
+ *
+ * When several clients have a frame waiting, the one with highest priority is served first, and clients of the same
+ * priority take turns. A waiting frame gains one priority level every SM_BUS_SERVER_AGING_FRAMES frames of other
+ * clients that are served before it, so busy high priority clients can't block others forever.
+ *
+ * Frames wait in the server while the bus is busy with other clients, so read timeout of clients (smSetTimeout) must
+ * cover the expected queuing time in addition to the device reply time. Changing bus speed is not possible through
+ * the server. Supported on Linux and macOS.
+ *
+ * With socketPath "tcp:<ip>:<port>" server listens at TCP port instead and works like a TCP/IP gateway: clients open
+ * the bus with the TCP/IP driver (smOpenBus("<ip>:<port>")) and send no priority byte. Each client may send several
+ * frames before reading replies (see smSetPipelineWindow), server buffers up to 4 frames of a client and returns
+ * the replies in the same order. Nothing is returned for a frame if device doesn't reply.
+ */
+
+#define SM_BUS_SERVER_MAX_CLIENTS 16
+#define SM_BUS_SERVER_MAX_PRIORITY 7
+#define SM_BUS_SERVER_AGING_FRAMES 4
+
+typedef struct _SMBusServer SMBusServer;
+
+/** Open bus device with built-in drivers (like smOpenBus) and start serving clients at socketPath, which is a path of
+ * Unix domain socket or "tcp:<ip>:<port>". Existing socket file is replaced.
+  -return value: server, NULL if bus or socket couldn't be opened or platform is not supported
+*/
+LIB SMBusServer *smBusServerOpen( const char *devicename, const char *socketPath );
+
+/** Same as smBusServerOpen but with custom bus device driver (like smOpenBusWithCallbacks) */
+LIB SMBusServer *smBusServerOpenWithCallbacks( const char *devicename, const char *socketPath, BusdeviceOpen busOpenCallback, BusdeviceClose busCloseCallback, BusdeviceReadBuffer busReadCallback, BusdeviceWriteBuffer busWriteCallback, BusdeviceMiscOperation busMiscOperationCallback );
+
+/** Disconnect clients, stop serving and close bus device and socket */
+LIB void smBusServerClose( SMBusServer *server );
+
+/** Number of frames forwarded to the bus since open */
+LIB smuint32 smBusServerFramesForwarded( const SMBusServer *server );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUSSERVER_H
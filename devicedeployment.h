@@ -56,7 +56,7 @@ typedef struct
 } FirmwareUploadStatusToStringType;
 
 /* table for converting enums to strings */
-const FirmwareUploadStatusToStringType FirmwareUploadStatusToString[]=
+static const FirmwareUploadStatusToStringType FirmwareUploadStatusToString[]=
 {
     {FWComplete,"FW install complete or given FW was already installed"},
     {FWInvalidFile,"Invalid FW file"},
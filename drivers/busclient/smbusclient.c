@@ -0,0 +1,183 @@
+/*
+ * smbusclient.c
+ *
+ * Client side of bus server connection. See smbusclient.h for usage and busserver.h for protocol.
+ */
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "smbusclient.h"
+#include "busserver.h"
+#include "user_options.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BUSCLIENT_PREFIX "unix:"
+#define BUSCLIENT_PRIORITY_OPTION "?priority="
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//socket descriptor is stored in bus device pointer
+#define SOCKET_OF(busdevicePointer) ((int)(intptr_t)(busdevicePointer))
+
+smBusdevicePointer busclientPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
+{
+    struct sockaddr_un addr;
+    const char *path, *option;
+    size_t pathLen;
+    unsigned char priority=0;
+    int fd;
+
+    *success=smfalse;
+
+    if(strncmp(port_device_name,BUSCLIENT_PREFIX,strlen(BUSCLIENT_PREFIX))!=0)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;//not a bus server name, this is normal when opening other ports
+
+    //bus speed is decided by the server
+    if(baudrate_bps!=SM_BAUDRATE)
+    {
+        smDebug(-1,SMDebugLow,"Bus client: Non-default baudrate not supported through bus server\n");
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    path=port_device_name+strlen(BUSCLIENT_PREFIX);
+    option=strstr(path,BUSCLIENT_PRIORITY_OPTION);
+    pathLen=option!=NULL ? (size_t)(option-path) : strlen(path);
+    if(option!=NULL)
+    {
+        int value=atoi(option+strlen(BUSCLIENT_PRIORITY_OPTION));
+        if(value<0 || value>SM_BUS_SERVER_MAX_PRIORITY)
+        {
+            smDebug(-1,SMDebugLow,"Bus client: priority must be 0-%d\n",SM_BUS_SERVER_MAX_PRIORITY);
+            return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+        }
+        priority=(unsigned char)value;
+    }
+    if(pathLen==0 || pathLen>=sizeof(addr.sun_path))
+    {
+        smDebug(-1,SMDebugLow,"Bus client: invalid socket path in '%s'\n",port_device_name);
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    memcpy(addr.sun_path,path,pathLen);
+
+    fd=socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd<0)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+#ifdef SO_NOSIGPIPE
+    {
+        int one=1;
+        setsockopt(fd,SOL_SOCKET,SO_NOSIGPIPE,&one,sizeof(one));
+    }
+#endif
+    if(connect(fd,(struct sockaddr*)&addr,sizeof(addr))!=0 || send(fd,&priority,1,MSG_NOSIGNAL)!=1)
+    {
+        smDebug(-1,SMDebugLow,"Bus client: connecting to %s failed (sys error: %s)\n",addr.sun_path,strerror(errno));
+        close(fd);
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    *success=smtrue;
+    return (smBusdevicePointer)(intptr_t)fd;
+}
+
+smint32 busclientPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    struct pollfd pfd;
+    int n;
+
+    pfd.fd=SOCKET_OF(busdevicePointer);
+    pfd.events=POLLIN;
+    if(poll(&pfd,1,smGetReadTimeoutMs())<1)
+        return -1;//timeout or error
+
+    n=(int)recv(pfd.fd,buf,size,0);
+    return n>0 ? n : -1;
+}
+
+smint32 busclientPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    return (smint32)send(SOCKET_OF(busdevicePointer),buf,size,MSG_NOSIGNAL);
+}
+
+smbool busclientPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
+{
+    switch(operation)
+    {
+    case MiscOperationPurgeRX:
+    case MiscOperationDiscardRX:
+        {
+            unsigned char discard[256];
+            //drop replies that have arrived already, server purges the bus device itself
+            while(recv(SOCKET_OF(busdevicePointer),discard,sizeof(discard),MSG_DONTWAIT)>0);
+            return smtrue;
+        }
+    case MiscOperationFlushTX:
+        //socket writes are passed to server immediately
+        return smtrue;
+    default:
+        smDebug(-1,SMDebugLow,"Bus client: given MiscOperation not implemented\n");
+        return smfalse;
+    }
+}
+
+void busclientPortClose(smBusdevicePointer busdevicePointer)
+{
+    close(SOCKET_OF(busdevicePointer));
+}
+
+#else
+
+//bus server is not available on this platform
+
+smBusdevicePointer busclientPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
+{
+    (void)port_device_name;
+    (void)baudrate_bps;
+    *success=smfalse;
+    return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+}
+
+smint32 busclientPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    (void)busdevicePointer;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+smint32 busclientPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    (void)busdevicePointer;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+smbool busclientPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
+{
+    (void)busdevicePointer;
+    (void)operation;
+    return smfalse;
+}
+
+void busclientPortClose(smBusdevicePointer busdevicePointer)
+{
+    (void)busdevicePointer;
+}
+
+#endif
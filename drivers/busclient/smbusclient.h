@@ -0,0 +1,33 @@
+/*
+ * smbusclient.h
+ *
+ * Bus driver that connects to a bus server (see busserver.h) through a Unix domain socket instead of opening
+ * a bus device directly. Opened by smOpenBus when built-in drivers are enabled, or with smOpenBusWithCallbacks:
+ *
+ *   smbus h=smOpenBusWithCallbacks("unix:/run/smbus.sock",busclientPortOpen,busclientPortClose,busclientPortRead,
+ *                                  busclientPortWrite,busclientPortMiscOperation);
+ *
+ * Device name format is unix:<socket path> or unix:<socket path>?priority=<0-7>. Frames of clients with higher
+ * priority are served first when the bus is busy (default priority 0). Supported on Linux and macOS.
+ */
+
+#ifndef SMBUSCLIENT_H
+#define SMBUSCLIENT_H
+
+#include "simplemotion_private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+smBusdevicePointer busclientPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success);
+smint32 busclientPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smint32 busclientPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smbool busclientPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation);
+void busclientPortClose(smBusdevicePointer busdevicePointer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,6 +14,41 @@
 #include <string.h>
 #include <simplemotion.h>
 
+//read timeout currently set to each open port. timeout may change per transaction (see smSetAdaptiveTimeout)
+//so it's compared before every read and FT_SetTimeouts is called only when it has changed
+//(for max this many ports, further ones get timeout set at every read)
+#define APPLIED_TIMEOUT_PORTS 16
+static struct
+{
+    FT_HANDLE handle;
+    smuint16 timeoutMs;
+} appliedTimeouts[APPLIED_TIMEOUT_PORTS];
+
+static void applyReadTimeout(FT_HANDLE handle)
+{
+    smuint16 timeoutMs=smGetReadTimeoutMs();
+    int i, slot=-1;
+
+    for(i=0;i<APPLIED_TIMEOUT_PORTS;i++)
+    {
+        if(appliedTimeouts[i].handle==handle)
+        {
+            if(appliedTimeouts[i].timeoutMs==timeoutMs)
+                return;
+            slot=i;
+            break;
+        }
+        if(slot<0 && appliedTimeouts[i].handle==NULL)
+            slot=i;
+    }
+
+    if(FT_SetTimeouts(handle,timeoutMs,readTimeoutMs)==FT_OK && slot>=0)
+    {
+        appliedTimeouts[slot].handle=handle;
+        appliedTimeouts[slot].timeoutMs=timeoutMs;
+    }
+}
+
 
 static int stringToNumber( const char *str, smbool *ok )
 {
@@ -160,6 +195,7 @@ smint32 d2xxPortRead(smBusdevicePointer busdevicepointer, unsigned char *buf, sm
     FT_STATUS s;
     DWORD BytesReceived;
 
+    applyReadTimeout(hanlde);
     s=FT_Read(hanlde,buf,size,&BytesReceived);
     if(s!=FT_OK)
     {
@@ -194,6 +230,7 @@ smbool d2xxPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscO
     switch(operation)
     {
         case MiscOperationPurgeRX:
+        case MiscOperationDiscardRX:
             if(FT_Purge(handle,FT_PURGE_RX)!=FT_OK)
             {
                 smDebug( -1, SMDebugLow, "FTDI port error: failed to purge\n");
@@ -237,6 +274,13 @@ smbool d2xxPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscO
 void d2xxPortClose(smBusdevicePointer busdevicepointer)
 {
     FT_HANDLE handle=(FT_HANDLE)busdevicepointer;
+    int i;
+
+    for(i=0;i<APPLIED_TIMEOUT_PORTS;i++)
+    {
+        if(appliedTimeouts[i].handle==handle)
+            appliedTimeouts[i].handle=NULL;
+    }
 
     if(FT_Close(handle)!=FT_OK)
     {
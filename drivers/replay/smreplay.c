@@ -0,0 +1,432 @@
+/*
+ * smreplay.c
+ *
+ * Bus drivers for recording bus traffic into a capture file and replaying it back through
+ * the library without hardware. See smreplay.h for usage.
+ */
+
+#include "smreplay.h"
+#include "buscapture.h"
+#include "user_options.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ENABLE_BUILT_IN_DRIVERS
+#include "drivers/serial/pcserialport.h"
+#include "drivers/tcpip/tcpclient.h"
+#include "drivers/ftdi_d2xx/sm_d2xx.h"
+#endif
+
+#define REPLAY_PREFIX "REPLAY:"
+#define RECORD_PREFIX "RECORD:"
+
+static smuint32 replayTimeScalePercent=0;
+
+void smSetReplayTimeScale( smuint32 timeScalePercent )
+{
+    replayTimeScalePercent=timeScalePercent;
+}
+
+typedef struct
+{
+    smuint8 type;
+    smuint16 length;
+    smuint64 timestamp;
+    smuint32 duration;
+    const smuint8 *data;
+} ReplayRecord;
+
+typedef struct
+{
+    smuint8 *fileData;
+    ReplayRecord *records;
+    smint32 numRecords;
+    smint32 nextRecord;//index of first record that has not yet been matched or queued for reading
+
+    //RX records that library may read, in order of arrival
+    smint32 *rxQueue;
+    smint32 rxQueueHead;
+    smint32 rxQueueTail;
+    smint32 rxOffset;//number of bytes already read from record at rxQueueHead
+
+    smuint32 timeScalePercent;
+    smuint64 anchorRealTime;//monotonic time when last TX frame was matched
+    smuint64 anchorCaptureTime;//capture timestamp of last matched TX frame
+
+    smuint32 matchedFrames;
+    smuint32 mismatchedFrames;
+} ReplayState;
+
+static smuint32 get16le( const smuint8 *buf )
+{
+    return buf[0]|(buf[1]<<8);
+}
+
+static smuint32 get32le( const smuint8 *buf )
+{
+    return get16le(buf)|(get16le(buf+2)<<16);
+}
+
+static smuint64 get64le( const smuint8 *buf )
+{
+    return (smuint64)get32le(buf)|((smuint64)get32le(buf+4)<<32);
+}
+
+//load file and index records. returns smfalse if file is not a valid capture file
+static smbool replayLoadFile( ReplayState *r, const char *filename )
+{
+    FILE *f;
+    long len;
+    smint32 pos, maxRecords;
+
+    f=fopen(filename,"rb");
+    if(f==NULL)
+    {
+        smDebug(-1,SMDebugLow,"Replay: unable to open file '%s'\n",filename);
+        return smfalse;
+    }
+
+    fseek(f,0,SEEK_END);
+    len=ftell(f);
+    fseek(f,0,SEEK_SET);
+    if(len<SM_CAPTURE_FILE_HEADER_LEN)
+    {
+        fclose(f);
+        smDebug(-1,SMDebugLow,"Replay: file '%s' too short\n",filename);
+        return smfalse;
+    }
+
+    r->fileData=(smuint8*)malloc(len);
+    if(r->fileData==NULL || fread(r->fileData,1,len,f)!=(size_t)len)
+    {
+        fclose(f);
+        smDebug(-1,SMDebugLow,"Replay: unable to read file '%s'\n",filename);
+        return smfalse;
+    }
+    fclose(f);
+
+    if(memcmp(r->fileData,SM_CAPTURE_FILE_MAGIC,4)!=0 || get16le(r->fileData+4)!=SM_CAPTURE_FILE_VERSION)
+    {
+        smDebug(-1,SMDebugLow,"Replay: '%s' is not a supported capture file\n",filename);
+        return smfalse;
+    }
+
+    pos=SM_CAPTURE_FILE_HEADER_LEN+get16le(r->fileData+6);
+    maxRecords=(len-pos)/SM_CAPTURE_RECORD_HEADER_LEN+1;
+    r->records=(ReplayRecord*)malloc(maxRecords*sizeof(ReplayRecord));
+    r->rxQueue=(smint32*)malloc(maxRecords*sizeof(smint32));
+    if(r->records==NULL || r->rxQueue==NULL)
+        return smfalse;
+
+    r->numRecords=0;
+    while(pos+SM_CAPTURE_RECORD_HEADER_LEN<=len)
+    {
+        ReplayRecord *rec=&r->records[r->numRecords];
+        const smuint8 *hdr=r->fileData+pos;
+
+        rec->type=hdr[0];
+        rec->length=get16le(hdr+2);
+        rec->timestamp=get64le(hdr+4);
+        rec->duration=get32le(hdr+12);
+        rec->data=hdr+SM_CAPTURE_RECORD_HEADER_LEN;
+
+        if(pos+SM_CAPTURE_RECORD_HEADER_LEN+rec->length>len)
+        {
+            smDebug(-1,SMDebugLow,"Replay: file '%s' has truncated last record, ignoring it\n",filename);
+            break;
+        }
+        pos+=SM_CAPTURE_RECORD_HEADER_LEN+rec->length;
+
+        if(rec->type==SM_CAPTURE_TX || rec->type==SM_CAPTURE_RX)
+            r->numRecords++;
+    }
+
+    return smtrue;
+}
+
+static void replayFree( ReplayState *r )
+{
+    free(r->rxQueue);
+    free(r->records);
+    free(r->fileData);
+    free(r);
+}
+
+smBusdevicePointer replayPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
+{
+    ReplayState *r;
+    (void)baudrate_bps;
+    *success=smfalse;
+
+    //check if devicename is correct format
+    if(strncmp(port_device_name,REPLAY_PREFIX,strlen(REPLAY_PREFIX))!=0)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+
+    r=(ReplayState*)calloc(1,sizeof(ReplayState));
+    if(r==NULL)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+
+    if(replayLoadFile(r,port_device_name+strlen(REPLAY_PREFIX))==smfalse)
+    {
+        replayFree(r);
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    r->timeScalePercent=replayTimeScalePercent;
+    r->anchorRealTime=smGetMonotonicTimeNs();
+    r->anchorCaptureTime=0;
+
+    smDebug(-1,SMDebugMid,"Replay: loaded %d records from '%s'\n",(int)r->numRecords,port_device_name+strlen(REPLAY_PREFIX));
+
+    *success=smtrue;
+    return (smBusdevicePointer)r;
+}
+
+smint32 replayPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    ReplayState *r=(ReplayState*)busdevicePointer;
+    ReplayRecord *rec;
+    smint32 n;
+
+    //nothing left from earlier bursts, take the next burst if it was received before next TX
+    if(r->rxQueueHead==r->rxQueueTail && r->nextRecord<r->numRecords && r->records[r->nextRecord].type==SM_CAPTURE_RX)
+        r->rxQueue[r->rxQueueTail++]=r->nextRecord++;
+
+    if(r->rxQueueHead==r->rxQueueTail)
+    {
+        //no more data was received at capture time, so this is a timeout
+        if(r->timeScalePercent>0)
+            smSleepMs(smGetReadTimeoutMs());
+        return 0;
+    }
+
+    rec=&r->records[r->rxQueue[r->rxQueueHead]];
+
+    if(r->timeScalePercent>0 && rec->timestamp+rec->duration>r->anchorCaptureTime)
+    {
+        smuint64 available=r->anchorRealTime+(rec->timestamp+rec->duration-r->anchorCaptureTime)*r->timeScalePercent/100;
+        smuint64 now=smGetMonotonicTimeNs();
+
+        if(available>now)
+        {
+            if(available-now>(smuint64)smGetReadTimeoutMs()*1000000)
+            {
+                smSleepMs(smGetReadTimeoutMs());
+                return 0;
+            }
+            smSleepUs((int)((available-now)/1000));
+        }
+    }
+
+    n=rec->length-r->rxOffset;
+    if(n>size)
+        n=size;
+    memcpy(buf,rec->data+r->rxOffset,n);
+    r->rxOffset+=n;
+    if(r->rxOffset>=rec->length)
+    {
+        r->rxQueueHead++;
+        r->rxOffset=0;
+    }
+
+    return n;
+}
+
+smint32 replayPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    ReplayState *r=(ReplayState*)busdevicePointer;
+    ReplayRecord *rec;
+    int i;
+
+    //RX data recorded before this TX stays readable, like in receive buffer of a real port
+    while(r->nextRecord<r->numRecords && r->records[r->nextRecord].type==SM_CAPTURE_RX)
+        r->rxQueue[r->rxQueueTail++]=r->nextRecord++;
+
+    if(r->nextRecord>=r->numRecords)
+    {
+        smDebug(-1,SMDebugLow,"Replay: TX frame of %d bytes after end of recording\n",(int)size);
+        r->mismatchedFrames++;
+        return -1;
+    }
+
+    rec=&r->records[r->nextRecord++];
+    r->anchorRealTime=smGetMonotonicTimeNs();
+    r->anchorCaptureTime=rec->timestamp;
+
+    for(i=0;i<size && i<rec->length;i++)
+    {
+        if(buf[i]!=rec->data[i])
+            break;
+    }
+
+    if(i!=size || size!=rec->length)
+    {
+        smDebug(-1,SMDebugLow,"Replay: TX frame %d differs from recording at byte %d (sent %d bytes, recorded %d bytes)\n",
+                (int)(r->nextRecord-1),i,(int)size,(int)rec->length);
+        r->mismatchedFrames++;
+        return -1;
+    }
+
+    r->matchedFrames++;
+    return size;
+}
+
+smbool replayPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
+{
+    ReplayState *r=(ReplayState*)busdevicePointer;
+
+    switch(operation)
+    {
+    case MiscOperationPurgeRX:
+    case MiscOperationDiscardRX:
+        r->rxQueueHead=r->rxQueueTail;
+        r->rxOffset=0;
+        return smtrue;
+        break;
+    case MiscOperationFlushTX:
+        return smtrue;
+        break;
+    default:
+        smDebug( -1, SMDebugLow, "Replay: given MiscOperataion not implemented\n");
+        return smfalse;
+        break;
+    }
+}
+
+void replayPortClose(smBusdevicePointer busdevicePointer)
+{
+    ReplayState *r=(ReplayState*)busdevicePointer;
+
+    smDebug(-1,SMDebugMid,"Replay: %u TX frames matched, %u mismatched, %d records not replayed\n",
+            (unsigned int)r->matchedFrames,(unsigned int)r->mismatchedFrames,(int)(r->numRecords-r->nextRecord));
+    replayFree(r);
+}
+
+
+typedef struct
+{
+    smBusdevicePointer targetPointer;
+    BusdeviceReadBuffer targetRead;
+    BusdeviceWriteBuffer targetWrite;
+    BusdeviceMiscOperation targetMiscOperation;
+    BusdeviceClose targetClose;
+    SMCapture *capture;
+} RecorderState;
+
+smBusdevicePointer recorderPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
+{
+#ifdef ENABLE_BUILT_IN_DRIVERS
+    const struct
+    {
+        BusdeviceOpen open;
+        BusdeviceClose close;
+        BusdeviceReadBuffer read;
+        BusdeviceWriteBuffer write;
+        BusdeviceMiscOperation misc;
+    } drivers[]=
+    {
+        { serialPortOpen, serialPortClose, serialPortRead, serialPortWrite, serialPortMiscOperation },
+        { tcpipPortOpen, tcpipPortClose, tcpipPortRead, tcpipPortWrite, tcpipMiscOperation },
+#ifdef FTDI_D2XX_SUPPORT
+        { d2xxPortOpen, d2xxPortClose, d2xxPortRead, d2xxPortWrite, d2xxPortMiscOperation },
+#endif
+    };
+    char targetName[SM_BUSDEVICENAME_LEN];
+    const char *separator;
+    RecorderState *rec;
+    unsigned int i;
+    size_t len;
+
+    *success=smfalse;
+
+    //check if devicename is correct format
+    if(strncmp(port_device_name,RECORD_PREFIX,strlen(RECORD_PREFIX))!=0)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+
+    port_device_name+=strlen(RECORD_PREFIX);
+    separator=strchr(port_device_name,'@');
+    len=separator!=NULL ? (size_t)(separator-port_device_name) : 0;
+    if(separator==NULL || len>=SM_BUSDEVICENAME_LEN)
+    {
+        smDebug(-1,SMDebugLow,"Recorder: device name must be formatted as " RECORD_PREFIX "<device name>@<capture file>\n");
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+    memcpy(targetName,port_device_name,len);
+    targetName[len]=0;
+
+    rec=(RecorderState*)calloc(1,sizeof(RecorderState));
+    if(rec==NULL)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+
+    for(i=0;i<sizeof(drivers)/sizeof(drivers[0]);i++)
+    {
+        smbool targetSuccess=smfalse;
+        rec->targetPointer=drivers[i].open(targetName,baudrate_bps,&targetSuccess);
+        if(targetSuccess==smtrue)
+        {
+            rec->targetRead=drivers[i].read;
+            rec->targetWrite=drivers[i].write;
+            rec->targetMiscOperation=drivers[i].misc;
+            rec->targetClose=drivers[i].close;
+            break;
+        }
+    }
+
+    if(rec->targetClose==NULL)
+    {
+        smDebug(-1,SMDebugLow,"Recorder: unable to open '%s'\n",targetName);
+        free(rec);
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    rec->capture=smCaptureOpen(separator+1,targetName);
+    if(rec->capture==NULL)
+    {
+        rec->targetClose(rec->targetPointer);
+        free(rec);
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    *success=smtrue;
+    return (smBusdevicePointer)rec;
+#else
+    (void)port_device_name;
+    (void)baudrate_bps;
+    *success=smfalse;
+    smDebug(-1,SMDebugLow,"Recorder: requires library compiled with ENABLE_BUILT_IN_DRIVERS\n");
+    return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+#endif
+}
+
+smint32 recorderPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    RecorderState *rec=(RecorderState*)busdevicePointer;
+    smint32 n=rec->targetRead(rec->targetPointer,buf,size);
+    if(n>0)
+        smCaptureRecord(rec->capture,SM_CAPTURE_RX,buf,n);
+    else
+        smCaptureEndRx(rec->capture);
+    return n;
+}
+
+smint32 recorderPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    RecorderState *rec=(RecorderState*)busdevicePointer;
+    smCaptureRecord(rec->capture,SM_CAPTURE_TX,buf,size);
+    return rec->targetWrite(rec->targetPointer,buf,size);
+}
+
+smbool recorderPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
+{
+    RecorderState *rec=(RecorderState*)busdevicePointer;
+    return rec->targetMiscOperation(rec->targetPointer,operation);
+}
+
+void recorderPortClose(smBusdevicePointer busdevicePointer)
+{
+    RecorderState *rec=(RecorderState*)busdevicePointer;
+    rec->targetClose(rec->targetPointer);
+    smCaptureClose(rec->capture);
+    free(rec);
+}
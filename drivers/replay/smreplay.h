@@ -0,0 +1,47 @@
+/*
+ * smreplay.h
+ *
+ * Bus drivers for recording bus traffic into a capture file and replaying it back through
+ * the library without hardware. Capture file format is described in buscapture.h.
+ *
+ * Device name formats:
+ *  RECORD:<device name>@<capture file>  i.e. RECORD:/dev/ttyUSB0@session.smcap
+ *    opens <device name> with built-in drivers and records all TX/RX data into <capture file>
+ *  REPLAY:<capture file>  i.e. REPLAY:session.smcap
+ *    serves recorded RX data back to library and verifies that library transmits
+ *    exactly the recorded TX frames. On mismatch, write fails (resulting SM_ERR_BUS).
+ */
+
+#ifndef SMREPLAY_H
+#define SMREPLAY_H
+
+#include "simplemotion_private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "simplemotion.h"
+
+smBusdevicePointer replayPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success);
+smint32 replayPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smint32 replayPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smbool replayPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation);
+void replayPortClose(smBusdevicePointer busdevicePointer);
+
+smBusdevicePointer recorderPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success);
+smint32 recorderPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smint32 recorderPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smbool recorderPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation);
+void recorderPortClose(smBusdevicePointer busdevicePointer);
+
+/** Set timing of replay buses opened after this call. timeScalePercent=100 serves RX data with the original
+ * delays between TX frames and received bytes, 50 at half delays etc. 0 (default) serves data immediately
+ * and also makes reads past the end of recorded reply return without waiting for timeout. */
+LIB void smSetReplayTimeScale( smuint32 timeScalePercent );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,6 +14,7 @@
 #include "pcserialport.h"
 #include "user_options.h"
 #include "simplemotion_private.h" //needed for timeout variable
+#include "drivers/uring/smuring.h"
 
 #if defined(__unix__) || defined(__APPLE__)
 
@@ -22,6 +23,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <string.h>
@@ -145,9 +147,7 @@ smBusdevicePointer serialPortOpen(const char * port_device_name, smint32 baudrat
     new_port_settings.c_oflag = 0;
     new_port_settings.c_lflag = 0;
     new_port_settings.c_cc[VMIN] = 0;      /* non blocking mode */
-    new_port_settings.c_cc[VTIME] = readTimeoutMs/100;     /* timeout 100 ms steps */
-    if(new_port_settings.c_cc[VTIME]<1)//don't allow value 0ms
-        new_port_settings.c_cc[VTIME]=1;
+    new_port_settings.c_cc[VTIME] = 0;     /* read timeout is waited with poll in serialPortRead with ms resolution */
 #if defined(_BSD_SOURCE)
     cfsetspeed(&new_port_settings, baudrateEnumValue);
 #else
@@ -210,16 +210,56 @@ smBusdevicePointer serialPortOpen(const char * port_device_name, smint32 baudrat
     usleep(100000);
     tcflush(port_handle,TCIOFLUSH);
 
+    //use io_uring for I/O if available, see smuring.h
+    smUringAttach(port_handle);
+
     *success=smtrue;
     return (smBusdevicePointer)port_handle;
 }
 
 
+//busy-poll mode (see smSetBusyPoll): spin until port is readable or spin window ends. returns true if readable
+static smbool serialPortBusyPoll(int serialport_handle, smuint32 spinUs)
+{
+    smuint64 deadline=smGetMonotonicTimeNs()+(smuint64)spinUs*1000;
+    struct pollfd pfd;
+
+    pfd.fd = serialport_handle;
+    pfd.events = POLLIN;
+    do
+    {
+        if(poll(&pfd, 1, 0) > 0)
+            return smtrue;
+        SM_CPU_RELAX();
+    } while(smGetMonotonicTimeNs()<deadline);
+    return smfalse;
+}
+
 smint32 serialPortRead(smBusdevicePointer busdevicePointer, smuint8 *buf, smint32 size)
 {
     int serialport_handle=(int)busdevicePointer;
+    struct pollfd pfd;
     smint32 n;
+    smuint32 spinUs=smGetBusyPollUs();
+    smbool readable=smfalse;
     if(size>4096)  size = 4096;
+
+    if(spinUs>0 && smUringBuffered(serialport_handle)==0)
+        readable=serialPortBusyPoll(serialport_handle, spinUs);
+
+    if(smUringAttached(serialport_handle))
+        return smUringRead(serialport_handle, buf, size, smGetReadTimeoutMs());
+
+    //wait for data. timeout is checked at every read as it may change per transaction (see smSetAdaptiveTimeout)
+    if(readable==smfalse)
+    {
+        pfd.fd = serialport_handle;
+        pfd.events = POLLIN;
+        n = poll(&pfd, 1, smGetReadTimeoutMs());
+        if(n < 1) //n=-1 error, n=0 timeout occurred
+            return 0;
+    }
+
     n = read((int)serialport_handle, buf, size);
     return n;
 }
@@ -229,6 +269,8 @@ smint32 serialPortRead(smBusdevicePointer busdevicePointer, smuint8 *buf, smint3
 smint32 serialPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
 {
     int serialport_handle=(int)busdevicePointer;
+    if(smUringAttached(serialport_handle))
+        return smUringWrite(serialport_handle, buf, size);
     return(write((int)serialport_handle, buf, size));
 }
 
@@ -241,6 +283,12 @@ smbool serialPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMis
         //flush any stray bytes from device receive buffer that may reside in it
         //note: according to following page, delay before this may be necessary http://stackoverflow.com/questions/13013387/clearing-the-serial-ports-buffer
         usleep(20000);
+        smUringDiscardRX(serialport_handle);
+        tcflush(serialport_handle,TCIFLUSH);
+        return smtrue;
+        break;
+    case MiscOperationDiscardRX:
+        smUringDiscardRX(serialport_handle);
         tcflush(serialport_handle,TCIFLUSH);
         return smtrue;
         break;
@@ -260,6 +308,7 @@ smbool serialPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMis
 void serialPortClose(smBusdevicePointer busdevicePointer)
 {
     int serialport_handle=(int)busdevicePointer;
+    smUringDetach(serialport_handle);
     close((int)serialport_handle);
 }
 
@@ -268,6 +317,46 @@ void serialPortClose(smBusdevicePointer busdevicePointer)
 #include <windows.h>
 #include <string.h>
 
+//read timeout currently set to each open port. timeout may change per transaction (see smSetAdaptiveTimeout)
+//so it's compared before every read and SetCommTimeouts is called only when it has changed
+//(for max this many ports, further ones get timeout set at every read)
+#define APPLIED_TIMEOUT_PORTS 16
+static struct
+{
+    HANDLE handle;
+    DWORD timeoutMs;
+} appliedTimeouts[APPLIED_TIMEOUT_PORTS];
+
+static void applyReadTimeout(HANDLE port_handle)
+{
+    DWORD timeoutMs=smGetReadTimeoutMs();
+    COMMTIMEOUTS port_timeouts;
+    int i, slot=-1;
+
+    for(i=0;i<APPLIED_TIMEOUT_PORTS;i++)
+    {
+        if(appliedTimeouts[i].handle==port_handle)
+        {
+            if(appliedTimeouts[i].timeoutMs==timeoutMs)
+                return;
+            slot=i;
+            break;
+        }
+        if(slot<0 && appliedTimeouts[i].handle==NULL)
+            slot=i;
+    }
+
+    if(GetCommTimeouts(port_handle,&port_timeouts))
+    {
+        port_timeouts.ReadTotalTimeoutConstant=timeoutMs;
+        if(SetCommTimeouts(port_handle,&port_timeouts) && slot>=0)
+        {
+            appliedTimeouts[slot].handle=port_handle;
+            appliedTimeouts[slot].timeoutMs=timeoutMs;
+        }
+    }
+}
+
 smBusdevicePointer serialPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
 {
     char port_def_string[64], port_name[32];
@@ -310,7 +399,7 @@ smBusdevicePointer serialPortOpen(const char *port_device_name, smint32 baudrate
 
     //set timeout
     COMMTIMEOUTS port_timeouts;
-    port_timeouts.ReadTotalTimeoutConstant    = readTimeoutMs;
+    port_timeouts.ReadTotalTimeoutConstant    = smGetReadTimeoutMs();
     port_timeouts.ReadIntervalTimeout         = 0;
     port_timeouts.ReadTotalTimeoutMultiplier  = 0;
     port_timeouts.WriteTotalTimeoutMultiplier = 50;
@@ -337,6 +426,7 @@ smint32 serialPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf,
     smint32 n;
     if(size>4096)
         size = 4096;
+    applyReadTimeout(serialport_handle);
     ReadFile((HANDLE)serialport_handle, buf, size, (LPDWORD)((void *)&n), NULL);
     return n;
 }
@@ -354,6 +444,12 @@ smint32 serialPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf,
 void serialPortClose(smBusdevicePointer busdevicePointer)
 {
     HANDLE serialport_handle=(HANDLE)busdevicePointer;
+    int i;
+    for(i=0;i<APPLIED_TIMEOUT_PORTS;i++)
+    {
+        if(appliedTimeouts[i].handle==serialport_handle)
+            appliedTimeouts[i].handle=NULL;
+    }
     CloseHandle((HANDLE)serialport_handle);
 }
 
@@ -364,6 +460,7 @@ smbool serialPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMis
     switch(operation)
     {
     case MiscOperationPurgeRX:
+    case MiscOperationDiscardRX:
         //flush any stray bytes from device receive buffer that may reside in it
         if(PurgeComm((HANDLE)serialport_handle, PURGE_RXABORT|PURGE_RXCLEAR) )
             return smtrue;
@@ -0,0 +1,861 @@
+/*
+ * smsimulator.c
+ *
+ * In-process simulated SimpleMotion devices. See smsimulator.h for usage.
+ *
+ * The simulation is driven only by the library calls, there are no threads. Device state is advanced
+ * lazily to the time of each received frame, and replies are queued with the time when each byte
+ * would have arrived over the wire.
+ */
+
+#include "smsimulator.h"
+#include "sm485.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_PREFIX "SIM"
+#define SIM_MAX_NODES 32
+#define SIM_BUFFER_SIZE 2048 //buffered command buffer size of one node in bytes
+#define SIM_RETURN_BUFFER_SIZE 2048 //buffered command return data that has not been read yet
+#define SIM_RX_QUEUE_SIZE 4096 //reply bytes waiting to be read by library
+#define SIM_MAX_FRAME_LEN (SM485_BUFSIZE*2+5)
+#define SIM_CLOCK_TICK_NS 100000 //unit of SM clock and SMP_BUFFERED_CMD_PERIOD, 100us
+#define SIM_SPIN_WAIT_NS 200000 //waits shorter than this are busy waited because sleep granularity is too coarse
+#define SIM_MAX_BUSES 16 //simulated buses that keep their device state after closing
+#define SIM_MAX_BUS_SPEED 3000000
+#define SIM_WATCHDOG_TICK_NS 10000000 //unit of SMP_FAULT_BEHAVIOR watchdog timeout, 10ms
+
+//identification values reported by simulated nodes
+#define SIM_SM_VERSION 28
+#define SIM_SM_VERSION_COMPAT 20
+#define SIM_FIRMWARE_VERSION 1000
+#define SIM_DEVICE_TYPE 0
+#define SIM_CAPABILITIES1 (DEVICE_CAPABILITY1_PMAC|DEVICE_CAPABILITY1_TORQUE|DEVICE_CAPABILITY1_POSITIONING|DEVICE_CAPABILITY1_VELOCITY| \
+    DEVICE_CAPABILITY1_TRAJ_PLANNER|DEVICE_CAPABILITY1_BUFFERED_MOTION_LINEAR_INTERPOLATION|DEVICE_CAPABILITY1_MOTOR_DRIVE| \
+    DEVICE_CAPABILITY1_SELECTABLE_FAST_UPDATE_CYCLE_FORMAT|DEVICE_CAPABILITY1_SUPPORTS_SMP_PARAMETER_PROPERTIES_MASK)
+#define SIM_CAPABILITIES2 (DEVICE_CAPABILITY2_RETURN_SMP_STATUS_ON_FAILED_SUBPACKETS)
+
+#define SIM_MIN_VALUE (-536870912) //smallest value that fits in 30 bit subpacket
+#define SIM_MAX_VALUE 536870911
+
+#define R SMP_PROPERTY_PARAM_IS_READABLE
+#define W SMP_PROPERTY_PARAM_IS_WRITABLE
+
+typedef struct
+{
+    smuint16 address;
+    smuint8 properties;
+    smint32 defaultValue;
+    smint32 minValue;
+    smint32 maxValue;
+} SimParameter;
+
+static const SimParameter simParameters[]=
+{
+    { SMP_NULL,                     R|W, 0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_NODE_ADDRSS,              R,   0,                      1,             255 },
+    { SMP_BUS_MODE,                 R|W, SMP_BUS_MODE_NORMAL,    0,             _SMP_BUS_MODE_LAST },
+    { SMP_SM_VERSION,               R,   SIM_SM_VERSION,         0,             SIM_MAX_VALUE },
+    { SMP_SM_VERSION_COMPAT,        R,   SIM_SM_VERSION_COMPAT,  0,             SIM_MAX_VALUE },
+    { SMP_BUS_SPEED,                R|W, SM_BAUDRATE,            9600,          SIM_MAX_BUS_SPEED },
+    { SMP_BUFFER_FREE_BYTES,        R,   SIM_BUFFER_SIZE,        0,             SIM_BUFFER_SIZE },
+    { SMP_BUFFERED_CMD_STATUS,      R,   SM_BUFCMD_STAT_IDLE,    0,             SIM_MAX_VALUE },
+    { SMP_BUFFERED_CMD_PERIOD,      R|W, 40,                     1,             10000 },
+    { SMP_RETURN_PARAM_ADDR,        R|W, SMP_NULL,               0,             0xffff },
+    { SMP_RETURN_PARAM_LEN,         R|W, SMPRET_CMD_STATUS,      SMPRET_32B,    SMPRET_CMD_STATUS },
+    { SMP_TIMEOUT,                  R|W, 1000,                   1,             65535 },
+    { SMP_CUMULATIVE_STATUS,        R|W, 0,                      0,             63 },
+    { SMP_ADDRESS_OFFSET,           R|W, 0,                      0,             254 },
+    { SMP_FAULT_BEHAVIOR,           R|W, 0,                      0,             SIM_MAX_VALUE },
+    { SMP_BUFFERED_MODE,            R|W, 0,                      0,             BUFFERED_INTERPOLATION_MODE_LINEAR },
+    { SMP_FAST_UPDATE_CYCLE_FORMAT, R|W, 0,                      0,             FAST_UPDATE_CYCLE_FORMAT_ALT1 },
+    { SMP_INCREMENTAL_SETPOINT,     R|W, 0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_ABSOLUTE_SETPOINT,        R|W, 0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_FAULTS,                   R|W, 0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_STATUS,                   R,   STAT_SERVO_READY,       SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_SYSTEM_CONTROL,           R|W, 0,                      0,             SIM_MAX_VALUE },
+    { SMP_CONTROL_MODE,             R|W, 3,                      0,             3 },
+    { SMP_DRIVE_FLAGS,              R|W, 0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_CONTROL_BITS1,            R|W, 0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_TRAJ_PLANNER_ACCEL,       R|W, 100,                    1,             32767 },
+    { SMP_ACTUAL_BUS_VOLTAGE,       R,   4800,                   0,             SIM_MAX_VALUE },
+    { SMP_ACTUAL_TORQUE,            R,   0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_ACTUAL_VELOCITY_FB,       R,   0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_ACTUAL_POSITION_FB,       R,   0,                      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_SERIAL_NR,                R,   0,                      0,             SIM_MAX_VALUE },
+    { SMP_DEVICE_CAPABILITIES1,     R,   SIM_CAPABILITIES1,      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_DEVICE_CAPABILITIES2,     R,   SIM_CAPABILITIES2,      SIM_MIN_VALUE, SIM_MAX_VALUE },
+    { SMP_FIRMWARE_VERSION,         R,   SIM_FIRMWARE_VERSION,   0,             SIM_MAX_VALUE },
+    { SMP_FIRMWARE_BACKWARDS_COMP_VERSION, R, SIM_FIRMWARE_VERSION, 0,          SIM_MAX_VALUE },
+    { SMP_DEVICE_TYPE,              R,   SIM_DEVICE_TYPE,        0,             SIM_MAX_VALUE },
+};
+
+#undef R
+#undef W
+
+#define SIM_NUM_PARAMETERS ((int)(sizeof(simParameters)/sizeof(simParameters[0])))
+
+typedef struct
+{
+    smuint8 address;
+    smint32 values[SIM_NUM_PARAMETERS];
+    smuint16 instantWriteAddress;//parameter address set by SM_SET_WRITE_ADDRESS subpackets of instant commands
+    smuint16 bufferedWriteAddress;//same for buffered commands
+    smuint64 startTime;
+    smuint64 lastUpdateTime;
+    smbool restartPending;
+    smint32 busSpeed;//speed at which node communicates, SMP_BUS_SPEED takes effect after reply has been sent
+    smuint64 lastFrameTime;//time of last frame received by node, for watchdog
+
+    //buffered commands waiting for execution, ring buffer
+    smuint8 buffer[SIM_BUFFER_SIZE];
+    smint32 bufferHead;
+    smint32 bufferUsed;
+    //return data of executed buffered commands, ring buffer of whole return subpackets
+    smuint8 returnData[SIM_RETURN_BUFFER_SIZE];
+    smint32 returnHead;
+    smint32 returnUsed;
+
+    smbool bufferedRunning;
+    smbool bufferedUnderrun;
+    smuint64 nextSetpointTime;
+} SimNode;
+
+typedef struct
+{
+    char name[SM_BUSDEVICENAME_LEN];
+    smbool opened;
+    smint32 baudrate;//speed of port opened by library, nodes at different speed don't understand it
+
+    SimNode nodes[SIM_MAX_NODES];
+    smint32 numNodes;
+    smint16 parameterIndex[SMP_ADDRESS_BITS_MASK+1];//index to simParameters by parameter address, -1 if not supported
+
+    smuint64 byteTimeNs;
+    smuint64 turnaroundNs;
+    smuint64 txLineFreeTime;//time when previously written bytes have been transferred to devices
+    smuint64 rxLineFreeTime;//time when previously queued reply bytes have been transferred from devices
+
+    //frame being received from library
+    smuint8 frame[SIM_MAX_FRAME_LEN];
+    smint32 frameLen;
+
+    //reply bytes and times when they become readable, ring buffer
+    smuint8 rxData[SIM_RX_QUEUE_SIZE];
+    smuint64 rxTime[SIM_RX_QUEUE_SIZE];
+    smint32 rxHead;
+    smint32 rxUsed;
+} SimBus;
+
+static smbool simWireDelayEnabled=smfalse;
+static smuint32 simTurnaroundUs=0;
+//simulated buses are kept in memory after closing so that devices keep their state over reopening like real devices
+static SimBus *simBuses[SIM_MAX_BUSES];
+
+void smSetSimulatorTiming( smbool simulateWireDelay, smuint32 turnaroundLatencyUs )
+{
+    simWireDelayEnabled=simulateWireDelay;
+    simTurnaroundUs=turnaroundLatencyUs;
+}
+
+//returns length of command or return subpacket in bytes from its first byte. both use the same 2 bit header coding except type 3
+static smint32 simSubpacketLength( smuint8 firstByte, smbool isReturn )
+{
+    switch(firstByte>>6)
+    {
+    case SM_WRITE_VALUE_32B: return 4;
+    case SM_WRITE_VALUE_24B: return 3;
+    case SM_SET_WRITE_ADDRESS: return 2;
+    default: return isReturn ? 1 : 0;
+    }
+}
+
+static smint32 simParameterIndex( SimBus *bus, smint32 address )
+{
+    return bus->parameterIndex[address&SMP_ADDRESS_BITS_MASK];
+}
+
+static void simAbortBuffered( SimNode *node )
+{
+    node->bufferHead=node->bufferUsed=0;
+    node->returnHead=node->returnUsed=0;
+    node->bufferedRunning=smfalse;
+    node->bufferedUnderrun=smfalse;
+}
+
+static void simResetNode( SimBus *bus, SimNode *node, smuint64 now )
+{
+    int i;
+    for(i=0;i<SIM_NUM_PARAMETERS;i++)
+        node->values[i]=simParameters[i].defaultValue;
+    node->values[simParameterIndex(bus,SMP_NODE_ADDRSS)]=node->address;
+    node->instantWriteAddress=node->bufferedWriteAddress=SMP_NULL;
+    node->startTime=node->lastUpdateTime=node->lastFrameTime=now;
+    node->restartPending=smfalse;
+    node->busSpeed=SM_BAUDRATE;
+    simAbortBuffered(node);
+}
+
+//read parameter value, address may contain SMP_..._MASK attribute bits. returns SMP_CMD_STATUS_ value
+static smuint8 simReadParameter( SimBus *bus, SimNode *node, smint32 address, smint32 *value )
+{
+    smint32 idx=simParameterIndex(bus,address);
+    smint32 attribute=address&SMP_ATTRIBUTE_BITS_MASK;
+
+    if(attribute==SMP_PROPERTIES_MASK)
+    {
+        *value=idx>=0 ? simParameters[idx].properties : 0;
+        return SMP_CMD_STATUS_ACK;
+    }
+    if(idx<0)
+        return SMP_CMD_STATUS_INVALID_ADDR;
+    if(!(simParameters[idx].properties&SMP_PROPERTY_PARAM_IS_READABLE))
+        return SMP_CMD_STATUS_NACK;
+
+    if(attribute==SMP_MIN_VALUE_MASK)
+        *value=simParameters[idx].minValue;
+    else if(attribute==SMP_MAX_VALUE_MASK)
+        *value=simParameters[idx].maxValue;
+    else if(simParameters[idx].address==SMP_BUFFER_FREE_BYTES)
+        *value=SIM_BUFFER_SIZE-node->bufferUsed;
+    else if(simParameters[idx].address==SMP_BUFFERED_CMD_STATUS)
+        *value=(node->bufferedRunning ? SM_BUFCMD_STAT_RUN : SM_BUFCMD_STAT_IDLE)|(node->bufferedUnderrun ? SM_BUFCMD_STAT_UNDERRUN : 0);
+    else
+        *value=node->values[idx];
+
+    return SMP_CMD_STATUS_ACK;
+}
+
+//returns SMP_CMD_STATUS_ value
+static smuint8 simWriteParameter( SimBus *bus, SimNode *node, smint32 address, smint32 value )
+{
+    smint32 idx=simParameterIndex(bus,address);
+
+    if(idx<0)
+        return SMP_CMD_STATUS_INVALID_ADDR;
+    if(simParameters[idx].address==SMP_RETURN_PARAM_ADDR)
+        value&=0xffff;//library sends addresses with attribute bits as negative 16 bit numbers
+    if(!(simParameters[idx].properties&SMP_PROPERTY_PARAM_IS_WRITABLE))
+        return SMP_CMD_STATUS_NACK;
+    if(value>simParameters[idx].maxValue)
+        return SMP_CMD_STATUS_VALUE_TOO_HIGH;
+    if(value<simParameters[idx].minValue)
+        return SMP_CMD_STATUS_VALUE_TOO_LOW;
+
+    switch(simParameters[idx].address)
+    {
+    case SMP_SYSTEM_CONTROL:
+        if(value&SMP_SYSTEM_CONTROL_ABORTBUFFERED)
+            simAbortBuffered(node);
+        if(value&SMP_SYSTEM_CONTROL_RESTART)
+            node->restartPending=smtrue;//done after reply has been sent
+        return SMP_CMD_STATUS_ACK;
+    case SMP_INCREMENTAL_SETPOINT:
+        value+=node->values[simParameterIndex(bus,SMP_ABSOLUTE_SETPOINT)];
+        node->values[simParameterIndex(bus,SMP_ABSOLUTE_SETPOINT)]=value;
+        node->values[simParameterIndex(bus,SMP_ACTUAL_POSITION_FB)]=value;
+        return SMP_CMD_STATUS_ACK;
+    case SMP_ABSOLUTE_SETPOINT:
+        node->values[simParameterIndex(bus,SMP_ACTUAL_POSITION_FB)]=value;
+        break;
+    default:
+        break;
+    }
+
+    node->values[idx]=value;
+    return SMP_CMD_STATUS_ACK;
+}
+
+//execute one command subpacket and write its return subpacket in ret. returns length of return subpacket
+static smint32 simExecuteSubpacket( SimBus *bus, SimNode *node, smuint16 *writeAddress, const smuint8 *cmd, smuint8 *ret )
+{
+    smuint8 status=SMP_CMD_STATUS_ACK;
+    smint32 returnType, value;
+
+    switch(cmd[0]>>6)
+    {
+    case SM_SET_WRITE_ADDRESS:
+        *writeAddress=((cmd[0]<<8)|cmd[1])&0x3fff;
+        break;
+    case SM_WRITE_VALUE_24B:
+        value=(((smint32)(cmd[0]&0x3f)<<16)|(cmd[1]<<8)|cmd[2]);
+        value=(value^0x200000)-0x200000;//sign extend 22 bits
+        status=simWriteParameter(bus,node,*writeAddress,value);
+        break;
+    case SM_WRITE_VALUE_32B:
+        value=(((smint32)(cmd[0]&0x3f)<<24)|((smint32)cmd[1]<<16)|(cmd[2]<<8)|cmd[3]);
+        value=(value^0x20000000)-0x20000000;//sign extend 30 bits
+        status=simWriteParameter(bus,node,*writeAddress,value);
+        break;
+    default:
+        status=SMP_CMD_STATUS_NACK;
+        break;
+    }
+
+    returnType=node->values[simParameterIndex(bus,SMP_RETURN_PARAM_LEN)];
+    if(status==SMP_CMD_STATUS_ACK && returnType!=SMPRET_CMD_STATUS)
+        status=simReadParameter(bus,node,node->values[simParameterIndex(bus,SMP_RETURN_PARAM_ADDR)],&value);
+
+    node->values[simParameterIndex(bus,SMP_CUMULATIVE_STATUS)]|=status;
+
+    //failed subpackets return status (DEVICE_CAPABILITY2_RETURN_SMP_STATUS_ON_FAILED_SUBPACKETS)
+    if(status!=SMP_CMD_STATUS_ACK || returnType==SMPRET_CMD_STATUS)
+    {
+        ret[0]=(SM_RETURN_STATUS<<6)|(status&0x3f);
+        return 1;
+    }
+
+    switch(returnType)
+    {
+    case SMPRET_16B:
+        ret[0]=(SM_RETURN_VALUE_16B<<6)|((value>>8)&0x3f);
+        ret[1]=value&0xff;
+        return 2;
+    case SMPRET_24B:
+        ret[0]=(SM_RETURN_VALUE_24B<<6)|((value>>16)&0x3f);
+        ret[1]=(value>>8)&0xff;
+        ret[2]=value&0xff;
+        return 3;
+    default:
+        ret[0]=(SM_RETURN_VALUE_32B<<6)|((value>>24)&0x3f);
+        ret[1]=(value>>16)&0xff;
+        ret[2]=(value>>8)&0xff;
+        ret[3]=value&0xff;
+        return 4;
+    }
+}
+
+//execute buffered commands that are due by given time
+static void simUpdateBuffered( SimBus *bus, SimNode *node, smuint64 now )
+{
+    smint32 periodIdx=simParameterIndex(bus,SMP_BUFFERED_CMD_PERIOD);
+
+    if(now<node->lastUpdateTime)
+        now=node->lastUpdateTime;
+    node->lastUpdateTime=now;
+
+    if(node->bufferedRunning==smfalse)
+        return;
+
+    while(node->bufferUsed>0)
+    {
+        smuint8 cmd[4], ret[4];
+        smint32 len, retLen, i;
+
+        len=simSubpacketLength(node->buffer[node->bufferHead],smfalse);
+        if(len==0 || len>node->bufferUsed)
+        {
+            //invalid data in buffer, discard it
+            node->bufferHead=node->bufferUsed=0;
+            node->values[simParameterIndex(bus,SMP_CUMULATIVE_STATUS)]|=SMP_CMD_STATUS_NACK;
+            break;
+        }
+
+        //setpoint writes execute at SMP_BUFFERED_CMD_PERIOD pace, all other commands without delay
+        if(node->buffer[node->bufferHead]>>6!=SM_SET_WRITE_ADDRESS && (node->bufferedWriteAddress==SMP_ABSOLUTE_SETPOINT || node->bufferedWriteAddress==SMP_INCREMENTAL_SETPOINT))
+        {
+            if(node->nextSetpointTime>now)
+                return;
+            node->nextSetpointTime+=(smuint64)node->values[periodIdx]*SIM_CLOCK_TICK_NS;
+        }
+
+        for(i=0;i<len;i++)
+            cmd[i]=node->buffer[(node->bufferHead+i)%SIM_BUFFER_SIZE];
+        node->bufferHead=(node->bufferHead+len)%SIM_BUFFER_SIZE;
+        node->bufferUsed-=len;
+
+        retLen=simExecuteSubpacket(bus,node,&node->bufferedWriteAddress,cmd,ret);
+        if(node->returnUsed+retLen<=SIM_RETURN_BUFFER_SIZE)
+        {
+            for(i=0;i<retLen;i++)
+                node->returnData[(node->returnHead+node->returnUsed+i)%SIM_RETURN_BUFFER_SIZE]=ret[i];
+            node->returnUsed+=retLen;
+        }
+    }
+
+    //buffer has ran empty, next setpoint will be executed when it arrives
+    if(node->nextSetpointTime<=now)
+    {
+        node->bufferedUnderrun=smtrue;
+        node->nextSetpointTime=now;
+    }
+}
+
+//take whole return subpackets of buffered commands, up to maxLen bytes
+static smint32 simTakeBufferedReturnData( SimNode *node, smuint8 *out, smint32 maxLen )
+{
+    smint32 n=0;
+
+    while(node->returnUsed>0)
+    {
+        smint32 i, len=simSubpacketLength(node->returnData[node->returnHead],smtrue);
+        if(n+len>maxLen)
+            break;
+        for(i=0;i<len;i++)
+            out[n++]=node->returnData[(node->returnHead+i)%SIM_RETURN_BUFFER_SIZE];
+        node->returnHead=(node->returnHead+len)%SIM_RETURN_BUFFER_SIZE;
+        node->returnUsed-=len;
+    }
+
+    return n;
+}
+
+static void simQueueRxBytes( SimBus *bus, const smuint8 *data, smint32 len, smuint64 startTime )
+{
+    smint32 i;
+
+    if(bus->rxLineFreeTime>startTime)
+        startTime=bus->rxLineFreeTime;
+
+    for(i=0;i<len && bus->rxUsed<SIM_RX_QUEUE_SIZE;i++)
+    {
+        smint32 pos=(bus->rxHead+bus->rxUsed)%SIM_RX_QUEUE_SIZE;
+        startTime+=bus->byteTimeNs;
+        bus->rxData[pos]=data[i];
+        bus->rxTime[pos]=startTime;
+        bus->rxUsed++;
+    }
+    bus->rxLineFreeTime=startTime;
+}
+
+//form SM485 reply frame and queue it for reading
+static void simQueueReply( SimBus *bus, smuint8 cmdid, smuint8 address, const smuint8 *payload, smint32 payloadLen, smuint64 startTime )
+{
+    smuint8 frame[SIM_MAX_FRAME_LEN];
+    smuint16 crc=SM485_CRCINIT;
+    smint32 len=0;
+
+    frame[len++]=cmdid;
+    if(cmdid&SMCMD_MASK_N_PARAMS)
+        frame[len++]=payloadLen;
+    frame[len++]=address;
+    memcpy(frame+len,payload,payloadLen);
+    len+=payloadLen;
+    crc=calcCRC16Update(crc,frame,len);
+    frame[len++]=crc>>8;
+    frame[len++]=crc&0xff;
+
+    simQueueRxBytes(bus,frame,len,startTime);
+}
+
+static void simQueueErrorReply( SimBus *bus, smuint8 address, smuint8 error, smuint64 startTime )
+{
+    smuint8 payload[2]={ 0, error };
+    simQueueReply(bus,SMCMD_ERROR_RET,address,payload,2,startTime);
+}
+
+static SimNode *simFindNode( SimBus *bus, smuint8 address )
+{
+    if(address<1 || address>bus->numNodes)
+        return NULL;
+    return &bus->nodes[address-1];
+}
+
+//nodes that haven't received frames within their SMP_FAULT_BEHAVIOR watchdog timeout revert to default
+//bus speed and abort buffered motion (SM protocol version 26 and later)
+static void simCheckWatchdogs( SimBus *bus, smuint64 now )
+{
+    smint32 i;
+
+    for(i=0;i<bus->numNodes;i++)
+    {
+        SimNode *node=&bus->nodes[i];
+        smuint64 timeout=(smuint64)((node->values[simParameterIndex(bus,SMP_FAULT_BEHAVIOR)]>>8)&0x3ff)*SIM_WATCHDOG_TICK_NS;
+
+        if(timeout>0 && now-node->lastFrameTime>timeout)
+        {
+            node->values[simParameterIndex(bus,SMP_BUS_SPEED)]=SM_BAUDRATE;
+            node->busSpeed=SM_BAUDRATE;
+            simAbortBuffered(node);
+        }
+    }
+}
+
+//node receives frames only if it communicates at the speed of the port
+static smbool simNodeReceives( SimBus *bus, SimNode *node, smuint64 now )
+{
+    if(node==NULL || node->busSpeed!=bus->baudrate)
+        return smfalse;
+    node->lastFrameTime=now;
+    return smtrue;
+}
+
+static void simHandleFastUpdateCycle( SimBus *bus, smuint64 replyTime )
+{
+    SimNode *node=simFindNode(bus,bus->frame[1]);
+    smuint16 write1, write2, read1, read2;
+    smint32 position, status;
+    smuint8 reply[6];
+
+    //corrupted fast update cycle frames are ignored, sender notices it from missing reply
+    if(calcCRC8Buf(bus->frame,6,0x52)!=bus->frame[6] || simNodeReceives(bus,node,replyTime)==smfalse)
+        return;
+
+    simUpdateBuffered(bus,node,replyTime);
+
+    write1=bus->frame[2]|(bus->frame[3]<<8);
+    write2=bus->frame[4]|(bus->frame[5]<<8);
+
+    if(node->values[simParameterIndex(bus,SMP_FAST_UPDATE_CYCLE_FORMAT)]==FAST_UPDATE_CYCLE_FORMAT_ALT1)
+    {
+        smint32 setpoint=write1|((smint32)(write2&0xfff)<<16);
+        smint32 cb1Idx=simParameterIndex(bus,SMP_CONTROL_BITS1);
+        simWriteParameter(bus,node,SMP_ABSOLUTE_SETPOINT,(setpoint^0x8000000)-0x8000000);//sign extend 28 bits
+        node->values[cb1Idx]=(node->values[cb1Idx]&~0xf)|(write2>>12);
+    }
+    else
+        simWriteParameter(bus,node,SMP_ABSOLUTE_SETPOINT,(smint16)write1);
+
+    simReadParameter(bus,node,SMP_ACTUAL_POSITION_FB,&position);
+    simReadParameter(bus,node,SMP_STATUS,&status);
+    read1=position&0xffff;
+    if(node->values[simParameterIndex(bus,SMP_FAST_UPDATE_CYCLE_FORMAT)]==FAST_UPDATE_CYCLE_FORMAT_ALT1)
+        read2=((position>>16)&0x3fff)|((status&STAT_FAULTSTOP)?BV(14):0)|((status&STAT_SERVO_READY)?BV(15):0);
+    else
+        read2=status&0xffff;
+
+    reply[0]=SMCMD_FAST_UPDATE_CYCLE_RET;
+    reply[1]=read1&0xff;
+    reply[2]=read1>>8;
+    reply[3]=read2&0xff;
+    reply[4]=read2>>8;
+    reply[5]=calcCRC8Buf(reply,5,0x52);
+    simQueueRxBytes(bus,reply,6,replyTime);
+}
+
+static void simHandleNodeFrame( SimBus *bus, SimNode *node, smuint8 cmdid, const smuint8 *payload, smint32 payloadLen, smbool sendReply, smuint64 replyTime )
+{
+    smuint8 ret[SIM_MAX_FRAME_LEN];
+    smint32 retLen=0, pos=0;
+
+    simUpdateBuffered(bus,node,replyTime);
+
+    switch(cmdid)
+    {
+    case SMCMD_INSTANT_CMD:
+        while(pos<payloadLen)
+        {
+            smint32 len=simSubpacketLength(payload[pos],smfalse);
+            if(len==0 || pos+len>payloadLen || retLen+4>SM485_MAX_PAYLOAD_BYTES)
+            {
+                if(sendReply)
+                    simQueueErrorReply(bus,node->address,SMERR_INVALID_PARAMETER,replyTime);
+                return;
+            }
+            retLen+=simExecuteSubpacket(bus,node,&node->instantWriteAddress,payload+pos,ret+retLen);
+            pos+=len;
+        }
+        if(sendReply)
+            simQueueReply(bus,SMCMD_INSTANT_CMD_RET,node->address,ret,retLen,replyTime);
+        break;
+
+    case SMCMD_BUFFERED_CMD:
+        if(payloadLen>SIM_BUFFER_SIZE-node->bufferUsed)
+        {
+            if(sendReply)
+                simQueueErrorReply(bus,node->address,SMERR_BUF_OVERFLOW,replyTime);
+            return;
+        }
+        for(pos=0;pos<payloadLen;pos++)
+            node->buffer[(node->bufferHead+node->bufferUsed+pos)%SIM_BUFFER_SIZE]=payload[pos];
+        node->bufferUsed+=payloadLen;
+        if(payloadLen>0)
+            node->bufferedUnderrun=smfalse;
+        simUpdateBuffered(bus,node,replyTime);
+        //reply contains available return data, same as SMCMD_BUFFERED_RETURN_DATA
+        //fall through
+    case SMCMD_BUFFERED_RETURN_DATA:
+        retLen=simTakeBufferedReturnData(node,ret,SM485_MAX_PAYLOAD_BYTES);
+        if(sendReply)
+            simQueueReply(bus,cmdid==SMCMD_BUFFERED_CMD ? SMCMD_BUFFERED_CMD_RET : SMCMD_BUFFERED_RETURN_DATA_RET,node->address,ret,retLen,replyTime);
+        break;
+
+    case SMCMD_GET_CLOCK:
+    {
+        smuint16 clock=(smuint16)((replyTime-node->startTime)/SIM_CLOCK_TICK_NS);
+        if(node->bufferedRunning==smfalse)
+        {
+            node->bufferedRunning=smtrue;
+            node->nextSetpointTime=replyTime;
+            simUpdateBuffered(bus,node,replyTime);
+        }
+        ret[0]=clock&0xff;
+        ret[1]=clock>>8;
+        if(sendReply)
+            simQueueReply(bus,SMCMD_GET_CLOCK_RET,node->address,ret,2,replyTime);
+        break;
+    }
+
+    default:
+        if(sendReply)
+            simQueueErrorReply(bus,node->address,SMERR_INVALID_CMD,replyTime);
+        break;
+    }
+
+    node->busSpeed=node->values[simParameterIndex(bus,SMP_BUS_SPEED)];
+    if(node->restartPending)
+        simResetNode(bus,node,replyTime);
+}
+
+//handle complete frame in bus->frame. receivedTime is the time when last byte of frame reached the devices
+static void simHandleFrame( SimBus *bus, smuint64 receivedTime )
+{
+    smuint64 replyTime=receivedTime+bus->turnaroundNs;
+    smuint8 cmdid=bus->frame[0];
+    smint32 addrPos, payloadPos, payloadLen, i;
+    smuint16 crc=SM485_CRCINIT;
+
+    simCheckWatchdogs(bus,receivedTime);
+
+    if(cmdid==SMCMD_FAST_UPDATE_CYCLE)
+    {
+        simHandleFastUpdateCycle(bus,replyTime);
+        return;
+    }
+
+    if(cmdid&SMCMD_MASK_N_PARAMS)
+    {
+        payloadLen=bus->frame[1];
+        addrPos=2;
+    }
+    else
+    {
+        payloadLen=(cmdid&SMCMD_MASK_2_PARAMS) ? 2 : 0;
+        addrPos=1;
+    }
+    payloadPos=addrPos+1;
+
+    crc=calcCRC16Update(crc,bus->frame,payloadPos+payloadLen);
+    if(crc!=((bus->frame[payloadPos+payloadLen]<<8)|bus->frame[payloadPos+payloadLen+1]))
+    {
+        //address may be corrupted too, but reply like a device would if it matches
+        SimNode *node=simFindNode(bus,bus->frame[addrPos]);
+        if(node!=NULL && node->busSpeed==bus->baudrate)
+            simQueueErrorReply(bus,node->address,SMERR_CRC,replyTime);
+        return;
+    }
+
+    if(bus->frame[addrPos]==SM_BROADCAST_ADDR)
+    {
+        for(i=0;i<bus->numNodes;i++)
+        {
+            if(simNodeReceives(bus,&bus->nodes[i],receivedTime))
+                simHandleNodeFrame(bus,&bus->nodes[i],cmdid,bus->frame+payloadPos,payloadLen,smfalse,replyTime);
+        }
+    }
+    else
+    {
+        SimNode *node=simFindNode(bus,bus->frame[addrPos]);
+        if(simNodeReceives(bus,node,receivedTime)==smfalse)
+            return;//no device with that address or it's at different speed, no reply
+
+        if(payloadLen>SM485_MAX_PAYLOAD_BYTES)
+            simQueueErrorReply(bus,node->address,SMERR_PAYLOAD_SIZE,replyTime);
+        else
+            simHandleNodeFrame(bus,node,cmdid,bus->frame+payloadPos,payloadLen,smtrue,replyTime);
+    }
+}
+
+//returns total length of frame in bus->frame, or 0 if not enough bytes received yet to know it
+static smint32 simExpectedFrameLength( SimBus *bus )
+{
+    smuint8 cmdid=bus->frame[0];
+
+    if(cmdid==SMCMD_FAST_UPDATE_CYCLE)
+        return 7;
+    switch(cmdid&SMCMD_MASK_PARAMS_BITS)
+    {
+    case SMCMD_MASK_0_PARAMS: return 4;
+    case SMCMD_MASK_2_PARAMS: return 6;
+    case SMCMD_MASK_N_PARAMS: return bus->frameLen>=2 ? bus->frame[1]+5 : 0;
+    default: return -1;//invalid
+    }
+}
+
+smBusdevicePointer simulatorPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
+{
+    SimBus *bus;
+    smint32 numNodes=1;
+    smuint64 now=smGetMonotonicTimeNs();
+    int i;
+
+    *success=smfalse;
+
+    //check if devicename is correct format
+    if(strncmp(port_device_name,SIM_PREFIX,strlen(SIM_PREFIX))!=0)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    if(port_device_name[strlen(SIM_PREFIX)]==':')
+        numNodes=atoi(port_device_name+strlen(SIM_PREFIX)+1);
+    else if(port_device_name[strlen(SIM_PREFIX)]!=0)
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    if(numNodes<1 || numNodes>SIM_MAX_NODES)
+    {
+        smDebug(-1,SMDebugLow,"Simulator: number of nodes must be 1-%d\n",SIM_MAX_NODES);
+        return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+    }
+
+    //reopen previously closed bus with the same name
+    bus=NULL;
+    for(i=0;i<SIM_MAX_BUSES;i++)
+    {
+        if(simBuses[i]!=NULL && simBuses[i]->opened==smfalse && strcmp(simBuses[i]->name,port_device_name)==0)
+        {
+            bus=simBuses[i];
+            bus->frameLen=0;
+            bus->rxHead=bus->rxUsed=0;
+            bus->txLineFreeTime=bus->rxLineFreeTime=0;
+            break;
+        }
+    }
+
+    if(bus==NULL)
+    {
+        bus=(SimBus*)calloc(1,sizeof(SimBus));
+        if(bus==NULL)
+            return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
+
+        strncpy(bus->name,port_device_name,SM_BUSDEVICENAME_LEN-1);
+        for(i=0;i<=SMP_ADDRESS_BITS_MASK;i++)
+            bus->parameterIndex[i]=-1;
+        for(i=0;i<SIM_NUM_PARAMETERS;i++)
+            bus->parameterIndex[simParameters[i].address]=i;
+
+        bus->numNodes=numNodes;
+        for(i=0;i<numNodes;i++)
+        {
+            bus->nodes[i].address=i+1;
+            simResetNode(bus,&bus->nodes[i],now);
+        }
+
+        //if table is full, bus is freed on close instead
+        for(i=0;i<SIM_MAX_BUSES;i++)
+        {
+            if(simBuses[i]==NULL)
+            {
+                simBuses[i]=bus;
+                break;
+            }
+        }
+    }
+
+    bus->opened=smtrue;
+    bus->baudrate=baudrate_bps;
+    bus->byteTimeNs=0;
+    if(simWireDelayEnabled && baudrate_bps>0)
+        bus->byteTimeNs=10ULL*1000000000ULL/baudrate_bps;
+    bus->turnaroundNs=(smuint64)simTurnaroundUs*1000;
+
+    *success=smtrue;
+    return (smBusdevicePointer)bus;
+}
+
+smint32 simulatorPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    SimBus *bus=(SimBus*)busdevicePointer;
+    smuint64 now, deadline;
+    smint32 n=0;
+
+    //nothing is coming, time out like a real port
+    if(bus->rxUsed==0)
+    {
+        smSleepMs(smGetReadTimeoutMs());
+        return 0;
+    }
+
+    //wait until first byte has arrived
+    now=smGetMonotonicTimeNs();
+    deadline=now+(smuint64)smGetReadTimeoutMs()*1000000;
+    while(bus->rxTime[bus->rxHead]>now)
+    {
+        smuint64 wait=bus->rxTime[bus->rxHead]-now;
+        if(bus->rxTime[bus->rxHead]>deadline)
+        {
+            smSleepUs((int)((deadline-now)/1000));
+            return 0;
+        }
+        if(wait>SIM_SPIN_WAIT_NS)
+            smSleepUs((int)((wait-SIM_SPIN_WAIT_NS/2)/1000));
+        now=smGetMonotonicTimeNs();
+    }
+
+    while(n<size && bus->rxUsed>0 && bus->rxTime[bus->rxHead]<=now)
+    {
+        buf[n++]=bus->rxData[bus->rxHead];
+        bus->rxHead=(bus->rxHead+1)%SIM_RX_QUEUE_SIZE;
+        bus->rxUsed--;
+    }
+
+    return n;
+}
+
+smint32 simulatorPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    SimBus *bus=(SimBus*)busdevicePointer;
+    smuint64 time=smGetMonotonicTimeNs();
+    smint32 i;
+
+    if(bus->txLineFreeTime>time)
+        time=bus->txLineFreeTime;
+
+    for(i=0;i<size;i++)
+    {
+        smint32 expectedLen;
+
+        time+=bus->byteTimeNs;
+        bus->frame[bus->frameLen++]=buf[i];
+
+        expectedLen=simExpectedFrameLength(bus);
+        if(expectedLen<0)
+            bus->frameLen=0;//not a valid command id, devices ignore it
+        else if(expectedLen>0 && bus->frameLen>=expectedLen)
+        {
+            simHandleFrame(bus,time);
+            bus->frameLen=0;
+        }
+    }
+
+    bus->txLineFreeTime=time;
+    return size;
+}
+
+smbool simulatorPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
+{
+    SimBus *bus=(SimBus*)busdevicePointer;
+
+    switch(operation)
+    {
+    case MiscOperationPurgeRX:
+    case MiscOperationDiscardRX:
+        bus->rxHead=bus->rxUsed=0;
+        return smtrue;
+        break;
+    case MiscOperationFlushTX:
+    {
+        smuint64 now=smGetMonotonicTimeNs();
+        if(bus->txLineFreeTime>now)
+            smSleepUs((int)((bus->txLineFreeTime-now)/1000));
+        return smtrue;
+        break;
+    }
+    default:
+        smDebug( -1, SMDebugLow, "Simulator: given MiscOperataion not implemented\n");
+        return smfalse;
+        break;
+    }
+}
+
+void simulatorPortClose(smBusdevicePointer busdevicePointer)
+{
+    SimBus *bus=(SimBus*)busdevicePointer;
+    int i;
+
+    for(i=0;i<SIM_MAX_BUSES;i++)
+    {
+        if(simBuses[i]==bus)
+        {
+            bus->opened=smfalse;
+            return;
+        }
+    }
+    free(bus);
+}
@@ -0,0 +1,52 @@
+/*
+ * smsimulator.h
+ *
+ * Bus driver that simulates SimpleMotion devices inside the application process. Useful for
+ * testing and benchmarking the library without hardware. Open with smOpenBusWithCallbacks:
+ *
+ *   smbus h=smOpenBusWithCallbacks("SIM:2",simulatorPortOpen,simulatorPortClose,simulatorPortRead,
+ *                                  simulatorPortWrite,simulatorPortMiscOperation);
+ *
+ * Device name format is SIM or SIM:<number of nodes>, nodes get addresses 1..N (default 1 node).
+ *
+ * Each simulated node implements SM485 framing (SMCMD_INSTANT_CMD, SMCMD_BUFFERED_CMD,
+ * SMCMD_BUFFERED_RETURN_DATA, SMCMD_GET_CLOCK, SMCMD_FAST_UPDATE_CYCLE and SMCMD_ERROR_RET replies),
+ * a parameter store with the common SM parameters and a basic set of motor drive parameters, and
+ * buffered motion buffer that executes setpoint commands at SMP_BUFFERED_CMD_PERIOD pace once started
+ * with SMCMD_GET_CLOCK. Position feedback follows setpoint ideally.
+ *
+ * Devices keep their state when bus is closed and opened again with the same name. Nodes communicate at
+ * SMP_BUS_SPEED (default 460800, max 3000000) and ignore frames when the port is opened at a different baudrate.
+ * SMP_FAULT_BEHAVIOR watchdog timeout reverts node to the default speed like in SM protocol version 26 and later.
+ *
+ * Reads time out like on a real port when no reply is pending or it would arrive later than the read timeout.
+ */
+
+#ifndef SMSIMULATOR_H
+#define SMSIMULATOR_H
+
+#include "simplemotion_private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "simplemotion.h"
+
+smBusdevicePointer simulatorPortOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success);
+smint32 simulatorPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smint32 simulatorPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size);
+smbool simulatorPortMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation);
+void simulatorPortClose(smBusdevicePointer busdevicePointer);
+
+/** Set timing of simulated buses opened after this call. If simulateWireDelay is smtrue, each byte takes
+ * 10 bit times of the baudrate (see smSetBaudrate) to transfer in either direction. turnaroundLatencyUs is
+ * the time from the end of received command frame to the start of reply. By default both are disabled
+ * and replies are available immediately. */
+LIB void smSetSimulatorTiming( smbool simulateWireDelay, smuint32 turnaroundLatencyUs );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,6 +1,7 @@
 #include "simplemotion_private.h"
 #include "tcpclient.h"
 #include "user_options.h"
+#include "drivers/uring/smuring.h"
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
@@ -102,6 +103,13 @@ smBusdevicePointer tcpipPortOpen(const char * devicename, smint32 baudrate_bps,
     int one = 1;
     setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (void *)&one, sizeof(one));
 
+#if defined(SO_BUSY_POLL)
+    // In busy-poll mode (see smSetBusyPoll) let also network device driver be polled while waiting for data
+    int busyPollUs = (int)smGetBusyPollUs();
+    if (busyPollUs > 0 && setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, (void *)&busyPollUs, sizeof(busyPollUs)) != 0)
+        smDebug(-1,SMDebugLow,"TCP/IP: Setting SO_BUSY_POLL failed (sys error: %s)\n",strerror(errno));
+#endif
+
     server.sin_addr.s_addr = inet_addr(ip_addr);
     server.sin_family = AF_INET;
     server.sin_port = htons(port);
@@ -159,10 +167,32 @@ smBusdevicePointer tcpipPortOpen(const char * devicename, smint32 baudrate_bps,
     ioctlsocket(sockfd, FIONBIO, &arg);
 #endif
 
+    // Use io_uring for I/O if available, see smuring.h
+    smUringAttach(sockfd);
+
     *success=smtrue;
     return (smBusdevicePointer)sockfd;//compiler warning expected here on 64 bit compilation but it's ok
 }
 
+// Busy-poll mode (see smSetBusyPoll): spin until socket is readable or spin window ends. Returns true if readable
+static smbool tcpipBusyPoll(int sockfd, smuint32 spinUs)
+{
+    smuint64 deadline = smGetMonotonicTimeNs() + (smuint64)spinUs * 1000;
+    do
+    {
+        fd_set input;
+        struct timeval timeout;
+        FD_ZERO(&input);
+        FD_SET((unsigned int)sockfd, &input);
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+        if (select(sockfd + 1, &input, NULL, NULL, &timeout) > 0)
+            return smtrue;
+        SM_CPU_RELAX();
+    } while (smGetMonotonicTimeNs() < deadline);
+    return smfalse;
+}
+
 // Read bytes from socket
 int tcpipPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, int size)
 {
@@ -172,18 +202,34 @@ int tcpipPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, int s
     FD_ZERO(&input);
     FD_SET((unsigned int)sockfd, &input);
     struct timeval timeout;
-    timeout.tv_sec = readTimeoutMs/1000;
-    timeout.tv_usec = (readTimeoutMs%1000) * 1000;
+    smuint16 timeoutMs = smGetReadTimeoutMs();
+    smuint32 spinUs = smGetBusyPollUs();
+    smbool readable = smfalse;
 
-    n = select(sockfd + 1, &input, NULL, NULL, &timeout);//n=-1, select failed. 0=no data within timeout ready, >0 data available. Note: sockfd+1 is correct usage.
+    if (spinUs > 0 && smUringBuffered(sockfd) == 0)
+        readable = tcpipBusyPoll(sockfd, spinUs);
 
-    if (n < 1) //n=-1 error, n=0 timeout occurred
+    if (smUringAttached(sockfd))
     {
-        return(-1);
+        n = smUringRead(sockfd, buf, size, timeoutMs);
+        return n > 0 ? n : -1;
     }
-    if(!FD_ISSET(sockfd, &input))
+
+    if (!readable)
     {
-        return(-1);//no data available
+        timeout.tv_sec = timeoutMs/1000;
+        timeout.tv_usec = (timeoutMs%1000) * 1000;
+
+        n = select(sockfd + 1, &input, NULL, NULL, &timeout);//n=-1, select failed. 0=no data within timeout ready, >0 data available. Note: sockfd+1 is correct usage.
+
+        if (n < 1) //n=-1 error, n=0 timeout occurred
+        {
+            return(-1);
+        }
+        if(!FD_ISSET(sockfd, &input))
+        {
+            return(-1);//no data available
+        }
     }
 
     n = read(sockfd, (char*)buf, size);
@@ -193,6 +239,18 @@ int tcpipPortRead(smBusdevicePointer busdevicePointer, unsigned char *buf, int s
 int tcpipPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, int size)
 {
     int sockfd=(int)busdevicePointer;//compiler warning expected here on 64 bit compilation but it's ok
+#if defined(TCP_QUICKACK)
+    // In busy-poll mode acknowledge the reply right away instead of delayed ACK. Kernel may turn quick ACKs off
+    // by itself, so it's enabled again before each transaction
+    if (smGetBusyPollUs() > 0)
+    {
+        int one = 1;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, (void *)&one, sizeof(one));
+    }
+#endif
+    if (smUringAttached(sockfd))
+        return smUringWrite(sockfd, buf, size);
+
     int sent = write(sockfd, (char*)buf, size);
     if (sent != size)
     {
@@ -203,15 +261,17 @@ int tcpipPortWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, int
 
 smbool tcpipMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
 {
+    int sockfd=(int)busdevicePointer;//compiler warning expected here on 64 bit compilation but it's ok
     switch(operation)
     {
     case MiscOperationPurgeRX:
+    case MiscOperationDiscardRX://purge doesn't wait for data either
         {
             int n;
+            smUringDiscardRX(sockfd);
             do //loop read as long as there is data coming in
             {
                 char discardbuf[256];
-                int sockfd=(int)busdevicePointer;//compiler warning expected here on 64 bit compilation but it's ok
                 fd_set input;
                 FD_ZERO(&input);
                 FD_SET((unsigned int)sockfd, &input);
@@ -253,6 +313,7 @@ smbool tcpipMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOper
 void tcpipPortClose(smBusdevicePointer busdevicePointer)
 {
     int sockfd=(int)busdevicePointer;//compiler warning expected here on 64 bit compilation but it's ok
+    smUringDetach(sockfd);
     close(sockfd);
 #if defined(_WIN32)
     WSACleanup();
@@ -0,0 +1,406 @@
+//io_uring I/O backend of serial and TCP/IP drivers, see smuring.h
+//Copyright (c) Granite Devices Oy
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "smuring.h"
+#include "user_options.h"
+
+#if defined(ENABLE_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SM_URING_SUPPORT
+#endif
+#endif
+
+#ifdef SM_URING_SUPPORT
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define SM_URING_ENTRIES 128
+#define SM_URING_RX_BUFFER 512
+
+typedef struct
+{
+    smbool pending;//submitted and completion not yet reaped
+    int result;//res of completion
+} SMUringOp;
+
+typedef struct
+{
+    smuint8 rx[SM_URING_RX_BUFFER];
+    int rxPos, rxLen;//unread bytes are rx[rxPos..rxLen-1]
+    SMUringOp readOp;
+    struct __kernel_timespec timeout;//timeout linked to read
+
+    SMUringOp writeOp;
+} SMUringFile;
+
+//one ring for the whole process. ring memory stays mapped until exit
+static struct
+{
+    int fd;//-1 if io_uring is not available
+
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned sqLocalTail;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    smbool reaping;//a thread is waiting for completions in kernel, others wait for RingCompleted
+    SMUringFile *files[SM_URING_MAX_FDS];
+} Ring={ .fd=-1 };
+
+static pthread_once_t RingOnce=PTHREAD_ONCE_INIT;
+static pthread_mutex_t RingLock=PTHREAD_MUTEX_INITIALIZER;//protects ring queues, ops and files
+static pthread_cond_t RingCompleted=PTHREAD_COND_INITIALIZER;
+
+static smbool smUringOpSupported( const struct io_uring_probe *probe, int op )
+{
+    return op<=probe->last_op && (probe->ops[op].flags&IO_URING_OP_SUPPORTED) ? smtrue : smfalse;
+}
+
+static void smUringSetup( void )
+{
+    struct io_uring_params params;
+    struct io_uring_probe *probe;
+    size_t ringSize, cqSize;
+    char *ring;
+    void *sqes;
+    smbool supported;
+    int fd;
+
+    memset(&params,0,sizeof(params));
+    fd=(int)syscall(__NR_io_uring_setup,SM_URING_ENTRIES,&params);
+    if(fd<0)
+    {
+        smDebug(-1,SMDebugLow,"io_uring: not available (sys error: %s), using plain I/O\n",strerror(errno));
+        return;
+    }
+
+    //reads at current position (5.6) and rings in single mapping (5.4), reads, writes and linked timeouts
+    probe=(struct io_uring_probe*)calloc(1,sizeof(struct io_uring_probe)+256*sizeof(struct io_uring_probe_op));
+    supported=(params.features&IORING_FEAT_SINGLE_MMAP) && (params.features&IORING_FEAT_NODROP) && (params.features&IORING_FEAT_RW_CUR_POS) ? smtrue : smfalse;
+    if(probe==NULL || syscall(__NR_io_uring_register,fd,IORING_REGISTER_PROBE,probe,256)<0
+            || smUringOpSupported(probe,IORING_OP_READ)==smfalse || smUringOpSupported(probe,IORING_OP_WRITE)==smfalse
+            || smUringOpSupported(probe,IORING_OP_LINK_TIMEOUT)==smfalse)
+        supported=smfalse;
+    free(probe);
+    if(supported==smfalse)
+    {
+        smDebug(-1,SMDebugLow,"io_uring: kernel lacks needed features, using plain I/O\n");
+        close(fd);
+        return;
+    }
+
+    ringSize=params.sq_off.array+params.sq_entries*sizeof(unsigned);
+    cqSize=params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+    if(cqSize>ringSize)
+        ringSize=cqSize;
+    ring=(char*)mmap(NULL,ringSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+    sqes=mmap(NULL,params.sq_entries*sizeof(struct io_uring_sqe),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQES);
+    if(ring==MAP_FAILED || sqes==MAP_FAILED)
+    {
+        smDebug(-1,SMDebugLow,"io_uring: mapping ring failed (sys error: %s), using plain I/O\n",strerror(errno));
+        if(ring!=MAP_FAILED)
+            munmap(ring,ringSize);
+        if(sqes!=MAP_FAILED)
+            munmap(sqes,params.sq_entries*sizeof(struct io_uring_sqe));
+        close(fd);
+        return;
+    }
+
+    Ring.sqHead=(unsigned*)(ring+params.sq_off.head);
+    Ring.sqTail=(unsigned*)(ring+params.sq_off.tail);
+    Ring.sqMask=(unsigned*)(ring+params.sq_off.ring_mask);
+    Ring.sqArray=(unsigned*)(ring+params.sq_off.array);
+    Ring.sqLocalTail=*Ring.sqTail;
+    Ring.sqes=(struct io_uring_sqe*)sqes;
+    Ring.cqHead=(unsigned*)(ring+params.cq_off.head);
+    Ring.cqTail=(unsigned*)(ring+params.cq_off.tail);
+    Ring.cqMask=(unsigned*)(ring+params.cq_off.ring_mask);
+    Ring.cqes=(struct io_uring_cqe*)(ring+params.cq_off.cqes);
+    Ring.fd=fd;
+}
+
+//get cleared submission entry, RingLock must be held. queue never fills as entries are submitted right away
+static struct io_uring_sqe *smUringGetSqe( void )
+{
+    unsigned index=Ring.sqLocalTail++&*Ring.sqMask;
+    struct io_uring_sqe *sqe=&Ring.sqes[index];
+
+    memset(sqe,0,sizeof(*sqe));
+    Ring.sqArray[index]=index;
+    return sqe;
+}
+
+//number of entries not yet consumed by kernel, RingLock must be held
+static unsigned smUringUnsubmitted( void )
+{
+    return Ring.sqLocalTail-__atomic_load_n(Ring.sqHead,__ATOMIC_ACQUIRE);
+}
+
+//pass queued entries to kernel, RingLock must be held. entries that couldn't be submitted now are submitted by next call
+static void smUringSubmit( void )
+{
+    int ret;
+
+    __atomic_store_n(Ring.sqTail,Ring.sqLocalTail,__ATOMIC_RELEASE);
+    do
+        ret=(int)syscall(__NR_io_uring_enter,Ring.fd,smUringUnsubmitted(),0,0,NULL,0);
+    while(ret<0 && errno==EINTR);
+    if(ret<0)
+        smDebug(-1,SMDebugLow,"io_uring: submit failed (sys error: %s)\n",strerror(errno));
+}
+
+//store results of completed operations, RingLock must be held
+static void smUringReap( void )
+{
+    unsigned head=*Ring.cqHead, tail=__atomic_load_n(Ring.cqTail,__ATOMIC_ACQUIRE);
+
+    for(;head!=tail;head++)
+    {
+        const struct io_uring_cqe *cqe=&Ring.cqes[head&*Ring.cqMask];
+        SMUringOp *op=(SMUringOp*)(uintptr_t)cqe->user_data;
+
+        //linked timeouts have no op
+        if(op!=NULL)
+        {
+            op->result=cqe->res;
+            op->pending=smfalse;
+        }
+    }
+    __atomic_store_n(Ring.cqHead,head,__ATOMIC_RELEASE);
+}
+
+//wait until op has completed, RingLock must be held. queued entries are submitted in the same system call. one thread
+//at a time waits in kernel and reaps completions of all threads, others sleep until it has done so
+static void smUringWait( SMUringOp *op )
+{
+    smUringReap();
+    while(op->pending==smtrue)
+    {
+        unsigned toSubmit;
+
+        if(Ring.reaping==smtrue)
+        {
+            //reaping thread may wait long for its own op, don't leave ours waiting for it
+            if(smUringUnsubmitted()>0)
+                smUringSubmit();
+            pthread_cond_wait(&RingCompleted,&RingLock);
+            continue;
+        }
+
+        Ring.reaping=smtrue;
+        __atomic_store_n(Ring.sqTail,Ring.sqLocalTail,__ATOMIC_RELEASE);
+        toSubmit=smUringUnsubmitted();
+        pthread_mutex_unlock(&RingLock);
+        syscall(__NR_io_uring_enter,Ring.fd,toSubmit,1,IORING_ENTER_GETEVENTS,NULL,0);
+        pthread_mutex_lock(&RingLock);
+        Ring.reaping=smfalse;
+        smUringReap();
+        pthread_cond_broadcast(&RingCompleted);
+    }
+}
+
+smbool smUringAttach( int fd )
+{
+    SMUringFile *file;
+
+    if(fd<0 || fd>=SM_URING_MAX_FDS)
+        return smfalse;
+    pthread_once(&RingOnce,smUringSetup);
+    if(Ring.fd<0)
+        return smfalse;
+
+    file=(SMUringFile*)calloc(1,sizeof(SMUringFile));
+    if(file==NULL)
+        return smfalse;
+
+    pthread_mutex_lock(&RingLock);
+    Ring.files[fd]=file;
+    pthread_mutex_unlock(&RingLock);
+    return smtrue;
+}
+
+void smUringDetach( int fd )
+{
+    SMUringFile *file;
+
+    if(smUringAttached(fd)==smfalse)
+        return;
+
+    pthread_mutex_lock(&RingLock);
+    file=Ring.files[fd];
+    Ring.files[fd]=NULL;
+    pthread_mutex_unlock(&RingLock);
+    free(file);
+}
+
+smbool smUringAttached( int fd )
+{
+    return fd>=0 && fd<SM_URING_MAX_FDS && Ring.files[fd]!=NULL ? smtrue : smfalse;
+}
+
+int smUringRead( int fd, smuint8 *buf, int size, int timeoutMs )
+{
+    SMUringFile *file;
+    struct io_uring_sqe *sqe;
+    int n;
+
+    if(smUringAttached(fd)==smfalse)
+        return -1;
+    file=Ring.files[fd];
+
+    if(file->rxPos>=file->rxLen)
+    {
+        pthread_mutex_lock(&RingLock);
+        file->timeout.tv_sec=timeoutMs/1000;
+        file->timeout.tv_nsec=(long long)(timeoutMs%1000)*1000000;
+
+        //read whatever arrives first, up to the whole buffer
+        sqe=smUringGetSqe();
+        sqe->opcode=IORING_OP_READ;
+        sqe->fd=fd;
+        sqe->addr=(uintptr_t)file->rx;
+        sqe->len=sizeof(file->rx);
+        sqe->off=(__u64)-1;//current position, devices and sockets have none
+        sqe->flags=IOSQE_IO_LINK;
+        sqe->user_data=(uintptr_t)&file->readOp;
+
+        sqe=smUringGetSqe();
+        sqe->opcode=IORING_OP_LINK_TIMEOUT;
+        sqe->addr=(uintptr_t)&file->timeout;
+        sqe->len=1;
+
+        file->readOp.pending=smtrue;
+        smUringSubmit();
+        smUringWait(&file->readOp);
+        pthread_mutex_unlock(&RingLock);
+
+        if(file->readOp.result==-ECANCELED)
+            return 0;//timeout
+        if(file->readOp.result<=0)
+            return -1;
+        file->rxPos=0;
+        file->rxLen=file->readOp.result;
+    }
+
+    n=file->rxLen-file->rxPos;
+    if(n>size)
+        n=size;
+    memcpy(buf,&file->rx[file->rxPos],n);
+    file->rxPos+=n;
+    return n;
+}
+
+int smUringWrite( int fd, const smuint8 *buf, int size )
+{
+    SMUringFile *file;
+    struct io_uring_sqe *sqe;
+    int written=0;
+
+    if(smUringAttached(fd)==smfalse)
+        return -1;
+    file=Ring.files[fd];
+
+    //submitting and waiting for the completion is one system call. rest of a short write is written by another one
+    pthread_mutex_lock(&RingLock);
+    while(written<size)
+    {
+        sqe=smUringGetSqe();
+        sqe->opcode=IORING_OP_WRITE;
+        sqe->fd=fd;
+        sqe->addr=(uintptr_t)&buf[written];
+        sqe->len=size-written;
+        sqe->off=(__u64)-1;
+        sqe->user_data=(uintptr_t)&file->writeOp;
+
+        file->writeOp.pending=smtrue;
+        smUringWait(&file->writeOp);
+        if(file->writeOp.result<=0)
+            break;
+        written+=file->writeOp.result;
+    }
+    pthread_mutex_unlock(&RingLock);
+
+    if(written<size)
+    {
+        smDebug(-1,SMDebugLow,"io_uring: write failed (sys error: %s)\n",file->writeOp.result<0 ? strerror(-file->writeOp.result) : "nothing written");
+        return -1;
+    }
+    return written;
+}
+
+void smUringDiscardRX( int fd )
+{
+    if(smUringAttached(fd)==smfalse)
+        return;
+    Ring.files[fd]->rxPos=Ring.files[fd]->rxLen=0;
+}
+
+int smUringBuffered( int fd )
+{
+    if(smUringAttached(fd)==smfalse)
+        return 0;
+    return Ring.files[fd]->rxLen-Ring.files[fd]->rxPos;
+}
+
+#else
+
+smbool smUringAttach( int fd )
+{
+    (void)fd;
+    return smfalse;
+}
+
+void smUringDetach( int fd )
+{
+    (void)fd;
+}
+
+smbool smUringAttached( int fd )
+{
+    (void)fd;
+    return smfalse;
+}
+
+int smUringRead( int fd, smuint8 *buf, int size, int timeoutMs )
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    (void)timeoutMs;
+    return -1;
+}
+
+int smUringWrite( int fd, const smuint8 *buf, int size )
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+void smUringDiscardRX( int fd )
+{
+    (void)fd;
+}
+
+int smUringBuffered( int fd )
+{
+    (void)fd;
+    return 0;
+}
+
+#endif
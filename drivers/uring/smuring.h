@@ -0,0 +1,52 @@
+#ifndef SMURING_H
+#define SMURING_H
+
+#include "simplemotion_private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* io_uring I/O backend shared by the serial and TCP/IP drivers on Linux.
+ *
+ * All attached file descriptors do their I/O through one process-wide ring, so a transaction costs one system call for
+ * the write and usually one for the reply instead of write, and poll/select plus read for every byte of the reply:
+ * -writes are submitted and waited for in the same system call, so errors are returned by the write that failed
+ * -reads fetch everything that has arrived into a receive buffer of the descriptor with a read that has a linked
+ *  timeout, and the following byte reads are served from the buffer
+ *
+ * The ring is created on first attach. If the kernel doesn't support io_uring (or it's disabled), smUringAttach fails
+ * and drivers use plain read/write. Compiled in when ENABLE_IO_URING is defined in user_options.h and Linux kernel
+ * headers have io_uring, otherwise smUringAttach always fails.
+ */
+
+//descriptors up to this number can be attached
+#define SM_URING_MAX_FDS 1024
+
+//start doing I/O of fd through the ring. returns smfalse if io_uring is not available or fd is out of range
+smbool smUringAttach( int fd );
+
+//stop using ring for fd. fd is not closed
+void smUringDetach( int fd );
+
+//returns smtrue if fd has been attached
+smbool smUringAttached( int fd );
+
+//read up to size bytes, waits up to timeoutMs if receive buffer is empty. returns number of bytes read,
+//0 on timeout or -1 on error
+int smUringRead( int fd, smuint8 *buf, int size, int timeoutMs );
+
+//write size bytes, rest of a short write is written again. returns size or -1 if write failed
+int smUringWrite( int fd, const smuint8 *buf, int size );
+
+//discard bytes in receive buffer of fd
+void smUringDiscardRX( int fd );
+
+//number of received bytes in receive buffer of fd that smUringRead returns without waiting
+int smUringBuffered( int fd );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SMURING_H
@@ -0,0 +1,61 @@
+//Table of pointers indexed by small integer handles, see handletable.h
+//Copyright (c) Granite Devices Oy
+
+#include "handletable.h"
+#include <stdlib.h>
+
+smint32 smHandleTableAdd( SMHandleTable *table, void *item )
+{
+    SMHandleTableChunk *chunk;
+    smint32 index;
+
+    //all allocated handles in use, add a chunk. its handles are linked so that the lowest one is used first
+    if(table->firstFree==0)
+    {
+        int i;
+
+        if(table->numChunks>=SM_HANDLE_TABLE_CHUNKS)
+            return -1;
+        chunk=(SMHandleTableChunk*)calloc(1,sizeof(SMHandleTableChunk));
+        if(chunk==NULL)
+            return -1;
+
+        index=table->numChunks*SM_HANDLE_TABLE_CHUNK_SIZE;
+        for(i=0;i<SM_HANDLE_TABLE_CHUNK_SIZE-1;i++)
+            chunk->nextFree[i]=index+i+2;
+        if(index+SM_HANDLE_TABLE_CHUNK_SIZE>SM_MAX_BUSES)//last chunk may be partially usable
+            chunk->nextFree[SM_MAX_BUSES-index-1]=0;
+
+        table->chunks[table->numChunks++]=chunk;
+        table->firstFree=index+1;
+    }
+
+    index=table->firstFree-1;
+    chunk=table->chunks[index>>SM_HANDLE_TABLE_CHUNK_BITS];
+    table->firstFree=chunk->nextFree[index&(SM_HANDLE_TABLE_CHUNK_SIZE-1)];
+    chunk->items[index&(SM_HANDLE_TABLE_CHUNK_SIZE-1)]=item;
+    return index|(chunk->generation[index&(SM_HANDLE_TABLE_CHUNK_SIZE-1)]<<SM_HANDLE_INDEX_BITS);
+}
+
+void smHandleTableRemove( SMHandleTable *table, smint32 handle )
+{
+    SMHandleTableChunk *chunk;
+    int slot;
+
+    if(smHandleTableGet(table,handle)==NULL)
+        return;
+
+    chunk=table->chunks[(handle&SM_HANDLE_INDEX_MASK)>>SM_HANDLE_TABLE_CHUNK_BITS];
+    slot=handle&(SM_HANDLE_TABLE_CHUNK_SIZE-1);
+    chunk->items[slot]=NULL;
+    chunk->generation[slot]=(chunk->generation[slot]+1)&((1<<table->generationBits)-1);
+    chunk->nextFree[slot]=table->firstFree;
+    table->firstFree=(handle&SM_HANDLE_INDEX_MASK)+1;
+}
+
+void *smHandleTableGet( const SMHandleTable *table, smint32 handle )
+{
+    if(handle<0 || !SM_HANDLE_TABLE_VALID(*table,handle))
+        return NULL;
+    return SM_HANDLE_TABLE_ITEM(*table,handle);
+}
@@ -0,0 +1,68 @@
+//Table of pointers indexed by small integer handles, used for bus and bus device handles
+//Copyright (c) Granite Devices Oy
+
+#ifndef HANDLETABLE_H
+#define HANDLETABLE_H
+
+#include "simplemotion_types.h"
+#include "user_options.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Handles are allocated in chunks of SM_HANDLE_TABLE_CHUNK_SIZE as needed, so memory use depends on the number of
+ * handles in use rather than SM_MAX_BUSES. Chunks are never moved or freed, so looking up an item of an open handle
+ * is safe while other handles are being added or removed. Free handles are kept in a linked list, most recently
+ * freed handle is reused first. A zero initialized SMHandleTable is an empty table.
+ *
+ * Lowest SM_HANDLE_INDEX_BITS bits of handle are index of slot. If generationBits of table is set, the bits above
+ * them carry generation of the slot that is incremented every time the slot is freed, so a stale handle of a removed
+ * item doesn't find the item that reuses its slot (until generation wraps around after 2^generationBits reuses). */
+
+#define SM_HANDLE_INDEX_BITS 16
+#define SM_HANDLE_INDEX_MASK ((1<<SM_HANDLE_INDEX_BITS)-1)
+#if SM_MAX_BUSES>(1<<SM_HANDLE_INDEX_BITS)
+#error SM_MAX_BUSES is too large
+#endif
+
+#define SM_HANDLE_TABLE_CHUNK_BITS 4
+#define SM_HANDLE_TABLE_CHUNK_SIZE (1<<SM_HANDLE_TABLE_CHUNK_BITS)
+#define SM_HANDLE_TABLE_CHUNKS ((SM_MAX_BUSES+SM_HANDLE_TABLE_CHUNK_SIZE-1)/SM_HANDLE_TABLE_CHUNK_SIZE)
+
+typedef struct
+{
+    void *items[SM_HANDLE_TABLE_CHUNK_SIZE];
+    smint32 nextFree[SM_HANDLE_TABLE_CHUNK_SIZE];//free list link as index+1, 0=end of list
+    smint32 generation[SM_HANDLE_TABLE_CHUNK_SIZE];
+} SMHandleTableChunk;
+
+typedef struct
+{
+    smuint8 generationBits;//0 if handles are plain indexes, max 15. must be set before first add
+    SMHandleTableChunk *chunks[SM_HANDLE_TABLE_CHUNKS];
+    smint32 numChunks;
+    smint32 firstFree;//index+1, 0=no free handles in allocated chunks
+} SMHandleTable;
+
+//store item and return its handle. returns -1 if all SM_MAX_BUSES handles are in use or out of memory
+smint32 smHandleTableAdd( SMHandleTable *table, void *item );
+
+//release handle for reuse, item itself is not freed
+void smHandleTableRemove( SMHandleTable *table, smint32 handle );
+
+//returns item of handle or NULL if handle is not in use
+void *smHandleTableGet( const SMHandleTable *table, smint32 handle );
+
+//item of handle that is known to be in use, without checks
+#define SM_HANDLE_TABLE_ITEM(table,handle) ((table).chunks[((handle)&SM_HANDLE_INDEX_MASK)>>SM_HANDLE_TABLE_CHUNK_BITS]->items[(handle)&(SM_HANDLE_TABLE_CHUNK_SIZE-1)])
+
+//returns nonzero if slot of handle >= 0 is allocated and has the same generation as handle. item may still be NULL
+#define SM_HANDLE_TABLE_VALID(table,handle) (((handle)&SM_HANDLE_INDEX_MASK)<(table).numChunks*SM_HANDLE_TABLE_CHUNK_SIZE \
+    && (table).chunks[((handle)&SM_HANDLE_INDEX_MASK)>>SM_HANDLE_TABLE_CHUNK_BITS]->generation[(handle)&(SM_HANDLE_TABLE_CHUNK_SIZE-1)]==((handle)>>SM_HANDLE_INDEX_BITS))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HANDLETABLE_H
@@ -0,0 +1,140 @@
+//Fast discovery of SM devices connected to buses, see nodediscovery.h
+//Copyright (c) Granite Devices Oy
+
+#include "nodediscovery.h"
+#include "simplemotion_private.h"
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+//each bus is scanned by its own thread. on other platforms buses are scanned one after another
+#define SM_DISCOVERY_THREADS
+#endif
+
+typedef struct
+{
+    smbus handle;
+    smaddr firstAddress;
+    smaddr lastAddress;
+    smuint16 probeTimeoutMs;
+    SM_NODE_INFO found[255];
+    int numFound;
+    SM_STATUS status;
+#ifdef SM_DISCOVERY_THREADS
+    pthread_t thread;
+    smbool threadStarted;
+#endif
+} SMDiscoveryScan;
+
+static void smScanBus( SMDiscoveryScan *scan )
+{
+    int address;
+
+    for(address=scan->firstAddress;address<=scan->lastAddress;address++)
+    {
+        SM_NODE_INFO *node=&scan->found[scan->numFound];
+        SM_STATUS stat;
+
+        if(smProbeNode(scan->handle,(smaddr)address,scan->probeTimeoutMs,NULL)!=SM_OK)
+            continue;
+
+        stat=smGetNodeInfo(scan->handle,(smaddr)address,node);
+        if(stat!=SM_OK)
+        {
+            smDebug(scan->handle,SMDebugLow,"smDiscoverNodes: reading details of SM address %d failed\n",address);
+            scan->status|=stat;
+            continue;
+        }
+
+        smDebug(scan->handle,SMDebugMid,"smDiscoverNodes: found device type %d at SM address %d\n",(int)node->deviceType,address);
+        scan->numFound++;
+    }
+}
+
+#ifdef SM_DISCOVERY_THREADS
+static void *smScanBusThread( void *arg )
+{
+    smScanBus((SMDiscoveryScan*)arg);
+    return NULL;
+}
+#endif
+
+LIB SM_STATUS smDiscoverNodes( const smbus *handles, int numBuses, smaddr firstAddress, smaddr lastAddress,
+                               smuint16 probeTimeoutMs, SM_NODE_INFO *nodes, int maxNodes, int *numNodes )
+{
+    SMDiscoveryScan *scans;
+    SM_STATUS stat=SM_OK;
+    smbool overflow=smfalse;
+    int i, j, count=0;
+
+    if(numNodes!=NULL)
+        *numNodes=0;
+    if(handles==NULL || numBuses<1 || numNodes==NULL || (nodes==NULL && maxNodes>0) || maxNodes<0)
+        return SM_ERR_PARAMETER;
+    if(firstAddress<1 || lastAddress<firstAddress || probeTimeoutMs<1 || probeTimeoutMs>5000)
+        return SM_ERR_PARAMETER;
+
+    for(i=0;i<numBuses;i++)
+    {
+        if(smIsHandleOpen(handles[i])==smfalse)
+            return SM_ERR_NODEVICE;
+        for(j=0;j<i;j++)
+            if(handles[j]==handles[i])//same bus can't be scanned by two threads
+                return recordStatus(handles[i],SM_ERR_PARAMETER);
+    }
+
+    scans=(SMDiscoveryScan*)calloc(numBuses,sizeof(SMDiscoveryScan));
+    if(scans==NULL)
+    {
+        //out of memory
+        for(i=0;i<numBuses;i++)
+            recordStatus(handles[i],SM_ERR_BUS);
+        return SM_ERR_BUS;
+    }
+
+    for(i=0;i<numBuses;i++)
+    {
+        scans[i].handle=handles[i];
+        scans[i].firstAddress=firstAddress;
+        scans[i].lastAddress=lastAddress;
+        scans[i].probeTimeoutMs=probeTimeoutMs;
+        scans[i].status=SM_OK;
+    }
+
+#ifdef SM_DISCOVERY_THREADS
+    //calling thread scans the first bus. if thread can't be created, bus is scanned after it
+    for(i=1;i<numBuses;i++)
+        scans[i].threadStarted=pthread_create(&scans[i].thread,NULL,smScanBusThread,&scans[i])==0 ? smtrue : smfalse;
+    smScanBus(&scans[0]);
+    for(i=1;i<numBuses;i++)
+    {
+        if(scans[i].threadStarted==smtrue)
+            pthread_join(scans[i].thread,NULL);
+        else
+            smScanBus(&scans[i]);
+    }
+#else
+    for(i=0;i<numBuses;i++)
+        smScanBus(&scans[i]);
+#endif
+
+    for(i=0;i<numBuses;i++)
+    {
+        stat|=scans[i].status;
+        for(j=0;j<scans[i].numFound;j++)
+        {
+            if(count>=maxNodes)
+            {
+                overflow=smtrue;
+                break;
+            }
+            nodes[count++]=scans[i].found[j];
+        }
+    }
+
+    free(scans);
+    *numNodes=count;
+    if(overflow==smtrue)
+        return SM_ERR_LENGTH;
+    return stat;
+}
@@ -0,0 +1,40 @@
+//Fast discovery of SM devices connected to buses
+//Copyright (c) Granite Devices Oy
+
+#ifndef NODEDISCOVERY_H
+#define NODEDISCOVERY_H
+
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+//suggested probe deadline for smDiscoverNodes. devices reply in few milliseconds, rest is USB adapter and OS latency
+#define SM_DISCOVERY_DEFAULT_PROBE_TIMEOUT_MS 20
+
+/** Find devices that reply in address range firstAddress..lastAddress on one or more opened buses.
+ * Every address is probed with a single frame that has its own reply deadline probeTimeoutMs instead of the
+ * timeout set with smSetTimeout, so a missing address costs only the probe deadline. Details of the devices that
+ * reply are then read with normal timeouts and stored in node info cache (see smGetNodeInfo).
+ * Missing addresses don't change cumulative status of the bus.
+ * On Linux and macOS buses are scanned concurrently with a thread per bus, on other platforms one after another.
+ * A bus must not be used by other threads during the scan.
+ * Parameters:
+ * -handles, numBuses: buses to scan, each handle may appear only once
+ * -firstAddress, lastAddress: address range to scan, 1-255
+ * -probeTimeoutMs: reply deadline of a probe, 1-5000ms. See SM_DISCOVERY_DEFAULT_PROBE_TIMEOUT_MS.
+ * -nodes, maxNodes: array where found devices are stored, ordered by bus (in order of handles) and address
+ * -numNodes: set to number of devices stored in nodes
+  -return value: SM_OK if scan succeeded, SM_ERR_LENGTH if more than maxNodes devices were found (first maxNodes are stored),
+   SM_ERR_NODEVICE if some handle is not open, SM_ERR_BUS if out of memory or other SM_STATUS if reading details of a
+   replying device failed
+*/
+LIB SM_STATUS smDiscoverNodes( const smbus *handles, int numBuses, smaddr firstAddress, smaddr lastAddress,
+                               smuint16 probeTimeoutMs, SM_NODE_INFO *nodes, int maxNodes, int *numNodes );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NODEDISCOVERY_H
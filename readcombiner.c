@@ -0,0 +1,207 @@
+//Combining concurrent parameter reads of threads into shared frames, see readcombiner.h
+//Copyright (c) Granite Devices Oy
+
+#include "readcombiner.h"
+#include "transactiontemplate.h"
+#include "simplemotion_private.h"
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+//reads of threads are queued while bus is busy. on other platforms each read is sent immediately
+#define SM_COMBINER_THREADS
+#endif
+
+//read request, lives on stack of the requesting thread until done is set
+typedef struct _SMCombinedRead
+{
+    smaddr nodeAddress;
+    smint16 paramId;
+    smint32 value;
+    SM_STATUS status;
+    int resultIndex;//index of value in frame results
+    smbool inFrame;//included in frame being built
+    smbool sent;
+    smbool done;//result has been delivered, set under lock
+    struct _SMCombinedRead *next;
+} SMCombinedRead;
+
+struct _SMReadCombiner
+{
+    smbus handle;
+    SMCombinedRead *pending;//queued requests in order of arrival
+    SMCombinedRead **pendingTail;
+    smbool busy;//a thread is sending a batch
+    smuint32 reads;
+    smuint32 frames;
+
+#ifdef SM_COMBINER_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+#endif
+};
+
+LIB SMReadCombiner *smReadCombinerCreate( const smbus handle )
+{
+    SMReadCombiner *combiner;
+
+    if(smAttachBusUser(handle)!=SM_OK) return NULL;
+    combiner=(SMReadCombiner*)calloc(1,sizeof(SMReadCombiner));
+    if(combiner==NULL)
+    {
+        smDetachBusUser(handle);
+        return NULL;
+    }
+
+    combiner->handle=handle;
+    combiner->pendingTail=&combiner->pending;
+#ifdef SM_COMBINER_THREADS
+    pthread_mutex_init(&combiner->lock,NULL);
+    pthread_cond_init(&combiner->wake,NULL);
+#endif
+    return combiner;
+}
+
+LIB void smReadCombinerDestroy( SMReadCombiner *combiner )
+{
+    if(combiner==NULL) return;
+#ifdef SM_COMBINER_THREADS
+    pthread_cond_destroy(&combiner->wake);
+    pthread_mutex_destroy(&combiner->lock);
+#endif
+    smDetachBusUser(combiner->handle);
+    free(combiner);
+}
+
+//send requests of batch with one frame per node (more if node has more different parameters than fit in a frame).
+//called without lock, returns number of frames sent
+static smuint32 smReadCombinerSend( SMReadCombiner *combiner, SMCombinedRead *batch )
+{
+    SMCombinedRead *first, *req;
+    smuint32 frames=0;
+
+    for(first=batch;first!=NULL;first=first->next)
+    {
+        SM_TRANSACTION_TEMPLATE tpl;
+        smint32 results[SM_TEMPLATE_MAX_READS];
+        smint16 params[SM_TEMPLATE_MAX_READS];
+        int numReads=0, i;
+        SM_STATUS stat;
+
+        if(first->sent==smtrue)
+            continue;
+
+        //collect reads of the same node, duplicate parameters share the same read
+        smTemplateInit(&tpl);
+        for(req=first;req!=NULL;req=req->next)
+        {
+            int index=-1;
+
+            if(req->sent==smtrue || req->nodeAddress!=first->nodeAddress)
+                continue;
+            for(i=0;i<numReads && index<0;i++)
+                if(params[i]==req->paramId)
+                    index=i;
+            if(index<0)
+            {
+                if(numReads>=SM_TEMPLATE_MAX_READS)
+                    continue;//goes to a later frame
+                index=numReads;
+                params[numReads++]=req->paramId;
+                smTemplateAppendGetParam(&tpl,req->paramId,index*sizeof(smint32));
+            }
+            req->resultIndex=index;
+            req->inFrame=smtrue;
+        }
+
+        stat=smTemplateExecute(combiner->handle,first->nodeAddress,&tpl,results);
+        frames++;
+
+        for(req=first;req!=NULL;req=req->next)
+        {
+            if(req->inFrame==smfalse)
+                continue;
+            req->status=stat;
+            if(stat==SM_OK)
+                req->value=results[req->resultIndex];
+            req->inFrame=smfalse;
+            req->sent=smtrue;
+        }
+    }
+
+    return frames;
+}
+
+LIB SM_STATUS smCombinedRead1Parameter( SMReadCombiner *combiner, const smaddr nodeAddress, const smint16 paramId, smint32 *paramVal )
+{
+    SMCombinedRead req;
+
+    req.nodeAddress=nodeAddress;
+    req.paramId=paramId;
+    req.value=0;
+    req.status=SM_NONE;
+    req.inFrame=smfalse;
+    req.sent=smfalse;
+    req.done=smfalse;
+    req.next=NULL;
+
+#ifdef SM_COMBINER_THREADS
+    pthread_mutex_lock(&combiner->lock);
+    *combiner->pendingTail=&req;
+    combiner->pendingTail=&req.next;
+    combiner->reads++;
+
+    while(req.done==smfalse)
+    {
+        SMCombinedRead *batch, *next;
+        smuint32 frames;
+
+        if(combiner->busy==smtrue)
+        {
+            pthread_cond_wait(&combiner->wake,&combiner->lock);
+            continue;
+        }
+
+        //take everything queued so far, including own request
+        batch=combiner->pending;
+        combiner->pending=NULL;
+        combiner->pendingTail=&combiner->pending;
+        combiner->busy=smtrue;
+        pthread_mutex_unlock(&combiner->lock);
+
+        frames=smReadCombinerSend(combiner,batch);
+
+        pthread_mutex_lock(&combiner->lock);
+        combiner->frames+=frames;
+        combiner->busy=smfalse;
+        for(;batch!=NULL;batch=next)
+        {
+            next=batch->next;//request may be gone once done is set and lock released
+            batch->done=smtrue;
+        }
+        pthread_cond_broadcast(&combiner->wake);
+    }
+    pthread_mutex_unlock(&combiner->lock);
+#else
+    combiner->reads++;
+    combiner->frames+=smReadCombinerSend(combiner,&req);
+#endif
+
+    if(req.status==SM_OK)
+        *paramVal=req.value;
+    return req.status;
+}
+
+LIB void smReadCombinerGetStats( SMReadCombiner *combiner, smuint32 *reads, smuint32 *frames )
+{
+#ifdef SM_COMBINER_THREADS
+    pthread_mutex_lock(&combiner->lock);
+#endif
+    if(reads!=NULL)
+        *reads=combiner->reads;
+    if(frames!=NULL)
+        *frames=combiner->frames;
+#ifdef SM_COMBINER_THREADS
+    pthread_mutex_unlock(&combiner->lock);
+#endif
+}
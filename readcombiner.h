@@ -0,0 +1,52 @@
+//Combining concurrent parameter reads of threads into shared frames
+//Copyright (c) Granite Devices Oy
+
+#ifndef READCOMBINER_H
+#define READCOMBINER_H
+
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Read combiner is an optional layer for applications where several threads read parameters of the same nodes. Instead
+ * of each smRead1Parameter being a frame and round trip of its own, reads made with smCombinedRead1Parameter while the
+ * bus is busy with an earlier combined read are queued, and the next thread that gets the bus sends all queued reads
+ * of each node in one frame and returns the values to their callers. The same parameter requested by several threads
+ * is read only once. Without contention a combined read is a single frame like smRead1Parameter.
+ *
+ * I.e.:
+ *  SMReadCombiner *combiner=smReadCombinerCreate(handle);
+ *
+ * and in any thread:
+ *  smCombinedRead1Parameter(combiner,1,SMP_ACTUAL_POSITION_FB,&position);
+ *
+ * The combiner serializes only reads made through it, other access to the same bus from other threads must be
+ * serialized by the application as usual. Combining requires threads, on platforms other than Linux and macOS each read
+ * is sent immediately.
+ */
+
+typedef struct _SMReadCombiner SMReadCombiner;
+
+/** Create combiner for an opened bus. Bus can't be closed until combiner is destroyed.
+  -return value: combiner, NULL if bus is not open or out of memory
+*/
+LIB SMReadCombiner *smReadCombinerCreate( const smbus handle );
+
+/** Free combiner. No thread may be reading through it. */
+LIB void smReadCombinerDestroy( SMReadCombiner *combiner );
+
+/** Read one parameter like smRead1Parameter, combined with reads of other threads that are waiting for the bus.
+  -return value: a SM_STATUS value of the frame that carried the read, i.e. SM_OK if read succeed
+*/
+LIB SM_STATUS smCombinedRead1Parameter( SMReadCombiner *combiner, const smaddr nodeAddress, const smint16 paramId, smint32 *paramVal );
+
+/** Get number of reads requested and frames sent since creation, reads/frames is the average combining ratio */
+LIB void smReadCombinerGetStats( SMReadCombiner *combiner, smuint32 *reads, smuint32 *frames );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // READCOMBINER_H
@@ -0,0 +1,346 @@
+//Publishing of telemetry to other processes through shared memory, see sharedtelemetry.h
+//Copyright (c) Granite Devices Oy
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "sharedtelemetry.h"
+#include "simplemotion_private.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SM_SHARED_TELEMETRY_SUPPORTED
+#endif
+
+struct _SMSharedTelemetry
+{
+    SM_SHARED_TELEMETRY_HEADER *header;
+    size_t size;
+    smbool publisher;
+    char *name;//publisher only, for unlinking
+};
+
+static SM_SHARED_TELEMETRY_SLOT *smSharedSlot( const SMSharedTelemetry *shared, int slot )
+{
+    const SM_SHARED_TELEMETRY_HEADER *header=shared->header;
+    return (SM_SHARED_TELEMETRY_SLOT*)((char*)header+header->slotsOffset+(size_t)slot*header->slotSize);
+}
+
+static SM_SHARED_TELEMETRY_SAMPLE *smSharedSample( const SMSharedTelemetry *shared, smuint32 number )
+{
+    const SM_SHARED_TELEMETRY_HEADER *header=shared->header;
+    return (SM_SHARED_TELEMETRY_SAMPLE*)((char*)header+header->samplesOffset+(size_t)(number&(header->maxSamples-1))*header->sampleSize);
+}
+
+//sequence of completed sample is its number+1. 0 means being written, so it's skipped when number+1 wraps around
+static smuint32 smSharedSampleSequence( smuint32 number )
+{
+    return number+1!=0 ? number+1 : 1;
+}
+
+LIB SMSharedTelemetry *smSharedTelemetryCreate( const char *name, int maxSlots, int maxSamples )
+{
+#ifdef SM_SHARED_TELEMETRY_SUPPORTED
+    SMSharedTelemetry *shared;
+    SM_SHARED_TELEMETRY_HEADER *header;
+    smuint32 ringSize=1;
+    size_t size;
+    void *map;
+    int fd;
+
+    if(name==NULL || maxSlots<1 || maxSamples<1 || maxSamples>0x40000000) return NULL;
+    while(ringSize<(smuint32)maxSamples)
+        ringSize<<=1;
+
+    size=sizeof(SM_SHARED_TELEMETRY_HEADER)+(size_t)maxSlots*sizeof(SM_SHARED_TELEMETRY_SLOT)+(size_t)ringSize*sizeof(SM_SHARED_TELEMETRY_SAMPLE);
+
+    //new object is created instead of resizing the old one, so readers that still have old one mapped won't crash
+    shm_unlink(name);
+    fd=shm_open(name,O_CREAT|O_EXCL|O_RDWR,0644);
+    if(fd<0) return NULL;
+    if(ftruncate(fd,(off_t)size)!=0)
+    {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    map=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if(map==MAP_FAILED)
+    {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    shared=(SMSharedTelemetry*)calloc(1,sizeof(SMSharedTelemetry));
+    if(shared==NULL || (shared->name=(char*)malloc(strlen(name)+1))==NULL)
+    {
+        free(shared);
+        munmap(map,size);
+        shm_unlink(name);
+        return NULL;
+    }
+    strcpy(shared->name,name);
+    shared->header=header=(SM_SHARED_TELEMETRY_HEADER*)map;
+    shared->size=size;
+    shared->publisher=smtrue;
+
+    //object is zero filled by ftruncate
+    header->version=SM_SHARED_TELEMETRY_VERSION;
+    header->headerSize=sizeof(SM_SHARED_TELEMETRY_HEADER);
+    header->slotSize=sizeof(SM_SHARED_TELEMETRY_SLOT);
+    header->maxSlots=maxSlots;
+    header->slotsOffset=sizeof(SM_SHARED_TELEMETRY_HEADER);
+    header->sampleSize=sizeof(SM_SHARED_TELEMETRY_SAMPLE);
+    header->maxSamples=ringSize;
+    header->samplesOffset=header->slotsOffset+maxSlots*sizeof(SM_SHARED_TELEMETRY_SLOT);
+    SM_MEMORY_BARRIER();
+    header->magic=SM_SHARED_TELEMETRY_MAGIC;
+
+    return shared;
+#else
+    (void)name;
+    (void)maxSlots;
+    (void)maxSamples;
+    return NULL;
+#endif
+}
+
+LIB SMSharedTelemetry *smSharedTelemetryOpen( const char *name )
+{
+#ifdef SM_SHARED_TELEMETRY_SUPPORTED
+    SMSharedTelemetry *shared;
+    const SM_SHARED_TELEMETRY_HEADER *header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if(name==NULL) return NULL;
+    fd=shm_open(name,O_RDONLY,0);
+    if(fd<0) return NULL;
+    if(fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(SM_SHARED_TELEMETRY_HEADER))
+    {
+        close(fd);
+        return NULL;
+    }
+    map=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if(map==MAP_FAILED) return NULL;
+
+    //check that layout is compatible and fits in the object
+    header=(const SM_SHARED_TELEMETRY_HEADER*)map;
+    if(header->magic!=SM_SHARED_TELEMETRY_MAGIC || header->version!=SM_SHARED_TELEMETRY_VERSION
+            || header->headerSize<sizeof(SM_SHARED_TELEMETRY_HEADER) || header->slotSize<sizeof(SM_SHARED_TELEMETRY_SLOT)
+            || header->sampleSize<sizeof(SM_SHARED_TELEMETRY_SAMPLE) || header->maxSamples==0 || (header->maxSamples&(header->maxSamples-1))!=0
+            || (smuint64)header->slotsOffset+(smuint64)header->maxSlots*header->slotSize>(smuint64)st.st_size
+            || (smuint64)header->samplesOffset+(smuint64)header->maxSamples*header->sampleSize>(smuint64)st.st_size)
+    {
+        munmap(map,(size_t)st.st_size);
+        return NULL;
+    }
+
+    shared=(SMSharedTelemetry*)calloc(1,sizeof(SMSharedTelemetry));
+    if(shared==NULL)
+    {
+        munmap(map,(size_t)st.st_size);
+        return NULL;
+    }
+    shared->header=(SM_SHARED_TELEMETRY_HEADER*)map;
+    shared->size=(size_t)st.st_size;
+    shared->publisher=smfalse;
+    return shared;
+#else
+    (void)name;
+    return NULL;
+#endif
+}
+
+LIB void smSharedTelemetryClose( SMSharedTelemetry *shared )
+{
+    if(shared==NULL) return;
+#ifdef SM_SHARED_TELEMETRY_SUPPORTED
+    if(shared->publisher==smtrue)
+    {
+        shared->header->closed=1;
+        shm_unlink(shared->name);
+        free(shared->name);
+    }
+    munmap(shared->header,shared->size);
+#endif
+    free(shared);
+}
+
+LIB int smSharedTelemetryNumSlots( const SMSharedTelemetry *shared )
+{
+    smuint32 numSlots=shared->header->numSlots;
+    SM_MEMORY_BARRIER();
+    return numSlots<shared->header->maxSlots ? (int)numSlots : (int)shared->header->maxSlots;
+}
+
+LIB int smSharedTelemetryFindSlot( const SMSharedTelemetry *shared, const smaddr nodeAddress, const smint16 paramAddress )
+{
+    int i, numSlots=smSharedTelemetryNumSlots(shared);
+
+    for(i=0;i<numSlots;i++)
+    {
+        const SM_SHARED_TELEMETRY_SLOT *slot=smSharedSlot(shared,i);
+        if(slot->nodeAddress==nodeAddress && slot->paramAddress==paramAddress)
+            return i;
+    }
+    return -1;
+}
+
+LIB int smSharedTelemetryAddSlot( SMSharedTelemetry *shared, const smaddr nodeAddress, const smint16 paramAddress )
+{
+    SM_SHARED_TELEMETRY_HEADER *header=shared->header;
+    SM_SHARED_TELEMETRY_SLOT *slot;
+    int index;
+
+    if(shared->publisher==smfalse) return -1;
+
+    index=smSharedTelemetryFindSlot(shared,nodeAddress,paramAddress);
+    if(index>=0) return index;
+    if(header->numSlots>=header->maxSlots) return -1;
+
+    //slot must be complete before readers see it
+    index=header->numSlots;
+    slot=smSharedSlot(shared,index);
+    slot->nodeAddress=nodeAddress;
+    slot->paramAddress=paramAddress;
+    slot->status=SM_NONE;
+    SM_MEMORY_BARRIER();
+    header->numSlots=index+1;
+    return index;
+}
+
+LIB SM_STATUS smSharedTelemetryWrite( SMSharedTelemetry *shared, int slotIndex, const SM_TELEMETRY_SAMPLE *sample )
+{
+    SM_SHARED_TELEMETRY_SLOT *slot;
+
+    if(shared->publisher==smfalse || slotIndex<0 || slotIndex>=(int)shared->header->numSlots) return SM_ERR_PARAMETER;
+    slot=smSharedSlot(shared,slotIndex);
+
+    slot->sequence++;
+    SM_MEMORY_BARRIER();
+    slot->value=sample->value;
+    slot->status=sample->status;
+    slot->updates=sample->updates;
+    slot->timestampNs=sample->timestampNs;
+    SM_MEMORY_BARRIER();
+    slot->sequence++;
+    return SM_OK;
+}
+
+LIB SM_STATUS smSharedTelemetryRead( const SMSharedTelemetry *shared, int slotIndex, SM_TELEMETRY_SAMPLE *sample )
+{
+    const SM_SHARED_TELEMETRY_SLOT *slot;
+    smuint32 before, after;
+
+    if(slotIndex<0 || slotIndex>=smSharedTelemetryNumSlots(shared)) return SM_ERR_PARAMETER;
+    slot=smSharedSlot(shared,slotIndex);
+
+    //retry if publisher updated the slot during copy
+    do
+    {
+        before=slot->sequence;
+        SM_MEMORY_BARRIER();
+        sample->value=slot->value;
+        sample->status=slot->status;
+        sample->updates=slot->updates;
+        sample->timestampNs=slot->timestampNs;
+        SM_MEMORY_BARRIER();
+        after=slot->sequence;
+    } while((before&1) || before!=after);
+
+    return SM_OK;
+}
+
+LIB SM_STATUS smSharedTelemetryWriteSamples( SMSharedTelemetry *shared, const smaddr nodeAddress, const smint16 paramAddress, const smint32 *values, int numValues )
+{
+    SM_SHARED_TELEMETRY_HEADER *header=shared->header;
+    smuint64 now=smGetMonotonicTimeNs();
+    smuint32 number=header->samplesWritten;
+    int i;
+
+    if(shared->publisher==smfalse || numValues<0) return SM_ERR_PARAMETER;
+
+    for(i=0;i<numValues;i++,number++)
+    {
+        SM_SHARED_TELEMETRY_SAMPLE *sample=smSharedSample(shared,number);
+
+        sample->sequence=0;
+        SM_MEMORY_BARRIER();
+        sample->nodeAddress=nodeAddress;
+        sample->paramAddress=paramAddress;
+        sample->value=values[i];
+        sample->timestampNs=now;
+        SM_MEMORY_BARRIER();
+        sample->sequence=smSharedSampleSequence(number);
+    }
+
+    SM_MEMORY_BARRIER();
+    header->samplesWritten=number;
+    return SM_OK;
+}
+
+LIB SM_STATUS smSharedTelemetryWriteBufferedSamples( SMSharedTelemetry *shared, const BufferedMotionAxis *axis, const smint32 *values, int numValues )
+{
+    return smSharedTelemetryWriteSamples(shared,axis->deviceAddress,axis->readParamAddr,values,numValues);
+}
+
+LIB smuint32 smSharedTelemetrySamplePosition( const SMSharedTelemetry *shared )
+{
+    return shared->header->samplesWritten;
+}
+
+LIB SM_STATUS smSharedTelemetryReadSamples( const SMSharedTelemetry *shared, smuint32 *position, SM_SHARED_TELEMETRY_SAMPLE *samples, int maxSamples, int *numSamples, smuint32 *numLost )
+{
+    const SM_SHARED_TELEMETRY_HEADER *header=shared->header;
+    smuint32 written=header->samplesWritten, number=*position, lost=0;
+    int count=0;
+
+    SM_MEMORY_BARRIER();
+
+    //samples older than ring size are gone. also position 0 lands here once ring has wrapped
+    if(written-number>header->maxSamples)
+    {
+        smuint32 first=written-header->maxSamples;
+        if(number!=0)
+            lost=first-number;
+        number=first;
+    }
+
+    for(;number!=written && count<maxSamples;number++)
+    {
+        const SM_SHARED_TELEMETRY_SAMPLE *sample=smSharedSample(shared,number);
+        smuint32 before, after;
+
+        before=sample->sequence;
+        SM_MEMORY_BARRIER();
+        samples[count]=*sample;
+        SM_MEMORY_BARRIER();
+        after=sample->sequence;
+
+        //overwritten by a newer sample during copy
+        if(before!=smSharedSampleSequence(number) || after!=smSharedSampleSequence(number))
+        {
+            lost++;
+            continue;
+        }
+        samples[count].sequence=before;
+        count++;
+    }
+
+    *position=number;
+    *numSamples=count;
+    if(numLost!=NULL)
+        *numLost=lost;
+    return SM_OK;
+}
@@ -0,0 +1,145 @@
+//Publishing of telemetry to other processes through shared memory
+//Copyright (c) Granite Devices Oy
+
+#ifndef SHAREDTELEMETRY_H
+#define SHAREDTELEMETRY_H
+
+#include "simplemotion.h"
+#include "telemetry.h"
+#include "bufferedmotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Only one process can own the bus, but values that it reads can be published to a POSIX shared memory object that any
+ * number of local processes (HMI, logger, diagnostics) read without touching the bus. Publisher holds:
+ *
+ * -slots: latest value of parameters, i.e. ones polled by the telemetry engine (see smTelemetrySetPublisher) or written
+ *  with smSharedTelemetryWrite
+ * -sample ring: stream of values, i.e. buffered motion readback returned by smBufferedFillAndReceive/smBufferedReceive,
+ *  written with smSharedTelemetryWriteBufferedSamples
+ *
+ * Readers never block the publisher. Each slot and sample has a sequence counter that reader checks before and after
+ * copying, so a value that was being overwritten during copy is detected and re-read or reported lost.
+ *
+ * I.e. in bus owner process:
+ *  SMSharedTelemetry *pub=smSharedTelemetryCreate("/smtelemetry",64,4096);
+ *  smTelemetrySetPublisher(telemetry,pub);
+ *
+ * and in any other process:
+ *  SMSharedTelemetry *reader=smSharedTelemetryOpen("/smtelemetry");
+ *  int slot=smSharedTelemetryFindSlot(reader,1,SMP_ACTUAL_POSITION_FB);
+ *  smSharedTelemetryRead(reader,slot,&sample);
+ *
+ * Supported on Linux and macOS. Layout of the shared memory object is described below so that it can be read also
+ * without this library. Fields are only appended to the structs in later layout versions, readers must use headerSize,
+ * slotSize, sampleSize and offsets from the header instead of sizeof.
+ */
+
+#define SM_SHARED_TELEMETRY_MAGIC 0x534d5450 //"SMTP"
+#define SM_SHARED_TELEMETRY_VERSION 1
+
+typedef struct
+{
+    smuint32 magic;//SM_SHARED_TELEMETRY_MAGIC, written last when publisher has initialized the object
+    smuint16 version;//SM_SHARED_TELEMETRY_VERSION, readers refuse other versions
+    smuint16 headerSize;
+    smuint32 slotSize;
+    smuint32 maxSlots;
+    smuint32 slotsOffset;//from start of object
+    smuint32 sampleSize;
+    smuint32 maxSamples;//size of sample ring, power of two
+    smuint32 samplesOffset;
+    volatile smuint32 numSlots;//number of slots in use, only grows
+    volatile smuint32 samplesWritten;//total number of samples written to ring (wraps around). sample n is at index n%maxSamples
+    volatile smuint32 closed;//nonzero when publisher has closed the object, readers should reopen to get a new one
+    smuint32 reserved;
+} SM_SHARED_TELEMETRY_HEADER;
+
+typedef struct
+{
+    volatile smuint32 sequence;//odd while slot is being written
+    smuint16 nodeAddress;
+    smint16 paramAddress;
+    smint32 value;
+    smint32 status;//SM_STATUS of latest read
+    smuint32 updates;
+    smuint32 reserved;
+    smuint64 timestampNs;//smGetMonotonicTimeNs clock of publisher (CLOCK_MONOTONIC)
+} SM_SHARED_TELEMETRY_SLOT;
+
+typedef struct
+{
+    volatile smuint32 sequence;//sample number+1 (1 for the number that wraps it to 0), 0 while sample is being written
+    smuint16 nodeAddress;
+    smint16 paramAddress;
+    smint32 value;
+    smuint32 reserved;
+    smuint64 timestampNs;
+} SM_SHARED_TELEMETRY_SAMPLE;
+
+typedef struct _SMSharedTelemetry SMSharedTelemetry;
+
+/** Create shared memory object for publishing. Name is a POSIX shared memory name, i.e. "/smtelemetry". Existing object
+ * with the same name is replaced. maxSamples is rounded up to a power of two.
+  -return value: publisher, NULL if creating failed or platform is not supported
+*/
+LIB SMSharedTelemetry *smSharedTelemetryCreate( const char *name, int maxSlots, int maxSamples );
+
+/** Get slot for a parameter, slot is created if it doesn't exist yet. Publisher only.
+  -return value: slot index, -1 if all slots are in use
+*/
+LIB int smSharedTelemetryAddSlot( SMSharedTelemetry *publisher, const smaddr nodeAddress, const smint16 paramAddress );
+
+/** Update value of slot. Publisher only. */
+LIB SM_STATUS smSharedTelemetryWrite( SMSharedTelemetry *publisher, int slot, const SM_TELEMETRY_SAMPLE *sample );
+
+/** Append values to sample ring, all values get the current time as timestamp. Publisher only. */
+LIB SM_STATUS smSharedTelemetryWriteSamples( SMSharedTelemetry *publisher, const smaddr nodeAddress, const smint16 paramAddress, const smint32 *values, int numValues );
+
+/** Append buffered motion readback values of axis (see smBufferedFillAndReceive) to sample ring. Publisher only. */
+LIB SM_STATUS smSharedTelemetryWriteBufferedSamples( SMSharedTelemetry *publisher, const BufferedMotionAxis *axis, const smint32 *values, int numValues );
+
+/** Open shared memory object created by publisher for reading.
+  -return value: reader, NULL if object doesn't exist or has incompatible layout version
+*/
+LIB SMSharedTelemetry *smSharedTelemetryOpen( const char *name );
+
+/** Unmap object. If called by publisher, object is also marked closed and removed. */
+LIB void smSharedTelemetryClose( SMSharedTelemetry *sharedTelemetry );
+
+/** Number of slots in use. Slots are never removed, so 0..numSlots-1 are valid slot indexes. */
+LIB int smSharedTelemetryNumSlots( const SMSharedTelemetry *sharedTelemetry );
+
+/** Find slot of parameter
+  -return value: slot index, -1 if not found
+*/
+LIB int smSharedTelemetryFindSlot( const SMSharedTelemetry *sharedTelemetry, const smaddr nodeAddress, const smint16 paramAddress );
+
+/** Get consistent copy of slot
+  -return value: SM_OK or SM_ERR_PARAMETER if slot index is invalid
+*/
+LIB SM_STATUS smSharedTelemetryRead( const SMSharedTelemetry *sharedTelemetry, int slot, SM_TELEMETRY_SAMPLE *sample );
+
+/** Returns the number of the next sample to be written to ring. Use as initial position of smSharedTelemetryReadSamples
+ * to get only samples that are written after this call, or 0 to get also older ones that are still in the ring. */
+LIB smuint32 smSharedTelemetrySamplePosition( const SMSharedTelemetry *sharedTelemetry );
+
+/** Read samples from ring starting at *position and advance *position.
+ * -numLost: if not NULL, set to number of samples that were overwritten by publisher before they could be read
+  -return value: SM_OK
+*/
+LIB SM_STATUS smSharedTelemetryReadSamples( const SMSharedTelemetry *sharedTelemetry, smuint32 *position, SM_SHARED_TELEMETRY_SAMPLE *samples, int maxSamples, int *numSamples, smuint32 *numLost );
+
+/** Publish values polled by telemetry engine. A slot is added for each item of engine. Must be called while worker
+ * thread is not running. Use NULL to stop publishing.
+  -return value: SM_OK, SM_ERR_PARAMETER if engine is running or publisher is out of slots
+*/
+LIB SM_STATUS smTelemetrySetPublisher( SMTelemetry *telemetry, SMSharedTelemetry *publisher );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHAREDTELEMETRY_H
@@ -1,10 +1,16 @@
 
 //Copyright (c) Granite Devices Oy
 
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE //usleep and clock_gettime are not declared in strict ISO C mode otherwise
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 #include "busdevice.h"
+#include "handletable.h"
 #include "user_options.h"
 #include "sm485.h"
 #include <stdarg.h>
@@ -12,12 +18,27 @@
 
 #include "simplemotion_private.h"
 
-SM_STATUS smParseReturnData( smbus handle, smuint8 data );
-
 #define HANDLE_STAT(stat) if(stat!=SM_OK)return (stat);
 #define HANDLE_STAT_AND_RET(stat,returndata) { if(returndata==RET_INVALID_CMD||returndata==RET_INVALID_PARAM) return SM_ERR_PARAMETER; if(stat!=SM_OK) return (stat); }
 
 enum RecvState {WaitCmdId,WaitAddr,WaitPayloadSize,WaitPayload,WaitCrcHi,WaitCrcLo};
+
+//longest SM485 frame: cmdid, size, addr, payload and crc
+#define SM485_MAX_FRAME_BYTES (SM485_MAX_PAYLOAD_BYTES+5)
+//on receive error, partially received frame found this close to start of failed frame is assumed to be
+//the actual reply preceded by noise and receiving continues. deeper in the failed frame it's likely just payload data.
+#define SM485_RESYNC_MAX_NOISE_BYTES 3
+//bytes of SM485 frame in addition to payload: cmdid, size, addr and crc
+#define SM485_FRAME_OVERHEAD_BYTES 5
+//adaptive timeouts: number of nodes per bus with own latency statistics and max timeout multiplier (2^n) after consecutive timeouts
+#define SM_LATENCY_STATS_NODES 16
+#define SM_ADAPTIVE_TIMEOUT_MAX_BACKOFF 3
+//bus speed escalation: oldest SM protocol version where watchdog timeout resets bus speed to default, watchdog timeout
+//(in SMP_FAULT_BEHAVIOR units of 10ms) that is enabled during switch on nodes that don't have it and extra wait for fallback
+#define SM_VERSION_WATCHDOG_RESETS_SPEED 26
+#define SM_SPEED_SWITCH_WATCHDOG 30
+#define SM_SPEED_SWITCH_FALLBACK_MARGIN_MS 100
+#define SM_FAULT_BEHAVIOR_WATCHDOG(faultbehavior) (((faultbehavior)>>8)&0x3ff)
 FILE *smDebugOut=NULL;
 
 //useful macros from extracting/storing multibyte values from/to byte buffer
@@ -33,6 +54,23 @@ smbool smIsHandleOpen( const smbus handle );
 
 SM_STATUS smReceiveReturnPacket( smbus bushandle );
 
+//reply latency estimate of a node or whole bus, see smSetAdaptiveTimeout
+typedef struct
+{
+    smaddr address;//node address, 0 if slot unused
+    smuint8 backoff;//number of consecutive timeouts, timeout is multiplied by 2^backoff
+    smuint32 samples;
+    smint32 srttUs;//smoothed latency
+    smint32 rttvarUs;//smoothed mean deviation of latency
+} SM_LATENCY_STATS;
+
+//cached identification of node, see smGetNodeInfo
+typedef struct
+{
+    smbool valid;
+    SM_NODE_INFO info;
+} SM_NODE_CACHE;
+
 typedef struct SM_BUS_
 {
     smbusdevicehandle bdHandle;
@@ -48,41 +86,131 @@ typedef struct SM_BUS_
     smuint16 recv_crc;
     smuint16 recv_read_crc_hi;
     smbool receiveComplete;
+    smuint8 recv_raw[SM485_MAX_FRAME_BYTES];//unparsed copy of frame being received, used for resynchronization
+    smint16 recv_rawlen;
+    smint16 recv_shifted_check_len;//recv_rawlen at which smCheckShiftedFrame is called next
     smbool transmitBufFull;//set true if user uploads too much commands in one SM transaction. if true, on execute commands, nothing will be sent to bus to prevent unvanted clipped commands and buffer will be cleared
     char busDeviceName[SM_BUSDEVICENAME_LEN];
 
-    smint16 cmd_send_queue_bytes;//for queued device commands
-    smint16 cmd_recv_queue_bytes;//recv_queue_bytes counted upwards at every smGetQueued.. and compared to payload size
+    smint32 cmd_send_queue_bytes;//for queued device commands
+    smint32 cmd_recv_queue_bytes;//recv_queue_bytes counted upwards at every smGetQueued.. and compared to payload size
+
+    //multi-frame command queue (see smSetMultiFrameQueue). when enabled, commands are queued to mfSendQueue instead of
+    //recv_rsbuf and return values of all frames are collected to mfRecvQueue
+    smbool multiFrameQueue;
+    smuint8 *mfSendQueue, *mfRecvQueue;
+    smint32 mfSendQueueSize, mfRecvQueueSize;//allocated bytes
+    smint32 mfRecvQueueBytes;
 
 
     SM_STATUS cumulativeSmStatus;
+
+    //adaptive timeouts
+    smbool adaptiveTimeout;
+    smuint16 adaptiveTimeoutFloorMs, adaptiveTimeoutCeilingMs;
+    unsigned long baudrate;//speed at which bus was opened, used for estimating transfer times
+    smuint64 transactionStartNs;
+    smint16 transactionTxBytes;
+    SM_LATENCY_STATS busLatency;
+    SM_LATENCY_STATS nodeLatency[SM_LATENCY_STATS_NODES];
+
+    SM_NODE_CACHE *nodeCache;//indexed by node address, allocated at first use
+    smbool queueInvalidatesNodeInfo;//command queue restarts target device or changes its firmware
+
+    //send window of pipelined transactions, see smSetPipelineWindow
+    int pipelineFrames;
+    int pipelineBytes;//0 if not limited
+    int pipelineRepliesPending;//replies of pipelined frames expected after the one being received
+
+    int users;//number of telemetry engines, read combiners and schedulers attached, see smAttachBusUser
 } SM_BUS;
 
 
-SM_BUS smBus[SM_MAX_BUSES];
-smuint16 readTimeoutMs=SM_READ_TIMEOUT;
+//state of opened buses is allocated at open and indexed by smbus handle. handles carry generation of their slot so
+//that a handle of a closed bus stays invalid when its slot is reused
+static SMHandleTable smBusTable={15,{NULL},0,0};
+#define smBus(handle) (*(SM_BUS*)SM_HANDLE_TABLE_ITEM(smBusTable,handle))
 
-//init on first smOpenBus call
-smbool smInitialized=smfalse;
+smuint16 readTimeoutMs=SM_READ_TIMEOUT;
+//busy-poll receive window of drivers, see smSetBusyPoll
+static smuint32 busyPollUs=0;
+//deadline of transaction in progress in this thread set by adaptive timeouts or node probe, 0=use readTimeoutMs
+static SM_THREAD_LOCAL smuint16 transactionTimeoutMs=0;
+//deadline of node probes made by this thread (see smProbeNode), 0=not probing
+static SM_THREAD_LOCAL smuint16 probeTimeoutMs=0;
 
 //if debug message has priority this or above will be printed to debug stream
 smVerbosityLevel smDebugThreshold=SMDebugTrace;
 
 #if defined(__unix__) || defined(__APPLE__)
 #include <unistd.h>
+#include <time.h>
 void smSleepMs(int millisecs)
 {
     usleep(millisecs*1000);
 }
 
+void smSleepUs(int microsecs)
+{
+    usleep(microsecs);
+}
+
+smuint64 smGetMonotonicTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (smuint64)ts.tv_sec*1000000000ULL+(smuint64)ts.tv_nsec;
+}
+
+void smCondInit( pthread_cond_t *cond )
+{
+#ifdef __APPLE__
+    pthread_cond_init(cond,NULL);//clock can't be selected, waits are relative instead
+#else
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr,CLOCK_MONOTONIC);
+    pthread_cond_init(cond,&attr);
+    pthread_condattr_destroy(&attr);
+#endif
+}
+
+int smCondWaitUntilNs( pthread_cond_t *cond, pthread_mutex_t *mutex, smuint64 deadlineNs )
+{
+    struct timespec ts;
+#ifdef __APPLE__
+    smuint64 now=smGetMonotonicTimeNs(), waitNs=deadlineNs>now ? deadlineNs-now : 0;
+    ts.tv_sec=(time_t)(waitNs/1000000000ULL);
+    ts.tv_nsec=(long)(waitNs%1000000000ULL);
+    return pthread_cond_timedwait_relative_np(cond,mutex,&ts);
+#else
+    ts.tv_sec=(time_t)(deadlineNs/1000000000ULL);
+    ts.tv_nsec=(long)(deadlineNs%1000000000ULL);
+    return pthread_cond_timedwait(cond,mutex,&ts);
+#endif
+}
+
 #elif defined(_WIN32) || defined(WIN32)
 #include <windows.h>
 void smSleepMs(int millisecs)
 {
     Sleep(millisecs);
 }
+
+void smSleepUs(int microsecs)
+{
+    Sleep((microsecs+999)/1000);
+}
+
+smuint64 smGetMonotonicTimeNs()
+{
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (smuint64)(count.QuadPart/freq.QuadPart)*1000000000ULL + (smuint64)(count.QuadPart%freq.QuadPart)*1000000000ULL/freq.QuadPart;
+}
 #else
-#warning Make sure to implement own smSleepMs function for your platform as it is not one of supported ones (unix/win). For more info, see simplemotion_private.h.
+#warning Make sure to implement own smSleepMs, smSleepUs and smGetMonotonicTimeNs functions for your platform as it is not one of supported ones (unix/win). For more info, see simplemotion_private.h.
 #endif
 
 
@@ -108,7 +236,7 @@ void smDebug( smbus handle, smVerbosityLevel verbositylevel, char *format, ...)
         {
             if(smIsHandleOpen(handle)==smtrue)
             {
-                fprintf(smDebugOut,"%s: %s",smBus[handle].busDeviceName, buffer);
+                fprintf(smDebugOut,"%s: %s",smBus(handle).busDeviceName, buffer);
             }
             else if(handle==DEBUG_PRINT_RAW)
             {
@@ -129,96 +257,116 @@ void smDebug( smbus handle, smVerbosityLevel verbositylevel, char *format, ...)
 }
 #endif
 
-void smResetSM485variables(smbus handle)
+static void smResetFrameReceiver(smbus handle)
 {
-    smBus[handle].recv_state=WaitCmdId;
-    smBus[handle].recv_state_next=WaitCmdId;
-    smBus[handle].recv_payloadsize=-1;
-    smBus[handle].recv_storepos=0;//number of bytes to expect data in cmd, -1=wait cmd header
-    smBus[handle].recv_cmdid=0;// cmdid=0 kun ed komento suoritettu
-    smBus[handle].recv_addr=255;
-    smBus[handle].recv_crc=SM485_CRCINIT;
-    smBus[handle].recv_read_crc_hi=0xffff;//bottom bits will be contains only 1 byte when read
-    smBus[handle].receiveComplete=smfalse;
-    smBus[handle].transmitBufFull=smfalse;
-    smBus[handle].cmd_send_queue_bytes=0;
-    smBus[handle].cmd_recv_queue_bytes=0;
+    SM_BUS *bus=&smBus(handle);
+    bus->recv_state=WaitCmdId;
+    bus->recv_state_next=WaitCmdId;
+    bus->recv_payloadsize=-1;
+    bus->recv_storepos=0;//number of bytes to expect data in cmd, -1=wait cmd header
+    bus->recv_cmdid=0;// cmdid=0 kun ed komento suoritettu
+    bus->recv_addr=255;
+    bus->recv_crc=SM485_CRCINIT;
+    bus->recv_read_crc_hi=0xffff;//bottom bits will be contains only 1 byte when read
+    bus->recv_rawlen=0;
+    bus->recv_shifted_check_len=SM485_RESYNC_MAX_NOISE_BYTES+2;//all possible shifted frame headers are received by then
+    bus->receiveComplete=smfalse;
 }
 
-smuint16 calcCRC16(smuint8 data, smuint16 crc)
+void smResetSM485variables(smbus handle)
 {
-    unsigned int i; /* will index into CRC lookup */
-
-    i = (crc>>8) ^ data; /* calculate the CRC  */
-    crc = (((crc&0xff) ^ table_crc16_hi[i])<<8) | table_crc16_lo[i];
-
-    return crc;
+    smResetFrameReceiver(handle);
+    smBus(handle).transmitBufFull=smfalse;
+    smBus(handle).cmd_send_queue_bytes=0;
+    smBus(handle).cmd_recv_queue_bytes=0;
 }
 
-smuint16 calcCRC16Buf(const char *buffer, smuint16 buffer_length)
+SM_STATUS smSetTimeout( smuint16 millsecs )
 {
-    smuint8 crc_hi = 0xFF; /* high CRC byte initialized */
-    smuint8 crc_lo = 0xFF; /* low CRC byte initialized */
-    unsigned int i; /* will index into CRC lookup */
-
-    /* pass through message buffer */
-    while (buffer_length--) {
-        i = crc_hi ^ *buffer++; /* calculate the CRC  */
-        crc_hi = crc_lo ^ table_crc16_hi[i];
-        crc_lo = table_crc16_lo[i];
+    if(millsecs<=5000 && millsecs>=1)
+    {
+        readTimeoutMs=millsecs;
+        return SM_OK;
     }
-
-    return (crc_hi << 8 | crc_lo);
+    return SM_ERR_PARAMETER;
 }
 
-smuint8 calcCRC8Buf( smuint8 *buf, int len, int crcinit )
+smuint16 smGetReadTimeoutMs()
 {
-    int i;
-    smuint8 crc=crcinit;
-
-    for(i=0;i<len;i++)
-    {
-            crc=table_crc8[crc^buf[i]];
-    }
-
-    return crc;
+    if(transactionTimeoutMs!=0)
+        return transactionTimeoutMs;
+    return readTimeoutMs;
 }
 
-SM_STATUS smSetTimeout( smuint16 millsecs )
+SM_STATUS smSetBusyPoll( smuint32 spinUs )
 {
-    if(millsecs<=5000 && millsecs>=1)
+    if(spinUs<=100000)
     {
-        readTimeoutMs=millsecs;
+        busyPollUs=spinUs;
         return SM_OK;
     }
     return SM_ERR_PARAMETER;
 }
 
+smuint32 smGetBusyPollUs()
+{
+    return busyPollUs;
+}
+
 smuint32 smGetVersion()
 {
     return SM_VERSION;
 }
 
 
-//init bus struct table
-void smBusesInit()
+smbool smIsHandleOpen( const smbus handle )
 {
-    int i;
-    for(i=0;i<SM_MAX_BUSES;i++)
-    {
-        smBus[i].opened=smfalse;;
-        smResetSM485variables(i);
-    }
-    smInitialized=smtrue;
+    SM_BUS *bus;
+    if(handle<0) return smfalse;
+    if(!SM_HANDLE_TABLE_VALID(smBusTable,handle)) return smfalse;
+    bus=(SM_BUS*)SM_HANDLE_TABLE_ITEM(smBusTable,handle);//checked here without call because this is called for every received byte
+    return bus!=NULL && bus->opened;
 }
 
-smbool smIsHandleOpen( const smbus handle )
+SM_STATUS smAttachBusUser( const smbus handle )
 {
-    if(handle<0) return smfalse;
-    if(handle>=SM_MAX_BUSES) return smfalse;
-    return smBus[handle].opened;
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    smBus(handle).users++;
+    return SM_OK;
 }
 
+void smDetachBusUser( const smbus handle )
+{
+    if(smIsHandleOpen(handle)==smtrue && smBus(handle).users>0)
+        smBus(handle).users--;
+}
+
+//allocate state and handle for bus which device has been opened. closes the bus device on failure
+static smbus smAddBus( smbusdevicehandle bdHandle, const char *devicename )
+{
+    SM_BUS *bus=(SM_BUS*)calloc(1,sizeof(SM_BUS));
+    smbus handle=-1;
+
+    if(bus!=NULL)
+        handle=smHandleTableAdd(&smBusTable,bus);
+    if(handle<0)
+    {
+        smDebug(-1,SMDebugLow,"Too many buses open or out of memory\n");
+        free(bus);
+        smBDClose(bdHandle);
+        return -1;
+    }
+
+    smResetSM485variables(handle);
+    bus->bdHandle=bdHandle;
+    strncpy( bus->busDeviceName, devicename, SM_BUSDEVICENAME_LEN );
+    bus->busDeviceName[SM_BUSDEVICENAME_LEN-1]=0;//null terminate string
+    bus->baudrate=SMBusBaudrate;
+    bus->adaptiveTimeout=smfalse;
+    bus->pipelineFrames=1;
+    bus->opened=smtrue;
+    return handle;
+}
 
 /** Open SM RS485 communication bus. Parameters:
 -devicename: on Windows COM port as "COMx" or on unix /dev/ttySx or /dev/ttyUSBx where x=port number
@@ -226,57 +374,21 @@ smbool smIsHandleOpen( const smbus handle )
 */
 smbus smOpenBus( const char * devicename )
 {
-    int handle;
-
-    //true on first call
-    if(smInitialized==smfalse)
-        smBusesInit();
-
-    //find free handle
-    for(handle=0;handle<SM_MAX_BUSES;handle++)
-    {
-        if(smBus[handle].opened==smfalse) break;//choose this
-    }
-    //all handles in use
-    if(handle>=SM_MAX_BUSES) return -1;
-
     //open bus device
-    smBus[handle].bdHandle=smBDOpen(devicename);
-    if(smBus[handle].bdHandle==-1) return -1;
+    smbusdevicehandle bdHandle=smBDOpen(devicename);
+    if(bdHandle==-1) return -1;
 
-    //success
-    strncpy( smBus[handle].busDeviceName, devicename, SM_BUSDEVICENAME_LEN );
-    smBus[handle].busDeviceName[SM_BUSDEVICENAME_LEN-1]=0;//null terminate string
-    smBus[handle].opened=smtrue;
-    return handle;
+    return smAddBus(bdHandle,devicename);
 }
 
 /** same as smOpenBus but with user supplied port driver callbacks */
 smbus smOpenBusWithCallbacks( const char *devicename, BusdeviceOpen busOpenCallback, BusdeviceClose busCloseCallback, BusdeviceReadBuffer busReadCallback, BusdeviceWriteBuffer busWriteCallback, BusdeviceMiscOperation busMiscOperationCallback )
 {
-    int handle;
-
-    //true on first call
-    if(smInitialized==smfalse)
-        smBusesInit();
-
-    //find free handle
-    for(handle=0;handle<SM_MAX_BUSES;handle++)
-    {
-        if(smBus[handle].opened==smfalse) break;//choose this
-    }
-    //all handles in use
-    if(handle>=SM_MAX_BUSES) return -1;
-
     //open bus device
-    smBus[handle].bdHandle=smBDOpenWithCallbacks(devicename, busOpenCallback, busCloseCallback, busReadCallback, busWriteCallback, busMiscOperationCallback );
-    if(smBus[handle].bdHandle==-1) return -1;
+    smbusdevicehandle bdHandle=smBDOpenWithCallbacks(devicename, busOpenCallback, busCloseCallback, busReadCallback, busWriteCallback, busMiscOperationCallback );
+    if(bdHandle==-1) return -1;
 
-    //success
-    strncpy( smBus[handle].busDeviceName, devicename, SM_BUSDEVICENAME_LEN );
-    smBus[handle].busDeviceName[SM_BUSDEVICENAME_LEN-1]=0;//null terminate string
-    smBus[handle].opened=smtrue;
-    return handle;
+    return smAddBus(bdHandle,devicename);
 }
 
 
@@ -301,21 +413,203 @@ LIB void smSetBaudrate( unsigned long pbs )
     SMBusBaudrate=pbs;
 }
 
+//bus speeds tried by smEscalateBusSpeed, fastest first
+static const unsigned long smEscalationBusSpeeds[]={4000000,3000000,2000000,1500000,1000000,921600,460800};
+
+//return all nodes to their original SMP_FAULT_BEHAVIOR if watchdog was enabled on them for speed switch
+static SM_STATUS smRestoreFaultBehaviors( smbus handle, const smaddr *nodeAddresses, int numNodes, const smint32 *faultBehaviors )
+{
+    SM_STATUS stat=SM_OK;
+    int i;
+
+    for(i=0;i<numNodes;i++)
+    {
+        if(SM_FAULT_BEHAVIOR_WATCHDOG(faultBehaviors[i])==0)
+            stat|=smSetParameter(handle,nodeAddresses[i],SMP_FAULT_BEHAVIOR,faultBehaviors[i]);
+    }
+    return stat;
+}
+
+//check that all nodes reply. tries twice per node as first frame after speed change may get lost
+static SM_STATUS smVerifyNodesReply( smbus handle, const smaddr *nodeAddresses, int numNodes )
+{
+    int i;
+
+    for(i=0;i<numNodes;i++)
+    {
+        smint32 version;
+        if(smRead1Parameter(handle,nodeAddresses[i],SMP_SM_VERSION,&version)!=SM_OK
+                && smRead1Parameter(handle,nodeAddresses[i],SMP_SM_VERSION,&version)!=SM_OK)
+            return SM_ERR_COMMUNICATION;
+    }
+    return SM_OK;
+}
+
+LIB SM_STATUS smEscalateBusSpeed( const smbus handle, const smaddr *nodeAddresses, int numNodes, unsigned long maxBps, unsigned long *resultBps )
+{
+    smint32 faultBehaviors[255];
+    unsigned long lowestMaxBps=maxBps, targetBps=0, originalBps;
+    int i, watchdogMs=0;
+    SM_STATUS stat;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    originalBps=smBus(handle).baudrate;
+    if(resultBps!=NULL)
+        *resultBps=originalBps;
+    if(nodeAddresses==NULL || numNodes<1 || numNodes>255)
+        return recordStatus(handle,SM_ERR_PARAMETER);
+
+    //find the highest speed supported by all nodes
+    for(i=0;i<numNodes;i++)
+    {
+        smint32 version, nodeMaxBps;
+
+        stat=smRead3Parameters(handle,nodeAddresses[i],SMP_SM_VERSION,&version,SMP_BUS_SPEED|SMP_MAX_VALUE_MASK,&nodeMaxBps,SMP_FAULT_BEHAVIOR,&faultBehaviors[i]);
+        if(stat!=SM_OK) return recordStatus(handle,stat);
+
+        //without watchdog speed reset there's no way to recover if some node doesn't make the switch
+        if(version<SM_VERSION_WATCHDOG_RESETS_SPEED)
+        {
+            smDebug(handle,SMDebugLow,"smEscalateBusSpeed: node %d has SM version %d which doesn't reset speed on watchdog timeout, keeping current speed\n",(int)nodeAddresses[i],(int)version);
+            return recordStatus(handle,SM_OK);
+        }
+        if(nodeMaxBps<0)
+            nodeMaxBps=0;
+        if((unsigned long)nodeMaxBps<lowestMaxBps)
+            lowestMaxBps=nodeMaxBps;
+    }
+
+    for(i=0;i<(int)(sizeof(smEscalationBusSpeeds)/sizeof(smEscalationBusSpeeds[0]));i++)
+    {
+        if(smEscalationBusSpeeds[i]<=lowestMaxBps)
+        {
+            targetBps=smEscalationBusSpeeds[i];
+            break;
+        }
+    }
+    if(targetBps<=originalBps)
+        return recordStatus(handle,SM_OK);//already at best speed
+
+    //enable watchdog on nodes that don't have it, so every node returns to default speed if switch fails
+    for(i=0;i<numNodes;i++)
+    {
+        int watchdog=SM_FAULT_BEHAVIOR_WATCHDOG(faultBehaviors[i]);
+        if(watchdog==0)
+        {
+            watchdog=SM_SPEED_SWITCH_WATCHDOG;
+            stat=smSetParameter(handle,nodeAddresses[i],SMP_FAULT_BEHAVIOR,faultBehaviors[i]|(watchdog<<8));
+            if(stat!=SM_OK)
+            {
+                smRestoreFaultBehaviors(handle,nodeAddresses,i,faultBehaviors);
+                return recordStatus(handle,stat);
+            }
+        }
+        if(watchdog*10>watchdogMs)
+            watchdogMs=watchdog*10;
+    }
+
+    smDebug(handle,SMDebugMid,"smEscalateBusSpeed: switching bus from %lu to %lu BPS\n",originalBps,targetBps);
+
+    //switch all nodes with broadcast, then the port
+    stat=smSetParameter(handle,0,SMP_BUS_SPEED,targetBps);
+    if(stat==SM_OK)
+    {
+        if(smBDReopen(smBus(handle).bdHandle,smBus(handle).busDeviceName,targetBps)==smfalse)
+            return recordStatus(handle,SM_ERR_BUS);
+        smResetSM485variables(handle);
+        smBus(handle).baudrate=targetBps;
+
+        if(smVerifyNodesReply(handle,nodeAddresses,numNodes)==SM_OK)
+        {
+            if(resultBps!=NULL)
+                *resultBps=targetBps;
+            return recordStatus(handle,smRestoreFaultBehaviors(handle,nodeAddresses,numNodes,faultBehaviors));
+        }
+    }
+
+    //fall back by staying silent until watchdogs of all nodes expire and they return to default speed
+    smDebug(handle,SMDebugLow,"smEscalateBusSpeed: nodes didn't reply at %lu BPS, falling back to %d BPS\n",targetBps,SM_BAUDRATE);
+    smSleepMs(watchdogMs+SM_SPEED_SWITCH_FALLBACK_MARGIN_MS);
+    if(smBDReopen(smBus(handle).bdHandle,smBus(handle).busDeviceName,SM_BAUDRATE)==smfalse)
+        return recordStatus(handle,SM_ERR_BUS);
+    smResetSM485variables(handle);
+    smBus(handle).baudrate=SM_BAUDRATE;
+    if(resultBps!=NULL)
+        *resultBps=SM_BAUDRATE;
+
+    smRestoreFaultBehaviors(handle,nodeAddresses,numNodes,faultBehaviors);
+    return recordStatus(handle,SM_ERR_COMMUNICATION);
+}
+
+LIB smbus smOpenBusWithAutoSpeed( const char *devicename, const smaddr *nodeAddresses, int numNodes, unsigned long maxBps )
+{
+    smbus handle=smOpenBus(devicename);
+    if(handle>=0)
+        smEscalateBusSpeed(handle,nodeAddresses,numNodes,maxBps,NULL);
+    return handle;
+}
+
 /** Close connection to given bus handle number. This frees communication link therefore makes it available for other apps for opening.
 -return value: a SM_STATUS value, i.e. SM_OK if command succeed
 */
 LIB SM_STATUS smCloseBus( const smbus bushandle )
 {
+    SM_BUS *bus;
+    smbool closed;
+
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    smBus[bushandle].opened=smfalse;
+    bus=&smBus(bushandle);
+    if(bus->users>0)
+    {
+        smDebug(bushandle,SMDebugLow,"Bus can't be closed while %d telemetry engines, read combiners or schedulers use it\n",bus->users);
+        return recordStatus(bushandle,SM_ERR_PARAMETER);
+    }
+    bus->opened=smfalse;
+    closed=smBDClose(bus->bdHandle);
+
+    smHandleTableRemove(&smBusTable,bushandle);
+    free(bus->nodeCache);
+    free(bus->mfSendQueue);
+    free(bus->mfRecvQueue);
+    free(bus);
 
-    if( smBDClose(smBus[bushandle].bdHandle) == smfalse ) return recordStatus(bushandle,SM_ERR_BUS);
+    if( closed == smfalse ) return SM_ERR_BUS;
 
     return SM_OK;
 }
 
+/** Start recording raw bus traffic of given bus into a capture file. See buscapture.h for file format.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smCaptureStart( const smbus bushandle, const char *filename )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
+
+    if(smBDCaptureStart( smBus(bushandle).bdHandle, filename, smBus(bushandle).busDeviceName )==smtrue)
+        return recordStatus(bushandle,SM_OK);
+    else
+        return recordStatus(bushandle,SM_ERR_PARAMETER);
+}
+
+/** Stop recording started with smCaptureStart and flush the capture file.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smCaptureStop( const smbus bushandle )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
+
+    if(smBDCaptureStop( smBus(bushandle).bdHandle )==smtrue)
+        return recordStatus(bushandle,SM_OK);
+    else
+        return recordStatus(bushandle,SM_ERR_PARAMETER);
+}
+
 /** Clear pending (stray) bytes in bus device reception buffer and reset receiver state. This may be needed i.e. after restarting device to eliminate clitches that appear in serial line.
   -return value: a SM_STATUS value, i.e. SM_OK if command succeed
 */
@@ -324,7 +618,7 @@ LIB SM_STATUS smPurge( const smbus bushandle )
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    if(smBDMiscOperation( bushandle, MiscOperationPurgeRX )==smtrue)
+    if(smBDMiscOperation( smBus(bushandle).bdHandle, MiscOperationPurgeRX )==smtrue)
         return recordStatus(bushandle,SM_OK);
     else
         return recordStatus(bushandle,SM_ERR_BUS);
@@ -338,7 +632,7 @@ LIB SM_STATUS smFlushTX( const smbus bushandle )
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    if(smBDMiscOperation( bushandle, MiscOperationFlushTX )==smtrue)
+    if(smBDMiscOperation( smBus(bushandle).bdHandle, MiscOperationFlushTX )==smtrue)
         return recordStatus(bushandle,SM_OK);
     else
         return recordStatus(bushandle,SM_ERR_BUS);
@@ -377,7 +671,7 @@ smbool smWriteByte( const smbus handle, const smuint8 byte, smuint16 *crc )
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    smbool success=smBDWrite(smBus[handle].bdHandle,byte);
+    smbool success=smBDWrite(smBus(handle).bdHandle,byte);
     if(crc!=NULL)
         *crc = calcCRC16(byte,*crc);
 
@@ -391,10 +685,179 @@ smbool smTransmitBuffer( const smbus handle )
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    smbool success=smBDTransmit(smBus[handle].bdHandle);
+    smbool success=smBDTransmit(smBus(handle).bdHandle);
     return success;
 }
 
+LIB SM_STATUS smSetAdaptiveTimeout( const smbus handle, smbool enabled, smuint16 floorMs, smuint16 ceilingMs )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    if(enabled==smtrue)
+    {
+        if(floorMs<1 || floorMs>ceilingMs || ceilingMs>5000)
+            return recordStatus(handle,SM_ERR_PARAMETER);
+
+        smBus(handle).adaptiveTimeoutFloorMs=floorMs;
+        smBus(handle).adaptiveTimeoutCeilingMs=ceilingMs;
+        memset(&smBus(handle).busLatency,0,sizeof(smBus(handle).busLatency));
+        memset(smBus(handle).nodeLatency,0,sizeof(smBus(handle).nodeLatency));
+    }
+    smBus(handle).adaptiveTimeout=enabled;
+    return recordStatus(handle,SM_OK);
+}
+
+//find latency statistics of node. if create is smtrue and node has none, a free slot or the one with least samples is taken for it
+static SM_LATENCY_STATS *smFindLatencyStats( smbus handle, smaddr address, smbool create )
+{
+    SM_LATENCY_STATS *stats=smBus(handle).nodeLatency, *replace=NULL;
+    int i;
+
+    if(address==0) return NULL;//broadcast
+
+    for(i=0;i<SM_LATENCY_STATS_NODES;i++)
+    {
+        if(stats[i].address==address)
+            return &stats[i];
+        if(replace==NULL || stats[i].samples<replace->samples)
+            replace=&stats[i];
+    }
+
+    if(create==smfalse) return NULL;
+    memset(replace,0,sizeof(SM_LATENCY_STATS));
+    replace->address=address;
+    return replace;
+}
+
+LIB SM_STATUS smGetNodeLatency( const smbus handle, const smaddr nodeAddress, smuint32 *averageUs, smuint32 *deviationUs )
+{
+    SM_LATENCY_STATS *stats;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    stats=smFindLatencyStats(handle,nodeAddress,smfalse);
+    if(stats==NULL || stats->samples==0)
+        return recordStatus(handle,SM_ERR_PARAMETER);
+
+    if(averageUs!=NULL)
+        *averageUs=stats->srttUs;
+    if(deviationUs!=NULL)
+        *deviationUs=stats->rttvarUs;
+    return recordStatus(handle,SM_OK);
+}
+
+//time of transferring bytes on bus in microseconds, each byte has 10 bits including start and stop bits
+static smint32 smTransferTimeUs( smbus handle, int bytes )
+{
+    if(smBus(handle).baudrate==0) return 0;
+    return (smint32)((smuint64)bytes*10*1000000/smBus(handle).baudrate);
+}
+
+smuint32 smEstimateTransactionUs( const smbus handle, const smaddr nodeAddress, int txBytes, int rxBytes )
+{
+    SM_LATENCY_STATS *stats;
+    smuint32 timeUs;
+
+    if(smIsHandleOpen(handle)==smfalse) return 0;
+
+    timeUs=smTransferTimeUs(handle,txBytes+rxBytes);
+    if(nodeAddress==0) return timeUs;//broadcast, nobody replies
+
+    //latency of node if measured, otherwise of any node of the bus
+    stats=smFindLatencyStats(handle,nodeAddress,smfalse);
+    if(stats==NULL || stats->samples==0)
+        stats=&smBus(handle).busLatency;
+    if(stats->samples>0)
+        timeUs+=stats->srttUs;
+    return timeUs;
+}
+
+static void smUpdateLatencyStats( SM_LATENCY_STATS *stats, smint32 latencyUs )
+{
+    if(stats->samples==0)
+    {
+        stats->srttUs=latencyUs;
+        stats->rttvarUs=latencyUs/2;
+    }
+    else
+    {
+        //moving averages with gains 1/8 and 1/4 like in TCP retransmission timer (RFC 6298)
+        smint32 err=latencyUs-stats->srttUs;
+        stats->srttUs+=err/8;
+        if(err<0) err=-err;
+        stats->rttvarUs+=(err-stats->rttvarUs)/4;
+    }
+    stats->samples++;
+    stats->backoff=0;
+}
+
+//called when transaction has been sent and reply is about to be received. if adaptive timeouts are enabled, sets read
+//timeout of this thread to the expected transfer time plus observed latency of node (or bus if node hasn't replied yet).
+//during smProbeNode the probe deadline is used instead
+static void smAdaptiveTimeoutBegin( smbus handle, smaddr address, int txBytes, int maxRxBytes )
+{
+    SM_LATENCY_STATS *node, *stats;
+    smuint32 timeoutMs;
+
+    if(probeTimeoutMs!=0)
+    {
+        transactionTimeoutMs=probeTimeoutMs;
+        return;
+    }
+    if(smBus(handle).adaptiveTimeout==smfalse) return;
+
+    smBus(handle).transactionStartNs=smGetMonotonicTimeNs();
+    smBus(handle).transactionTxBytes=txBytes;
+
+    node=smFindLatencyStats(handle,address,smfalse);
+    stats=node;
+    if(stats==NULL || stats->samples==0)
+        stats=&smBus(handle).busLatency;
+
+    if(stats->samples==0)
+        timeoutMs=smBus(handle).adaptiveTimeoutCeilingMs;//nothing measured yet
+    else
+    {
+        smuint32 timeoutUs=stats->srttUs+4*stats->rttvarUs+smTransferTimeUs(handle,txBytes+maxRxBytes);
+        if(node!=NULL)
+            timeoutUs<<=node->backoff;
+        timeoutMs=(timeoutUs+999)/1000;
+        if(timeoutMs<smBus(handle).adaptiveTimeoutFloorMs)
+            timeoutMs=smBus(handle).adaptiveTimeoutFloorMs;
+        if(timeoutMs>smBus(handle).adaptiveTimeoutCeilingMs)
+            timeoutMs=smBus(handle).adaptiveTimeoutCeilingMs;
+    }
+
+    transactionTimeoutMs=(smuint16)timeoutMs;
+    smDebug(handle,SMDebugTrace,"  Adaptive reply timeout %d ms\n",(int)timeoutMs);
+}
+
+//called after reception started with smAdaptiveTimeoutBegin. restores default read timeout and updates latency statistics
+static void smAdaptiveTimeoutEnd( smbus handle, smaddr address, int rxBytes, smbool replied )
+{
+    SM_LATENCY_STATS *node;
+
+    if(transactionTimeoutMs==0) return;
+    transactionTimeoutMs=0;
+    if(probeTimeoutMs!=0 || smBus(handle).adaptiveTimeout==smfalse) return;//probes of missing nodes must not affect statistics
+
+    node=smFindLatencyStats(handle,address,smtrue);
+    if(node==NULL) return;
+
+    if(replied==smtrue)
+    {
+        smint32 elapsedUs=(smint32)((smGetMonotonicTimeNs()-smBus(handle).transactionStartNs)/1000);
+        smint32 latencyUs=elapsedUs-smTransferTimeUs(handle,smBus(handle).transactionTxBytes+rxBytes);
+        if(latencyUs<0) latencyUs=0;
+        smUpdateLatencyStats(node,latencyUs);
+        smUpdateLatencyStats(&smBus(handle).busLatency,latencyUs);
+    }
+    else if(node->backoff<SM_ADAPTIVE_TIMEOUT_MAX_BACKOFF)
+        node->backoff++;
+}
+
 SM_STATUS smSendSMCMD( smbus handle, smuint8 cmdid, smuint8 addr, smuint8 datalen, smuint8 *cmddata )
 {
     int i;
@@ -423,10 +886,11 @@ SM_STATUS smSendSMCMD( smbus handle, smuint8 cmdid, smuint8 addr, smuint8 datale
     if( smWriteByte(handle,addr, &sendcrc) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
 
     smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"PAYLOAD (");
+    sendcrc=calcCRC16Update(sendcrc,cmddata,datalen);
     for(i=0;i<datalen;i++)
     {
         smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"%02x ",cmddata[i]);
-        if( smWriteByte(handle,cmddata[i], &sendcrc) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
+        if( smWriteByte(handle,cmddata[i], NULL) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
     }
     smDebug(DEBUG_PRINT_RAW,SMDebugHigh,") ");
     smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"CRC (%02x %02x)\n",sendcrc>>8, sendcrc&0xff);
@@ -473,18 +937,21 @@ SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1,
     smTransmitBuffer(handle);//this sends the bytes entered with smWriteByte
 
     smDebug(handle, SMDebugHigh, "  Reading reply packet\n");
+    smAdaptiveTimeoutBegin(handle,nodeAddress,7,6);
     for(i=0;i<6;i++)
     {
         smbool success;
         smuint8 rx;
-        success=smBDRead(smBus[handle].bdHandle,&rx);
+        success=smBDRead(smBus(handle).bdHandle,&rx);
         cmd[i]=rx;
         if(success!=smtrue)
         {
+            smAdaptiveTimeoutEnd(handle,nodeAddress,i,smfalse);
             smDebug(handle,SMDebugLow,"Not enough data received on smFastUpdateCycle");
             return recordStatus(handle,SM_ERR_BUS|SM_ERR_LENGTH);//no enough data received
         }
     }
+    smAdaptiveTimeoutEnd(handle,nodeAddress,6,smtrue);
 
     //parse
     smuint8 localCRC=calcCRC8Buf(cmd,5,0x52);
@@ -498,139 +965,506 @@ SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1,
     if(read2!=NULL)
         *read2=bufget16bit(cmd,3);
 
-    //return data read complete
-    smDebug(handle,SMDebugHigh, "< %s (id=%d, r1=%d, r2=%d)\n",
-            cmdidToStr( cmd[0] ),
-            cmd[0],*read1,*read2);
+    //return data read complete
+    smDebug(handle,SMDebugHigh, "< %s (id=%d, r1=%d, r2=%d)\n",
+            cmdidToStr( cmd[0] ),
+            cmd[0],*read1,*read2);
+
+    return recordStatus(handle,SM_OK);
+}
+
+
+
+SM_STATUS smReceiveErrorHandler( smbus handle, smbool flushrx )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+
+    //discard data that is already buffered in bus device to avoid further parse errors. bytes that are
+    //still arriving are skipped by frame resynchronization in smParseReturnData. buffered data of pipelined
+    //transactions also has replies to later frames, then resynchronization alone finds them
+    if(flushrx==smtrue && smBus(handle).pipelineRepliesPending==0)
+        smBDMiscOperation(smBus(handle).bdHandle,MiscOperationDiscardRX);
+    smResetSM485variables(handle);
+    smBus(handle).receiveComplete=smtrue;
+    return recordStatus(handle,SM_ERR_COMMUNICATION);
+}
+
+
+//grow buffer of multi-frame queue to have room for at least needed bytes. returns smfalse if out of memory
+static smbool smReserveQueue( smuint8 **buf, smint32 *size, smint32 needed )
+{
+    smuint8 *newbuf;
+    smint32 newsize=*size>0 ? *size : SM485_MAX_PAYLOAD_BYTES;
+
+    if(needed<=*size) return smtrue;
+    while(newsize<needed)
+        newsize*=2;
+
+    newbuf=(smuint8*)realloc(*buf,newsize);
+    if(newbuf==NULL) return smfalse;
+    *buf=newbuf;
+    *size=newsize;
+    return smtrue;
+}
+
+LIB SM_STATUS smSetMultiFrameQueue( const smbus handle, smbool enabled )
+{
+    SM_BUS *bus;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    bus=&smBus(handle);
+
+    //commands queued in the previous mode are discarded
+    bus->cmd_send_queue_bytes=0;
+    bus->cmd_recv_queue_bytes=0;
+    bus->mfRecvQueueBytes=0;
+    bus->transmitBufFull=smfalse;
+    bus->queueInvalidatesNodeInfo=smfalse;
+
+    if(enabled==smfalse)
+    {
+        free(bus->mfSendQueue);
+        free(bus->mfRecvQueue);
+        bus->mfSendQueue=bus->mfRecvQueue=NULL;
+        bus->mfSendQueueSize=bus->mfRecvQueueSize=0;
+    }
+    bus->multiFrameQueue=enabled;
+    return recordStatus(handle,SM_OK);
+}
+
+SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType,smint32 paramvalue  )
+{
+    SM_BUS *bus;
+    smuint8 *queue;
+    int cmdlength;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    bus=&smBus(handle);
+
+    switch(smpCmdType)
+    {
+    case SMPCMD_SETPARAMADDR:
+        cmdlength=2;
+        break;
+    case SMPCMD_24B:
+        cmdlength=3;
+        break;
+    case SMPCMD_32B:
+        cmdlength=4;
+        break;
+    default:
+        return recordStatus(handle,SM_ERR_PARAMETER);
+        break;
+    }
+
+    if(bus->multiFrameQueue==smtrue)
+    {
+        //queue grows as needed and is split to frames on execute
+        if(smReserveQueue(&bus->mfSendQueue,&bus->mfSendQueueSize,bus->cmd_send_queue_bytes+cmdlength)==smfalse)
+        {
+            bus->transmitBufFull=smtrue;
+            return recordStatus(handle,SM_ERR_LENGTH);
+        }
+        queue=bus->mfSendQueue;
+    }
+    else
+    {
+        //check if space if buffer
+        if(bus->cmd_send_queue_bytes>(SM485_MAX_PAYLOAD_BYTES-cmdlength) )
+        {
+            bus->transmitBufFull=smtrue; //when set true, smExecute will do nothing but clear transmit buffer. so this prevents any of overflowed commands getting thru
+            return recordStatus(handle,SM_ERR_LENGTH); //overflow, too many commands in buffer
+        }
+        queue=bus->recv_rsbuf;
+    }
+
+    bus->cmd_send_queue_bytes+=smEncodeSubpacket(&queue[bus->cmd_send_queue_bytes],smpCmdType,paramvalue);
+
+    return recordStatus(handle,SM_OK);
+}
+
+
+SMPayloadCommandRet32 smConvertToPayloadRet32_16(SMPayloadCommandRet16 in)
+{
+    SMPayloadCommandRet32 out;
+    out.ID=in.ID;
+    out.retData=(long)in.retData; //negative value, extend ones
+    return out;
+}
+
+//for library internal use only
+SM_STATUS smTransmitReceiveFrame( const smbus bushandle, const smaddr targetaddress, smuint8 cmdid, smuint8 payloadLen, smuint8 *payload )
+{
+    SM_STATUS stat;
+
+    stat=smSendSMCMD(bushandle,cmdid,targetaddress,payloadLen,payload); //send commands to bus
+    smBus(bushandle).cmd_recv_queue_bytes=0;//counted upwards at every smGetQueued.. and compared to payload size
+    if(stat!=SM_OK) return stat;
+
+    if(targetaddress!=0)//target is not broadcast address (0) where no slave will respond and it's ok
+    {
+        smAdaptiveTimeoutBegin(bushandle,targetaddress,payloadLen+SM485_FRAME_OVERHEAD_BYTES,SM485_MAX_FRAME_BYTES);
+        stat=smReceiveReturnPacket(bushandle);//blocking wait & receive return values from bus
+        smAdaptiveTimeoutEnd(bushandle,targetaddress,smBus(bushandle).recv_payloadsize+SM485_FRAME_OVERHEAD_BYTES,stat==SM_OK);
+    }
+    else
+    {
+        //make sure we don't return function before all data is really sent as we're not waiting for RX data
+        //note: we're note checking return value of it as some driver's dont support this atm and will return smfalse. TODO fix this & drivers.
+        smFlushTX(bushandle);
+    }
+
+    return stat;
+}
+
+smint16 smGetReceivedPayload( const smbus bushandle, const smuint8 **payload )
+{
+    *payload=smBus(bushandle).recv_rsbuf;
+    return smBus(bushandle).recv_payloadsize;
+}
+
+LIB SM_STATUS smSetPipelineWindow( const smbus handle, int maxFrames, int maxBytes )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    //window must have room for at least one frame of any size
+    if(maxFrames<1 || maxFrames>SM_MAX_PIPELINE_FRAMES || (maxBytes!=0 && maxBytes<SM485_MAX_FRAME_BYTES))
+        return recordStatus(handle,SM_ERR_PARAMETER);
+
+    smBus(handle).pipelineFrames=maxFrames;
+    smBus(handle).pipelineBytes=maxBytes;
+    return recordStatus(handle,SM_OK);
+}
+
+//frame that has been sent and waits for its reply in smTransmitReceivePipelined
+typedef struct
+{
+    smaddr address;
+    smint16 txBytes;
+    smuint64 sentNs;
+    SM_STATUS status;//not SM_OK if sending failed
+} SM_PIPELINE_FRAME;
+
+SM_STATUS smTransmitReceivePipelined( const smbus bushandle, SMPipelineFrameCallback frame, SMPipelineReplyCallback reply, void *context, smbool stopOnError )
+{
+    SM_BUS *bus;
+    SM_PIPELINE_FRAME window[SM_MAX_PIPELINE_FRAMES];
+    int first=0, inFlight=0, windowBytes=0, sent=0, completed=0;
+    smaddr address=0;
+    smuint8 cmdid=0, payloadLen=0, *payload=NULL;
+    smbool more=smtrue, pending=smfalse, stopSending=smfalse, stopReplies=smfalse, nodeBusy;
+    SM_STATUS result=SM_OK;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+    bus=&smBus(bushandle);
+    bus->cmd_recv_queue_bytes=0;
+
+    for(;;)
+    {
+        SM_PIPELINE_FRAME *oldest;
+        SM_STATUS stat;
+        int i, lost=0;
+
+        if(pending==smfalse && more==smtrue && stopSending==smfalse)
+            more=pending=frame(context,sent,&address,&cmdid,&payloadLen,&payload);
 
-    return recordStatus(handle,SM_OK);
-}
+        //a node has one frame in flight at a time. replies are recognized only by sender address, so if a node doesn't
+        //reply to its frame, the reply to its next frame would be taken as the missing one
+        nodeBusy=smfalse;
+        for(i=0;pending==smtrue && address!=0 && i<inFlight;i++)
+        {
+            const SM_PIPELINE_FRAME *f=&window[(first+i)%SM_MAX_PIPELINE_FRAMES];
+            if(f->status==SM_OK && f->address==address)
+                nodeBusy=smtrue;
+        }
 
+        //send while window has room, the first frame is sent regardless of its size
+        if(pending==smtrue && stopSending==smfalse && (inFlight==0 || (nodeBusy==smfalse && inFlight<bus->pipelineFrames
+                && (bus->pipelineBytes==0 || windowBytes+payloadLen+SM485_FRAME_OVERHEAD_BYTES<=bus->pipelineBytes))))
+        {
+            SM_PIPELINE_FRAME *f=&window[(first+inFlight)%SM_MAX_PIPELINE_FRAMES];
+
+            f->address=address;
+            f->txBytes=payloadLen+SM485_FRAME_OVERHEAD_BYTES;
+            f->status=smSendSMCMD(bushandle,cmdid,address,payloadLen,payload);
+            f->sentNs=smGetMonotonicTimeNs();
+            if(f->status!=SM_OK && stopOnError==smtrue)
+                stopSending=smtrue;
+            windowBytes+=f->txBytes;
+            inFlight++;
+            sent++;
+            pending=smfalse;
+            continue;
+        }
 
+        if(inFlight==0)
+            break;
 
-SM_STATUS smReceiveErrorHandler( smbus handle, smbool flushrx )
-{
-    //check if bus handle is valid & opened
-    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+        //complete the oldest frame, replies come in the same order as frames were sent
+        oldest=&window[first];
+        stat=oldest->status;
+        if(stat==SM_OK && oldest->address==0)
+            smFlushTX(bushandle);//nobody replies to broadcast, see smTransmitReceiveFrame
+        else if(stat==SM_OK)
+        {
+            smAdaptiveTimeoutBegin(bushandle,oldest->address,oldest->txBytes,SM485_MAX_FRAME_BYTES);
+            bus->transactionStartNs=oldest->sentNs;//latency includes waiting behind earlier frames
+            bus->pipelineRepliesPending=inFlight-1;
+            stat=smReceiveReturnPacket(bushandle);
+            bus->pipelineRepliesPending=0;
+
+            //gateway passes nothing to client if node doesn't reply, so reply may belong to a later frame
+            if(stat==SM_OK && bus->recv_addr!=oldest->address)
+            {
+                for(i=1;i<inFlight;i++)
+                {
+                    SM_PIPELINE_FRAME *f=&window[(first+i)%SM_MAX_PIPELINE_FRAMES];
+                    if(f->status==SM_OK && f->address==bus->recv_addr)
+                        break;
+                }
+                smDebug(bushandle,SMDebugMid,"Pipelined transaction: no reply from SM address %d, got reply from %d\n",(int)oldest->address,(int)bus->recv_addr);
+                smAdaptiveTimeoutEnd(bushandle,oldest->address,0,smfalse);
+                if(i<inFlight)
+                    lost=i;
+                else
+                    stat=SM_ERR_COMMUNICATION;//not a reply to any frame in flight, discarded
+            }
+            else
+                smAdaptiveTimeoutEnd(bushandle,oldest->address,bus->recv_payloadsize+SM485_FRAME_OVERHEAD_BYTES,stat==SM_OK);
+        }
+
+        //frames that lost their reply fail and the reply goes to the frame after them
+        for(i=0;i<=lost;i++)
+        {
+            SM_STATUS frameStat=i<lost ? SM_ERR_COMMUNICATION : stat;
 
+            if(stopReplies==smfalse)
+                frameStat=reply(context,completed,frameStat);
+            if(frameStat!=SM_OK)
+            {
+                result=result==SM_OK ? frameStat : (result|frameStat);
+                if(stopOnError==smtrue)
+                    stopSending=stopReplies=smtrue;
+            }
 
-    //empty pending rx buffer to avoid further parse errors
-    if(flushrx==smtrue)
-    {
-        smbool success;
-        do{
-            smuint8 rx;
-            success=smBDRead(smBus[handle].bdHandle,&rx);
-        }while(success==smtrue);
+            windowBytes-=window[first].txBytes;
+            first=(first+1)%SM_MAX_PIPELINE_FRAMES;
+            inFlight--;
+            completed++;
+        }
     }
-    smResetSM485variables(handle);
-    smBus[handle].receiveComplete=smtrue;
-    return recordStatus(handle,SM_ERR_COMMUNICATION);
+
+    return result;
 }
 
+//by SMPCMD type: length of subpacket and mask of its value bits
+static const smuint8 smSubpacketLength[4]={4,3,2,0};
+static const smuint32 smSubpacketValueMask[4]={0x3fffffff,0x3fffff,0x3fff,0};
 
-SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType,smint32 paramvalue  )
+int smEncodeSubpacket( smuint8 *buf, int type, smint32 value )
 {
-    int cmdlength;
+    smuint32 word;
+    int i, len;
 
-    //check if bus handle is valid & opened
-    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    type&=3;
+    len=smSubpacketLength[type];
+    if(len==0) return 0;
 
-    switch(smpCmdType)
-    {
-    case SMPCMD_SETPARAMADDR:
-        cmdlength=2;
-        break;
-    case SMPCMD_24B:
-        cmdlength=3;
-        break;
-    case SMPCMD_32B:
-        cmdlength=4;
-        break;
-    default:
-        return recordStatus(handle,SM_ERR_PARAMETER);
-        break;
-    }
+    //subpacket is the highest len bytes of big endian word, type in 2 highest bits
+    word=((smuint32)type<<30)|(((smuint32)value&smSubpacketValueMask[type])<<(32-8*len));
+    for(i=0;i<len;i++)
+        buf[i]=(smuint8)(word>>(24-8*i));
+    return len;
+}
 
-    //check if space if buffer
-    if(smBus[handle].cmd_send_queue_bytes>(SM485_MAX_PAYLOAD_BYTES-cmdlength) )
-    {
-        smBus[handle].transmitBufFull=smtrue; //when set true, smExecute will do nothing but clear transmit buffer. so this prevents any of overflowed commands getting thru
-        return recordStatus(handle,SM_ERR_LENGTH); //overflow, too many commands in buffer
-    }
+int smDecodeReturnValue( const smuint8 *buf, int bytes, smint32 *value )
+{
+    //length of return subpacket by its type, SMPRET_32B=0, SMPRET_24B=1, SMPRET_16B=2 and SMPRET_OTHER=3
+    static const smuint8 subpacketLength[4]={4,3,2,1};
+    smuint32 raw, sign;
+    int i, len;
+
+    if(bytes<1) return 0;
+    len=subpacketLength[buf[0]>>6];
+    if(len>bytes) return 0;
+
+    raw=buf[0]&0x3f;
+    for(i=1;i<len;i++)
+        raw=(raw<<8)|buf[i];
+    sign=1UL<<(len*8-3);//sign extend from the highest value bit
+    *value=(smint32)((raw^sign)-sign);
+    return len;
+}
 
-    if(smpCmdType==SMPCMD_SETPARAMADDR)
+int smDecodeReturnValues( const smuint8 *buf, int bytes, smint32 *values, smuint8 *types, int maxValues, int *numValues )
+{
+    //by SMPRET type: subpacket length, right shift of 32 bit big endian word to value bits and sign bit of value
+    static const smuint8 length[4]={4,3,2,1};
+    static const smuint8 shift[4]={0,8,16,24};
+    static const smuint32 sign[4]={1UL<<29,1UL<<21,1UL<<13,1UL<<5};
+    int pos=0, n=0;
+
+    //whole word is loaded while at least 4 bytes are left, so decoding doesn't branch by subpacket type
+    while(n<maxValues && pos+4<=bytes)
     {
-        SMPayloadCommand16 newcmd;
-        newcmd.ID=SMPCMD_SETPARAMADDR;
-        newcmd.param=paramvalue;
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[1]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[0]);
+        smuint32 word=((smuint32)buf[pos]<<24)|((smuint32)buf[pos+1]<<16)|((smuint32)buf[pos+2]<<8)|buf[pos+3];
+        int type=buf[pos]>>6;
+        smuint32 raw=(word>>shift[type])&((sign[type]<<1)-1);
+
+        values[n]=(smint32)((raw^sign[type])-sign[type]);
+        if(types!=NULL) types[n]=(smuint8)type;
+        pos+=length[type];
+        n++;
     }
-    if(smpCmdType==SMPCMD_24B)
+
+    //the last ones one by one
+    while(n<maxValues && pos<bytes)
     {
-        SMPayloadCommand24 newcmd;
-        newcmd.ID=SMPCMD_24B;
-        newcmd.param=paramvalue;
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[2]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[1]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[0]);
+        int len=smDecodeReturnValue(&buf[pos],bytes-pos,&values[n]);
+        if(len==0) break;
+        if(types!=NULL) types[n]=buf[pos]>>6;
+        pos+=len;
+        n++;
     }
-    if(smpCmdType==SMPCMD_32B)
+
+    *numValues=n;
+    return pos;
+}
+
+//state of splitting multi-frame queue to frames in smTransmitReceiveMultiFrameQueue
+typedef struct
+{
+    smbus handle;
+    smaddr targetaddress;
+    smuint8 cmdid;
+    smint32 queueBytes;
+    smint32 pos;
+    int returnLen;//return length set in device is unknown until queue sets SMP_RETURN_PARAM_LEN, assume the longest
+} SM_MULTI_FRAME_SPLIT;
+
+//next frame of multi-frame queue whose payload and reply both fit in SM485_MAX_PAYLOAD_BYTES
+static smbool smMultiFrameQueueNextFrame( void *context, int index, smaddr *address, smuint8 *cmdid, smuint8 *payloadLen, smuint8 **payload )
+{
+    //length of subpacket by its type (SMPCMD_32B, SMPCMD_24B, SMPCMD_SETPARAMADDR) and of return value by SMP_RETURN_PARAM_LEN
+    static const smuint8 subpacketBytes[4]={4,3,2,2};
+    static const smuint8 returnBytes[4]={4,3,2,1};
+    SM_MULTI_FRAME_SPLIT *split=(SM_MULTI_FRAME_SPLIT*)context;
+    SM_BUS *bus=&smBus(split->handle);
+    smint32 start=split->pos;
+    int replyBytes=0;
+
+    (void)index;
+    if(split->pos>=split->queueBytes)
+        return smfalse;
+
+    while(split->pos<split->queueBytes)
     {
-        SMPayloadCommand32 newcmd;
-        newcmd.ID=SMPCMD_32B;
-        newcmd.param=paramvalue;
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[3]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[2]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[1]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[0]);
-    }
+        const smuint8 *subpacket=&bus->mfSendQueue[split->pos];
+        int len=subpacketBytes[subpacket[0]>>6], subpackets=1, nextReturnLen=split->returnLen;
 
+        //write address and the value written to it are kept in the same frame
+        if((subpacket[0]>>6)==SMPCMD_SETPARAMADDR && split->pos+len<split->queueBytes)
+        {
+            int valueLen=subpacketBytes[subpacket[len]>>6];
 
-    return recordStatus(handle,SM_OK);
+            //return length changes after this value
+            if((((subpacket[0]&0x3f)<<8)|subpacket[1])==SMP_RETURN_PARAM_LEN)
+                nextReturnLen=returnBytes[subpacket[len+valueLen-1]&3];
+            len+=valueLen;
+            subpackets=2;
+        }
+
+        if(split->pos+len-start>SM485_MAX_PAYLOAD_BYTES
+                || replyBytes+subpackets*(split->returnLen>nextReturnLen ? split->returnLen : nextReturnLen)>SM485_MAX_PAYLOAD_BYTES)
+            break;
+
+        replyBytes+=subpackets*(split->returnLen>nextReturnLen ? split->returnLen : nextReturnLen);
+        split->returnLen=nextReturnLen;
+        split->pos+=len;
+    }
+
+    smDebug(split->handle,SMDebugHigh,"  Multi-frame queue: sending bytes %d-%d of %d\n",start,split->pos-1,split->queueBytes);
+    *address=split->targetaddress;
+    *cmdid=split->cmdid;
+    *payloadLen=(smuint8)(split->pos-start);
+    *payload=&bus->mfSendQueue[start];
+    return smtrue;
 }
 
+//append return values of a frame of multi-frame queue to mfRecvQueue
+static SM_STATUS smMultiFrameQueueReply( void *context, int index, SM_STATUS stat )
+{
+    SM_MULTI_FRAME_SPLIT *split=(SM_MULTI_FRAME_SPLIT*)context;
+    SM_BUS *bus=&smBus(split->handle);
+
+    (void)index;
+    if(stat!=SM_OK || split->targetaddress==0)
+        return stat;
 
-SMPayloadCommandRet32 smConvertToPayloadRet32_16(SMPayloadCommandRet16 in)
+    if(smReserveQueue(&bus->mfRecvQueue,&bus->mfRecvQueueSize,bus->mfRecvQueueBytes+bus->recv_payloadsize)==smfalse)
+        return SM_ERR_LENGTH;
+    memcpy(&bus->mfRecvQueue[bus->mfRecvQueueBytes],bus->recv_rsbuf,bus->recv_payloadsize);
+    bus->mfRecvQueueBytes+=bus->recv_payloadsize;
+    return SM_OK;
+}
+
+//send multi-frame queue split at subpacket boundaries to frames whose payload and reply both fit in SM485_MAX_PAYLOAD_BYTES.
+//return values of frames are concatenated to mfRecvQueue in the same order as commands were queued. frames are pipelined
+//if bus has send window for it (see smSetPipelineWindow)
+static SM_STATUS smTransmitReceiveMultiFrameQueue( const smbus bushandle, const smaddr targetaddress, smuint8 cmdid, smint32 queueBytes )
 {
-    SMPayloadCommandRet32 out;
-    out.ID=in.ID;
-    out.retData=(long)in.retData; //negative value, extend ones
-    return out;
+    SM_MULTI_FRAME_SPLIT split;
+    SM_STATUS stat;
+
+    split.handle=bushandle;
+    split.targetaddress=targetaddress;
+    split.cmdid=cmdid;
+    split.queueBytes=queueBytes;
+    split.pos=0;
+    split.returnLen=4;
+
+    smBus(bushandle).mfRecvQueueBytes=0;
+    stat=smTransmitReceivePipelined(bushandle,smMultiFrameQueueNextFrame,smMultiFrameQueueReply,&split,smtrue);
+    smBus(bushandle).cmd_recv_queue_bytes=0;
+    return stat;
 }
 
-//for library internal use only
 SM_STATUS smTransmitReceiveCommandQueue( const smbus bushandle, const smaddr targetaddress, smuint8 cmdid )
 {
-    SM_STATUS stat;
+    SM_STATUS stat=SM_OK;
+    smint32 payloadLen;
 
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    if(smBus[bushandle].transmitBufFull!=smtrue) //dont send/receive commands if queue was overflowed by user error
-    {
-        stat=smSendSMCMD(bushandle,cmdid,targetaddress, smBus[bushandle].cmd_send_queue_bytes, smBus[bushandle].recv_rsbuf ); //send commands to bus
-        if(stat!=SM_OK) return recordStatus(bushandle,stat);
-    }
-
-    smBus[bushandle].cmd_send_queue_bytes=0;
-    smBus[bushandle].cmd_recv_queue_bytes=0;//counted upwards at every smGetQueued.. and compared to payload size
+    payloadLen=smBus(bushandle).cmd_send_queue_bytes;
+    smBus(bushandle).cmd_send_queue_bytes=0;
 
-    if(smBus[bushandle].transmitBufFull!=smtrue && targetaddress!=0)//dont send/receive commands if queue was overflowed by user error, or if target is broadcast address (0) where no slave will respond and it's ok
+    if(smBus(bushandle).transmitBufFull!=smtrue) //dont send/receive commands if queue was overflowed by user error
     {
-        stat=smReceiveReturnPacket(bushandle);//blocking wait & receive return values from bus
-        if(stat!=SM_OK) return recordStatus(bushandle,stat); //maybe timeouted
+        if(smBus(bushandle).queueInvalidatesNodeInfo==smtrue)
+            smInvalidateNodeInfo(bushandle,targetaddress);
+
+        if(smBus(bushandle).multiFrameQueue==smtrue)
+            stat=smTransmitReceiveMultiFrameQueue(bushandle,targetaddress,cmdid,payloadLen);
+        else //reply is received to the same buffer after queue has been sent
+            stat=smTransmitReceiveFrame(bushandle,targetaddress,cmdid,(smuint8)payloadLen,smBus(bushandle).recv_rsbuf);
     }
-    if(targetaddress==0)
+    else
     {
-        //make sure we don't return function before all data is really sent as we're not waiting for RX data
-        //note: we're note checking return value of it as some driver's dont support this atm and will return smfalse. TODO fix this & drivers.
-        smFlushTX(bushandle);
+        smBus(bushandle).cmd_recv_queue_bytes=0;
+        smBus(bushandle).mfRecvQueueBytes=0;
     }
 
-    smBus[bushandle].transmitBufFull=smfalse;//reset overflow status
-    return recordStatus(bushandle,SM_OK);
+    smBus(bushandle).queueInvalidatesNodeInfo=smfalse;
+    smBus(bushandle).transmitBufFull=smfalse;//reset overflow status
+    return recordStatus(bushandle,stat);
 }
 
 
@@ -647,27 +1481,78 @@ SM_STATUS smUploadCommandQueueToDeviceBuffer( const smbus bushandle, const smadd
     return recordStatus(bushandle,smTransmitReceiveCommandQueue(bushandle,targetaddress,SMCMD_BUFFERED_CMD));
 }
 
+//sets rxbuf to return data of executed command queue and returns its length. return values of multi-frame queue are
+//collected from all frames
+static smint32 smGetQueuedReturnData( SM_BUS *bus, const smuint8 **rxbuf )
+{
+    if(bus->multiFrameQueue==smtrue)
+    {
+        *rxbuf=bus->mfRecvQueue;
+        return bus->mfRecvQueueBytes;
+    }
+    *rxbuf=bus->recv_rsbuf;
+    return bus->recv_payloadsize;
+}
+
 //return number of how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
 SM_STATUS smBytesReceived( const smbus bushandle, smint32 *bytesinbuffer )
 {
+    const smuint8 *rxbuf;
+
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    smint32 bytes=smBus[bushandle].recv_payloadsize - smBus[bushandle].cmd_recv_queue_bytes;//how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
+    smint32 bytes=smGetQueuedReturnData(&smBus(bushandle),&rxbuf) - smBus(bushandle).cmd_recv_queue_bytes;//how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
     *bytesinbuffer=bytes;
 
     return recordStatus(bushandle,SM_OK);
 }
 
+SM_STATUS smGetQueuedSMCommandReturnValues( const smbus bushandle, smint32 *values, smuint8 *types, smint32 maxValues, smint32 *numValues )
+{
+    SM_BUS *bus;
+    const smuint8 *rxbuf;
+    smint32 rxsize;
+    int n;
+
+    *numValues=0;
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+    bus=&smBus(bushandle);
+
+    rxsize=smGetQueuedReturnData(bus,&rxbuf);
+    if(bus->cmd_recv_queue_bytes>=rxsize)
+        return recordStatus(bushandle,SM_OK);
+
+    bus->cmd_recv_queue_bytes+=smDecodeReturnValues(&rxbuf[bus->cmd_recv_queue_bytes],rxsize-bus->cmd_recv_queue_bytes,values,types,maxValues,&n);
+    *numValues=n;
+
+    //last subpacket is cut
+    if(n<maxValues && bus->cmd_recv_queue_bytes<rxsize)
+    {
+        smDebug(bushandle,SMDebugTrace, "Packet receive error, return data coudn't be parsed\n");
+        return recordStatus(bushandle,SM_ERR_LENGTH);
+    }
+
+    return recordStatus(bushandle,SM_OK);
+}
+
 SM_STATUS smGetQueuedSMCommandReturnValue(  const smbus bushandle, smint32 *retValue )
 {
-    smuint8 rxbyte, rettype;
+    //by SMPRET type, for debug output
+    static const char * const returnTypeNames[4]={"32B","24B","16B","_OTHER"};
+    SM_BUS *bus;
+    const smuint8 *rxbuf;
+    smint32 rxsize, value;
+    int len;
 
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+    bus=&smBus(bushandle);
 
+    rxsize=smGetQueuedReturnData(bus,&rxbuf);
 
     //if get called so many times that receive queue buffer is already empty, return error
-    if(smBus[bushandle].cmd_recv_queue_bytes>=smBus[bushandle].recv_payloadsize)
+    if(bus->cmd_recv_queue_bytes>=rxsize)
     {
 
         smDebug(bushandle,SMDebugTrace, "Packet receive error, return data coudn't be parsed\n");
@@ -678,64 +1563,19 @@ SM_STATUS smGetQueuedSMCommandReturnValue(  const smbus bushandle, smint32 *retV
         return recordStatus(bushandle,SM_ERR_LENGTH);//not a single byte left
     }
 
-    //get first byte to deterime packet length
-    rxbyte=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-    rettype=rxbyte>>6; //extract ret packet header 2 bits
-
-    //read rest of data based on packet header:
-
-    if(rettype == SMPRET_16B)
-    {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet16 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[1]=rxbyte;
-        readBuf[0]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        smDebug(bushandle,SMDebugTrace,"  RET16B: %d\n",read.retData);
-
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
-    }
-    if(rettype == SMPRET_24B)
-    {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet24 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[2]=rxbyte;
-        readBuf[1]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        readBuf[0]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        smDebug(bushandle,SMDebugTrace,"  RET24B: %d\n",read.retData);
-
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
-    }
-    if(rettype == SMPRET_32B)
-    {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet32 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[3]=rxbyte;
-        readBuf[2]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        readBuf[1]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        readBuf[0]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        smDebug(bushandle,SMDebugTrace,"  RET32B: %d\n",read.retData);
-
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
-    }
-    if(rettype == SMPRET_OTHER) //8bit
+    len=smDecodeReturnValue(&rxbuf[bus->cmd_recv_queue_bytes],rxsize-bus->cmd_recv_queue_bytes,&value);
+    if(len==0)
     {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet8 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[0]=rxbyte;
-        smDebug(bushandle,SMDebugTrace,"  RET_OTHER: %d\n",read.retData);
-
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
+        smDebug(bushandle,SMDebugTrace, "Packet receive error, return data coudn't be parsed\n");
+        if(retValue!=NULL) *retValue=0;
+        bus->cmd_recv_queue_bytes=rxsize;//skip the cut subpacket
+        return recordStatus(bushandle,SM_ERR_LENGTH);
     }
+    smDebug(bushandle,SMDebugTrace,"  RET%s: %d\n",returnTypeNames[rxbuf[bus->cmd_recv_queue_bytes]>>6],value);
+    bus->cmd_recv_queue_bytes+=len;
 
-    return recordStatus(bushandle,SM_ERR_PARAMETER); //something went wrong, rettype not known
+    if(retValue!=NULL) *retValue=value;
+    return recordStatus(bushandle,SM_OK);
 }
 
 
@@ -750,7 +1590,7 @@ SM_STATUS smReceiveReturnPacket( smbus bushandle )
         smuint8 ret;
         SM_STATUS stat;
 
-        smbool succ=smBDRead(smBus[bushandle].bdHandle,&ret);
+        smbool succ=smBDRead(smBus(bushandle).bdHandle,&ret);
 
         if(succ==smfalse)
         {
@@ -760,14 +1600,14 @@ SM_STATUS smReceiveReturnPacket( smbus bushandle )
 
         stat=smParseReturnData( bushandle, ret );
         if(stat!=SM_OK) return recordStatus(bushandle,stat);
-    } while(smBus[bushandle].receiveComplete==smfalse); //loop until complete packaget has been read
+    } while(smBus(bushandle).receiveComplete==smfalse); //loop until complete packaget has been read
 
     //return data read complete
     smDebug(bushandle,SMDebugHigh, "< %s (id=%d, addr=%d, payload=%d)\n",
-            cmdidToStr( smBus[bushandle].recv_cmdid ),
-            smBus[bushandle].recv_cmdid,
-            smBus[bushandle].recv_addr,
-            smBus[bushandle].recv_payloadsize);
+            cmdidToStr( smBus(bushandle).recv_cmdid ),
+            smBus(bushandle).recv_cmdid,
+            smBus(bushandle).recv_addr,
+            smBus(bushandle).recv_payloadsize);
 
     return recordStatus(bushandle,SM_OK);
 }
@@ -781,108 +1621,240 @@ LIB void smSetDebugOutput( smVerbosityLevel level, FILE *stream )
 }
 
 
-//short returndata16=0, payload=0;
-//can be called at any frequency
-SM_STATUS smParseReturnData( smbus handle, smuint8 data )
+//feeds one byte to frame receiver state machine. returns SM_ERR_COMMUNICATION on framing error
+static SM_STATUS smParseFrameByte( smbus handle, smuint8 data )
 {
-    //check if bus handle is valid & opened
-    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
-
+    SM_BUS *bus=&smBus(handle);
     //buffered variable allows placing if's in any order (because recv_state may changes in this function)
-    smBus[handle].recv_state=smBus[handle].recv_state_next;
-    smBus[handle].receiveComplete=smfalse;//overwritten to true later if complete
+    bus->recv_state=bus->recv_state_next;
+    bus->receiveComplete=smfalse;//overwritten to true later if complete
 
-    if(smBus[handle].recv_state==WaitPayload)
+    if(bus->recv_state==WaitPayload)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
-
-        //normal handling for all payload data
-        if(smBus[handle].recv_storepos<SM485_MAX_PAYLOAD_BYTES)
-            smBus[handle].recv_rsbuf[smBus[handle].recv_storepos++]=data;
+        //normal handling for all payload data, CRC is calculated over whole payload once it's received
+        if(bus->recv_storepos<SM485_MAX_PAYLOAD_BYTES)
+            bus->recv_rsbuf[bus->recv_storepos++]=data;
         else//rx payload buffer overflow
         {
-            return recordStatus(handle,(smReceiveErrorHandler(handle,smtrue)));
+            return SM_ERR_COMMUNICATION;
         }
 
         //all received
-        if(smBus[handle].recv_payloadsize<=smBus[handle].recv_storepos)
-            smBus[handle].recv_state_next=WaitCrcHi;
+        if(bus->recv_payloadsize<=bus->recv_storepos)
+        {
+            bus->recv_crc=calcCRC16Update(bus->recv_crc,bus->recv_rsbuf,bus->recv_storepos);
+            bus->recv_state_next=WaitCrcHi;
+        }
 
-        return recordStatus(handle,SM_OK);
+        return SM_OK;
     }
 
 
-    if(smBus[handle].recv_state==WaitCmdId)
+    if(bus->recv_state==WaitCmdId)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
-        smBus[handle].recv_cmdid=data;
+        bus->recv_crc=calcCRC16(data,bus->recv_crc);
+        bus->recv_cmdid=data;
         switch(data&SMCMD_MASK_PARAMS_BITS)//commands with fixed payload size
         {
-        case SMCMD_MASK_2_PARAMS: smBus[handle].recv_payloadsize=2; smBus[handle].recv_state_next=WaitAddr; break;
-        case SMCMD_MASK_0_PARAMS: smBus[handle].recv_payloadsize=0; smBus[handle].recv_state_next=WaitAddr; break;
-        case SMCMD_MASK_N_PARAMS: smBus[handle].recv_payloadsize=-1; smBus[handle].recv_state_next=WaitPayloadSize;break;//-1 = N databytes
+        case SMCMD_MASK_2_PARAMS: bus->recv_payloadsize=2; bus->recv_state_next=WaitAddr; break;
+        case SMCMD_MASK_0_PARAMS: bus->recv_payloadsize=0; bus->recv_state_next=WaitAddr; break;
+        case SMCMD_MASK_N_PARAMS: bus->recv_payloadsize=-1; bus->recv_state_next=WaitPayloadSize;break;//-1 = N databytes
         default:
-            return recordStatus(handle,(smReceiveErrorHandler(handle, smtrue)));
+            return SM_ERR_COMMUNICATION;
             break; //error, unsupported command id
         }
 
-        return recordStatus(handle,SM_OK);
+        return SM_OK;
     }
 
     //no data payload size known yet
-    if(smBus[handle].recv_state==WaitPayloadSize)
+    if(bus->recv_state==WaitPayloadSize)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
-        smBus[handle].recv_payloadsize=data;
-        smBus[handle].recv_state_next=WaitAddr;
-        return recordStatus(handle,SM_OK);
+        if(data>SM485_MAX_PAYLOAD_BYTES)
+            return SM_ERR_COMMUNICATION;//can't be valid frame
+        bus->recv_crc=calcCRC16(data,bus->recv_crc);
+        bus->recv_payloadsize=data;
+        bus->recv_state_next=WaitAddr;
+        return SM_OK;
     }
 
-    if(smBus[handle].recv_state==WaitAddr)
+    if(bus->recv_state==WaitAddr)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
-        smBus[handle].recv_addr=data;//can be receiver or sender addr depending on cmd
-        if(smBus[handle].recv_payloadsize>smBus[handle].recv_storepos)
-            smBus[handle].recv_state_next=WaitPayload;
+        bus->recv_crc=calcCRC16(data,bus->recv_crc);
+        bus->recv_addr=data;//can be receiver or sender addr depending on cmd
+        if(bus->recv_payloadsize>bus->recv_storepos)
+            bus->recv_state_next=WaitPayload;
         else
-            smBus[handle].recv_state_next=WaitCrcHi;
-        return recordStatus(handle,SM_OK);
+            bus->recv_state_next=WaitCrcHi;
+        return SM_OK;
     }
 
-    if(smBus[handle].recv_state==WaitCrcHi)
+    if(bus->recv_state==WaitCrcHi)
     {
-        smBus[handle].recv_read_crc_hi=data;//crc_msb
-        smBus[handle].recv_state_next=WaitCrcLo;
-        return recordStatus(handle,SM_OK);
+        bus->recv_read_crc_hi=data;//crc_msb
+        bus->recv_state_next=WaitCrcLo;
+        return SM_OK;
     }
 
     //get crc_lsb, check crc and execute
-    if(smBus[handle].recv_state==WaitCrcLo)
+    if(bus->recv_state==WaitCrcLo)
     {
-        if(((smBus[handle].recv_read_crc_hi<<8)|data)!=smBus[handle].recv_crc)
+        if(((bus->recv_read_crc_hi<<8)|data)!=bus->recv_crc)
         {
             //CRC error
-            return recordStatus(handle,(smReceiveErrorHandler(handle,smtrue)));
+            return SM_ERR_COMMUNICATION;
         }
         else
         {
             //CRC ok
-            //if(smBus[handle].recv_addr==config.deviceAddress || smBus[handle].recv_cmdid==SMCMD_GET_CLOCK_RET || smBus[handle].recv_cmdid==SMCMD_PROCESS_IMAGE ) executeSMcmd();
-            smBus[handle].receiveComplete=smtrue;
+            //if(bus->recv_addr==config.deviceAddress || bus->recv_cmdid==SMCMD_GET_CLOCK_RET || bus->recv_cmdid==SMCMD_PROCESS_IMAGE ) executeSMcmd();
+            bus->receiveComplete=smtrue;
         }
 
         //smResetSM485variables(handle);
-        smBus[handle].recv_storepos=0;
-        smBus[handle].recv_crc=SM485_CRCINIT;
-        smBus[handle].recv_state_next=WaitCmdId;
-        return recordStatus(handle,SM_OK);
+        bus->recv_storepos=0;
+        bus->recv_crc=SM485_CRCINIT;
+        bus->recv_state_next=WaitCmdId;
+        return SM_OK;
+    }
+
+    return SM_OK;
+}
+
+//re-parses received bytes starting from offset start. returns SM_OK if they form a valid complete or partial frame
+static SM_STATUS smReparseFrom( smbus handle, const smuint8 *raw, int rawlen, int start )
+{
+    SM_STATUS stat=SM_OK;
+    int i;
+
+    smResetFrameReceiver(handle);
+    for(i=start;i<rawlen && stat==SM_OK && smBus(handle).receiveComplete==smfalse;i++)
+    {
+        smBus(handle).recv_raw[smBus(handle).recv_rawlen++]=raw[i];
+        stat=smParseFrameByte(handle,raw[i]);
+    }
+    return stat;
+}
+
+//while receiving a frame, checks whether received bytes already end a complete CRC valid frame that starts
+//after few noise bytes. i.e. noise byte in front of reply may be taken as frame header that claims longer
+//payload than the actual reply has, and without this check the reply would be found only after read timeout.
+//called only when recv_rawlen reaches recv_shifted_check_len to keep per byte cost low.
+static void smCheckShiftedFrame( smbus handle )
+{
+    smuint8 raw[SM485_MAX_FRAME_BYTES];
+    int rawlen=smBus(handle).recv_rawlen;
+    int nextCheck=SM485_MAX_FRAME_BYTES+1;
+    int start;
+
+    for(start=1;start<=SM485_RESYNC_MAX_NOISE_BYTES && start<rawlen;start++)
+    {
+        const smuint8 *frame=&smBus(handle).recv_raw[start];
+        int framelen;
+
+        if(!(frame[0]&SMCMD_MASK_RETURN))
+            continue;
+
+        switch(frame[0]&SMCMD_MASK_PARAMS_BITS)
+        {
+        case SMCMD_MASK_0_PARAMS: framelen=4; break;
+        case SMCMD_MASK_2_PARAMS: framelen=6; break;
+        case SMCMD_MASK_N_PARAMS: framelen=frame[1]+5; break;
+        default: continue;
+        }
+
+        if(start+framelen>rawlen && start+framelen<nextCheck)
+            nextCheck=start+framelen;
+
+        if(framelen!=rawlen-start || calcCRC16Update(SM485_CRCINIT,frame,framelen-2)!=((frame[framelen-2]<<8)|frame[framelen-1]))
+            continue;
+
+        memcpy(raw,smBus(handle).recv_raw,rawlen);
+        if(smReparseFrom(handle,raw,rawlen,start)==SM_OK && smBus(handle).receiveComplete==smtrue)
+        {
+            smDebug(handle,SMDebugMid,"Receiver resynchronized, skipped %d bytes\n",start);
+            smBus(handle).recv_rawlen=0;
+        }
+        return;
+    }
+
+    smBus(handle).recv_shifted_check_len=nextCheck;
+}
+
+//called on framing error (CRC mismatch, invalid command ID or payload size). instead of discarding all incoming data,
+//looks for a plausible frame start from the already received bytes of the failed frame and re-parses from there.
+//returns SM_OK if a complete valid frame was found or a plausible frame is still being received, otherwise discards
+//data that is already buffered in bus device, without waiting for more data or sleeping, and returns SM_ERR_COMMUNICATION.
+static SM_STATUS smReceiveResync( smbus handle )
+{
+    smuint8 raw[SM485_MAX_FRAME_BYTES];
+    int rawlen=smBus(handle).recv_rawlen;
+    int start;
+
+    memcpy(raw,smBus(handle).recv_raw,rawlen);
+
+    for(start=1;start<rawlen;start++)
+    {
+        //frames from devices always have return bit set
+        if(!(raw[start]&SMCMD_MASK_RETURN))
+            continue;
+
+        if(smReparseFrom(handle,raw,rawlen,start)!=SM_OK)
+            continue;
+
+        if(smBus(handle).receiveComplete==smtrue)
+        {
+            smDebug(handle,SMDebugMid,"Receiver resynchronized, skipped %d bytes\n",start);
+            smBus(handle).recv_rawlen=0;
+            return SM_OK;
+        }
+
+        if(start<=SM485_RESYNC_MAX_NOISE_BYTES)
+            return SM_OK;//continue receiving rest of the frame
+    }
+
+    smResetFrameReceiver(handle);
+
+    //byte that can't start a frame is skipped without error, reply may still follow it
+    if(rawlen==1)
+    {
+        smDebug(handle,SMDebugMid,"Skipped invalid frame start byte %02x\n",raw[0]);
+        return SM_OK;
     }
 
+    smDebug(handle,SMDebugLow,"Frame receive error, discarding %d received bytes\n",rawlen);
+    return smReceiveErrorHandler(handle,smtrue);
+}
+
+//can be called at any frequency
+SM_STATUS smParseReturnData( smbus handle, smuint8 data )
+{
+    SM_BUS *bus;
+    SM_STATUS stat;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    bus=&smBus(handle);
+
+    if(bus->recv_rawlen==0)//first byte of frame
+        bus->recv_shifted_check_len=SM485_RESYNC_MAX_NOISE_BYTES+2;
+    if(bus->recv_rawlen<SM485_MAX_FRAME_BYTES)
+        bus->recv_raw[bus->recv_rawlen++]=data;
+
+    stat=smParseFrameByte(handle,data);
+    if(stat!=SM_OK)
+        return recordStatus(handle,smReceiveResync(handle));
+
+    if(bus->receiveComplete==smtrue)
+        bus->recv_rawlen=0;
+    else if(bus->recv_rawlen>=bus->recv_shifted_check_len)
+        smCheckShiftedFrame(handle);
+
     return recordStatus(handle,SM_OK);
 }
 
 
-//reply consumes 16 bytes in payload buf, so max calls per cycle is 7
+//reply consumes 16 bytes in payload buf, so max calls per cycle is 7 unless smSetMultiFrameQueue is enabled
 SM_STATUS smAppendGetParamCommandToQueue( smbus handle, smint16 paramAddress )
 {
     SM_STATUS stat=SM_NONE;
@@ -917,7 +1889,7 @@ SM_STATUS smGetQueuedGetParamReturnValue(  const smbus bushandle, smint32 *retVa
     return recordStatus(bushandle,stat);
 }
 
-//consumes 6 bytes in payload buf, so max calls per cycle is 20
+//consumes 6 bytes in payload buf, so max calls per cycle is 20 unless smSetMultiFrameQueue is enabled
 SM_STATUS smAppendSetParamCommandToQueue( smbus handle, smint16 paramAddress, smint32 paramValue )
 {
     SM_STATUS stat=SM_NONE;
@@ -927,6 +1899,12 @@ SM_STATUS smAppendSetParamCommandToQueue( smbus handle, smint16 paramAddress, sm
 
     stat|=smAppendSMCommandToQueue( handle, SMPCMD_SETPARAMADDR, paramAddress );//2b
     stat|=smAppendSMCommandToQueue( handle, SMPCMD_32B, paramValue );//4b
+
+    //restart and firmware upload may change identification of device
+    if((paramAddress==SMP_SYSTEM_CONTROL && (paramValue==SMP_SYSTEM_CONTROL_RESTART || paramValue==SMP_SYSTEM_CONTROL_RESTART_TO_DFU_MODE))
+            || paramAddress==SMP_BOOTLOADER_FUNCTION)
+        smBus(handle).queueInvalidatesNodeInfo=smtrue;
+
     return recordStatus(handle,stat);
 }
 
@@ -960,17 +1938,56 @@ SM_STATUS smGetBufferClock( const smbus handle, const smaddr targetaddr, smuint1
     stat=smSendSMCMD(handle, SMCMD_GET_CLOCK ,targetaddr, 0, NULL ); //send get clock commands to bus
     if(stat!=SM_OK) return recordStatus(handle,stat);
 
+    smAdaptiveTimeoutBegin(handle,targetaddr,4,6);
     stat=smReceiveReturnPacket(handle);//blocking wait & receive return values from bus
+    smAdaptiveTimeoutEnd(handle,targetaddr,6,stat==SM_OK);
     if(stat!=SM_OK) return recordStatus(handle,stat); //maybe timeouted
 
     if(clock!=NULL)
-	memcpy(clock,smBus[handle].recv_rsbuf,sizeof(smuint16));
+	memcpy(clock,smBus(handle).recv_rsbuf,sizeof(smuint16));
 
-    smBus[handle].recv_storepos=0;
+    smBus(handle).recv_storepos=0;
 
     return recordStatus(handle,SM_OK);
 }
 
+SM_STATUS smProbeNode( const smbus handle, const smaddr nodeAddress, smuint16 timeoutMs, smint32 *smVersion )
+{
+    SM_STATUS cumulativeStatus, stat=SM_ERR_COMMUNICATION;
+    smint32 version=0;
+    int attempt;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    if(nodeAddress==0 || timeoutMs<1 || timeoutMs>5000) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    cumulativeStatus=smBus(handle).cumulativeSmStatus;
+    probeTimeoutMs=timeoutMs;
+
+    //reply of previously probed node may arrive after its deadline and get received instead of the reply of this node.
+    //it is recognized from the sender address and the reply of this node is received again after it.
+    for(attempt=0;attempt<2;attempt++)
+    {
+        stat=smAppendGetParamCommandToQueue(handle,SMP_SM_VERSION);
+        stat|=smExecuteCommandQueue(handle,nodeAddress);
+        stat|=smGetQueuedGetParamReturnValue(handle,&version);
+        if(stat!=SM_OK || smBus(handle).recv_addr==nodeAddress)
+            break;
+        smDebug(handle,SMDebugMid,"smProbeNode: discarded late reply from SM address %d\n",(int)smBus(handle).recv_addr);
+        stat=SM_ERR_COMMUNICATION;
+    }
+
+    probeTimeoutMs=0;
+
+    //late reply of missing node isn't purged, that would sleep on serial ports. the next probe recognizes it as above
+    if(stat==SM_OK && smVersion!=NULL)
+        *smVersion=version;
+
+    //missing node is the expected result of a probe, not an error of the bus
+    smBus(handle).cumulativeSmStatus=cumulativeStatus;
+    return stat==SM_OK ? SM_OK : SM_ERR_COMMUNICATION;
+}
+
 /** Simple read & write of parameters with internal queueing, so only one call needed.
 Use these for non-time critical operations. */
 SM_STATUS smRead1Parameter( const smbus handle, const smaddr nodeAddress, const smint16 paramId1, smint32 *paramVal1 )
@@ -1058,10 +2075,10 @@ SM_STATUS recordStatus( const smbus handle, const SM_STATUS stat )
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    if(smBus[handle].cumulativeSmStatus!=stat && stat!=SM_OK)//if status changed and new status is not SM_OK
-        smDebug(handle,SMDebugLow,"Previous SM call failed and changed the SM_STATUS value obtainable with getCumulativeStatus(). Status before failure was %d, and new error flag valued %d has been now set.\n",(int)smBus[handle].cumulativeSmStatus,(int)stat);
+    if(smBus(handle).cumulativeSmStatus!=stat && stat!=SM_OK)//if status changed and new status is not SM_OK
+        smDebug(handle,SMDebugLow,"Previous SM call failed and changed the SM_STATUS value obtainable with getCumulativeStatus(). Status before failure was %d, and new error flag valued %d has been now set.\n",(int)smBus(handle).cumulativeSmStatus,(int)stat);
 
-    smBus[handle].cumulativeSmStatus|=stat;
+    smBus(handle).cumulativeSmStatus|=stat;
 
     return stat;
 }
@@ -1072,7 +2089,7 @@ SM_STATUS getCumulativeStatus( const smbus handle )
 {
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    return smBus[handle].cumulativeSmStatus;
+    return smBus(handle).cumulativeSmStatus;
 }
 
 /** Reset cululative status so getCumultiveStatus returns 0 after calling this until one of the other functions are called*/
@@ -1082,7 +2099,7 @@ SM_STATUS resetCumulativeStatus( const smbus handle )
 
     smDebug(handle,SMDebugMid,"resetCumulativeStatus called.\n");
 
-    smBus[handle].cumulativeSmStatus=0;
+    smBus(handle).cumulativeSmStatus=0;
 
     return SM_OK;
 }
@@ -1279,26 +2296,87 @@ LIB int smDescribeStatus(char* str, const size_t size, int32_t status)
 #undef TRIM_TRAILING_WS
 
 
+LIB SM_STATUS smGetNodeInfo( const smbus handle, const smaddr nodeAddress, SM_NODE_INFO *info )
+{
+    SM_NODE_CACHE *entry;
+    SM_NODE_INFO read;
+    SM_STATUS smStat;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    if(nodeAddress==0 || info==NULL) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    if(smBus(handle).nodeCache==NULL)
+    {
+        smBus(handle).nodeCache=(SM_NODE_CACHE*)calloc(256,sizeof(SM_NODE_CACHE));
+        if(smBus(handle).nodeCache==NULL) return recordStatus(handle,SM_ERR_BUS);//out of memory
+    }
+
+    entry=&smBus(handle).nodeCache[nodeAddress];
+    if(entry->valid==smtrue)
+    {
+        *info=entry->info;
+        return SM_OK;
+    }
+
+    read.bus=handle;
+    read.address=nodeAddress;
+    read.capabilities1=0;
+    read.capabilities2=0;
+    smStat=smRead3Parameters(handle,nodeAddress,SMP_SM_VERSION,&read.smVersion,SMP_DEVICE_TYPE,&read.deviceType,SMP_FIRMWARE_VERSION,&read.firmwareVersion);
+    if(smStat!=SM_OK) return smStat;
+
+    if(read.smVersion>=28) //v28+ supports capabilities flags
+    {
+        smStat=smRead2Parameters(handle,nodeAddress,SMP_DEVICE_CAPABILITIES1,&read.capabilities1,SMP_DEVICE_CAPABILITIES2,&read.capabilities2);
+        if(smStat!=SM_OK) return smStat;
+    }
+
+    smDebug(handle,SMDebugMid,"smGetNodeInfo: SM address %d has SM version %d, device type %d, firmware version %d\n",
+            (int)nodeAddress,(int)read.smVersion,(int)read.deviceType,(int)read.firmwareVersion);
+
+    entry->info=read;
+    entry->valid=smtrue;
+    *info=read;
+    return SM_OK;
+}
+
+LIB SM_STATUS smInvalidateNodeInfo( const smbus handle, const smaddr nodeAddress )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    if(smBus(handle).nodeCache==NULL)
+        return SM_OK;
+
+    if(nodeAddress==0)//broadcast
+        memset(smBus(handle).nodeCache,0,256*sizeof(SM_NODE_CACHE));
+    else
+        smBus(handle).nodeCache[nodeAddress].valid=smfalse;
+
+    return SM_OK;
+}
+
 LIB SM_STATUS smCheckDeviceCapabilities(const smbus handle, const int nodeAddress,
                                          const smint32 capabilitiesParameterNr,
                                          const smint32 requiredCapabilityFlags,
                                          smbool *resultHasAllCapabilities )
 {
     SM_STATUS smStat=0;
-    smint32 SMProtocolVersion;
+    SM_NODE_INFO info;
     *resultHasAllCapabilities=smfalse;//set true later
 
-    smStat|=smRead1Parameter(handle,nodeAddress,SMP_SM_VERSION,&SMProtocolVersion);
+    if(nodeAddress<1 || nodeAddress>255) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    smStat|=smGetNodeInfo(handle,(smaddr)nodeAddress,&info);
     if(smStat!=SM_OK) return smStat; //error in above call
 
-    if(SMProtocolVersion>=28) //v28+ supports capabilities flags
+    if(info.smVersion>=28) //v28+ supports capabilities flags
     {
         //all devices with v28+ has two frist capabilities flags
         if(capabilitiesParameterNr==SMP_DEVICE_CAPABILITIES1 || capabilitiesParameterNr==SMP_DEVICE_CAPABILITIES2)
         {
-            smint32 capabilities;
-            smStat|=smRead1Parameter(handle,nodeAddress,capabilitiesParameterNr,&capabilities);
-            if(smStat!=SM_OK) return smStat; //error in above call
+            smint32 capabilities=capabilitiesParameterNr==SMP_DEVICE_CAPABILITIES1 ? info.capabilities1 : info.capabilities2;
 
             if( (capabilities&requiredCapabilityFlags)==requiredCapabilityFlags )//if all required capabilities are supported
                 *resultHasAllCapabilities=smtrue;//set result
@@ -1307,12 +2385,8 @@ LIB SM_STATUS smCheckDeviceCapabilities(const smbus handle, const int nodeAddres
         }
         else //for rest (future capabilities parameters), test if capabilitiesParameterNr is readable
         {
-            smint32 capabilities1;
-            smStat|=smRead1Parameter(handle,nodeAddress,SMP_DEVICE_CAPABILITIES1,&capabilities1);
-            if(smStat!=SM_OK) return smStat; //error in above call
-
             //check if device supports testing whether paramter is available
-            if(capabilities1&DEVICE_CAPABILITY1_SUPPORTS_SMP_PARAMETER_PROPERTIES_MASK)
+            if(info.capabilities1&DEVICE_CAPABILITY1_SUPPORTS_SMP_PARAMETER_PROPERTIES_MASK)
             {
                 smint32 paramProperties;
                 //test if parameter is readable
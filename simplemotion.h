@@ -31,9 +31,7 @@ extern "C"{
 #define SMBUSDEVICE_RETURN_ON_OPEN_FAIL NULL
 
 
-//max number of simultaneously opened buses. change this and recompiple SMlib if
-//necessary (to increase channels or reduce to save memory)
-//#define SM_MAX_BUSES 5
+//max number of simultaneously opened buses is set by SM_MAX_BUSES in user_options.h
 ///////////////////////////////////////////////////////////////////////////////////////
 //FUNCTIONS////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -50,6 +48,8 @@ extern "C"{
     ---Opening by device description (programmed in FTDI EEPROM): raw name, i.e. USB-SMV2 or TTL232R (hint: name is displayed in Granity 1.14 or later)
     ---Hint: D2XX driver supports listing available devices. See: smGetNumberOfDetectedBuses() and smGetBusDeviceDetails()
 	-return value: handle to be used with all other commands, -1 if fails
+	Handle is an opaque non-negative value, not an index: it carries a generation count so that handle of a closed bus
+	stays invalid when the bus slot is reused, so it may be large and must not be used for indexing arrays.
 	*/
 LIB smbus smOpenBus( const char * devicename );
 
@@ -71,21 +71,102 @@ LIB smbus smOpenBusWithCallbacks(const char *devicename, BusdeviceOpen busOpenCa
 	*/
 LIB void smSetBaudrate( unsigned long pbs );
 
-/** Set timeout of how long to wait reply packet from bus. Must be set before smOpenBus and cannot be changed afterwards
+/** Switch an opened bus and all devices on it to the highest speed that every given node supports, without the manual
+ * procedure described at smSetBaudrate. Speed of nodes is changed with broadcasted SMP_BUS_SPEED, the port is reopened at the new
+ * speed and communication with every node is verified. If verification fails, library stays silent until SM watchdog of all
+ * nodes has timed out and they have returned to the default speed (460800), and reopens the port at default speed.
+ * Watchdog is temporarily enabled on nodes that don't have it, note that its timeout causes a fault stop on devices.
+ * Requires SM protocol version 26 or later on all nodes (see SMP_SM_VERSION), otherwise speed is not changed.
+ * Parameters:
+ * -nodeAddresses, numNodes: all devices connected to the bus. Every node must reply or nothing is changed.
+ * -maxBps: highest speed supported by the bus device (i.e. USB adapter) on host side
+ * -resultBps: if not NULL, set to the speed at which bus operates after the call
+  -return value: SM_OK if bus operates at resultBps, SM_ERR_COMMUNICATION if switch failed and bus was returned to default speed
+*/
+LIB SM_STATUS smEscalateBusSpeed( const smbus handle, const smaddr *nodeAddresses, int numNodes, unsigned long maxBps, unsigned long *resultBps );
+
+/** Same as smOpenBus followed by smEscalateBusSpeed. Bus is opened at the speed set by smSetBaudrate (460800 by default)
+ * and returned handle is valid also if speed could not be raised. */
+LIB smbus smOpenBusWithAutoSpeed( const char *devicename, const smaddr *nodeAddresses, int numNodes, unsigned long maxBps );
+
+/** Set timeout of how long to wait reply packet from bus. Takes effect on the next read also on already opened buses.
  * max value 5000ms. Range may depend on underyling OS / drivers. If supplied argument is lower than minimum supported by drivers,
  * then driver minimum is used without notice (return SM_OK).
  *
- * In unix PC serial port minimum is 100ms, on Windows serial port recommended minimum is 30ms and with FTDI driver 10ms. On TCP/IP: TBD.
+ * On Windows serial port recommended minimum is 30ms and with FTDI driver 10ms. On TCP/IP: TBD.
  *
  *This is the only function that returns SM_STATUS which doesn't accumulate status bits to be read with getCumulativeStatus because it has no bus handle
  */
 LIB SM_STATUS smSetTimeout( smuint16 millsecs );
 
+/** Set busy-poll receive window. While waiting for a reply, serial (Linux and macOS) and TCP/IP drivers poll the port
+ * without sleeping for up to spinUs microseconds before falling back to blocking wait of smSetTimeout. This removes the
+ * wakeup latency of the reading thread from reply time at cost of one CPU core spinning at 100% while waiting, so it's
+ * meant for threads on isolated real-time cores, i.e. running smFastUpdateCycle. Set spinUs to cover the usual reply
+ * time. Takes effect on the next read also on already opened buses. On Linux TCP/IP buses opened after this call also
+ * get SO_BUSY_POLL (needs CAP_NET_ADMIN if spinUs exceeds net.core.busy_read) and TCP_QUICKACK for each reply.
+ * 0 disables (default), max value 100000us.
+ *
+ *Like smSetTimeout, this function has no bus handle and doesn't accumulate status bits
+ */
+LIB SM_STATUS smSetBusyPoll( smuint32 spinUs );
+
+/** Enable or disable adaptive reply timeouts of an opened bus. When enabled, library measures reply latency of each node
+ * and sets the deadline of every transaction from the expected transfer time at bus baudrate plus the observed latency
+ * and its variation. This makes requests to missing or unresponsive nodes fail fast instead of waiting the full smSetTimeout time.
+ * Deadline of consecutive timeouts of the same node is doubled (up to 8x) until it replies again.
+ * Parameters:
+ * -floorMs: shortest allowed timeout. Should cover OS scheduling and USB latencies, i.e. 5-20ms for USB serial adapters.
+ * -ceilingMs: longest allowed timeout, used also before any replies have been measured. Max value 5000ms.
+ * Statistics are reset when bus is opened or adaptive timeouts are re-enabled. Disabled by default.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed or SM_ERR_PARAMETER if limits are invalid
+*/
+LIB SM_STATUS smSetAdaptiveTimeout( const smbus handle, smbool enabled, smuint16 floorMs, smuint16 ceilingMs );
+
+/** Read reply latency statistics measured by adaptive timeouts (see smSetAdaptiveTimeout). Latency is time from sending
+ * a command to the reply excluding the transfer time of bytes on bus. Any of output pointers may be NULL.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed or SM_ERR_PARAMETER if node has not replied since statistics were reset
+*/
+LIB SM_STATUS smGetNodeLatency( const smbus handle, const smaddr nodeAddress, smuint32 *averageUs, smuint32 *deviationUs );
+
+#define SM_MAX_PIPELINE_FRAMES 16
+
+/** Set send window for pipelining transactions on an opened bus. Normally library waits for the reply of each frame before
+ * sending the next one, so every transaction costs a full network round trip on TCP/IP gateways. With pipelining up to
+ * maxFrames frames are sent before waiting for replies, which the gateway must buffer and execute on the bus one by one.
+ * Replies are matched to frames in sending order. maxBytes limits total size of frames in flight to fit the receive buffer
+ * of the gateway, 0 means no limit, otherwise it must be at least 125 (largest frame). Pipelining is used by
+ * smTemplateExecuteBatch and multi-frame command queues (see smSetMultiFrameQueue). Only frames to different nodes
+ * are in flight at the same time, a frame to a node that already has one in flight waits for its reply. So a batch
+ * that polls several nodes is pipelined, but frames of a multi-frame queue (all to one node) are sent one at a time.
+ *
+ * Enable only for gateways that buffer frames and return replies in order. If a node doesn't reply, the gateway must
+ * return nothing for its frame, the frame then fails when reply of a later frame arrives. Direct RS485 and USB adapters
+ * must use the default window of 1 frame (no pipelining). Max value of maxFrames is SM_MAX_PIPELINE_FRAMES.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed or SM_ERR_PARAMETER if window is invalid
+*/
+LIB SM_STATUS smSetPipelineWindow( const smbus handle, int maxFrames, int maxBytes );
+
 /** Close connection to given bus handle number. This frees communication link therefore makes it available for other apps for opening.
-  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+ * Telemetry engines, read combiners and schedulers created for the bus must be destroyed first. Handle of a closed
+ * bus stays invalid even if a later smOpenBus reuses its slot.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed, SM_ERR_PARAMETER if bus is still in use
 */
 LIB SM_STATUS smCloseBus( const smbus bushandle );
 
+/** Start recording all transmitted frames and received bytes of given bus into a binary capture file with monotonic timestamps.
+ * Data is buffered in memory and written to file by a background writer so capture does not disturb bus timing.
+ * Capture is stopped by smCaptureStop or when bus is closed. File format is described in buscapture.h.
+ * Starting a new capture on a bus that is already being captured closes the previous capture file.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smCaptureStart( const smbus bushandle, const char *filename );
+
+/** Stop capture started with smCaptureStart and flush all recorded data to file.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed or SM_ERR_PARAMETER if capture was not running
+*/
+LIB SM_STATUS smCaptureStop( const smbus bushandle );
+
 /** Return SM lib version number in hexadecimal format.
 Ie V 2.5.1 would be 0x020501 and 1.2.33 0x010233 */
 LIB smuint32 smGetVersion();
@@ -121,12 +202,31 @@ LIB SM_STATUS smBytesReceived( const smbus bushandle, smint32 *bytesinbuffer );
 
 LIB SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType, smint32 paramvalue  );
 LIB SM_STATUS smGetQueuedSMCommandReturnValue(  const smbus bushandle, smint32 *retValue );
+/** Read all remaining return values of executed command queue at once, same as calling smGetQueuedSMCommandReturnValue
+ * until smBytesReceived gives 0 but much faster.
+ * -values: up to maxValues values are stored here, the rest can be read with the next call
+ * -types: if not NULL, return type of each value is stored here (SMPRET_32B, SMPRET_24B, SMPRET_16B or SMPRET_OTHER)
+ * -numValues: number of values stored
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smGetQueuedSMCommandReturnValues( const smbus bushandle, smint32 *values, smuint8 *types, smint32 maxValues, smint32 *numValues );
 
 LIB SM_STATUS smAppendGetParamCommandToQueue( smbus handle, smint16 paramAddress );
 LIB SM_STATUS smGetQueuedGetParamReturnValue(  const smbus bushandle, smint32 *retValue  );
 LIB SM_STATUS smAppendSetParamCommandToQueue( smbus handle, smint16 paramAddress, smint32 paramValue );
 LIB SM_STATUS smGetQueuedSetParamReturnValue(  const smbus bushandle, smint32 *retValue  );
 
+/** Enable or disable multi-frame command queue of an opened bus. By default command queue holds one frame (120 bytes) and
+ * appending more commands fails with SM_ERR_LENGTH and discards the queue. When enabled, queue grows without limit and
+ * smExecuteCommandQueue/smUploadCommandQueueToDeviceBuffer split it at subpacket boundaries into consecutive frames so that
+ * the reply of each frame fits in one frame as well (taking SMP_RETURN_PARAM_LEN writes of the queue into account).
+ * Write address and value subpackets are never split into separate frames. Return values of all frames are read in
+ * queued order with smGetQueued.. functions as if they were one reply. If a frame fails, the following frames are not sent.
+ * Commands queued before the call are discarded.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smSetMultiFrameQueue( const smbus handle, smbool enabled );
+
 /** Simple read & write of parameters with internal queueing, so only one call needed.
 Use these for non-time critical operations. */
 LIB SM_STATUS smRead1Parameter( const smbus handle, const smaddr nodeAddress, const smint16 paramId1, smint32 *paramVal1 );
@@ -276,6 +376,33 @@ LIB SM_STATUS smCheckDeviceCapabilities( const smbus handle, const int nodeAddre
                                          const smint32 requiredCapabilityFlags,
                                          smbool *resultHasAllCapabilities );
 
+/** Identification of a device, see smGetNodeInfo */
+typedef struct
+{
+    smbus bus;
+    smaddr address;
+    smint32 smVersion;//SMP_SM_VERSION
+    smint32 deviceType;//SMP_DEVICE_TYPE
+    smint32 firmwareVersion;//SMP_FIRMWARE_VERSION
+    smint32 capabilities1;//SMP_DEVICE_CAPABILITIES1 if SM version is 28 or later, otherwise 0
+    smint32 capabilities2;//SMP_DEVICE_CAPABILITIES2 if SM version is 28 or later, otherwise 0
+} SM_NODE_INFO;
+
+/** Get SM protocol version, device type, firmware version and capability flags of a device. They are read from device
+ * in at most two transactions on the first call and cached per bus and node, following calls don't communicate with device.
+ * smCheckDeviceCapabilities and smBufferedInit use the same cache.
+ * Cache is cleared when bus is closed and entry of a device is cleared when library writes SMP_SYSTEM_CONTROL_RESTART,
+ * SMP_SYSTEM_CONTROL_RESTART_TO_DFU_MODE or SMP_BOOTLOADER_FUNCTION to it (to all devices if written to broadcast address).
+ * If device is restarted or its firmware is changed by other means, call smInvalidateNodeInfo.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed or SM_ERR_BUS if cache can't be allocated
+*/
+LIB SM_STATUS smGetNodeInfo( const smbus handle, const smaddr nodeAddress, SM_NODE_INFO *info );
+
+/** Clear cached info of a device (see smGetNodeInfo), nodeAddress 0 clears all devices of the bus.
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smInvalidateNodeInfo( const smbus handle, const smaddr nodeAddress );
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,9 +28,43 @@ extern unsigned long SMBusBaudrate; //the next opened port (with smOpenBus) will
 extern const smuint8 table_crc16_hi[];
 extern const smuint8 table_crc16_lo[];
 extern const smuint8 table_crc8[];
+#ifdef ENABLE_FAST_CRC
+extern const smuint16 table_crc16_slice8[8][256];
+extern const smuint8 table_crc8_slice8[8][256];
+#endif
 extern FILE *smDebugOut; //such as stderr or file handle. if NULL, debug info disbled
 extern smuint16 readTimeoutMs;
 
+//storage class for per-thread variables. on platforms without thread support variable is just global
+#if (defined(__unix__) || defined(__APPLE__) || defined(_WIN32)) && defined(_MSC_VER)
+#define SM_THREAD_LOCAL __declspec(thread)
+#elif (defined(__unix__) || defined(__APPLE__) || defined(_WIN32)) && defined(__GNUC__)
+#define SM_THREAD_LOCAL __thread
+#else
+#define SM_THREAD_LOCAL
+#endif
+
+//read timeout that bus device drivers should apply for the current read. this is readTimeoutMs unless
+//adaptive timeouts (smSetAdaptiveTimeout) have set a shorter deadline for transaction in progress in calling thread
+smuint16 smGetReadTimeoutMs();
+
+//busy-poll window set with smSetBusyPoll that bus device drivers should spin before blocking read, 0=disabled
+smuint32 smGetBusyPollUs();
+
+//returns smtrue if handle is a bus opened with smOpenBus
+smbool smIsHandleOpen( const smbus handle );
+
+//register a component that keeps using bus from its own thread or between calls (telemetry engine, read combiner,
+//scheduler). smCloseBus fails while bus has users. returns SM_ERR_NODEVICE if bus is not open.
+//smDetachBusUser must be called once for each successful attach before the component is freed.
+SM_STATUS smAttachBusUser( const smbus handle );
+void smDetachBusUser( const smbus handle );
+
+//checks whether node replies within timeoutMs by reading its SMP_SM_VERSION in a single frame. timeoutMs overrides
+//smSetTimeout and adaptive timeouts for this transaction. used for node discovery (see nodediscovery.h).
+//returns SM_OK if node replied, SM_ERR_COMMUNICATION if not. cumulative status of bus is not changed by missing node.
+SM_STATUS smProbeNode( const smbus handle, const smaddr nodeAddress, smuint16 timeoutMs, smint32 *smVersion );
+
 #define DEBUG_PRINT_RAW 0x524157
 //smDebug: prints debug info to smDebugOut stream. If no handle available, set it to -1, or if wish to print as raw text, set handle to DEBUG_PRINT_RAW.
 //set verbositylevel according to frequency of prints made.
@@ -46,6 +80,61 @@ SM_STATUS recordStatus( const smbus handle, const SM_STATUS stat );
 
 SM_STATUS smRawCmd( const char *axisname, smuint8 cmd, smuint16 val, smuint32 *retdata );
 
+//CRC calculation of SM485 frames (calcCRC16 with SM485_CRCINIT) and fast update cycle frames (calcCRC8Buf with init 0x52),
+//see smcrc.c. calcCRC16Update gives same result as calling calcCRC16 for each byte of buffer.
+smuint16 calcCRC16(smuint8 data, smuint16 crc);
+smuint16 calcCRC16Update( smuint16 crc, const smuint8 *buf, int len );
+smuint16 calcCRC16Buf(const char *buffer, smuint16 buffer_length);
+smuint8 calcCRC8Buf( smuint8 *buf, int len, int crcinit );
+
+//CRC kernel implementations. best supported one is selected automatically at first use,
+//smSetCRCImplementation is meant for tests and benchmarks. returns smfalse if not supported on this CPU or build.
+typedef enum {
+    SMCRCImplementationBytewise,
+    SMCRCImplementationSlicing8,
+    SMCRCImplementationCarrylessMultiply
+} SMCRCImplementation;
+smbool smSetCRCImplementation( SMCRCImplementation implementation );
+SMCRCImplementation smGetCRCImplementation();
+
+//send SM485 frame with given payload and receive reply (unless targetaddress is broadcast address 0). handle must be open.
+//received payload can be accessed with smGetReceivedPayload until next transaction of bus.
+SM_STATUS smTransmitReceiveFrame( const smbus bushandle, const smaddr targetaddress, smuint8 cmdid, smuint8 payloadLen, smuint8 *payload );
+smint16 smGetReceivedPayload( const smbus bushandle, const smuint8 **payload );
+
+//pipelined transactions, see smSetPipelineWindow. frame callback gives frame number index and returns smfalse when there
+//are no more frames, payload must stay valid until the frame is completed. reply callback is called for every sent frame
+//in the order they were sent, received payload can be accessed with smGetReceivedPayload if stat is SM_OK and frame was
+//not sent to broadcast address. return value of reply callback is taken as status of the frame
+typedef smbool (*SMPipelineFrameCallback)( void *context, int index, smaddr *address, smuint8 *cmdid, smuint8 *payloadLen, smuint8 **payload );
+typedef SM_STATUS (*SMPipelineReplyCallback)( void *context, int index, SM_STATUS stat );
+
+//send frames keeping as many of them in flight as send window of bus allows, at most one per node address (broadcasts
+//are not limited as they have no reply). if stopOnError is smtrue, no frames are sent
+//after a frame fails and replies of frames already in flight are received but not passed to reply callback. returns SM_OK
+//if all frames succeeded, otherwise error bits of failed frames. handle must be open
+SM_STATUS smTransmitReceivePipelined( const smbus bushandle, SMPipelineFrameCallback frame, SMPipelineReplyCallback reply, void *context, smbool stopOnError );
+
+//expected duration of transaction in microseconds: transfer time of bytes at bus baudrate plus reply latency of node
+//measured by adaptive timeouts (see smSetAdaptiveTimeout), if any
+smuint32 smEstimateTransactionUs( const smbus handle, const smaddr nodeAddress, int txBytes, int rxBytes );
+
+//encode SMPCMD_SETPARAMADDR, SMPCMD_24B or SMPCMD_32B subpacket with value to buf in wire format (big endian, type in
+//highest 2 bits of first byte). returns length of subpacket in bytes or 0 if type is invalid
+int smEncodeSubpacket( smuint8 *buf, int type, smint32 value );
+
+//decode one return subpacket (SMPRET_32B, SMPRET_24B, SMPRET_16B or SMPRET_OTHER) from beginning of buf to sign extended value.
+//returns length of subpacket in bytes or 0 if buf has less than the whole subpacket
+int smDecodeReturnValue( const smuint8 *buf, int bytes, smint32 *value );
+
+//decode up to maxValues return subpackets from buf to values and their SMPRET types to types (may be NULL).
+//returns number of bytes decoded, number of values is stored to numValues
+int smDecodeReturnValues( const smuint8 *buf, int bytes, smint32 *values, smuint8 *types, int maxValues, int *numValues );
+
+//SM485 receiver state machine, fed one received byte at time
+void smResetSM485variables(smbus handle);
+SM_STATUS smParseReturnData( smbus handle, smuint8 data );
+
 /*Workaround to have packed structs that compile on GCC and MSVC*/
 #ifdef __GNUC__
 #define PACKED __attribute__ ((__packed__))
@@ -54,6 +143,8 @@ SM_STATUS smRawCmd( const char *axisname, smuint8 cmd, smuint16 val, smuint32 *r
 #pragma pack(push,1)
 #endif
 
+//subpacket layouts as compiler bitfields. only valid on little endian targets, library encodes and decodes subpackets
+//with smEncodeSubpacket and smDecodeReturnValue
 typedef struct {
         /* ID=0 param size 30 bits (cmd total 4 bytes)
          * ID=1 param size 22 bits (cmd total 3 bytes)
@@ -165,5 +256,49 @@ LIB SM_STATUS smFlushTX( const smbus bushandle );
  */
 void smSleepMs(int millisecs);
 
+/* Same as smSleepMs but with microsecond argument. Actual resolution depends on OS (on Windows rounded up to milliseconds). */
+void smSleepUs(int microsecs);
+
+/* OS independent monotonic clock for SM internal use, returns nanoseconds from arbitrary starting point.
+ *
+ * Like smSleepMs, implementation exists for unix/win systems. For other systems, implement this in your application.
+ */
+smuint64 smGetMonotonicTimeNs();
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+/* Timed waits of worker threads against smGetMonotonicTimeNs clock, so that changes of wall clock don't stretch or cut them.
+ * Condition variable must be initialized with smCondInit. smCondWaitUntilNs returns like pthread_cond_timedwait,
+ * ETIMEDOUT when deadlineNs has passed. */
+void smCondInit( pthread_cond_t *cond );
+int smCondWaitUntilNs( pthread_cond_t *cond, pthread_mutex_t *mutex, smuint64 deadlineNs );
+#endif
+
+/* Full memory barrier for data that is shared between threads or processes without locking, i.e. snapshots guarded by a sequence counter.
+ * SM_CPU_RELAX hints to CPU that caller is spinning in a busy-wait loop, saves power and lets the other hardware thread of the core run.
+ * MSVC versions use intrinsics instead of windows.h so that including this doesn't conflict with winsock2.h in drivers */
+#if defined(__GNUC__)
+#define SM_MEMORY_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__i386__) || defined(__x86_64__)
+#define SM_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define SM_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define SM_CPU_RELAX()
+#endif
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_ARM64)
+#define SM_MEMORY_BARRIER() __dmb(_ARM64_BARRIER_ISH)
+#define SM_CPU_RELAX() __yield()
+#else
+#define SM_MEMORY_BARRIER() _mm_mfence()
+#define SM_CPU_RELAX() _mm_pause()
+#endif
+#else
+#define SM_MEMORY_BARRIER()
+#define SM_CPU_RELAX()
+#endif
+
 
 #endif // SIMPLEMOTION_PRIVATE_H
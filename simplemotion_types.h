@@ -17,6 +17,7 @@
 
 //declare SM lib integer types
 typedef long smbus;
+typedef uint64_t smuint64;
 typedef uint32_t smuint32;
 typedef uint16_t smuint16;
 typedef uint8_t smuint8;
@@ -54,10 +55,12 @@ typedef enum _smVerbosityLevel {SMDebugOff,SMDebugLow,SMDebugMid,SMDebugHigh,SMD
  *   If flush operation timeouted, return smfalse (fail), otherwise smtrue (success).
  * MiscOperationPurgeRX = discard all incoming data that is waiting to be read. Return smtrue on success,
  *   smfalse on fail.
+ * MiscOperationDiscardRX = discard incoming data that has already been received, without waiting for bytes
+ *   that may still be arriving. Must not block. Return smtrue on success, smfalse on fail.
  *
  * If operation is unsupported by the callback, return smfalse.
  */
-typedef enum _BusDeviceMiscOperationType {MiscOperationFlushTX,MiscOperationPurgeRX} BusDeviceMiscOperationType;
+typedef enum _BusDeviceMiscOperationType {MiscOperationFlushTX,MiscOperationPurgeRX,MiscOperationDiscardRX} BusDeviceMiscOperationType;
 
 //define communication interface device driver callback types
 typedef void* smBusdevicePointer;
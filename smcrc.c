@@ -0,0 +1,309 @@
+//CRC calculation of SM485 and fast update cycle frames
+//Copyright (c) Granite Devices Oy
+//
+//Long buffers are calculated with slicing-by-8 tables or by folding with carry-less multiply
+//instructions when CPU supports them (ENABLE_FAST_CRC in user_options.h). All implementations
+//give bit-exact same result as the byte-wise tables table_crc16_hi/lo and table_crc8.
+
+#include "simplemotion_private.h"
+
+#ifdef ENABLE_FAST_CRC
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SM_CRC_CLMUL_X86
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define SM_CRC_CLMUL_TARGET __attribute__((target("pclmul,sse2")))
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER)
+#define SM_CRC_CLMUL_X86
+#include <intrin.h>
+#include <wmmintrin.h>
+#define SM_CRC_CLMUL_TARGET
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)) && !defined(__ARM_BIG_ENDIAN)
+//PMULL is part of crypto extension, only used when compiling for CPU that has it (i.e. -march=armv8-a+crypto)
+#define SM_CRC_CLMUL_ARM
+#include <arm_neon.h>
+#endif
+#endif
+
+//folding is worth it only for buffers that are longer than few 16 byte blocks
+#define SM_CRC_CLMUL_MIN_LEN 64
+
+/* Folding constants for reflected CRC16 polynomial 0x18005. Constants are x^n mod P in bit reflected
+ * 64 bit form (coefficient of x^i at bit 63-i). Folding 128 bit block by d bits multiplies its
+ * low 64 bits by x^(d+63) mod P and high 64 bits by x^(d-1) mod P, extra x^1 comes from reflected
+ * multiplication. */
+#define SM_CRC16_X191 0xccd0000000000000ULL //fold by 128 bits
+#define SM_CRC16_X127 0xc100000000000000ULL
+#define SM_CRC16_X575 0xc450000000000000ULL //fold by 512 bits
+#define SM_CRC16_X511 0x8101000000000000ULL
+
+static smuint16 crc16Resolve( smuint16 crc, const smuint8 *buf, int len );
+static smuint8 crc8Resolve( smuint8 crc, const smuint8 *buf, int len );
+
+//kernels take CRC16 register in reflected order (bytes swapped compared to calcCRC16)
+static smuint16 (*crc16Kernel)( smuint16 crc, const smuint8 *buf, int len )=crc16Resolve;
+static smuint8 (*crc8Kernel)( smuint8 crc, const smuint8 *buf, int len )=crc8Resolve;
+static SMCRCImplementation crcImplementation=SMCRCImplementationBytewise;
+
+static smuint16 crc16Bytewise( smuint16 crc, const smuint8 *buf, int len )
+{
+    while(len-->0)
+    {
+        unsigned int i=(crc^*buf++)&0xff;
+        crc=(crc>>8)^((table_crc16_lo[i]<<8)|table_crc16_hi[i]);
+    }
+    return crc;
+}
+
+static smuint8 crc8Bytewise( smuint8 crc, const smuint8 *buf, int len )
+{
+    while(len-->0)
+        crc=table_crc8[crc^*buf++];
+    return crc;
+}
+
+#ifdef ENABLE_FAST_CRC
+static smuint16 crc16Slicing8( smuint16 crc, const smuint8 *buf, int len )
+{
+    const smuint16 (*t)[256]=table_crc16_slice8;
+
+    while(len>=8)
+    {
+        crc^=buf[0]|(buf[1]<<8);
+        crc=t[7][crc&0xff]^t[6][crc>>8]^t[5][buf[2]]^t[4][buf[3]]^
+            t[3][buf[4]]^t[2][buf[5]]^t[1][buf[6]]^t[0][buf[7]];
+        buf+=8;
+        len-=8;
+    }
+
+    while(len-->0)
+        crc=(crc>>8)^t[0][(crc^*buf++)&0xff];
+
+    return crc;
+}
+
+static smuint8 crc8Slicing8( smuint8 crc, const smuint8 *buf, int len )
+{
+    const smuint8 (*t)[256]=table_crc8_slice8;
+
+    while(len>=8)
+    {
+        crc=t[7][crc^buf[0]]^t[6][buf[1]]^t[5][buf[2]]^t[4][buf[3]]^
+            t[3][buf[4]]^t[2][buf[5]]^t[1][buf[6]]^t[0][buf[7]];
+        buf+=8;
+        len-=8;
+    }
+
+    while(len-->0)
+        crc=t[0][crc^*buf++];
+
+    return crc;
+}
+#endif
+
+#ifdef SM_CRC_CLMUL_X86
+SM_CRC_CLMUL_TARGET static __m128i crc16Fold( __m128i x, __m128i k, __m128i next )
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x,k,0x00),_mm_clmulepi64_si128(x,k,0x11)),next);
+}
+
+//folds buffer into a 16 byte block that has same CRC remainder and finishes with table lookups
+SM_CRC_CLMUL_TARGET static smuint16 crc16CarrylessMultiply( smuint16 crc, const smuint8 *buf, int len )
+{
+    const __m128i k128=_mm_set_epi32((int)(SM_CRC16_X127>>32),0,(int)(SM_CRC16_X191>>32),0);
+    const __m128i k512=_mm_set_epi32((int)(SM_CRC16_X511>>32),0,(int)(SM_CRC16_X575>>32),0);
+    __m128i x0, x1, x2, x3;
+    smuint8 folded[16];
+
+    if(len<SM_CRC_CLMUL_MIN_LEN)
+        return crc16Slicing8(crc,buf,len);
+
+    //initial value is xored to first bytes of message
+    x0=_mm_xor_si128(_mm_loadu_si128((const __m128i*)buf),_mm_cvtsi32_si128(crc));
+    x1=_mm_loadu_si128((const __m128i*)(buf+16));
+    x2=_mm_loadu_si128((const __m128i*)(buf+32));
+    x3=_mm_loadu_si128((const __m128i*)(buf+48));
+    buf+=64;
+    len-=64;
+
+    //four independent folding chains to hide multiply latency
+    while(len>=64)
+    {
+        x0=crc16Fold(x0,k512,_mm_loadu_si128((const __m128i*)buf));
+        x1=crc16Fold(x1,k512,_mm_loadu_si128((const __m128i*)(buf+16)));
+        x2=crc16Fold(x2,k512,_mm_loadu_si128((const __m128i*)(buf+32)));
+        x3=crc16Fold(x3,k512,_mm_loadu_si128((const __m128i*)(buf+48)));
+        buf+=64;
+        len-=64;
+    }
+
+    x0=crc16Fold(x0,k128,x1);
+    x0=crc16Fold(x0,k128,x2);
+    x0=crc16Fold(x0,k128,x3);
+
+    while(len>=16)
+    {
+        x0=crc16Fold(x0,k128,_mm_loadu_si128((const __m128i*)buf));
+        buf+=16;
+        len-=16;
+    }
+
+    _mm_storeu_si128((__m128i*)folded,x0);
+    crc=crc16Slicing8(0,folded,16);
+    return crc16Slicing8(crc,buf,len);
+}
+
+static smbool crcCarrylessMultiplySupported()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info,1);
+    return (info[2]&(1<<1)) && (info[3]&(1<<26)) ? smtrue : smfalse;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if(__get_cpuid(1,&eax,&ebx,&ecx,&edx)==0)
+        return smfalse;
+    return (ecx&bit_PCLMUL) && (edx&bit_SSE2) ? smtrue : smfalse;
+#endif
+}
+#elif defined(SM_CRC_CLMUL_ARM)
+static uint64x2_t crc16Fold( uint64x2_t x, poly64_t kLow, poly64_t kHigh, uint64x2_t next )
+{
+    uint64x2_t lo=vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(x,0),kLow));
+    uint64x2_t hi=vreinterpretq_u64_p128(vmull_p64((poly64_t)vgetq_lane_u64(x,1),kHigh));
+    return veorq_u64(veorq_u64(lo,hi),next);
+}
+
+//same algorithm as x86 version above
+static smuint16 crc16CarrylessMultiply( smuint16 crc, const smuint8 *buf, int len )
+{
+    uint64x2_t x0, x1, x2, x3;
+    smuint8 folded[16];
+
+    if(len<SM_CRC_CLMUL_MIN_LEN)
+        return crc16Slicing8(crc,buf,len);
+
+    x0=veorq_u64(vld1q_u64((const uint64_t*)buf),vcombine_u64(vcreate_u64(crc),vcreate_u64(0)));
+    x1=vld1q_u64((const uint64_t*)(buf+16));
+    x2=vld1q_u64((const uint64_t*)(buf+32));
+    x3=vld1q_u64((const uint64_t*)(buf+48));
+    buf+=64;
+    len-=64;
+
+    while(len>=64)
+    {
+        x0=crc16Fold(x0,SM_CRC16_X575,SM_CRC16_X511,vld1q_u64((const uint64_t*)buf));
+        x1=crc16Fold(x1,SM_CRC16_X575,SM_CRC16_X511,vld1q_u64((const uint64_t*)(buf+16)));
+        x2=crc16Fold(x2,SM_CRC16_X575,SM_CRC16_X511,vld1q_u64((const uint64_t*)(buf+32)));
+        x3=crc16Fold(x3,SM_CRC16_X575,SM_CRC16_X511,vld1q_u64((const uint64_t*)(buf+48)));
+        buf+=64;
+        len-=64;
+    }
+
+    x0=crc16Fold(x0,SM_CRC16_X191,SM_CRC16_X127,x1);
+    x0=crc16Fold(x0,SM_CRC16_X191,SM_CRC16_X127,x2);
+    x0=crc16Fold(x0,SM_CRC16_X191,SM_CRC16_X127,x3);
+
+    while(len>=16)
+    {
+        x0=crc16Fold(x0,SM_CRC16_X191,SM_CRC16_X127,vld1q_u64((const uint64_t*)buf));
+        buf+=16;
+        len-=16;
+    }
+
+    vst1q_u64((uint64_t*)folded,x0);
+    crc=crc16Slicing8(0,folded,16);
+    return crc16Slicing8(crc,buf,len);
+}
+
+static smbool crcCarrylessMultiplySupported()
+{
+    return smtrue;
+}
+#endif
+
+smbool smSetCRCImplementation( SMCRCImplementation implementation )
+{
+    switch(implementation)
+    {
+    case SMCRCImplementationBytewise:
+        crc16Kernel=crc16Bytewise;
+        crc8Kernel=crc8Bytewise;
+        break;
+#ifdef ENABLE_FAST_CRC
+    case SMCRCImplementationSlicing8:
+        crc16Kernel=crc16Slicing8;
+        crc8Kernel=crc8Slicing8;
+        break;
+#endif
+#if defined(SM_CRC_CLMUL_X86) || defined(SM_CRC_CLMUL_ARM)
+    case SMCRCImplementationCarrylessMultiply:
+        if(crcCarrylessMultiplySupported()==smfalse)
+            return smfalse;
+        crc16Kernel=crc16CarrylessMultiply;
+        crc8Kernel=crc8Slicing8;//fast update cycle frames are too short to benefit from folding
+        break;
+#endif
+    default:
+        return smfalse;
+    }
+
+    crcImplementation=implementation;
+    return smtrue;
+}
+
+//select the fastest supported implementation
+static void crcSelectImplementation()
+{
+    if(smSetCRCImplementation(SMCRCImplementationCarrylessMultiply)==smtrue)
+        return;
+    if(smSetCRCImplementation(SMCRCImplementationSlicing8)==smtrue)
+        return;
+    smSetCRCImplementation(SMCRCImplementationBytewise);
+}
+
+SMCRCImplementation smGetCRCImplementation()
+{
+    if(crc16Kernel==crc16Resolve)
+        crcSelectImplementation();
+    return crcImplementation;
+}
+
+static smuint16 crc16Resolve( smuint16 crc, const smuint8 *buf, int len )
+{
+    crcSelectImplementation();
+    return crc16Kernel(crc,buf,len);
+}
+
+static smuint8 crc8Resolve( smuint8 crc, const smuint8 *buf, int len )
+{
+    crcSelectImplementation();
+    return crc8Kernel(crc,buf,len);
+}
+
+smuint16 calcCRC16(smuint8 data, smuint16 crc)
+{
+    unsigned int i; /* will index into CRC lookup */
+
+    i = (crc>>8) ^ data; /* calculate the CRC  */
+    crc = (((crc&0xff) ^ table_crc16_hi[i])<<8) | table_crc16_lo[i];
+
+    return crc;
+}
+
+smuint16 calcCRC16Update( smuint16 crc, const smuint8 *buf, int len )
+{
+    crc=(smuint16)((crc>>8)|(crc<<8));
+    crc=crc16Kernel(crc,buf,len);
+    return (smuint16)((crc>>8)|(crc<<8));
+}
+
+smuint16 calcCRC16Buf(const char *buffer, smuint16 buffer_length)
+{
+    return calcCRC16Update(0xffff,(const smuint8*)buffer,buffer_length);
+}
+
+smuint8 calcCRC8Buf( smuint8 *buf, int len, int crcinit )
+{
+    return crc8Kernel((smuint8)crcinit,buf,len);
+}
@@ -0,0 +1,358 @@
+//Cyclic polling of device parameters, see telemetry.h
+//Copyright (c) Granite Devices Oy
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "telemetry.h"
+#include "sharedtelemetry.h"
+#include "transactiontemplate.h"
+#include "simplemotion_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+//polling worker thread. on other platforms application calls smTelemetryPoll from its own loop
+#define SM_TELEMETRY_THREAD
+#endif
+
+typedef struct
+{
+    smuint32 periodMs;
+    smuint64 nextDueNs;
+    smbool due;//set during poll
+} SMTelemetryRateGroup;
+
+//snapshot slot of one item. sample is written by the poll thread only, sequence is odd while it's being written (seqlock)
+typedef struct
+{
+    volatile smuint32 sequence;
+    SM_TELEMETRY_SAMPLE sample;
+} SMTelemetrySlot;
+
+typedef struct
+{
+    smaddr nodeAddress;
+    smint16 paramAddress;
+    int rateGroup;
+    int sharedSlot;//slot in publisher
+} SMTelemetryItem;
+
+struct _SMTelemetry
+{
+    smbus handle;
+    SMTelemetryItem items[SM_TELEMETRY_MAX_ITEMS];
+    SMTelemetrySlot slots[SM_TELEMETRY_MAX_ITEMS];
+    int numItems;
+    SMTelemetryRateGroup groups[SM_TELEMETRY_MAX_RATE_GROUPS];
+    int numGroups;
+    SMSharedTelemetry *publisher;//NULL if not publishing
+
+#ifdef SM_TELEMETRY_THREAD
+    pthread_mutex_t busLock;//held while polling
+    pthread_mutex_t lock;//protects running and stopWorker
+    pthread_cond_t wake;
+    pthread_t worker;
+    smbool stopWorker;
+#endif
+    smbool running;
+};
+
+static void smTelemetryWriteSlot( SMTelemetrySlot *slot, const SM_TELEMETRY_SAMPLE *sample )
+{
+    slot->sequence++;
+    SM_MEMORY_BARRIER();
+    slot->sample=*sample;
+    SM_MEMORY_BARRIER();
+    slot->sequence++;
+}
+
+LIB SM_STATUS smTelemetryRead( const SMTelemetry *telemetry, int item, SM_TELEMETRY_SAMPLE *sample )
+{
+    const SMTelemetrySlot *slot;
+    smuint32 before, after;
+
+    if(item<0 || item>=telemetry->numItems) return SM_ERR_PARAMETER;
+    slot=&telemetry->slots[item];
+
+    //retry if writer updated the slot during copy
+    do
+    {
+        before=slot->sequence;
+        SM_MEMORY_BARRIER();
+        *sample=slot->sample;
+        SM_MEMORY_BARRIER();
+        after=slot->sequence;
+    } while((before&1) || before!=after);
+
+    return SM_OK;
+}
+
+LIB SMTelemetry *smTelemetryCreate( const smbus handle )
+{
+    SMTelemetry *telemetry;
+
+    if(smAttachBusUser(handle)!=SM_OK) return NULL;
+    telemetry=(SMTelemetry*)calloc(1,sizeof(SMTelemetry));
+    if(telemetry==NULL)
+    {
+        smDetachBusUser(handle);
+        return NULL;
+    }
+
+    telemetry->handle=handle;
+#ifdef SM_TELEMETRY_THREAD
+    pthread_mutex_init(&telemetry->busLock,NULL);
+    pthread_mutex_init(&telemetry->lock,NULL);
+    smCondInit(&telemetry->wake);
+#endif
+    return telemetry;
+}
+
+LIB void smTelemetryDestroy( SMTelemetry *telemetry )
+{
+    if(telemetry==NULL) return;
+
+    smTelemetryStop(telemetry);
+#ifdef SM_TELEMETRY_THREAD
+    pthread_cond_destroy(&telemetry->wake);
+    pthread_mutex_destroy(&telemetry->lock);
+    pthread_mutex_destroy(&telemetry->busLock);
+#endif
+    smDetachBusUser(telemetry->handle);
+    free(telemetry);
+}
+
+LIB int smTelemetryAddItem( SMTelemetry *telemetry, const smaddr nodeAddress, const smint16 paramAddress, smuint32 periodMs )
+{
+    SMTelemetryItem *item;
+    int group, sharedSlot=-1;
+
+    if(telemetry->running==smtrue || telemetry->numItems>=SM_TELEMETRY_MAX_ITEMS) return -1;
+    if(periodMs<1 || periodMs>60000 || nodeAddress==0) return -1;
+
+    if(telemetry->publisher!=NULL)
+    {
+        sharedSlot=smSharedTelemetryAddSlot(telemetry->publisher,nodeAddress,paramAddress);
+        if(sharedSlot<0) return -1;
+    }
+
+    //items with the same period are read together
+    for(group=0;group<telemetry->numGroups;group++)
+        if(telemetry->groups[group].periodMs==periodMs)
+            break;
+    if(group==telemetry->numGroups)
+    {
+        if(telemetry->numGroups>=SM_TELEMETRY_MAX_RATE_GROUPS) return -1;
+        telemetry->groups[group].periodMs=periodMs;
+        telemetry->groups[group].nextDueNs=0;//due on the next poll
+        telemetry->numGroups++;
+    }
+
+    item=&telemetry->items[telemetry->numItems];
+    item->nodeAddress=nodeAddress;
+    item->paramAddress=paramAddress;
+    item->rateGroup=group;
+    item->sharedSlot=sharedSlot;
+    telemetry->slots[telemetry->numItems].sample.status=SM_NONE;
+    return telemetry->numItems++;
+}
+
+//read due items of node in as few frames as possible. done[] marks items that have been read during this poll
+static SM_STATUS smTelemetryPollNode( SMTelemetry *telemetry, smaddr nodeAddress, int firstItem, smbool *done )
+{
+    SM_TRANSACTION_TEMPLATE tpl;
+    smint32 results[SM_TEMPLATE_MAX_READS];
+    int frameItems[SM_TEMPLATE_MAX_READS];
+    SM_STATUS result=SM_OK;
+    int i=firstItem;
+
+    while(i<telemetry->numItems)
+    {
+        SM_STATUS stat;
+        smuint64 now;
+        int numReads=0, j;
+
+        smTemplateInit(&tpl);
+        for(;i<telemetry->numItems && numReads<SM_TEMPLATE_MAX_READS;i++)
+        {
+            const SMTelemetryItem *item=&telemetry->items[i];
+            if(done[i]==smtrue || item->nodeAddress!=nodeAddress || telemetry->groups[item->rateGroup].due==smfalse)
+                continue;
+
+            smTemplateAppendGetParam(&tpl,item->paramAddress,numReads*sizeof(smint32));
+            frameItems[numReads++]=i;
+            done[i]=smtrue;
+        }
+        if(numReads==0)
+            break;
+
+        stat=smTemplateExecute(telemetry->handle,nodeAddress,&tpl,results);
+        now=smGetMonotonicTimeNs();
+        if(stat!=SM_OK)
+            result=stat;
+
+        for(j=0;j<numReads;j++)
+        {
+            SMTelemetrySlot *slot=&telemetry->slots[frameItems[j]];
+            SM_TELEMETRY_SAMPLE sample=slot->sample;
+
+            sample.status=stat;
+            if(stat==SM_OK)
+            {
+                sample.value=results[j];
+                sample.timestampNs=now;
+                sample.updates++;
+            }
+            smTelemetryWriteSlot(slot,&sample);
+            if(telemetry->publisher!=NULL)
+                smSharedTelemetryWrite(telemetry->publisher,telemetry->items[frameItems[j]].sharedSlot,&sample);
+        }
+    }
+
+    return result;
+}
+
+LIB SM_STATUS smTelemetryPoll( SMTelemetry *telemetry, smuint32 *nextDueMs )
+{
+    smbool done[SM_TELEMETRY_MAX_ITEMS];
+    SM_STATUS result=SM_OK;
+    smuint64 now=smGetMonotonicTimeNs(), nextDue;
+    int i;
+
+    for(i=0;i<telemetry->numGroups;i++)
+    {
+        SMTelemetryRateGroup *group=&telemetry->groups[i];
+        group->due=group->nextDueNs<=now ? smtrue : smfalse;
+        if(group->due==smfalse)
+            continue;
+
+        //keep phase of group unless polling has fallen behind
+        group->nextDueNs+=(smuint64)group->periodMs*1000000;
+        if(group->nextDueNs<=now)
+            group->nextDueNs=now+(smuint64)group->periodMs*1000000;
+    }
+
+    memset(done,0,sizeof(done));
+    for(i=0;i<telemetry->numItems;i++)
+    {
+        SM_STATUS stat;
+        if(done[i]==smtrue || telemetry->groups[telemetry->items[i].rateGroup].due==smfalse)
+            continue;
+
+        stat=smTelemetryPollNode(telemetry,telemetry->items[i].nodeAddress,i,done);
+        if(stat!=SM_OK)
+            result=stat;
+    }
+
+    if(nextDueMs!=NULL)
+    {
+        now=smGetMonotonicTimeNs();
+        nextDue=now+60000ULL*1000000;
+        for(i=0;i<telemetry->numGroups;i++)
+            if(telemetry->groups[i].nextDueNs<nextDue)
+                nextDue=telemetry->groups[i].nextDueNs;
+        *nextDueMs=nextDue>now ? (smuint32)((nextDue-now+999999)/1000000) : 0;
+    }
+
+    return result;
+}
+
+LIB SM_STATUS smTelemetrySetPublisher( SMTelemetry *telemetry, SMSharedTelemetry *publisher )
+{
+    int i;
+
+    if(telemetry->running==smtrue) return SM_ERR_PARAMETER;
+
+    telemetry->publisher=NULL;
+    if(publisher==NULL) return SM_OK;
+
+    for(i=0;i<telemetry->numItems;i++)
+    {
+        SMTelemetryItem *item=&telemetry->items[i];
+        item->sharedSlot=smSharedTelemetryAddSlot(publisher,item->nodeAddress,item->paramAddress);
+        if(item->sharedSlot<0) return SM_ERR_PARAMETER;
+    }
+    telemetry->publisher=publisher;
+    return SM_OK;
+}
+
+#ifdef SM_TELEMETRY_THREAD
+static void *smTelemetryWorkerThread( void *arg )
+{
+    SMTelemetry *telemetry=(SMTelemetry*)arg;
+
+    pthread_mutex_lock(&telemetry->lock);
+    while(telemetry->stopWorker==smfalse)
+    {
+        smuint32 nextDueMs;
+
+        pthread_mutex_unlock(&telemetry->lock);
+        pthread_mutex_lock(&telemetry->busLock);
+        smTelemetryPoll(telemetry,&nextDueMs);
+        pthread_mutex_unlock(&telemetry->busLock);
+        pthread_mutex_lock(&telemetry->lock);
+
+        if(nextDueMs==0 || telemetry->stopWorker==smtrue)
+            continue;
+
+        smCondWaitUntilNs(&telemetry->wake,&telemetry->lock,smGetMonotonicTimeNs()+(smuint64)nextDueMs*1000000);
+    }
+    pthread_mutex_unlock(&telemetry->lock);
+
+    return NULL;
+}
+#endif
+
+LIB SM_STATUS smTelemetryStart( SMTelemetry *telemetry )
+{
+#ifdef SM_TELEMETRY_THREAD
+    if(telemetry->running==smtrue) return SM_ERR_PARAMETER;
+
+    telemetry->stopWorker=smfalse;
+    if(pthread_create(&telemetry->worker,NULL,smTelemetryWorkerThread,telemetry)!=0)
+    {
+        smDebug(telemetry->handle,SMDebugLow,"Telemetry: unable to start worker thread\n");
+        return SM_ERR_PARAMETER;
+    }
+    telemetry->running=smtrue;
+    return SM_OK;
+#else
+    return SM_ERR_PARAMETER;
+#endif
+}
+
+LIB SM_STATUS smTelemetryStop( SMTelemetry *telemetry )
+{
+#ifdef SM_TELEMETRY_THREAD
+    if(telemetry->running==smfalse) return SM_OK;
+
+    pthread_mutex_lock(&telemetry->lock);
+    telemetry->stopWorker=smtrue;
+    pthread_cond_signal(&telemetry->wake);
+    pthread_mutex_unlock(&telemetry->lock);
+    pthread_join(telemetry->worker,NULL);
+    telemetry->running=smfalse;
+#endif
+    return SM_OK;
+}
+
+LIB void smTelemetryLockBus( SMTelemetry *telemetry )
+{
+#ifdef SM_TELEMETRY_THREAD
+    pthread_mutex_lock(&telemetry->busLock);
+#else
+    (void)telemetry;
+#endif
+}
+
+LIB void smTelemetryUnlockBus( SMTelemetry *telemetry )
+{
+#ifdef SM_TELEMETRY_THREAD
+    pthread_mutex_unlock(&telemetry->busLock);
+#else
+    (void)telemetry;
+#endif
+}
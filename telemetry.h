@@ -0,0 +1,88 @@
+//Cyclic polling of device parameters
+//Copyright (c) Granite Devices Oy
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Telemetry engine reads registered parameters of devices of one bus periodically, i.e. SMP_STATUS and SMP_FAULTS at
+ * 100ms and positions at 10ms. Parameters with the same period form a rate group that is read at the same time.
+ * Due parameters of the same device are read with as few frames as possible (up to 14 parameters per frame, see
+ * transactiontemplate.h).
+ *
+ * Latest value of each parameter is stored with a timestamp to a snapshot that can be read from any thread without
+ * locking with smTelemetryRead, while values are being updated by smTelemetryPoll or the worker thread started with
+ * smTelemetryStart.
+ *
+ * I.e.:
+ *  SMTelemetry *telemetry=smTelemetryCreate(handle);
+ *  int status=smTelemetryAddItem(telemetry,1,SMP_STATUS,100);
+ *  int position=smTelemetryAddItem(telemetry,1,SMP_ACTUAL_POSITION_FB,10);
+ *  smTelemetryStart(telemetry);
+ *  ...
+ *  SM_TELEMETRY_SAMPLE sample;
+ *  smTelemetryRead(telemetry,position,&sample);
+ */
+
+//max number of parameters and rate groups of one telemetry engine
+#define SM_TELEMETRY_MAX_ITEMS 256
+#define SM_TELEMETRY_MAX_RATE_GROUPS 16
+
+typedef struct _SMTelemetry SMTelemetry;
+
+typedef struct
+{
+    smint32 value;//latest successfully read value
+    smuint64 timestampNs;//time when value was received (smGetMonotonicTimeNs clock), 0 if value has not been read yet
+    smuint32 updates;//number of successful reads
+    SM_STATUS status;//status of the latest read, value and timestamp are kept if read failed
+} SM_TELEMETRY_SAMPLE;
+
+/** Create telemetry engine for an opened bus. Bus can't be closed until engine is destroyed.
+ * Returns NULL if bus is not open or out of memory. */
+LIB SMTelemetry *smTelemetryCreate( const smbus handle );
+
+/** Stop worker thread if running and free engine */
+LIB void smTelemetryDestroy( SMTelemetry *telemetry );
+
+/** Register parameter to be read every periodMs milliseconds (1-60000). Items can be added only while worker thread is not running.
+  -return value: index of item for smTelemetryRead, -1 if engine is full, running or arguments are invalid
+*/
+LIB int smTelemetryAddItem( SMTelemetry *telemetry, const smaddr nodeAddress, const smint16 paramAddress, smuint32 periodMs );
+
+/** Read parameters that are due now. For applications that run their own loop instead of smTelemetryStart, must not be
+ * called while worker thread is running.
+ * -nextDueMs: if not NULL, set to milliseconds until the next parameters are due
+  -return value: SM_OK if all reads succeeded, otherwise status of a failed read
+*/
+LIB SM_STATUS smTelemetryPoll( SMTelemetry *telemetry, smuint32 *nextDueMs );
+
+/** Start worker thread that calls smTelemetryPoll on time. Other threads must access the bus only between
+ * smTelemetryLockBus and smTelemetryUnlockBus while worker is running. Worker thread is supported on Linux and macOS.
+  -return value: SM_OK if started, SM_ERR_PARAMETER if already running or not supported on the platform
+*/
+LIB SM_STATUS smTelemetryStart( SMTelemetry *telemetry );
+
+/** Stop worker thread and wait until it has exited */
+LIB SM_STATUS smTelemetryStop( SMTelemetry *telemetry );
+
+/** Get exclusive access to the bus of engine, i.e. for smSetParameter calls while worker thread is running. Waits until
+ * the ongoing poll has finished. */
+LIB void smTelemetryLockBus( SMTelemetry *telemetry );
+LIB void smTelemetryUnlockBus( SMTelemetry *telemetry );
+
+/** Get latest value of item. Can be called from any thread at any time, doesn't block or access the bus.
+  -return value: SM_OK or SM_ERR_PARAMETER if item index is invalid
+*/
+LIB SM_STATUS smTelemetryRead( const SMTelemetry *telemetry, int item, SM_TELEMETRY_SAMPLE *sample );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
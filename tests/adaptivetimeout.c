@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../drivers/simulator/smsimulator.h"
+
+static smuint32 elapsed_ms(smuint64 start) {
+	return (smuint32)((smGetMonotonicTimeNs() - start) / 1000000);
+}
+
+int main(void) {
+	smbus h;
+	smint32 value;
+	smuint32 average, deviation;
+	smuint64 start;
+	int i;
+
+	assert(smSetTimeout(300) == SM_OK);
+	smSetSimulatorTiming(smtrue, 200);
+	h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	{
+		// invalid limits
+		assert(smSetAdaptiveTimeout(h, smtrue, 0, 100) == SM_ERR_PARAMETER);
+		assert(smSetAdaptiveTimeout(h, smtrue, 50, 20) == SM_ERR_PARAMETER);
+		assert(smSetAdaptiveTimeout(h, smtrue, 5, 6000) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// latency of each node is measured from replies
+		assert(smSetAdaptiveTimeout(h, smtrue, 5, 300) == SM_OK);
+		assert(smGetNodeLatency(h, 1, &average, &deviation) == SM_ERR_PARAMETER);
+		for (i = 0; i < 10; i++) {
+			assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) == SM_OK);
+			assert(value == 28);
+		}
+		assert(smGetNodeLatency(h, 1, &average, &deviation) == SM_OK);
+		assert(average >= 100 && average < 50000);
+		assert(smGetNodeLatency(h, 2, NULL, NULL) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// missing node fails fast based on latency of the bus, other nodes keep working
+		start = smGetMonotonicTimeNs();
+		assert(smRead1Parameter(h, 3, SMP_SM_VERSION, &value) != SM_OK);
+		assert(elapsed_ms(start) < 150);
+		resetCumulativeStatus(h);
+
+		assert(smRead1Parameter(h, 2, SMP_SM_VERSION, &value) == SM_OK);
+		assert(smGetNodeLatency(h, 2, NULL, NULL) == SM_OK);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	{
+		// fast update cycle and buffer clock are also covered
+		smuint16 read1, read2, clock;
+		assert(smFastUpdateCycle(h, 1, 0, 0, &read1, &read2) == SM_OK);
+		assert(smGetBufferClock(h, 1, &clock) == SM_OK);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	{
+		// disabled: missing node waits the full timeout
+		assert(smSetAdaptiveTimeout(h, smfalse, 0, 0) == SM_OK);
+		start = smGetMonotonicTimeNs();
+		assert(smRead1Parameter(h, 3, SMP_SM_VERSION, &value) != SM_OK);
+		assert(elapsed_ms(start) >= 290);
+		resetCumulativeStatus(h);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,508 @@
+/*
+ * smbench.c
+ *
+ * Microbenchmarks of the protocol hot paths. Not a test case, built and run with "make bench"
+ * (optimized, without sanitizers). Usage:
+ *
+ *   smbench [--csv] [--time <ms>] [name filter]
+ *
+ * Each benchmark is repeated until it has run at least --time milliseconds (default 200).
+ * Results are printed as a table, or with --csv as machine readable lines of
+ * name,iterations,ns_per_op,bytes_per_op,mbytes_per_s so that results of different builds
+ * can be compared with a script.
+ *
+ * Bus dependent benchmarks use the simulator driver so no hardware is needed.
+ */
+
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../../simplemotion.h"
+#include "../../simplemotion_private.h"
+#include "../../sm485.h"
+#include "../../devicedeployment.h"
+#include "../../transactiontemplate.h"
+#include "../../drivers/simulator/smsimulator.h"
+#include "crc.h"
+
+#define BENCH_DATA_LEN 4096
+#define BENCH_GDF_PAYLOAD_LEN (1024*1024)
+#define BENCH_DRC_PARAMS 1000
+
+typedef struct
+{
+    const char *name;
+    void (*run)( long iterations );
+    long bytesPerOp;
+} Benchmark;
+
+static smbus benchBus=-1;
+static smuint8 benchData[BENCH_DATA_LEN];
+static smuint8 replyFrame[SM485_MAX_PAYLOAD_BYTES+5];
+static int replyFrameLen;
+static int replyValues;
+static smuint8 *drcData;
+static int drcDataLen;
+static smuint8 *gdfData;
+static int gdfDataLen;
+static SM_TRANSACTION_TEMPLATE cycleTemplate;
+static int cycleSetpoint;
+
+//values read by polling cycle benchmarks
+typedef struct
+{
+    smint32 position, velocity, torque, status;
+} CycleFeedback;
+
+//results are accumulated here so that compiler can't optimize benchmarked code away
+static volatile smuint32 sink;
+
+static void benchCRC16Byte( long iterations )
+{
+    long n;
+    int i;
+    for(n=0;n<iterations;n++)
+    {
+        smuint16 crc=SM485_CRCINIT;
+        for(i=0;i<BENCH_DATA_LEN;i++)
+            crc=calcCRC16(benchData[i],crc);
+        sink+=crc;
+    }
+}
+
+static void benchCRC16Frame( long iterations )
+{
+    long n;
+    int i;
+    for(n=0;n<iterations;n++)
+    {
+        smuint16 crc=SM485_CRCINIT;
+        for(i=0;i<replyFrameLen-2;i++)
+            crc=calcCRC16(replyFrame[i],crc);
+        sink+=crc;
+    }
+}
+
+static void benchCRC16Buf( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+        sink+=calcCRC16Buf((const char*)benchData,BENCH_DATA_LEN);
+}
+
+static void benchCRC16Update( long iterations, SMCRCImplementation implementation )
+{
+    SMCRCImplementation previous=smGetCRCImplementation();
+    long n;
+
+    if(smSetCRCImplementation(implementation)==smfalse)
+        return;
+    for(n=0;n<iterations;n++)
+        sink+=calcCRC16Update(SM485_CRCINIT,benchData,BENCH_DATA_LEN);
+    smSetCRCImplementation(previous);
+}
+
+static smbool crcImplementationSupported( SMCRCImplementation implementation )
+{
+    SMCRCImplementation previous=smGetCRCImplementation();
+    smbool supported=smSetCRCImplementation(implementation);
+    smSetCRCImplementation(previous);
+    return supported;
+}
+
+static void benchCRC16UpdateBytewise( long iterations )
+{
+    benchCRC16Update(iterations,SMCRCImplementationBytewise);
+}
+
+static void benchCRC16UpdateSlicing8( long iterations )
+{
+    benchCRC16Update(iterations,SMCRCImplementationSlicing8);
+}
+
+static void benchCRC16UpdateCarrylessMultiply( long iterations )
+{
+    benchCRC16Update(iterations,SMCRCImplementationCarrylessMultiply);
+}
+
+static void benchCRC8Buf( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+        sink+=calcCRC8Buf(benchData,BENCH_DATA_LEN,0x52);
+}
+
+//fills one full command queue with 13 write address/24 bit/32 bit subpacket triplets (117 bytes)
+static void benchQueueAppend( long iterations )
+{
+    long n;
+    int i;
+    for(n=0;n<iterations;n++)
+    {
+        smResetSM485variables(benchBus);
+        for(i=0;i<13;i++)
+        {
+            smAppendSMCommandToQueue(benchBus,SM_SET_WRITE_ADDRESS,SMP_ABSOLUTE_SETPOINT+i);
+            smAppendSMCommandToQueue(benchBus,SM_WRITE_VALUE_24B,-1000*i);
+            smAppendSMCommandToQueue(benchBus,SM_WRITE_VALUE_32B,100000*i);
+        }
+    }
+}
+
+static void parseReplyFrame()
+{
+    int i;
+    smResetSM485variables(benchBus);
+    for(i=0;i<replyFrameLen;i++)
+        smParseReturnData(benchBus,replyFrame[i]);
+}
+
+static void benchFrameParse( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+        parseReplyFrame();
+}
+
+static void benchFrameParseDecode( long iterations )
+{
+    long n;
+    int i;
+    for(n=0;n<iterations;n++)
+    {
+        smint32 value;
+        parseReplyFrame();
+        for(i=0;i<replyValues;i++)
+        {
+            smGetQueuedSMCommandReturnValue(benchBus,&value);
+            sink+=value;
+        }
+    }
+}
+
+static void benchFrameParseDecodeBulk( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+    {
+        smint32 values[SM485_MAX_PAYLOAD_BYTES], numValues;
+        parseReplyFrame();
+        smGetQueuedSMCommandReturnValues(benchBus,values,NULL,SM485_MAX_PAYLOAD_BYTES,&numValues);
+        sink+=values[numValues-1];
+    }
+}
+
+//decoding of reply payload without frame parsing
+static void benchDecodeBulk( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+    {
+        smint32 values[SM485_MAX_PAYLOAD_BYTES];
+        int numValues;
+        smDecodeReturnValues(&replyFrame[3],replyFrame[1],values,NULL,SM485_MAX_PAYLOAD_BYTES,&numValues);
+        sink+=values[numValues-1];
+    }
+}
+
+//polling cycle of simulated node: write setpoint and read 4 parameters with command queue
+static void benchCycleQueue( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+    {
+        CycleFeedback fb;
+        smAppendSetParamCommandToQueue(benchBus,SMP_ABSOLUTE_SETPOINT,(smint32)n);
+        smAppendGetParamCommandToQueue(benchBus,SMP_ACTUAL_POSITION_FB);
+        smAppendGetParamCommandToQueue(benchBus,SMP_ACTUAL_VELOCITY_FB);
+        smAppendGetParamCommandToQueue(benchBus,SMP_ACTUAL_TORQUE);
+        smAppendGetParamCommandToQueue(benchBus,SMP_STATUS);
+        smExecuteCommandQueue(benchBus,1);
+        smGetQueuedSetParamReturnValue(benchBus,NULL);
+        smGetQueuedGetParamReturnValue(benchBus,&fb.position);
+        smGetQueuedGetParamReturnValue(benchBus,&fb.velocity);
+        smGetQueuedGetParamReturnValue(benchBus,&fb.torque);
+        smGetQueuedGetParamReturnValue(benchBus,&fb.status);
+        sink+=fb.position;
+    }
+}
+
+//same cycle with transaction template
+static void benchCycleTemplate( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+    {
+        CycleFeedback fb;
+        smTemplateSetValue(&cycleTemplate,cycleSetpoint,(smint32)n);
+        smTemplateExecute(benchBus,1,&cycleTemplate,&fb);
+        sink+=fb.position;
+    }
+}
+
+static void benchDRCLoad( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+    {
+        int skipped, errors;
+        LoadConfigurationStatus stat=smLoadConfigurationFromBuffer(benchBus,1,drcData,drcDataLen,0,&skipped,&errors);
+        assert(stat==CFGComplete);
+    }
+}
+
+static void benchGDFVerify( long iterations )
+{
+    long n;
+    for(n=0;n<iterations;n++)
+    {
+        //file is valid but targeted to another device type, so upload stops right after file checksum verification
+        FirmwareUploadStatus stat=smFirmwareUploadFromBuffer(benchBus,1,gdfData,gdfDataLen);
+        assert(stat==FWUnsupportedTargetDevice);
+    }
+}
+
+static void appendReturnValue( int type, smint32 value )
+{
+    smuint8 *payload=&replyFrame[3];
+    int *len=&replyFrameLen;
+    int bytes=(type==SMPRET_32B) ? 4 : (type==SMPRET_24B) ? 3 : (type==SMPRET_16B) ? 2 : 1;
+    int i;
+
+    for(i=bytes-1;i>=0;i--)
+        payload[(*len)++]=(smuint8)(value>>(8*i));
+    payload[*len-bytes]=(smuint8)((payload[*len-bytes]&0x3f)|(type<<6));
+    replyValues++;
+}
+
+//SMCMD_INSTANT_CMD_RET frame with 12 groups of 32, 24, 16 bit and status return values (120 bytes payload)
+static void buildReplyFrame()
+{
+    smuint16 crc=SM485_CRCINIT;
+    int i, payloadLen;
+
+    replyFrameLen=0;
+    replyValues=0;
+    for(i=0;i<12;i++)
+    {
+        appendReturnValue(SMPRET_32B,-100000*i);
+        appendReturnValue(SMPRET_24B,1000*i);
+        appendReturnValue(SMPRET_16B,-10*i);
+        appendReturnValue(SMPRET_CMD_STATUS,SMP_CMD_STATUS_ACK);
+    }
+    payloadLen=replyFrameLen;
+
+    replyFrame[0]=SMCMD_INSTANT_CMD_RET;
+    replyFrame[1]=(smuint8)payloadLen;
+    replyFrame[2]=1;
+    replyFrameLen=payloadLen+3;
+    for(i=0;i<replyFrameLen;i++)
+        crc=calcCRC16(replyFrame[i],crc);
+    replyFrame[replyFrameLen++]=crc>>8;
+    replyFrame[replyFrameLen++]=crc&0xff;
+}
+
+//DRC file with BENCH_DRC_PARAMS read-only parameters. read-only parameters are not written to device
+//so loading time is dominated by parsing
+static void buildDRCFile()
+{
+    int capacity=BENCH_DRC_PARAMS*200+1000;
+    int i;
+
+    drcData=malloc(capacity);
+    assert(drcData!=NULL);
+    drcDataLen=snprintf((char*)drcData,capacity,"[General]\nDRCVersion=111\nFileFeatureBits=1\nFileFeatureBitsEssential=1\n\n[Parameters]\n");
+    for(i=1;i<BENCH_DRC_PARAMS;i++)
+        drcDataLen+=snprintf((char*)drcData+drcDataLen,capacity-drcDataLen,
+                             "%d\\addr=%d\n%d\\name=Benchmark parameter %d\n%d\\offset=0\n%d\\readonly=true\n%d\\scaling=1\n%d\\unit=\n%d\\value=%d\n",
+                             i,1000+i,i,i,i,i,i,i,i,i*3);
+    drcDataLen+=snprintf((char*)drcData+drcDataLen,capacity-drcDataLen,"size=%d\n",BENCH_DRC_PARAMS);
+    assert(drcDataLen<capacity);
+}
+
+static void gdfPut32( smuint8 **p, smuint32 value )
+{
+    memcpy(*p,&value,4);
+    *p+=4;
+}
+
+//GDF v400 file with BENCH_GDF_PAYLOAD_LEN bytes of main MCU firmware for device type ID range 11000-11200
+static void buildGDFFile()
+{
+    smuint8 *p;
+    smuint16 version=400;
+    crc fileCRC;
+    int i;
+
+    gdfDataLen=4+2+2+4+4 + (4+2+4+4+4+BENCH_GDF_PAYLOAD_LEN) + (4+2+4+4+4+8) + 4;
+    gdfData=malloc(gdfDataLen);
+    assert(gdfData!=NULL);
+    p=gdfData;
+    memcpy(p,"GDFW",4); p+=4;
+    memcpy(p,&version,2); p+=2;
+    memcpy(p,&version,2); p+=2;
+    gdfPut32(&p,100);
+    gdfPut32(&p,2);
+
+    gdfPut32(&p,2); memcpy(p,"FW",2); p+=2;
+    gdfPut32(&p,100);
+    gdfPut32(&p,0);
+    gdfPut32(&p,BENCH_GDF_PAYLOAD_LEN);
+    for(i=0;i<BENCH_GDF_PAYLOAD_LEN;i++)
+        *p++=(smuint8)(i*7+(i>>9));
+
+    gdfPut32(&p,2); memcpy(p,"ID",2); p+=2;
+    gdfPut32(&p,50);
+    gdfPut32(&p,0);
+    gdfPut32(&p,8);
+    gdfPut32(&p,11000);
+    gdfPut32(&p,11200);
+
+    crcInit();
+    fileCRC=crcFast(gdfData,(int)(p-gdfData));
+    gdfPut32(&p,fileCRC);
+    assert(p-gdfData==gdfDataLen);
+}
+
+static const Benchmark benchmarks[]=
+{
+    {"crc16_byte",benchCRC16Byte,BENCH_DATA_LEN},
+    {"crc16_frame",benchCRC16Frame,SM485_MAX_PAYLOAD_BYTES+3},
+    {"crc16_buf",benchCRC16Buf,BENCH_DATA_LEN},
+    {"crc16_update_bytewise",benchCRC16UpdateBytewise,BENCH_DATA_LEN},
+    {"crc16_update_slicing8",benchCRC16UpdateSlicing8,BENCH_DATA_LEN},
+    {"crc16_update_clmul",benchCRC16UpdateCarrylessMultiply,BENCH_DATA_LEN},
+    {"crc8_buf",benchCRC8Buf,BENCH_DATA_LEN},
+    {"queue_append",benchQueueAppend,117},
+    {"frame_parse",benchFrameParse,SM485_MAX_PAYLOAD_BYTES+5},
+    {"frame_parse_decode",benchFrameParseDecode,SM485_MAX_PAYLOAD_BYTES+5},
+    {"frame_parse_decode_bulk",benchFrameParseDecodeBulk,SM485_MAX_PAYLOAD_BYTES+5},
+    {"decode_bulk",benchDecodeBulk,SM485_MAX_PAYLOAD_BYTES},
+    {"cycle_queue",benchCycleQueue,0},
+    {"cycle_template",benchCycleTemplate,0},
+    {"drc_load",benchDRCLoad,0},
+    {"gdf_verify",benchGDFVerify,0}
+};
+
+//runs benchmark with increasing iteration count until it takes at least minTimeNs. returns ns per iteration
+static double runBenchmark( const Benchmark *bench, smuint64 minTimeNs, long *iterationsOut )
+{
+    long iterations=1;
+    smuint64 elapsed;
+
+    bench->run(1);//warm up caches and lazy initializations
+
+    for(;;)
+    {
+        smuint64 start=smGetMonotonicTimeNs();
+        bench->run(iterations);
+        elapsed=smGetMonotonicTimeNs()-start;
+
+        if(elapsed>=minTimeNs)
+            break;
+
+        //aim for 1.2x minimum time, but grow at most 100x per round
+        if(elapsed==0)
+            iterations*=100;
+        else if(elapsed*100<minTimeNs)
+            iterations*=100;
+        else
+            iterations=(long)((double)iterations*1.2*minTimeNs/elapsed)+1;
+    }
+
+    *iterationsOut=iterations;
+    return (double)elapsed/iterations;
+}
+
+int main( int argc, char *argv[] )
+{
+    smbool csv=smfalse;
+    const char *filter=NULL;
+    smuint64 minTimeNs=200000000;
+    unsigned int i;
+    int arg;
+
+    for(arg=1;arg<argc;arg++)
+    {
+        if(strcmp(argv[arg],"--csv")==0)
+            csv=smtrue;
+        else if(strcmp(argv[arg],"--time")==0 && arg+1<argc)
+            minTimeNs=(smuint64)atoi(argv[++arg])*1000000;
+        else if(argv[arg][0]!='-')
+            filter=argv[arg];
+        else
+        {
+            fprintf(stderr,"Usage: %s [--csv] [--time <ms>] [name filter]\n",argv[0]);
+            return 1;
+        }
+    }
+
+    for(i=0;i<BENCH_DATA_LEN;i++)
+        benchData[i]=(smuint8)(i*31+(i>>8));
+    buildReplyFrame();
+    buildDRCFile();
+    buildGDFFile();
+
+    benchBus=smOpenBusWithCallbacks("SIM",simulatorPortOpen,simulatorPortClose,simulatorPortRead,simulatorPortWrite,simulatorPortMiscOperation);
+    assert(benchBus>=0);
+
+    smTemplateInit(&cycleTemplate);
+    cycleSetpoint=smTemplateAppendSetParam(&cycleTemplate,SMP_ABSOLUTE_SETPOINT,0);
+    smTemplateAppendGetParam(&cycleTemplate,SMP_ACTUAL_POSITION_FB,offsetof(CycleFeedback,position));
+    smTemplateAppendGetParam(&cycleTemplate,SMP_ACTUAL_VELOCITY_FB,offsetof(CycleFeedback,velocity));
+    smTemplateAppendGetParam(&cycleTemplate,SMP_ACTUAL_TORQUE,offsetof(CycleFeedback,torque));
+    smTemplateAppendGetParam(&cycleTemplate,SMP_STATUS,offsetof(CycleFeedback,status));
+
+    //sanity check of the decoding benchmark input
+    {
+        smint32 value;
+        parseReplyFrame();
+        assert(smGetQueuedSMCommandReturnValue(benchBus,&value)==SM_OK && value==0);
+        assert(smGetQueuedSMCommandReturnValue(benchBus,&value)==SM_OK && value==0);
+        assert(smGetQueuedSMCommandReturnValue(benchBus,&value)==SM_OK && value==0);
+        assert(smGetQueuedSMCommandReturnValue(benchBus,&value)==SM_OK && value==SMP_CMD_STATUS_ACK);
+    }
+
+    if(csv)
+        printf("name,iterations,ns_per_op,bytes_per_op,mbytes_per_s\n");
+    else
+        printf("%-24s %12s %14s %12s\n","benchmark","iterations","ns/op","MB/s");
+
+    for(i=0;i<sizeof(benchmarks)/sizeof(benchmarks[0]);i++)
+    {
+        const Benchmark *bench=&benchmarks[i];
+        long iterations, bytesPerOp;
+        double nsPerOp, mbytesPerSec;
+
+        if(filter!=NULL && strstr(bench->name,filter)==NULL)
+            continue;
+        if(bench->run==benchCRC16UpdateSlicing8 && crcImplementationSupported(SMCRCImplementationSlicing8)==smfalse)
+            continue;
+        if(bench->run==benchCRC16UpdateCarrylessMultiply && crcImplementationSupported(SMCRCImplementationCarrylessMultiply)==smfalse)
+            continue;
+
+        nsPerOp=runBenchmark(bench,minTimeNs,&iterations);
+        bytesPerOp=bench->bytesPerOp;
+        if(bench->run==benchDRCLoad)
+            bytesPerOp=drcDataLen;
+        else if(bench->run==benchGDFVerify)
+            bytesPerOp=gdfDataLen;
+        mbytesPerSec=nsPerOp>0 ? bytesPerOp*1000.0/nsPerOp : 0;
+
+        if(csv)
+            printf("%s,%ld,%.2f,%ld,%.2f\n",bench->name,iterations,nsPerOp,bytesPerOp,mbytesPerSec);
+        else
+            printf("%-24s %12ld %14.2f %12.2f\n",bench->name,iterations,nsPerOp,mbytesPerSec);
+        fflush(stdout);
+    }
+
+    smCloseBus(benchBus);
+    free(drcData);
+    free(gdfData);
+    return 0;
+}
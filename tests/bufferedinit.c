@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../bufferedmotion.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "countingwrite.h"
+
+int main(void) {
+	const smaddr addresses[] = {1, 2, 3};
+	BufferedMotionAxis axes[3];
+	SM_NODE_INFO info;
+	smint32 value;
+	int i;
+	smbus h = smOpenBusWithCallbacks("SIM:3", simulatorPortOpen, simulatorPortClose, simulatorPortRead, counting_write, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	{
+		// one axis takes two transactions when node info is cached
+		assert(smGetNodeInfo(h, 1, &info) == SM_OK);
+		assert(smSetParameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, 500) == SM_OK);
+		frames = 0;
+		assert(smBufferedInit(&axes[0], h, 1, 1000, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_OK);
+		assert(frames == 2);
+		assert(axes[0].initialized == smtrue);
+		assert(axes[0].bufferLength > 0);
+		assert(axes[0].bufferFreeBytes == axes[0].bufferLength);
+		assert(axes[0].driveAccelerationBeforeInit == 500);
+
+		assert(smRead1Parameter(h, 1, SMP_BUFFERED_CMD_PERIOD, &value) == SM_OK);
+		assert(value == 10);
+		assert(smRead1Parameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 32767);
+		assert(smRead1Parameter(h, 1, SMP_BUFFERED_MODE, &value) == SM_OK);
+		assert(value == BUFFERED_INTERPOLATION_MODE_LINEAR);
+
+		assert(smBufferedDeinit(&axes[0]) == SM_OK);
+		assert(smRead1Parameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 500);
+	}
+
+	{
+		// many axes at once, setup transactions of axes are pipelined
+		assert(smInvalidateNodeInfo(h, 0) == SM_OK);
+		assert(smSetPipelineWindow(h, 3, 0) == SM_OK);
+		frames = 0;
+		assert(smBufferedInitMultiple(axes, 3, h, addresses, 500, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_OK);
+		assert(frames == 3 * 4);
+		assert(smSetPipelineWindow(h, 1, 0) == SM_OK);
+		for (i = 0; i < 3; i++) {
+			assert(axes[i].initialized == smtrue);
+			assert(axes[i].deviceAddress == addresses[i]);
+			assert(axes[i].smProtocolVersion == 28);
+			assert(smRead1Parameter(h, addresses[i], SMP_BUFFERED_CMD_PERIOD, &value) == SM_OK);
+			assert(value == 20);
+			assert(smBufferedDeinit(&axes[i]) == SM_OK);
+		}
+	}
+
+	{
+		// nothing is written if one of devices is missing
+		const smaddr missing[] = {1, 4};
+		assert(smSetParameter(h, 1, SMP_BUFFERED_CMD_PERIOD, 40) == SM_OK);
+		assert(smBufferedInitMultiple(axes, 2, h, missing, 500, SMP_ACTUAL_POSITION_FB, SMPRET_32B) != SM_OK);
+		assert(axes[0].initialized == smfalse);
+		resetCumulativeStatus(h);
+		assert(smRead1Parameter(h, 1, SMP_BUFFERED_CMD_PERIOD, &value) == SM_OK);
+		assert(value == 40);
+	}
+
+	{
+		// invalid arguments
+		assert(smBufferedInitMultiple(axes, 0, h, addresses, 500, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_ERR_PARAMETER);
+		assert(smBufferedInit(&axes[0], h, 1, 3000, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(h);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
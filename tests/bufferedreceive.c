@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../bufferedmotion.h"
+#include "../sm485.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "countingwrite.h"
+
+int main(void) {
+	BufferedMotionAxis axis;
+	smint32 fill[60], received[2 * SM_BUFFERED_MAX_POINTS_PER_RECEIVE], numReceived, bytesFilled, i, iterations;
+	smbus h = smOpenBusWithCallbacks("SIM", simulatorPortOpen, simulatorPortClose, simulatorPortRead, counting_write, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	for (i = 0; i < 60; i++)
+		fill[i] = i * 10 - 300;
+
+	{
+		// tail of motion is read without filling more points
+		assert(smBufferedInit(&axis, h, 1, 2500, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_OK);
+		assert(smBufferedRunAndSyncClocks(&axis) == SM_OK);
+		assert(smBufferedFillAndReceive(&axis, 10, fill, &numReceived, received, &bytesFilled) == SM_OK);
+
+		command_frames[SMCMD_BUFFERED_CMD] = 0;
+		for (iterations = 0; iterations < 1000 && numReceived < 10; iterations++) {
+			smSleepMs(1);
+			assert(smBufferedReceive(&axis, SM_BUFFERED_MAX_POINTS_PER_RECEIVE, &i, received + numReceived) == SM_OK);
+			numReceived += i;
+		}
+		assert(command_frames[SMCMD_BUFFERED_CMD] == 0);
+		assert(numReceived == 10);
+		assert(axis.numberOfPendingReadPackets == 0);
+		assert(memcmp(fill, received, 10 * sizeof(smint32)) == 0);
+		assert(smBufferedDeinit(&axis) == SM_OK);
+	}
+
+	{
+		// return data that doesn't fit in one frame is drained in one call
+		assert(smBufferedInit(&axis, h, 1, 2500, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_OK);
+		assert(smBufferedRunAndSyncClocks(&axis) == SM_OK);
+		numReceived = 0;
+		for (iterations = 0; iterations < 3; iterations++) {
+			assert(smBufferedFillAndReceive(&axis, 20, fill + iterations * 20, &i, received + numReceived, &bytesFilled) == SM_OK);
+			numReceived += i;
+		}
+		assert(numReceived < 40);
+
+		// 60 points at 2500 Hz take 24 ms
+		smSleepMs(50);
+		command_frames[SMCMD_BUFFERED_RETURN_DATA] = 0;
+		assert(smBufferedReceive(&axis, 2 * SM_BUFFERED_MAX_POINTS_PER_RECEIVE - numReceived, &i, received + numReceived) == SM_OK);
+		numReceived += i;
+		assert(command_frames[SMCMD_BUFFERED_RETURN_DATA] > 1);
+		assert(numReceived == 60);
+		assert(axis.numberOfPendingReadPackets == 0);
+		assert(memcmp(fill, received, sizeof(fill)) == 0);
+
+		// nothing left
+		assert(smBufferedReceive(&axis, SM_BUFFERED_MAX_POINTS_PER_RECEIVE, &i, received) == SM_OK);
+		assert(i == 0);
+		assert(smBufferedDeinit(&axis) == SM_OK);
+	}
+
+	{
+		// receive buffer must have room for a full reply
+		assert(smBufferedReceive(&axis, 10, &i, received) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(h);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
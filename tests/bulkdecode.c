@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../sm485.h"
+#include "../drivers/simulator/smsimulator.h"
+
+static unsigned char frame[SM485_MAX_PAYLOAD_BYTES + 5];
+static int frame_len;
+
+// SMCMD_INSTANT_CMD_RET frame with random return subpackets
+static void build_random_frame(void) {
+	static const int lengths[4] = {4, 3, 2, 1};
+	unsigned char *payload = &frame[3];
+	smuint16 crc = SM485_CRCINIT;
+	int len = 0, i;
+
+	for (;;) {
+		int type = rand() & 3;
+		if (len + lengths[type] > SM485_MAX_PAYLOAD_BYTES)
+			break;
+		for (i = 0; i < lengths[type]; i++)
+			payload[len + i] = (unsigned char)rand();
+		payload[len] = (unsigned char)((payload[len] & 0x3f) | (type << 6));
+		len += lengths[type];
+	}
+
+	frame[0] = SMCMD_INSTANT_CMD_RET;
+	frame[1] = (unsigned char)len;
+	frame[2] = 1;
+	frame_len = len + 3;
+	for (i = 0; i < frame_len; i++)
+		crc = calcCRC16(frame[i], crc);
+	frame[frame_len++] = crc >> 8;
+	frame[frame_len++] = crc & 0xff;
+}
+
+static void parse_frame(smbus h) {
+	int i;
+	smResetSM485variables(h);
+	for (i = 0; i < frame_len; i++)
+		assert(smParseReturnData(h, frame[i]) == SM_OK);
+}
+
+int main(void) {
+	smint32 expected[SM485_MAX_PAYLOAD_BYTES], values[SM485_MAX_PAYLOAD_BYTES], num, bytes;
+	smuint8 types[SM485_MAX_PAYLOAD_BYTES];
+	int round, n;
+	smbus h = smOpenBusWithCallbacks("SIM", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	srand(1);
+
+	{
+		// gives the same values as reading them one by one
+		for (round = 0; round < 1000; round++) {
+			build_random_frame();
+			parse_frame(h);
+			for (n = 0; n < SM485_MAX_PAYLOAD_BYTES; n++) {
+				assert(smBytesReceived(h, &bytes) == SM_OK);
+				if (bytes == 0)
+					break;
+				assert(smGetQueuedSMCommandReturnValue(h, &expected[n]) == SM_OK);
+			}
+
+			parse_frame(h);
+			assert(smGetQueuedSMCommandReturnValues(h, values, types, SM485_MAX_PAYLOAD_BYTES, &num) == SM_OK);
+			assert(num == n);
+			assert(memcmp(values, expected, n * sizeof(smint32)) == 0);
+			assert(smBytesReceived(h, &bytes) == SM_OK);
+			assert(bytes == 0);
+		}
+	}
+
+	{
+		// types, sign extension and reading in parts
+		static const unsigned char payload[] = {
+			0x20, 0x00, 0x00, 0x00,	// 32B, most negative
+			0x1f, 0xff, 0xff, 0xff,	// 32B, most positive
+			0x7f, 0xff, 0xff,	// 24B, -1
+			0xa0, 0x00,		// 16B, most negative
+			0xc1,			// status 1
+		};
+		static const smint32 expected_values[] = {-0x20000000, 0x1fffffff, -1, -0x2000, 1};
+		static const smuint8 expected_types[] = {SMPRET_32B, SMPRET_32B, SMPRET_24B, SMPRET_16B, SMPRET_OTHER};
+		smuint16 crc = SM485_CRCINIT;
+		int i;
+
+		frame[0] = SMCMD_INSTANT_CMD_RET;
+		frame[1] = sizeof(payload);
+		frame[2] = 1;
+		memcpy(&frame[3], payload, sizeof(payload));
+		frame_len = 3 + sizeof(payload);
+		for (i = 0; i < frame_len; i++)
+			crc = calcCRC16(frame[i], crc);
+		frame[frame_len++] = crc >> 8;
+		frame[frame_len++] = crc & 0xff;
+		parse_frame(h);
+
+		assert(smGetQueuedSMCommandReturnValues(h, values, types, 3, &num) == SM_OK);
+		assert(num == 3);
+		assert(smGetQueuedSMCommandReturnValues(h, values + 3, NULL, 3, &num) == SM_OK);
+		assert(num == 2);
+		assert(memcmp(values, expected_values, sizeof(expected_values)) == 0);
+		assert(memcmp(types, expected_types, 3) == 0);
+		assert(smGetQueuedSMCommandReturnValues(h, values, types, 3, &num) == SM_OK);
+		assert(num == 0);
+	}
+
+	{
+		// executed queue
+		assert(smAppendGetParamCommandToQueue(h, SMP_BUFFERED_CMD_PERIOD) == SM_OK);
+		assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, -5000) == SM_OK);
+		assert(smAppendGetParamCommandToQueue(h, SMP_ACTUAL_POSITION_FB) == SM_OK);
+		assert(smExecuteCommandQueue(h, 1) == SM_OK);
+		assert(smGetQueuedSMCommandReturnValues(h, values, types, SM485_MAX_PAYLOAD_BYTES, &num) == SM_OK);
+		assert(num == 4 + 2 + 4);
+		assert(values[9] == -5000 && types[9] == SMPRET_32B);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../handletable.h"
+#include "../telemetry.h"
+#include "../readcombiner.h"
+#include "../busscheduler.h"
+#include "../drivers/simulator/smsimulator.h"
+
+#define NUM_BUSES 40
+
+static smbus open_simulator(void) {
+	return smOpenBusWithCallbacks("SIM", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+}
+
+int main(void) {
+	smbus h[NUM_BUSES];
+	smint32 value;
+	int i, j;
+
+	{
+		// more buses than fit in one handle table chunk, all handles are different and work
+		for (i = 0; i < NUM_BUSES; i++) {
+			h[i] = open_simulator();
+			assert(h[i] >= 0);
+			for (j = 0; j < i; j++)
+				assert(h[i] != h[j]);
+		}
+		for (i = 0; i < NUM_BUSES; i++) {
+			assert(smRead1Parameter(h[i], 1, SMP_SM_VERSION, &value) == SM_OK);
+			assert(value == 28);
+		}
+	}
+
+	{
+		// closed handle is rejected and its slot is reused by the next open, other buses are not affected
+		smbus closed = h[5];
+		assert(smCloseBus(closed) == SM_OK);
+		assert(smRead1Parameter(closed, 1, SMP_SM_VERSION, &value) == SM_ERR_NODEVICE);
+		assert(smCloseBus(closed) == SM_ERR_NODEVICE);
+		assert(smRead1Parameter(h[6], 1, SMP_SM_VERSION, &value) == SM_OK);
+		h[5] = open_simulator();
+		assert((h[5] & SM_HANDLE_INDEX_MASK) == (closed & SM_HANDLE_INDEX_MASK));
+		assert(smRead1Parameter(h[5], 1, SMP_SM_VERSION, &value) == SM_OK);
+
+		// stale handle doesn't reach the bus that reuses its slot
+		assert(h[5] != closed);
+		assert(smIsHandleOpen(closed) == smfalse);
+		assert(smRead1Parameter(closed, 1, SMP_SM_VERSION, &value) == SM_ERR_NODEVICE);
+		assert(smCloseBus(closed) == SM_ERR_NODEVICE);
+		assert(smIsHandleOpen(h[5]) == smtrue);
+	}
+
+	{
+		// bus can't be closed while components use it, and they can't be created for a closed bus
+		SMTelemetry *telemetry = smTelemetryCreate(h[7]);
+		SMReadCombiner *combiner = smReadCombinerCreate(h[7]);
+		SMBusScheduler *scheduler = smSchedulerCreate(h[7], 1000);
+		assert(telemetry != NULL && combiner != NULL && scheduler != NULL);
+		assert(smCloseBus(h[7]) == SM_ERR_PARAMETER);
+		smTelemetryDestroy(telemetry);
+		smReadCombinerDestroy(combiner);
+		assert(smCloseBus(h[7]) == SM_ERR_PARAMETER);
+		smSchedulerDestroy(scheduler);
+		resetCumulativeStatus(h[7]);
+		assert(smCloseBus(h[7]) == SM_OK);
+		assert(smTelemetryCreate(h[7]) == NULL);
+		assert(smReadCombinerCreate(h[7]) == NULL);
+		h[7] = open_simulator();
+		assert(h[7] >= 0);
+	}
+
+	{
+		// invalid handles
+		assert(getCumulativeStatus(-1) == SM_ERR_NODEVICE);
+		assert(getCumulativeStatus(NUM_BUSES + 100) == SM_ERR_NODEVICE);
+		assert(getCumulativeStatus(SM_MAX_BUSES + 1) == SM_ERR_NODEVICE);
+	}
+
+	for (i = 0; i < NUM_BUSES; i++)
+		assert(smCloseBus(h[i]) == SM_OK);
+	return 0;
+}
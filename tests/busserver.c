@@ -0,0 +1,188 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../busserver.h"
+#include "../sm485.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "../drivers/busclient/smbusclient.h"
+
+static char path[64];
+
+static SMBusServer *open_server(void) {
+	return smBusServerOpenWithCallbacks("SIM:4", path, simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+}
+
+static smbus open_client(const char *options) {
+	char name[96];
+	snprintf(name, sizeof(name), "unix:%s%s", path, options);
+	return smOpenBusWithCallbacks(name, busclientPortOpen, busclientPortClose, busclientPortRead, busclientPortWrite, busclientPortMiscOperation);
+}
+
+// raw connection that speaks the server protocol directly
+static int connect_raw(unsigned char priority) {
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(send(fd, &priority, 1, 0) == 1);
+	return fd;
+}
+
+// SMCMD_INSTANT_CMD without subpackets, reply is 5 bytes
+static void send_empty_frame(int fd, smuint8 address) {
+	unsigned char frame[5] = {SMCMD_INSTANT_CMD, 0, address};
+	smuint16 crc = SM485_CRCINIT;
+	int i;
+	for (i = 0; i < 3; i++)
+		crc = calcCRC16(frame[i], crc);
+	frame[3] = crc >> 8;
+	frame[4] = crc & 0xff;
+	assert(send(fd, frame, sizeof(frame), 0) == sizeof(frame));
+}
+
+static void *client_thread(void *arg) {
+	smint32 node = (smint32)(intptr_t)arg, value, i;
+	smbus h = open_client("");
+	if (h < 0)
+		return (void *)1;
+	for (i = 0; i < 200; i++) {
+		if (smSetParameter(h, node, SMP_ABSOLUTE_SETPOINT, i * node) != SM_OK)
+			return (void *)2;
+		if (smRead1Parameter(h, node, SMP_ACTUAL_POSITION_FB, &value) != SM_OK || value != i * node)
+			return (void *)3;
+	}
+	smCloseBus(h);
+	return NULL;
+}
+
+int main(void) {
+	SMBusServer *server;
+	smint32 value;
+	smbus h[2];
+	int i;
+
+	snprintf(path, sizeof(path), "/tmp/smtest-%d.sock", (int)getpid());
+
+	{
+		// invalid names
+		assert(smBusServerOpenWithCallbacks("SIM", "/tmp/this/path/does/not/exist.sock", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation) == NULL);
+		assert(open_client("") < 0);
+		server = open_server();
+		assert(server != NULL);
+		assert(open_client("?priority=8") < 0);
+		smBusServerClose(server);
+	}
+
+	{
+		// clients access devices like on a direct connection
+		server = open_server();
+		h[0] = open_client("");
+		h[1] = open_client("?priority=3");
+		assert(h[0] >= 0 && h[1] >= 0);
+
+		assert(smSetParameter(h[0], 1, SMP_ABSOLUTE_SETPOINT, 1234) == SM_OK);
+		assert(smRead1Parameter(h[1], 1, SMP_ACTUAL_POSITION_FB, &value) == SM_OK);
+		assert(value == 1234);
+		assert(smSetParameter(h[1], 2, SMP_ABSOLUTE_SETPOINT, -99) == SM_OK);
+		assert(smRead1Parameter(h[0], 2, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK);
+		assert(value == -99);
+
+		// broadcast has no reply, missing node times out
+		assert(smSetParameter(h[0], 0, SMP_ABSOLUTE_SETPOINT, 5) == SM_OK);
+		assert(smRead1Parameter(h[0], 1, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK);
+		assert(value == 5);
+		assert(smRead1Parameter(h[0], 5, SMP_ABSOLUTE_SETPOINT, &value) != SM_OK);
+		resetCumulativeStatus(h[0]);
+		assert(smRead1Parameter(h[1], 1, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK);
+		assert(smBusServerFramesForwarded(server) == 8);
+
+		assert(getCumulativeStatus(h[1]) == SM_OK);
+		assert(smCloseBus(h[0]) == SM_OK);
+		assert(smCloseBus(h[1]) == SM_OK);
+	}
+
+	{
+		// concurrent clients
+		pthread_t threads[4];
+		void *result;
+
+		for (i = 0; i < 4; i++)
+			assert(pthread_create(&threads[i], NULL, client_thread, (void *)(intptr_t)(i + 1)) == 0);
+		for (i = 0; i < 4; i++) {
+			assert(pthread_join(threads[i], &result) == 0);
+			assert(result == NULL);
+		}
+	}
+
+	{
+		// invalid frame disconnects client
+		int fd = connect_raw(0);
+		unsigned char garbage = SMCMD_MASK_RESERVED;
+		unsigned char byte;
+		assert(send(fd, &garbage, 1, 0) == 1);
+		assert(recv(fd, &byte, 1, 0) == 0);
+		close(fd);
+		smBusServerClose(server);
+	}
+
+	{
+		// waiting frames of higher priority client are served first
+		struct pollfd fds[3];
+		smuint64 lastHigh = 0, firstLow = 0;
+		int replies[3] = {0, 0, 0};
+		unsigned char buf[64];
+
+		smSetSimulatorTiming(smfalse, 20000);
+		server = open_server();
+		smSetSimulatorTiming(smfalse, 0);
+		fds[0].fd = connect_raw(0);
+		fds[1].fd = connect_raw(0);
+		fds[2].fd = connect_raw(5);
+
+		// bus is busy with the first frame while others arrive
+		send_empty_frame(fds[0].fd, 1);
+		smSleepMs(5);
+		for (i = 0; i < 3; i++)
+			send_empty_frame(fds[1].fd, 1);
+		smSleepMs(1);
+		for (i = 0; i < 3; i++)
+			send_empty_frame(fds[2].fd, 2);
+
+		while (replies[0] + replies[1] + replies[2] < 7 * 5) {
+			for (i = 0; i < 3; i++)
+				fds[i].events = POLLIN;
+			assert(poll(fds, 3, 2000) > 0);
+			for (i = 0; i < 3; i++) {
+				int n;
+				if (!(fds[i].revents & POLLIN))
+					continue;
+				n = (int)recv(fds[i].fd, buf, sizeof(buf), 0);
+				assert(n > 0);
+				replies[i] += n;
+				if (i == 1 && firstLow == 0)
+					firstLow = smGetMonotonicTimeNs();
+				if (i == 2 && replies[2] == 15)
+					lastHigh = smGetMonotonicTimeNs();
+			}
+		}
+		assert(lastHigh != 0 && lastHigh < firstLow);
+		for (i = 0; i < 3; i++)
+			close(fds[i].fd);
+		smBusServerClose(server);
+	}
+
+	assert(access(path, F_OK) != 0);
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../drivers/simulator/smsimulator.h"
+
+// simulator wrapper that can lose broadcast frames, so nodes miss the speed change
+static int drop_broadcasts;
+
+static smint32 lossy_write(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	if (drop_broadcasts && size > 3 && buf[2] == 0)
+		return size;
+	return simulatorPortWrite(busdevicePointer, buf, size);
+}
+
+static smbus open_simulator(const char *name) {
+	return smOpenBusWithCallbacks(name, simulatorPortOpen, simulatorPortClose, simulatorPortRead, lossy_write, simulatorPortMiscOperation);
+}
+
+int main(void) {
+	const smaddr nodes[] = {1, 2, 3};
+	unsigned long bps;
+	smint32 value;
+	smbus h;
+
+	assert(smSetTimeout(50) == SM_OK);
+
+	{
+		// switch to the highest speed allowed by host
+		h = open_simulator("SIM:2");
+		assert(h >= 0);
+		assert(smEscalateBusSpeed(h, nodes, 2, 2000000, &bps) == SM_OK);
+		assert(bps == 2000000);
+		assert(smRead1Parameter(h, 2, SMP_BUS_SPEED, &value) == SM_OK);
+		assert(value == 2000000);
+		assert(smRead1Parameter(h, 1, SMP_FAULT_BEHAVIOR, &value) == SM_OK);
+		assert(value == 0);
+		assert(getCumulativeStatus(h) == SM_OK);
+
+		// already at best speed
+		assert(smEscalateBusSpeed(h, nodes, 2, 2000000, &bps) == SM_OK);
+		assert(bps == 2000000);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	{
+		// missing node prevents switch
+		h = open_simulator("SIM:3");
+		assert(h >= 0);
+		const smaddr missing[] = {1, 4};
+		assert(smEscalateBusSpeed(h, missing, 2, 10000000, &bps) != SM_OK);
+		assert(bps == 460800);
+		resetCumulativeStatus(h);
+
+		// highest speed supported by nodes
+		assert(smEscalateBusSpeed(h, nodes, 3, 10000000, &bps) == SM_OK);
+		assert(bps == 3000000);
+		assert(smRead1Parameter(h, 3, SMP_SM_VERSION, &value) == SM_OK);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	{
+		// nodes miss the broadcast: watchdog returns them to default speed and bus falls back to it
+		h = open_simulator("SIM");
+		assert(h >= 0);
+		assert(smSetParameter(h, 1, SMP_FAULT_BEHAVIOR, 1) == SM_OK);
+		drop_broadcasts = 1;
+		assert(smEscalateBusSpeed(h, nodes, 1, 1000000, &bps) == SM_ERR_COMMUNICATION);
+		drop_broadcasts = 0;
+		assert(bps == 460800);
+		resetCumulativeStatus(h);
+		assert(smRead1Parameter(h, 1, SMP_BUS_SPEED, &value) == SM_OK);
+		assert(value == 460800);
+		assert(smRead1Parameter(h, 1, SMP_FAULT_BEHAVIOR, &value) == SM_OK);
+		assert(value == 1);
+		assert(getCumulativeStatus(h) == SM_OK);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	return 0;
+}
@@ -0,0 +1,178 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../buscapture.h"
+#include "../sm485.h"
+#include "../drivers/simulator/smsimulator.h"
+
+typedef struct {
+	int type, length;
+	uint64_t timestamp;
+	uint32_t duration;
+	unsigned char data[256];
+} Record;
+
+static unsigned get_le(const unsigned char *buf, int bytes) {
+	unsigned value = 0;
+	while (bytes--)
+		value = (value << 8) | buf[bytes];
+	return value;
+}
+
+// read next record, returns 0 at end of file
+static int read_record(FILE *f, Record *rec) {
+	unsigned char header[SM_CAPTURE_RECORD_HEADER_LEN];
+	if (fread(header, 1, sizeof(header), f) != sizeof(header))
+		return 0;
+	rec->type = header[0];
+	assert(header[1] == 0);
+	rec->length = (int)get_le(header + 2, 2);
+	rec->timestamp = get_le(header + 4, 4) | (uint64_t)get_le(header + 8, 4) << 32;
+	rec->duration = get_le(header + 12, 4);
+	assert(rec->length <= (int)sizeof(rec->data));
+	assert(fread(rec->data, 1, rec->length, f) == (size_t)rec->length);
+	return 1;
+}
+
+static smbus open_simulator(const char *name) {
+	return smOpenBusWithCallbacks(name, simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+}
+
+// reads parameters until stopped, while capture is started and stopped by another thread
+static volatile int stop_reading;
+
+static void *read_loop(void *arg) {
+	smbus h = *(smbus *)arg;
+	smint32 value;
+	while (!stop_reading)
+		assert(smRead1Parameter(h, 1, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK && value == 1234);
+	return NULL;
+}
+
+int main(void) {
+	char path[64];
+	unsigned char header[SM_CAPTURE_FILE_HEADER_LEN + 16];
+	const smaddr nodes[] = {1, 2};
+	unsigned long bps;
+	smint32 value;
+	Record rec;
+	uint64_t lastTimestamp = 0;
+	int tx = 0, rx = 0, lastType = 0, setParamFrames = 0;
+	FILE *f;
+	smbus h;
+
+	snprintf(path, sizeof(path), "/tmp/smtest-capture-%d.smcap", (int)getpid());
+	h = open_simulator("SIM:2");
+	assert(h >= 0);
+
+	{
+		// invalid file and stop without capture
+		assert(smCaptureStart(h, "/tmp/this/path/does/not/exist.smcap") == SM_ERR_PARAMETER);
+		assert(smCaptureStop(h) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// capture continues over reopening the port at a higher speed
+		assert(smCaptureStart(h, path) == SM_OK);
+		assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 1234) == SM_OK);
+		assert(smEscalateBusSpeed(h, nodes, 2, 2000000, &bps) == SM_OK);
+		assert(bps == 2000000);
+		assert(smSetParameter(h, 2, SMP_ABSOLUTE_SETPOINT, 5678) == SM_OK);
+		assert(smRead1Parameter(h, 1, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK && value == 1234);
+		assert(smCaptureStop(h) == SM_OK);
+		assert(smCaptureStop(h) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// file header has bus name
+		f = fopen(path, "rb");
+		assert(f != NULL);
+		assert(fread(header, 1, SM_CAPTURE_FILE_HEADER_LEN, f) == SM_CAPTURE_FILE_HEADER_LEN);
+		assert(memcmp(header, SM_CAPTURE_FILE_MAGIC, 4) == 0);
+		assert(get_le(header + 4, 2) == SM_CAPTURE_FILE_VERSION);
+		assert(get_le(header + 6, 2) == 5);
+		assert(fread(header, 1, 5, f) == 5 && memcmp(header, "SIM:2", 5) == 0);
+	}
+
+	{
+		// records are TX frames followed by their replies in time order, also after the speed change
+		while (read_record(f, &rec)) {
+			assert(rec.type == SM_CAPTURE_TX || rec.type == SM_CAPTURE_RX);
+			assert(rec.length > 0);
+			assert(rec.timestamp >= lastTimestamp);
+			lastTimestamp = rec.timestamp;
+			if (rec.type == SM_CAPTURE_TX) {
+				tx++;
+				assert(rec.duration == 0);
+				// SMCMD_INSTANT_CMD frame: cmd, size, address, payload, crc
+				if (rec.data[0] == SMCMD_INSTANT_CMD) {
+					assert(rec.length == 5 + rec.data[1]);
+					int i;
+					// write of 5678 (0x162e) to node 2 is sent after the port was reopened
+					for (i = 3; i + 1 < rec.length - 2; i++)
+						if (rec.data[2] == 2 && rec.data[i] == 0x16 && rec.data[i + 1] == 0x2e)
+							setParamFrames++;
+				}
+			} else {
+				// reply is a single burst, not a record per byte
+				rx++;
+				assert(lastType == SM_CAPTURE_TX);
+				assert(rec.length >= 5);
+			}
+			lastType = rec.type;
+		}
+		fclose(f);
+		assert(setParamFrames == 1);
+		assert(tx >= 4 && rx >= 3);
+		assert(rx <= tx);
+	}
+
+	{
+		// closing the bus stops capture and the file can be replaced
+		assert(smCaptureStart(h, path) == SM_OK);
+		assert(smRead1Parameter(h, 2, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK && value == 5678);
+		assert(smCloseBus(h) == SM_OK);
+		f = fopen(path, "rb");
+		assert(f != NULL);
+		assert(fseek(f, SM_CAPTURE_FILE_HEADER_LEN + 5, SEEK_SET) == 0);
+		tx = rx = 0;
+		while (read_record(f, &rec)) {
+			if (rec.type == SM_CAPTURE_TX)
+				tx++;
+			else
+				rx++;
+		}
+		fclose(f);
+		assert(tx == 1 && rx == 1);
+	}
+
+	{
+		// capture can be started and stopped while another thread uses the bus
+		pthread_t thread;
+		int i;
+		h = open_simulator("SIM:3");
+		assert(h >= 0);
+		assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 1234) == SM_OK);
+		stop_reading = 0;
+		assert(pthread_create(&thread, NULL, read_loop, &h) == 0);
+		for (i = 0; i < 50; i++) {
+			assert(smCaptureStart(h, path) == SM_OK);
+			usleep(200);
+			assert(smCaptureStop(h) == SM_OK);
+		}
+		stop_reading = 1;
+		assert(pthread_join(thread, NULL) == 0);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,19 @@
+// simulator write callback that counts transmitted frames, included by tests that check how many frames are sent
+#ifndef COUNTINGWRITE_H
+#define COUNTINGWRITE_H
+
+#include "../drivers/simulator/smsimulator.h"
+
+// transmitted frames in total and by command byte, and the longest frame. tests reset the ones they check
+static int frames, command_frames[256], longest_frame;
+
+static smint32 counting_write(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	frames++;
+	if (size > 0)
+		command_frames[buf[0]]++;
+	if (size > longest_frame)
+		longest_frame = size;
+	return simulatorPortWrite(busdevicePointer, buf, size);
+}
+
+#endif
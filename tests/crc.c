@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../sm485.h"
+
+static smuint16 reference_crc16(smuint16 crc, const smuint8 *buf, int len);
+static smuint8 reference_crc8(smuint8 crc, const smuint8 *buf, int len);
+
+int main(void) {
+	static smuint8 data[4096 + 16];
+	const SMCRCImplementation implementations[] = {SMCRCImplementationBytewise, SMCRCImplementationSlicing8, SMCRCImplementationCarrylessMultiply};
+	smuint32 seed = 12345;
+	size_t impl;
+	int i;
+
+	for (i = 0; i < (int)sizeof(data); i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = (smuint8)(seed >> 16);
+	}
+
+	{
+		// automatically selected implementation is the best supported one
+		SMCRCImplementation selected = smGetCRCImplementation();
+		assert(selected == SMCRCImplementationBytewise || smSetCRCImplementation(selected) == smtrue);
+	}
+
+	{
+		// known values: SM485 CRC of a SMCMD_INSTANT_CMD frame header and Modbus CRC of "123456789"
+		const smuint8 header[] = {0x12, 0x00, 0x01};
+		assert(calcCRC16Update(SM485_CRCINIT, header, 0) == SM485_CRCINIT);
+		assert(calcCRC16Buf("123456789", 9) == 0x374b); // 0x4b37 in Modbus byte order
+		assert(calcCRC16Update(SM485_CRCINIT, header, 3) == reference_crc16(SM485_CRCINIT, header, 3));
+	}
+
+	for (impl = 0; impl < sizeof(implementations) / sizeof(implementations[0]); impl++) {
+		int offset, len;
+
+		if (smSetCRCImplementation(implementations[impl]) == smfalse) {
+			printf("crc implementation %d not supported, skipping\n", (int)implementations[impl]);
+			continue;
+		}
+
+		// all lengths around block boundaries from all alignments and different initial values
+		for (offset = 0; offset < 16; offset++) {
+			for (len = 0; len <= 300; len++) {
+				smuint16 init16 = (smuint16)(len * 0x1021 + offset);
+				smuint8 init8 = (smuint8)(len + offset);
+				assert(calcCRC16Update(init16, data + offset, len) == reference_crc16(init16, data + offset, len));
+				assert(calcCRC8Buf(data + offset, len, init8) == reference_crc8(init8, data + offset, len));
+			}
+		}
+
+		for (len = 1000; len <= 4096; len += 517) {
+			assert(calcCRC16Update(SM485_CRCINIT, data + 3, len) == reference_crc16(SM485_CRCINIT, data + 3, len));
+			assert(calcCRC16Buf((const char *)data, len) == reference_crc16(0xffff, data, len));
+			assert(calcCRC8Buf(data + 5, len, 0x52) == reference_crc8(0x52, data + 5, len));
+		}
+
+		{
+			// buffer can be calculated in pieces
+			smuint16 crc = calcCRC16Update(SM485_CRCINIT, data, 100);
+			crc = calcCRC16Update(crc, data + 100, 1000);
+			assert(crc == reference_crc16(SM485_CRCINIT, data, 1100));
+		}
+	}
+
+	return 0;
+}
+
+static smuint16 reference_crc16(smuint16 crc, const smuint8 *buf, int len) {
+	int i;
+	for (i = 0; i < len; i++)
+		crc = calcCRC16(buf[i], crc);
+	return crc;
+}
+
+static smuint8 reference_crc8(smuint8 crc, const smuint8 *buf, int len) {
+	int i;
+	for (i = 0; i < len; i++)
+		crc = table_crc8[crc ^ buf[i]];
+	return crc;
+}
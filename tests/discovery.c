@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../nodediscovery.h"
+#include "../drivers/simulator/smsimulator.h"
+
+// frames sent to each address of both buses, and order in which first and last frame of each bus were sent
+static int frames[2][256], sequence, firstFrame[2], lastFrame[2];
+
+static smint32 count_frame(int bus, smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	int n = __sync_add_and_fetch(&sequence, 1);
+	if (size >= 3)
+		frames[bus][buf[2]]++;
+	if (firstFrame[bus] == 0)
+		firstFrame[bus] = n;
+	lastFrame[bus] = n;
+	return simulatorPortWrite(busdevicePointer, buf, size);
+}
+
+static smint32 write_bus0(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	return count_frame(0, busdevicePointer, buf, size);
+}
+
+static smint32 write_bus1(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	return count_frame(1, busdevicePointer, buf, size);
+}
+
+// purges of bus device receive buffer, they sleep on serial ports
+static int purges;
+
+static smbool counting_misc(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation) {
+	if (operation == MiscOperationPurgeRX)
+		__sync_add_and_fetch(&purges, 1);
+	return simulatorPortMiscOperation(busdevicePointer, operation);
+}
+
+static void reset_counts(void) {
+	memset(frames, 0, sizeof(frames));
+	sequence = 0;
+	memset(firstFrame, 0, sizeof(firstFrame));
+	memset(lastFrame, 0, sizeof(lastFrame));
+	purges = 0;
+}
+
+// number of addresses in range that got exactly one frame
+static int probed_once(int bus, int first, int last) {
+	int address, count = 0;
+	for (address = first; address <= last; address++)
+		if (frames[bus][address] == 1)
+			count++;
+	return count;
+}
+
+int main(void) {
+	SM_NODE_INFO nodes[16];
+	int count;
+	smbus h[2];
+
+	assert(smSetTimeout(500) == SM_OK);
+	h[0] = smOpenBusWithCallbacks("SIM:3", simulatorPortOpen, simulatorPortClose, simulatorPortRead, write_bus0, counting_misc);
+	h[1] = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, write_bus1, counting_misc);
+	assert(h[0] >= 0 && h[1] >= 0);
+
+	{
+		// invalid arguments
+		assert(smDiscoverNodes(h, 2, 0, 10, 10, nodes, 16, &count) == SM_ERR_PARAMETER);
+		assert(smDiscoverNodes(h, 2, 5, 4, 10, nodes, 16, &count) == SM_ERR_PARAMETER);
+		assert(smDiscoverNodes(h, 2, 1, 10, 0, nodes, 16, &count) == SM_ERR_PARAMETER);
+		assert(smDiscoverNodes(h, 0, 1, 10, 10, nodes, 16, &count) == SM_ERR_PARAMETER);
+		const smbus twice[] = {h[0], h[0]};
+		assert(smDiscoverNodes(twice, 2, 1, 10, 10, nodes, 16, &count) == SM_ERR_PARAMETER);
+		const smbus closed[] = {h[0], 77};
+		assert(smDiscoverNodes(closed, 2, 1, 10, 10, nodes, 16, &count) == SM_ERR_NODEVICE);
+		resetCumulativeStatus(h[0]);
+	}
+
+	{
+		// missing addresses get one probe each and no retries, detail reads or purges
+		reset_counts();
+		assert(smDiscoverNodes(h, 1, 1, 20, 10, nodes, 16, &count) == SM_OK);
+		assert(count == 3);
+		assert(probed_once(0, 4, 20) == 17);
+		assert(frames[0][0] == 0 && frames[0][21] == 0);
+		assert(frames[0][1] > 1 && frames[0][3] > 1);
+		assert(sequence == frames[0][1] + frames[0][2] + frames[0][3] + 17);
+		assert(purges == 0);
+		assert(nodes[0].bus == h[0] && nodes[0].address == 1);
+		assert(nodes[2].address == 3);
+		assert(nodes[1].smVersion == 28);
+		assert(nodes[1].deviceType == 0);
+		assert(nodes[1].capabilities1 != 0);
+		assert(getCumulativeStatus(h[0]) == SM_OK);
+	}
+
+	{
+		// buses are scanned concurrently and results are ordered by bus and address
+		reset_counts();
+		assert(smDiscoverNodes(&h[1], 1, 1, 40, 10, nodes, 16, &count) == SM_OK);
+		assert(count == 2);
+		assert(probed_once(1, 3, 40) == 38);
+		assert(firstFrame[0] == 0);
+
+		reset_counts();
+		assert(smDiscoverNodes(h, 2, 1, 40, 10, nodes, 16, &count) == SM_OK);
+		assert(count == 5);
+		assert(probed_once(0, 4, 40) == 37);
+		assert(probed_once(1, 3, 40) == 38);
+		// second bus is scanned while the first one is still in progress
+		assert(firstFrame[1] < lastFrame[0] && firstFrame[0] < lastFrame[1]);
+		assert(nodes[0].bus == h[0] && nodes[0].address == 1);
+		assert(nodes[2].bus == h[0] && nodes[2].address == 3);
+		assert(nodes[3].bus == h[1] && nodes[3].address == 1);
+		assert(nodes[4].bus == h[1] && nodes[4].address == 2);
+	}
+
+	{
+		// result array too small
+		assert(smDiscoverNodes(h, 2, 1, 3, 10, nodes, 4, &count) == SM_ERR_LENGTH);
+		assert(count == 4);
+		assert(nodes[3].bus == h[1] && nodes[3].address == 1);
+	}
+
+	{
+		// normal transactions work after scan
+		smint32 value;
+		assert(smRead1Parameter(h[1], 2, SMP_SM_VERSION, &value) == SM_OK);
+		assert(value == 28);
+		assert(getCumulativeStatus(h[1]) == SM_OK);
+	}
+
+	assert(smCloseBus(h[0]) == SM_OK);
+	assert(smCloseBus(h[1]) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+
+// encode subpackets of an array one by one like command queues do. returns bytes written, -1 if some type is
+// invalid or they don't fit in bufSize bytes
+static int encode_subpackets(smuint8 *buf, int bufSize, const smuint8 *types, const smint32 *values, int count) {
+	smuint8 subpacket[4];
+	int i, len, pos = 0;
+
+	for (i = 0; i < count; i++) {
+		len = smEncodeSubpacket(subpacket, types[i], values[i]);
+		if (len == 0 || pos + len > bufSize)
+			return -1;
+		memcpy(&buf[pos], subpacket, len);
+		pos += len;
+	}
+	return pos;
+}
+
+// reference encoding with compiler bitfields, as the library did before (little endian only)
+static int encode_bitfield(unsigned char *buf, int type, smint32 value) {
+	if (type == SMPCMD_SETPARAMADDR) {
+		SMPayloadCommand16 cmd;
+		cmd.ID = type;
+		cmd.param = value;
+		buf[0] = ((unsigned char *)&cmd)[1];
+		buf[1] = ((unsigned char *)&cmd)[0];
+		return 2;
+	}
+	if (type == SMPCMD_24B) {
+		SMPayloadCommand24 cmd;
+		cmd.ID = type;
+		cmd.param = value;
+		buf[0] = ((unsigned char *)&cmd)[2];
+		buf[1] = ((unsigned char *)&cmd)[1];
+		buf[2] = ((unsigned char *)&cmd)[0];
+		return 3;
+	}
+	{
+		SMPayloadCommand32 cmd;
+		cmd.ID = type;
+		cmd.param = value;
+		buf[0] = ((unsigned char *)&cmd)[3];
+		buf[1] = ((unsigned char *)&cmd)[2];
+		buf[2] = ((unsigned char *)&cmd)[1];
+		buf[3] = ((unsigned char *)&cmd)[0];
+		return 4;
+	}
+}
+
+// reference decoding with compiler bitfields
+static smint32 decode_bitfield(const unsigned char *buf) {
+	switch (buf[0] >> 6) {
+	case SMPRET_16B: {
+		SMPayloadCommandRet16 ret;
+		((unsigned char *)&ret)[1] = buf[0];
+		((unsigned char *)&ret)[0] = buf[1];
+		return ret.retData;
+	}
+	case SMPRET_24B: {
+		SMPayloadCommandRet24 ret;
+		((unsigned char *)&ret)[2] = buf[0];
+		((unsigned char *)&ret)[1] = buf[1];
+		((unsigned char *)&ret)[0] = buf[2];
+		return ret.retData;
+	}
+	case SMPRET_32B: {
+		SMPayloadCommandRet32 ret;
+		((unsigned char *)&ret)[3] = buf[0];
+		((unsigned char *)&ret)[2] = buf[1];
+		((unsigned char *)&ret)[1] = buf[2];
+		((unsigned char *)&ret)[0] = buf[3];
+		return ret.retData;
+	}
+	default: {
+		SMPayloadCommandRet8 ret;
+		((unsigned char *)&ret)[0] = buf[0];
+		return ret.retData;
+	}
+	}
+}
+
+static smint32 random_value(void) {
+	static const smint32 edges[] = {0, 1, -1, 0x1fff, -0x2000, 0x1fffff, -0x200000, 0x1fffffff, -0x20000000, INT32_MAX, INT32_MIN};
+	if (rand() % 4 == 0)
+		return edges[rand() % (sizeof(edges) / sizeof(edges[0]))];
+	return (smint32)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+}
+
+int main(void) {
+	static const smuint8 types[] = {SMPCMD_SETPARAMADDR, SMPCMD_24B, SMPCMD_32B};
+	unsigned char expected[8], actual[8];
+	int i, t, len;
+
+	srand(1);
+
+	{
+		// encoding is byte identical to bitfields
+		for (i = 0; i < 100000; i++) {
+			smint32 value = random_value();
+			for (t = 0; t < 3; t++) {
+				memset(actual, 0xee, sizeof(actual));
+				len = encode_bitfield(expected, types[t], value);
+				assert(smEncodeSubpacket(actual, types[t], value) == len);
+				assert(memcmp(actual, expected, len) == 0);
+				assert(actual[len] == 0xee);
+			}
+		}
+		assert(smEncodeSubpacket(actual, 3, 0) == 0);
+	}
+
+	{
+		// decoding gives the same values as bitfields
+		for (i = 0; i < 100000; i++) {
+			smint32 value;
+			smint32 random = random_value();
+			memcpy(actual, &random, 4);
+			len = smDecodeReturnValue(actual, 4, &value);
+			assert(len == 4 - (actual[0] >> 6));
+			assert(value == decode_bitfield(actual));
+		}
+		assert(smDecodeReturnValue(actual, 0, &i) == 0);
+	}
+
+	{
+		// array encoding equals subpackets encoded one by one
+		smuint8 array_types[40], buf[120], reference[120];
+		smint32 values[40];
+		int pos = 0;
+
+		for (i = 0; i < 40; i++) {
+			array_types[i] = types[i % 3];
+			values[i] = random_value();
+			if (pos + 4 <= (int)sizeof(reference))
+				pos += encode_bitfield(&reference[pos], array_types[i], values[i]);
+		}
+		// 13 full triplets (117 bytes) fit
+		assert(encode_subpackets(buf, sizeof(buf), array_types, values, 39) == 117);
+		assert(memcmp(buf, reference, 117) == 0);
+		assert(encode_subpackets(buf, 117, array_types, values, 40) == -1);
+		array_types[0] = 3;
+		assert(encode_subpackets(buf, sizeof(buf), array_types, values, 1) == -1);
+	}
+
+	return 0;
+}
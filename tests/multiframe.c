@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../sm485.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "countingwrite.h"
+
+int main(void) {
+	smint32 value, bytes;
+	int i;
+	smbus h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, counting_write, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	{
+		// single frame queue overflows
+		for (i = 0; i < 20; i++)
+			assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, i) == SM_OK);
+		assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, i) == SM_ERR_LENGTH);
+		frames = 0;
+		assert(smExecuteCommandQueue(h, 1) == SM_OK);
+		assert(frames == 0);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// return values of all frames are read in queued order
+		assert(smSetMultiFrameQueue(h, smtrue) == SM_OK);
+		for (i = 0; i < 40; i++) {
+			assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, i * 1000) == SM_OK);
+			assert(smAppendGetParamCommandToQueue(h, SMP_ACTUAL_POSITION_FB) == SM_OK);
+		}
+		frames = 0;
+		longest_frame = 0;
+		assert(smExecuteCommandQueue(h, 1) == SM_OK);
+		assert(frames > 1);
+		assert(longest_frame <= SM485_MAX_PAYLOAD_BYTES + 5); // cmdid, address, length and crc
+		for (i = 0; i < 40; i++) {
+			assert(smGetQueuedSetParamReturnValue(h, &value) == SM_OK);
+			assert(smGetQueuedGetParamReturnValue(h, &value) == SM_OK);
+			assert(value == i * 1000);
+		}
+		assert(smBytesReceived(h, &bytes) == SM_OK);
+		assert(bytes == 0);
+		assert(smGetQueuedSMCommandReturnValue(h, &value) == SM_ERR_LENGTH);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// frames are packed by return length set in the queue: 60 writes with 1 byte replies take 3 full frames
+		assert(smAppendSetParamCommandToQueue(h, SMP_RETURN_PARAM_LEN, SMPRET_CMD_STATUS) == SM_OK);
+		for (i = 1; i < 60; i++)
+			assert(smAppendSetParamCommandToQueue(h, SMP_TRAJ_PLANNER_ACCEL, i) == SM_OK);
+		frames = 0;
+		assert(smExecuteCommandQueue(h, 2) == SM_OK);
+		assert(frames == 3);
+		for (i = 0; i < 60; i++)
+			assert(smGetQueuedSetParamReturnValue(h, &value) == SM_OK);
+		assert(smRead1Parameter(h, 2, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 59);
+	}
+
+	{
+		// following frames are not sent after failure
+		assert(smSetTimeout(50) == SM_OK);
+		for (i = 0; i < 40; i++)
+			assert(smAppendGetParamCommandToQueue(h, SMP_STATUS) == SM_OK);
+		frames = 0;
+		assert(smExecuteCommandQueue(h, 3) != SM_OK);
+		assert(frames == 1);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// disabling returns to single frame queue
+		assert(smSetMultiFrameQueue(h, smfalse) == SM_OK);
+		for (i = 0; i < 20; i++)
+			assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, i) == SM_OK);
+		assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, i) == SM_ERR_LENGTH);
+		assert(smExecuteCommandQueue(h, 1) == SM_OK);
+		resetCumulativeStatus(h);
+		assert(smRead1Parameter(h, 1, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK);
+		assert(value == 39000);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../bufferedmotion.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "countingwrite.h"
+
+int main(void) {
+	SM_NODE_INFO info;
+	smbool result;
+	smbus h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, counting_write, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	{
+		// filled in two transactions, then served from cache
+		frames = 0;
+		assert(smGetNodeInfo(h, 1, &info) == SM_OK);
+		assert(frames == 2);
+		assert(info.bus == h && info.address == 1);
+		assert(info.smVersion == 28);
+		assert(info.firmwareVersion == 1000);
+		assert(info.capabilities1 & DEVICE_CAPABILITY1_BUFFERED_MOTION_LINEAR_INTERPOLATION);
+		assert(info.capabilities2 == DEVICE_CAPABILITY2_RETURN_SMP_STATUS_ON_FAILED_SUBPACKETS);
+
+		memset(&info, 0, sizeof(info));
+		assert(smGetNodeInfo(h, 1, &info) == SM_OK);
+		assert(frames == 2);
+		assert(info.smVersion == 28);
+	}
+
+	{
+		// capability checks don't communicate once node is cached
+		frames = 0;
+		assert(smCheckDeviceCapabilities(h, 1, SMP_DEVICE_CAPABILITIES1, DEVICE_CAPABILITY1_TORQUE | DEVICE_CAPABILITY1_VELOCITY, &result) == SM_OK);
+		assert(result == smtrue);
+		assert(smCheckDeviceCapabilities(h, 1, SMP_DEVICE_CAPABILITIES2, DEVICE_CAPABILITY2_LOW_LEVEL_GPIO, &result) == SM_OK);
+		assert(result == smfalse);
+		assert(frames == 0);
+	}
+
+	{
+		// restart of device clears its entry only
+		assert(smGetNodeInfo(h, 2, &info) == SM_OK);
+		assert(smSetParameter(h, 1, SMP_SYSTEM_CONTROL, SMP_SYSTEM_CONTROL_RESTART) == SM_OK);
+		frames = 0;
+		assert(smGetNodeInfo(h, 2, &info) == SM_OK);
+		assert(frames == 0);
+		assert(smGetNodeInfo(h, 1, &info) == SM_OK);
+		assert(frames == 2);
+
+		// other system control commands keep it
+		assert(smSetParameter(h, 1, SMP_SYSTEM_CONTROL, SMP_SYSTEM_CONTROL_ABORTBUFFERED) == SM_OK);
+		frames = 0;
+		assert(smGetNodeInfo(h, 1, &info) == SM_OK);
+		assert(frames == 0);
+	}
+
+	{
+		// explicit invalidation, 0 clears all nodes
+		assert(smInvalidateNodeInfo(h, 0) == SM_OK);
+		frames = 0;
+		assert(smGetNodeInfo(h, 1, &info) == SM_OK);
+		assert(smGetNodeInfo(h, 2, &info) == SM_OK);
+		assert(frames == 4);
+	}
+
+	{
+		// buffered motion init uses cached capabilities
+		BufferedMotionAxis axis;
+		assert(smBufferedInit(&axis, h, 2, 1000, SMP_ACTUAL_POSITION_FB, SMPRET_24B) == SM_OK);
+		assert(axis.smProtocolVersion == 28);
+		assert(axis.deviceCapabilityFlags1 & DEVICE_CAPABILITY1_BUFFERED_MOTION_LINEAR_INTERPOLATION);
+		assert(smBufferedDeinit(&axis) == SM_OK);
+	}
+
+	{
+		// missing node is not cached
+		assert(smGetNodeInfo(h, 3, &info) != SM_OK);
+		assert(smGetNodeInfo(h, 0, &info) != SM_OK);
+		resetCumulativeStatus(h);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
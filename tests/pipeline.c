@@ -0,0 +1,339 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../busserver.h"
+#include "../transactiontemplate.h"
+#include "../sm485.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "../drivers/tcpip/tcpclient.h"
+
+#define BATCH 8
+
+typedef struct {
+	smint32 setpoint, position;
+} Feedback;
+
+static int maxInFlight, dropFrame;
+
+static smbus open_tcp(const char *name) {
+	return smOpenBusWithCallbacks(name, tcpipPortOpen, tcpipPortClose, tcpipPortRead, tcpipPortWrite, tcpipMiscOperation);
+}
+
+// empty reply from node
+static void send_reply(int fd, unsigned char address) {
+	unsigned char reply[5] = {SMCMD_INSTANT_CMD_RET, 0, address};
+	smuint16 crc = SM485_CRCINIT;
+	int i;
+	for (i = 0; i < 3; i++)
+		crc = calcCRC16(reply[i], crc);
+	reply[3] = crc >> 8;
+	reply[4] = crc & 0xff;
+	assert(send(fd, reply, sizeof(reply), 0) == sizeof(reply));
+}
+
+static int accept_gateway(void *arg, struct pollfd *pfd) {
+	int fd = accept((int)(intptr_t)arg, NULL, NULL);
+	assert(fd >= 0);
+	pfd->fd = fd;
+	pfd->events = POLLIN;
+	return fd;
+}
+
+// gateway that answers each frame with an empty reply once client has stopped sending for a while, and records
+// how many frames client had sent ahead at most
+static void *counting_gateway(void *arg) {
+	int fd, len = 0, n;
+	unsigned char buf[2048];
+	struct pollfd pfd;
+
+	fd = accept_gateway(arg, &pfd);
+	for (;;) {
+		int frames = 0, pos = 0;
+
+		if (poll(&pfd, 1, 5) > 0) {
+			n = (int)recv(fd, buf + len, sizeof(buf) - len, 0);
+			if (n <= 0)
+				break;
+			len += n;
+		}
+		while (pos + 2 <= len && pos + 5 + buf[pos + 1] <= len) {
+			pos += 5 + buf[pos + 1];
+			frames++;
+		}
+		if (frames > maxInFlight)
+			maxInFlight = frames;
+
+		if (frames > 0 && !(pfd.revents & POLLIN)) {
+			int first = 5 + buf[1];
+			send_reply(fd, buf[2]);
+			len -= first;
+			memmove(buf, buf + first, len);
+		}
+		pfd.revents = 0;
+	}
+	close(fd);
+	return NULL;
+}
+
+// gateway that answers each frame right away, except frame number dropFrame that gets no reply like from a missing node
+static void *dropping_gateway(void *arg) {
+	int fd, len = 0, n, frames = 0;
+	unsigned char buf[2048];
+	struct pollfd pfd;
+
+	fd = accept_gateway(arg, &pfd);
+	while ((n = (int)recv(fd, buf + len, sizeof(buf) - len, 0)) > 0) {
+		len += n;
+		while (len >= 2 && len >= 5 + buf[1]) {
+			int first = 5 + buf[1];
+			if (frames++ != dropFrame)
+				send_reply(fd, buf[2]);
+			len -= first;
+			memmove(buf, buf + first, len);
+		}
+	}
+	close(fd);
+	return NULL;
+}
+
+static smbus open_gateway(void *(*gateway)(void *), int *listener, pthread_t *thread) {
+	struct sockaddr_in addr;
+	socklen_t addrLen = sizeof(addr);
+	char name[32];
+
+	*listener = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(*listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(*listener, 1) == 0);
+	assert(getsockname(*listener, (struct sockaddr *)&addr, &addrLen) == 0);
+	assert(pthread_create(thread, NULL, gateway, (void *)(intptr_t)*listener) == 0);
+
+	snprintf(name, sizeof(name), "127.0.0.1:%d", ntohs(addr.sin_port));
+	return open_tcp(name);
+}
+
+// execute batch of write-only templates of given payload size to given number of nodes through counting gateway
+static int frames_in_flight(int maxFrames, int maxBytes, int writes, int nodes) {
+	SM_TRANSACTION_TEMPLATE tpl;
+	SM_TEMPLATE_TRANSACTION batch[BATCH];
+	pthread_t thread;
+	int listener, i;
+	smbus h;
+
+	maxInFlight = 0;
+	h = open_gateway(counting_gateway, &listener, &thread);
+	assert(h >= 0);
+	assert(smSetPipelineWindow(h, maxFrames, maxBytes) == SM_OK);
+
+	smTemplateInit(&tpl);
+	for (i = 0; i < writes; i++)
+		assert(smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, i) == i);
+	for (i = 0; i < BATCH; i++) {
+		batch[i].nodeAddress = i % nodes + 1;
+		batch[i].tpl = &tpl;
+		batch[i].results = NULL;
+	}
+	assert(smTemplateExecuteBatch(h, batch, BATCH) == SM_OK);
+	for (i = 0; i < BATCH; i++)
+		assert(batch[i].status == SM_OK);
+
+	smCloseBus(h);
+	assert(pthread_join(thread, NULL) == 0);
+	close(listener);
+	return maxInFlight;
+}
+
+int main(void) {
+	SMBusServer *server = NULL;
+	char path[32], name[32];
+	smbus h;
+	int i, port = 0;
+
+	for (i = 0; i < 10 && server == NULL; i++) {
+		port = 20000 + (getpid() + i * 1009) % 40000;
+		snprintf(path, sizeof(path), "tcp:127.0.0.1:%d", port);
+		server = smBusServerOpenWithCallbacks("SIM:4", path, simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+	}
+	assert(server != NULL);
+	snprintf(name, sizeof(name), "127.0.0.1:%d", port);
+	h = open_tcp(name);
+	assert(h >= 0);
+
+	{
+		// invalid windows and addresses
+		assert(smSetPipelineWindow(h, 0, 0) == SM_ERR_PARAMETER);
+		assert(smSetPipelineWindow(h, SM_MAX_PIPELINE_FRAMES + 1, 0) == SM_ERR_PARAMETER);
+		assert(smSetPipelineWindow(h, 4, 124) == SM_ERR_PARAMETER);
+		assert(smSetPipelineWindow(h, 4, 125) == SM_OK);
+		assert(smSetPipelineWindow(-1, 4, 0) == SM_ERR_NODEVICE);
+		assert(smBusServerOpen("SIM", "tcp:127.0.0.1") == NULL);
+		assert(smBusServerOpen("SIM", "tcp:localhost:1234") == NULL);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// window is bounded by frame count and bytes, default is no pipelining
+		assert(frames_in_flight(1, 0, 1, BATCH) == 1);
+		assert(frames_in_flight(4, 0, 1, BATCH) == 4);
+		// frame of 15 writes is 95 bytes
+		assert(frames_in_flight(SM_MAX_PIPELINE_FRAMES, 200, 15, BATCH) == 2);
+		assert(frames_in_flight(SM_MAX_PIPELINE_FRAMES, 0, 15, BATCH) == BATCH);
+		// and by one frame per node
+		assert(frames_in_flight(4, 0, 1, 1) == 1);
+		assert(frames_in_flight(4, 0, 1, 2) == 2);
+	}
+
+	{
+		// reply of a node that doesn't come is not taken from the next frame to the same node
+		SM_TRANSACTION_TEMPLATE tpl;
+		SM_TEMPLATE_TRANSACTION batch[6];
+		pthread_t thread;
+		int listener;
+		smbus gw;
+
+		dropFrame = 2;
+		gw = open_gateway(dropping_gateway, &listener, &thread);
+		assert(gw >= 0);
+		assert(smSetPipelineWindow(gw, 4, 0) == SM_OK);
+		assert(smSetTimeout(50) == SM_OK);
+		smTemplateInit(&tpl);
+		smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, 1);
+		for (i = 0; i < 6; i++) {
+			batch[i].nodeAddress = i < 2 ? 2 : 1;
+			batch[i].tpl = &tpl;
+			batch[i].results = NULL;
+		}
+		assert(smTemplateExecuteBatch(gw, batch, 6) == SM_ERR_COMMUNICATION);
+		for (i = 0; i < 6; i++)
+			assert(batch[i].status == (i == 2 ? SM_ERR_COMMUNICATION : SM_OK));
+		assert(smSetTimeout(SM_READ_TIMEOUT) == SM_OK);
+		resetCumulativeStatus(gw);
+		assert(smCloseBus(gw) == SM_OK);
+		assert(pthread_join(thread, NULL) == 0);
+		close(listener);
+	}
+
+	{
+		// batch through stand-in gateway, broadcast write is executed before the following reads
+		SM_TRANSACTION_TEMPLATE write, read;
+		SM_TEMPLATE_TRANSACTION batch[BATCH];
+		Feedback fb[BATCH];
+		int setpoint;
+
+		assert(smSetPipelineWindow(h, 4, 0) == SM_OK);
+		smTemplateInit(&write);
+		setpoint = smTemplateAppendSetParam(&write, SMP_ABSOLUTE_SETPOINT, 0);
+		smTemplateInit(&read);
+		smTemplateAppendGetParam(&read, SMP_ABSOLUTE_SETPOINT, offsetof(Feedback, setpoint));
+		smTemplateAppendGetParam(&read, SMP_ACTUAL_POSITION_FB, offsetof(Feedback, position));
+
+		for (i = 1; i <= 4; i++) {
+			smTemplateSetValue(&write, setpoint, i * 100);
+			assert(smTemplateExecute(h, i, &write, NULL) == SM_OK);
+		}
+		memset(fb, 0, sizeof(fb));
+		for (i = 0; i < 4; i++) {
+			batch[i].nodeAddress = i + 1;
+			batch[i].tpl = &read;
+			batch[i].results = &fb[i];
+		}
+		smTemplateSetValue(&write, setpoint, 555);
+		batch[4].nodeAddress = 0;
+		batch[4].tpl = &write;
+		batch[4].results = NULL;
+		for (i = 5; i < BATCH; i++) {
+			batch[i].nodeAddress = i - 3;
+			batch[i].tpl = &read;
+			batch[i].results = &fb[i];
+		}
+		assert(smTemplateExecuteBatch(h, batch, BATCH) == SM_OK);
+		for (i = 0; i < BATCH; i++)
+			assert(batch[i].status == SM_OK);
+		for (i = 0; i < 4; i++)
+			assert(fb[i].setpoint == (i + 1) * 100);
+		for (i = 5; i < BATCH; i++)
+			assert(fb[i].setpoint == 555);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	{
+		// missing node fails when reply of the next frame arrives, without waiting for timeout
+		SM_TRANSACTION_TEMPLATE read;
+		SM_TEMPLATE_TRANSACTION batch[4];
+		Feedback fb[4];
+		const smaddr nodes[4] = {1, 9, 2, 3};
+		smuint64 start;
+
+		// server gives up on missing node long before the client would
+		assert(smSetTimeout(50) == SM_OK);
+		assert(smSetAdaptiveTimeout(h, smtrue, 2000, 3000) == SM_OK);
+		smTemplateInit(&read);
+		smTemplateAppendGetParam(&read, SMP_ABSOLUTE_SETPOINT, offsetof(Feedback, setpoint));
+		for (i = 0; i < 4; i++) {
+			batch[i].nodeAddress = nodes[i];
+			batch[i].tpl = &read;
+			batch[i].results = &fb[i];
+		}
+		start = smGetMonotonicTimeNs();
+		assert(smTemplateExecuteBatch(h, batch, 4) == SM_ERR_COMMUNICATION);
+		assert(smGetMonotonicTimeNs() - start < 1000000000ULL);
+		assert(batch[0].status == SM_OK && fb[0].setpoint == 555);
+		assert(batch[1].status == SM_ERR_COMMUNICATION);
+		assert(batch[2].status == SM_OK && fb[2].setpoint == 555);
+		assert(batch[3].status == SM_OK && fb[3].setpoint == 555);
+		assert(smSetAdaptiveTimeout(h, smfalse, 0, 0) == SM_OK);
+		assert(smSetTimeout(SM_READ_TIMEOUT) == SM_OK);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// multi-frame queue goes to one node, so its frames are sent one at a time
+		smint32 value;
+		smuint32 forwarded;
+		assert(smSetPipelineWindow(h, SM_MAX_PIPELINE_FRAMES, 4 * 125) == SM_OK);
+		assert(smSetMultiFrameQueue(h, smtrue) == SM_OK);
+		for (i = 0; i < 60; i++)
+			assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, i) == SM_OK);
+		for (i = 0; i < 60; i++)
+			assert(smAppendGetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT) == SM_OK);
+		assert(smExecuteCommandQueue(h, 2) == SM_OK);
+		for (i = 0; i < 60; i++)
+			assert(smGetQueuedSetParamReturnValue(h, &value) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(h, &value) == SM_OK);
+		assert(value == 59);
+		for (i = 1; i < 60; i++)
+			assert(smGetQueuedGetParamReturnValue(h, &value) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(h, &value) == SM_ERR_LENGTH);
+		resetCumulativeStatus(h);
+
+		// failed frame stops sending the rest of the queue (60 reads take more than 2 frames)
+		assert(smSetPipelineWindow(h, 2, 0) == SM_OK);
+		assert(smSetTimeout(50) == SM_OK);
+		forwarded = smBusServerFramesForwarded(server);
+		for (i = 0; i < 60; i++)
+			assert(smAppendGetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT) == SM_OK);
+		assert(smExecuteCommandQueue(h, 9) == SM_ERR_COMMUNICATION);
+		assert(smSetTimeout(SM_READ_TIMEOUT) == SM_OK);
+		assert(smSetMultiFrameQueue(h, smfalse) == SM_OK);
+		resetCumulativeStatus(h);
+		assert(smRead1Parameter(h, 2, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK && value == 59);
+		assert(smBusServerFramesForwarded(server) - forwarded == 2);
+	}
+
+	smCloseBus(h);
+	smBusServerClose(server);
+	return 0;
+}
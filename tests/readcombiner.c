@@ -0,0 +1,75 @@
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../simplemotion.h"
+#include "../readcombiner.h"
+#include "../drivers/simulator/smsimulator.h"
+
+#define THREADS 8
+#define READS 50
+
+static SMReadCombiner *combiner;
+
+static void *reader_thread(void *arg) {
+	smint32 node = (smint32)(intptr_t)arg % 2 + 1, value, i;
+	for (i = 0; i < READS; i++) {
+		if (smCombinedRead1Parameter(combiner, node, SMP_ABSOLUTE_SETPOINT, &value) != SM_OK || value != node * 100)
+			return (void *)1;
+		if (smCombinedRead1Parameter(combiner, node, SMP_ACTUAL_POSITION_FB, &value) != SM_OK || value != node * 100)
+			return (void *)2;
+	}
+	return NULL;
+}
+
+int main(void) {
+	smuint32 reads, frames;
+	smint32 value;
+	smbus h;
+	int i;
+
+	smSetSimulatorTiming(smfalse, 2000);
+	h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+	smSetSimulatorTiming(smfalse, 0);
+	assert(h >= 0);
+	assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 100) == SM_OK);
+	assert(smSetParameter(h, 2, SMP_ABSOLUTE_SETPOINT, 200) == SM_OK);
+	combiner = smReadCombinerCreate(h);
+	assert(combiner != NULL);
+
+	{
+		// single read is one frame
+		value = 0;
+		assert(smCombinedRead1Parameter(combiner, 2, SMP_ACTUAL_POSITION_FB, &value) == SM_OK);
+		assert(value == 200);
+		smReadCombinerGetStats(combiner, &reads, &frames);
+		assert(reads == 1 && frames == 1);
+	}
+
+	{
+		// missing node fails and leaves value untouched
+		value = 7;
+		assert(smCombinedRead1Parameter(combiner, 3, SMP_ACTUAL_POSITION_FB, &value) != SM_OK);
+		assert(value == 7);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		// concurrent reads share frames
+		pthread_t threads[THREADS];
+		void *result;
+
+		for (i = 0; i < THREADS; i++)
+			assert(pthread_create(&threads[i], NULL, reader_thread, (void *)(intptr_t)i) == 0);
+		for (i = 0; i < THREADS; i++) {
+			assert(pthread_join(threads[i], &result) == 0);
+			assert(result == NULL);
+		}
+		smReadCombinerGetStats(combiner, &reads, &frames);
+		assert(reads == 2 + THREADS * READS * 2);
+		assert(frames < reads * 2 / 3);
+	}
+
+	smReadCombinerDestroy(combiner);
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "../drivers/replay/smreplay.h"
+
+static char path[64];
+
+static smbus open_replay(void) {
+	char name[80];
+	snprintf(name, sizeof(name), "REPLAY:%s", path);
+	return smOpenBusWithCallbacks(name, replayPortOpen, replayPortClose, replayPortRead, replayPortWrite, replayPortMiscOperation);
+}
+
+// the session that is recorded and replayed
+static void session(smbus h, smint32 *values) {
+	assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 1234) == SM_OK);
+	assert(smRead1Parameter(h, 1, SMP_ABSOLUTE_SETPOINT, &values[0]) == SM_OK);
+	assert(smRead2Parameters(h, 2, SMP_SM_VERSION, &values[1], SMP_FIRMWARE_VERSION, &values[2]) == SM_OK);
+}
+
+int main(void) {
+	smint32 recorded[3], replayed[3], value;
+	smbus h;
+
+	snprintf(path, sizeof(path), "/tmp/smtest-replay-%d.smcap", (int)getpid());
+	assert(smSetTimeout(50) == SM_OK);
+
+	{
+		// record simulator session
+		h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+		assert(h >= 0);
+		assert(smCaptureStart(h, path) == SM_OK);
+		session(h, recorded);
+		assert(smRead1Parameter(h, 3, SMP_SM_VERSION, &value) & SM_ERR_COMMUNICATION);
+		assert(smCloseBus(h) == SM_OK);
+		assert(recorded[0] == 1234);
+	}
+
+	{
+		// replay gives the same replies, missing node times out like at capture time
+		h = open_replay();
+		assert(h >= 0);
+		memset(replayed, 0, sizeof(replayed));
+		session(h, replayed);
+		assert(memcmp(recorded, replayed, sizeof(recorded)) == 0);
+		assert(smRead1Parameter(h, 3, SMP_SM_VERSION, &value) & SM_ERR_COMMUNICATION);
+		resetCumulativeStatus(h);
+
+		// nothing left to replay
+		assert(smRead1Parameter(h, 1, SMP_ABSOLUTE_SETPOINT, &value) & SM_ERR_BUS);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	{
+		// frame that differs from recording fails
+		h = open_replay();
+		assert(h >= 0);
+		assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 4321) & SM_ERR_BUS);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	{
+		// replay at recorded pace gives the same replies
+		smSetReplayTimeScale(100);
+		h = open_replay();
+		assert(h >= 0);
+		memset(replayed, 0, sizeof(replayed));
+		session(h, replayed);
+		assert(memcmp(recorded, replayed, sizeof(recorded)) == 0);
+		assert(smCloseBus(h) == SM_OK);
+		smSetReplayTimeScale(0);
+	}
+
+	{
+		// not a capture file
+		unlink(path);
+		assert(open_replay() < 0);
+		assert(smOpenBusWithCallbacks("SIM", replayPortOpen, replayPortClose, replayPortRead, replayPortWrite, replayPortMiscOperation) < 0);
+	}
+
+	return 0;
+}
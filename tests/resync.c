@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../sm485.h"
+#include "../transactiontemplate.h"
+#include "../drivers/simulator/smsimulator.h"
+
+// simulator wrapper that injects noise bytes in front of the next reply or corrupts one of its bytes
+static smuint8 noise[4];
+static int noise_len, noise_pos;
+static int corrupt_at = -1;
+static int reads;
+
+static smint32 noisy_read(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	smint32 n;
+	if (noise_pos < noise_len) {
+		buf[0] = noise[noise_pos++];
+		return 1;
+	}
+	n = simulatorPortRead(busdevicePointer, buf, size);
+	if (n == 1 && corrupt_at >= 0 && reads++ == corrupt_at) {
+		buf[0] ^= 0x10;
+		corrupt_at = -1;
+	}
+	return n;
+}
+
+// counts how receive errors discard buffered data
+static int purges, discards;
+
+static smbool counting_misc(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation) {
+	if (operation == MiscOperationPurgeRX)
+		purges++;
+	if (operation == MiscOperationDiscardRX)
+		discards++;
+	return simulatorPortMiscOperation(busdevicePointer, operation);
+}
+
+static void inject_noise(const smuint8 *bytes, int len) {
+	memcpy(noise, bytes, len);
+	noise_len = len;
+	noise_pos = 0;
+}
+
+static void corrupt_reply_byte(int index) {
+	reads = 0;
+	corrupt_at = index;
+}
+
+int main(void) {
+	smbus h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, noisy_read, simulatorPortWrite, counting_misc);
+	smint32 value;
+	int i;
+	assert(h >= 0);
+
+	{
+		// byte that can't start a frame is skipped
+		const smuint8 bytes[] = {0x07};
+		inject_noise(bytes, sizeof(bytes));
+		resetCumulativeStatus(h);
+		assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) == SM_OK);
+		assert(value == 28);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	{
+		// noise that looks like a frame start is detected by CRC and the actual reply is found after it
+		const smuint8 bytes[] = {SMCMD_FAST_UPDATE_CYCLE_RET};
+		inject_noise(bytes, sizeof(bytes));
+		assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) == SM_OK);
+		assert(value == 28);
+	}
+
+	{
+		const smuint8 bytes[] = {SMCMD_ERROR_RET, 0x40, SMCMD_GET_CLOCK_RET};
+		inject_noise(bytes, sizeof(bytes));
+		assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) == SM_OK);
+		assert(value == 28);
+	}
+
+	{
+		// noise byte that makes reply command ID look like payload size longer than the actual reply
+		const smuint8 bytes[] = {SMCMD_INSTANT_CMD_RET};
+		inject_noise(bytes, sizeof(bytes));
+		assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) == SM_OK);
+		assert(value == 28);
+	}
+
+	{
+		// corrupted reply fails but the following transactions work normally. buffered data is discarded without the
+		// sleeping purge
+		purges = discards = 0;
+		corrupt_reply_byte(4);
+		assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) != SM_OK);
+		assert(purges == 0 && discards == 1);
+		resetCumulativeStatus(h);
+		assert(smRead1Parameter(h, 1, SMP_SM_VERSION, &value) == SM_OK);
+		assert(value == 28);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	{
+		// corrupted reply of pipelined frame doesn't discard replies of the frames after it
+		SM_TRANSACTION_TEMPLATE tpl;
+		SM_TEMPLATE_TRANSACTION batch[2];
+
+		smTemplateInit(&tpl);
+		smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, 1);
+		for (i = 0; i < 2; i++) {
+			batch[i].nodeAddress = i + 1;
+			batch[i].tpl = &tpl;
+			batch[i].results = NULL;
+		}
+		assert(smSetPipelineWindow(h, 2, 0) == SM_OK);
+		purges = discards = 0;
+		corrupt_reply_byte(4);
+		assert(smTemplateExecuteBatch(h, batch, 2) != SM_OK);
+		assert(batch[0].status != SM_OK && batch[1].status == SM_OK);
+		assert(purges == 0 && discards == 0);
+		resetCumulativeStatus(h);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
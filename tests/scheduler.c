@@ -0,0 +1,150 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../busscheduler.h"
+#include "../drivers/simulator/smsimulator.h"
+
+#define PERIOD_US 20000
+
+static SMBusScheduler *scheduler;
+static smuint64 cyclicGrantNs;
+static int order[2], served;
+
+static void *cyclic_thread(void *arg) {
+	smuint64 dueNs = *(smuint64 *)arg;
+	while (smGetMonotonicTimeNs() < dueNs)
+		smSleepUs(100);
+	assert(smSchedulerBegin(scheduler, SM_SCHEDULER_CYCLIC, 1000) == SM_OK);
+	cyclicGrantNs = smGetMonotonicTimeNs();
+	smSleepMs(1);
+	smSchedulerEnd(scheduler);
+	return NULL;
+}
+
+static void *class_thread(void *arg) {
+	SM_SCHEDULER_CLASS schedulingClass = (SM_SCHEDULER_CLASS)(long)arg;
+	assert(smSchedulerBegin(scheduler, schedulingClass, 100) == SM_OK);
+	order[served++] = schedulingClass;
+	smSchedulerEnd(scheduler);
+	return NULL;
+}
+
+int main(void) {
+	SM_SCHEDULER_STATS stats;
+	smuint64 start;
+	int i;
+
+	{
+		// invalid arguments
+		assert(smSchedulerCreate(0, 0) == NULL);
+		scheduler = smSchedulerCreate(0, PERIOD_US);
+		assert(scheduler != NULL);
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_NUM_CLASSES, 100) == SM_ERR_PARAMETER);
+		assert(smSchedulerSetBudget(scheduler, SM_SCHEDULER_CYCLIC, 100) == SM_ERR_PARAMETER);
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_NUM_CLASSES, &stats) == SM_ERR_PARAMETER);
+		assert(smSchedulerEstimateUs(scheduler, 1, SM_SCHEDULER_READ_TX_BYTES, SM_SCHEDULER_READ_RX_BYTES) == 0);
+		smSchedulerDestroy(scheduler);
+	}
+
+	{
+		// estimate includes wire time of both frames
+		smbus h = smOpenBusWithCallbacks("SIM:1", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+		smuint32 readUs, writeUs;
+		assert(h >= 0);
+		scheduler = smSchedulerCreate(h, PERIOD_US);
+		readUs = smSchedulerEstimateUs(scheduler, 1, SM_SCHEDULER_READ_TX_BYTES, SM_SCHEDULER_READ_RX_BYTES);
+		writeUs = smSchedulerEstimateUs(scheduler, 1, SM_SCHEDULER_WRITE_TX_BYTES, SM_SCHEDULER_WRITE_RX_BYTES);
+		assert(writeUs > 0 && readUs > writeUs);
+		smSchedulerDestroy(scheduler);
+		smCloseBus(h);
+	}
+
+	{
+		// without cyclic traffic others are granted immediately
+		scheduler = smSchedulerCreate(0, PERIOD_US);
+		for (i = 0; i < 3; i++) {
+			assert(smSchedulerBegin(scheduler, SM_SCHEDULER_ACYCLIC, 50000) == SM_OK);
+			smSchedulerEnd(scheduler);
+		}
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_ACYCLIC, &stats) == SM_OK);
+		assert(stats.granted == 3 && stats.deferred == 0 && stats.usedUs == 150000);
+		smSchedulerDestroy(scheduler);
+	}
+
+	{
+		// transaction that doesn't fit before next cyclic one waits until it has been made
+		pthread_t thread;
+		smuint64 cycleNs, dueNs;
+
+		scheduler = smSchedulerCreate(0, PERIOD_US);
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_CYCLIC, 1000) == SM_OK);
+		cycleNs = smGetMonotonicTimeNs();
+		smSchedulerEnd(scheduler);
+
+		// fits in the gap
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_ACYCLIC, PERIOD_US / 4) == SM_OK);
+		smSchedulerEnd(scheduler);
+		// longer than the whole gap, goes right after the cyclic one
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_BACKGROUND, PERIOD_US * 2) == SM_OK);
+		smSchedulerEnd(scheduler);
+
+		dueNs = cycleNs + PERIOD_US * 1000ULL;
+		assert(pthread_create(&thread, NULL, cyclic_thread, &dueNs) == 0);
+		while (smGetMonotonicTimeNs() < cycleNs + PERIOD_US * 1000ULL / 2)
+			smSleepUs(100);
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_ACYCLIC, PERIOD_US * 3 / 4) == SM_OK);
+		assert(cyclicGrantNs != 0 && smGetMonotonicTimeNs() > cyclicGrantNs);
+		smSchedulerEnd(scheduler);
+		assert(pthread_join(thread, NULL) == 0);
+
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_ACYCLIC, &stats) == SM_OK);
+		assert(stats.granted == 2 && stats.deferred == 1 && stats.maxWaitUs > 0);
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_BACKGROUND, &stats) == SM_OK);
+		assert(stats.granted == 1 && stats.deferred == 0);
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_CYCLIC, &stats) == SM_OK);
+		assert(stats.granted == 2 && stats.deferred == 0);
+		smSchedulerDestroy(scheduler);
+	}
+
+	{
+		// budget limits time of a class per cycle
+		scheduler = smSchedulerCreate(0, PERIOD_US);
+		assert(smSchedulerSetBudget(scheduler, SM_SCHEDULER_BACKGROUND, 1000) == SM_OK);
+		start = smGetMonotonicTimeNs();
+		for (i = 0; i < 2; i++) {
+			assert(smSchedulerBegin(scheduler, SM_SCHEDULER_BACKGROUND, 400) == SM_OK);
+			smSchedulerEnd(scheduler);
+		}
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_BACKGROUND, &stats) == SM_OK);
+		assert(stats.deferred == 0);
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_BACKGROUND, 400) == SM_OK);
+		smSchedulerEnd(scheduler);
+		assert(smSchedulerGetStats(scheduler, SM_SCHEDULER_BACKGROUND, &stats) == SM_OK);
+		assert(stats.granted == 3 && stats.deferred == 1);
+		assert(smGetMonotonicTimeNs() - start > PERIOD_US * 1000ULL / 2);
+		smSchedulerDestroy(scheduler);
+	}
+
+	{
+		// higher class is served first when bus becomes free
+		pthread_t threads[2];
+
+		scheduler = smSchedulerCreate(0, PERIOD_US);
+		assert(smSchedulerBegin(scheduler, SM_SCHEDULER_ACYCLIC, 100) == SM_OK);
+		assert(pthread_create(&threads[0], NULL, class_thread, (void *)(long)SM_SCHEDULER_BACKGROUND) == 0);
+		smSleepMs(10);
+		assert(pthread_create(&threads[1], NULL, class_thread, (void *)(long)SM_SCHEDULER_ACYCLIC) == 0);
+		smSleepMs(10);
+		smSchedulerEnd(scheduler);
+		for (i = 0; i < 2; i++)
+			assert(pthread_join(threads[i], NULL) == 0);
+		assert(served == 2);
+		assert(order[0] == SM_SCHEDULER_ACYCLIC && order[1] == SM_SCHEDULER_BACKGROUND);
+		smSchedulerDestroy(scheduler);
+	}
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../sharedtelemetry.h"
+#include "../drivers/simulator/smsimulator.h"
+
+static char name[64];
+
+// move sample position of published object as if that many samples had been written
+static void set_samples_written(smuint32 samplesWritten) {
+	SM_SHARED_TELEMETRY_HEADER *header;
+	int fd = shm_open(name, O_RDWR, 0);
+	assert(fd >= 0);
+	header = mmap(NULL, sizeof(*header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	assert(header != MAP_FAILED);
+	header->samplesWritten = samplesWritten;
+	munmap(header, sizeof(*header));
+	close(fd);
+}
+
+// reader process: waits for a value and samples written by the parent
+static int child_reader(void) {
+	SM_SHARED_TELEMETRY_SAMPLE samples[16];
+	SM_TELEMETRY_SAMPLE sample;
+	SMSharedTelemetry *reader = smSharedTelemetryOpen(name);
+	smuint32 position = 0, lost;
+	int slot, num, received = 0, i;
+
+	if (reader == NULL)
+		return 1;
+	slot = smSharedTelemetryFindSlot(reader, 1, SMP_ACTUAL_POSITION_FB);
+	if (slot < 0)
+		return 2;
+	for (i = 0; i < 5000 && received < 100; i++) {
+		if (smSharedTelemetryReadSamples(reader, &position, samples, 16, &num, &lost) != SM_OK || lost != 0)
+			return 3;
+		while (num-- > 0) {
+			if (samples[num].value != (received + num) * 3)
+				return 4;
+		}
+		received = (int)position;
+		usleep(1000);
+	}
+	if (received != 100)
+		return 5;
+	if (smSharedTelemetryRead(reader, slot, &sample) != SM_OK || sample.value != 1234 || sample.updates != 1)
+		return 6;
+	smSharedTelemetryClose(reader);
+	return 0;
+}
+
+int main(void) {
+	SM_SHARED_TELEMETRY_SAMPLE samples[64];
+	SM_TELEMETRY_SAMPLE sample;
+	SMSharedTelemetry *pub, *reader;
+	smuint32 position, lost;
+	smint32 values[100];
+	int i, num;
+
+	snprintf(name, sizeof(name), "/smtest-%d", (int)getpid());
+	for (i = 0; i < 100; i++)
+		values[i] = i * 3;
+
+	{
+		// invalid arguments and missing object
+		assert(smSharedTelemetryCreate(name, 0, 16) == NULL);
+		assert(smSharedTelemetryCreate(name, 4, 0) == NULL);
+		assert(smSharedTelemetryOpen(name) == NULL);
+	}
+
+	{
+		// slots
+		pub = smSharedTelemetryCreate(name, 2, 16);
+		assert(pub != NULL);
+		reader = smSharedTelemetryOpen(name);
+		assert(reader != NULL);
+		assert(smSharedTelemetryNumSlots(reader) == 0);
+		assert(smSharedTelemetryAddSlot(pub, 1, SMP_STATUS) == 0);
+		assert(smSharedTelemetryAddSlot(pub, 2, SMP_STATUS) == 1);
+		assert(smSharedTelemetryAddSlot(pub, 1, SMP_STATUS) == 0);
+		assert(smSharedTelemetryAddSlot(pub, 3, SMP_STATUS) == -1);
+		assert(smSharedTelemetryAddSlot(reader, 3, SMP_STATUS) == -1);
+		assert(smSharedTelemetryNumSlots(reader) == 2);
+		assert(smSharedTelemetryFindSlot(reader, 2, SMP_STATUS) == 1);
+		assert(smSharedTelemetryFindSlot(reader, 2, SMP_FAULTS) == -1);
+
+		sample.value = -55;
+		sample.status = SM_OK;
+		sample.updates = 7;
+		sample.timestampNs = 123456789;
+		assert(smSharedTelemetryWrite(pub, 1, &sample) == SM_OK);
+		assert(smSharedTelemetryWrite(pub, 2, &sample) == SM_ERR_PARAMETER);
+		assert(smSharedTelemetryWrite(reader, 1, &sample) == SM_ERR_PARAMETER);
+		memset(&sample, 0, sizeof(sample));
+		assert(smSharedTelemetryRead(reader, 1, &sample) == SM_OK);
+		assert(sample.value == -55 && sample.status == SM_OK && sample.updates == 7 && sample.timestampNs == 123456789);
+		assert(smSharedTelemetryRead(reader, 0, &sample) == SM_OK);
+		assert(sample.status == SM_NONE && sample.updates == 0);
+		assert(smSharedTelemetryRead(reader, 2, &sample) == SM_ERR_PARAMETER);
+		smSharedTelemetryClose(reader);
+		smSharedTelemetryClose(pub);
+	}
+
+	{
+		// sample ring, size is rounded up to power of two and overwritten samples are reported lost
+		pub = smSharedTelemetryCreate(name, 1, 20);
+		reader = smSharedTelemetryOpen(name);
+		position = smSharedTelemetrySamplePosition(reader);
+		assert(position == 0);
+
+		assert(smSharedTelemetryWriteSamples(pub, 1, SMP_ACTUAL_POSITION_FB, values, 10) == SM_OK);
+		assert(smSharedTelemetryReadSamples(reader, &position, samples, 64, &num, &lost) == SM_OK);
+		assert(num == 10 && lost == 0 && position == 10);
+		for (i = 0; i < 10; i++)
+			assert(samples[i].value == values[i] && samples[i].nodeAddress == 1 && samples[i].paramAddress == SMP_ACTUAL_POSITION_FB);
+
+		assert(smSharedTelemetryWriteSamples(pub, 2, SMP_ACTUAL_POSITION_FB, values, 40) == SM_OK);
+		assert(smSharedTelemetryReadSamples(reader, &position, samples, 64, &num, &lost) == SM_OK);
+		assert(num == 32 && lost == 8 && position == 50);
+		assert(samples[0].value == values[8] && samples[31].value == values[39]);
+
+		// read in parts
+		assert(smSharedTelemetryWriteSamples(pub, 2, SMP_ACTUAL_POSITION_FB, values, 5) == SM_OK);
+		assert(smSharedTelemetryReadSamples(reader, &position, samples, 3, &num, &lost) == SM_OK);
+		assert(num == 3 && position == 53);
+		assert(smSharedTelemetryReadSamples(reader, &position, samples, 3, &num, &lost) == SM_OK);
+		assert(num == 2 && position == 55 && samples[1].value == values[4]);
+
+		// sample number wraps around without a sample getting the being written sequence 0
+		set_samples_written(0xfffffffe);
+		position = smSharedTelemetrySamplePosition(reader);
+		assert(smSharedTelemetryWriteSamples(pub, 3, SMP_ACTUAL_POSITION_FB, values, 4) == SM_OK);
+		assert(smSharedTelemetryReadSamples(reader, &position, samples, 64, &num, &lost) == SM_OK);
+		assert(num == 4 && lost == 0 && position == 2);
+		for (i = 0; i < 4; i++)
+			assert(samples[i].sequence != 0 && samples[i].value == values[i]);
+
+		smSharedTelemetryClose(pub);
+		assert(smSharedTelemetryOpen(name) == NULL);
+		smSharedTelemetryClose(reader);
+	}
+
+	{
+		// telemetry engine publishes polled values
+		SMTelemetry *t;
+		int item;
+		smbus h = smOpenBusWithCallbacks("SIM:1", simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+		assert(h >= 0);
+		assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 777) == SM_OK);
+
+		pub = smSharedTelemetryCreate(name, 4, 16);
+		reader = smSharedTelemetryOpen(name);
+		t = smTelemetryCreate(h);
+		item = smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 10);
+		assert(smTelemetrySetPublisher(t, pub) == SM_OK);
+		assert(smTelemetryAddItem(t, 1, SMP_ABSOLUTE_SETPOINT, 10) == item + 1);
+		assert(smSharedTelemetryNumSlots(reader) == 2);
+		assert(smTelemetryPoll(t, NULL) == SM_OK);
+
+		assert(smSharedTelemetryRead(reader, smSharedTelemetryFindSlot(reader, 1, SMP_ACTUAL_POSITION_FB), &sample) == SM_OK);
+		assert(sample.value == 777 && sample.updates == 1 && sample.status == SM_OK);
+		assert(smSharedTelemetryRead(reader, smSharedTelemetryFindSlot(reader, 1, SMP_ABSOLUTE_SETPOINT), &sample) == SM_OK);
+		assert(sample.value == 777);
+
+		smTelemetryDestroy(t);
+		smSharedTelemetryClose(reader);
+		smSharedTelemetryClose(pub);
+		assert(smCloseBus(h) == SM_OK);
+	}
+
+	{
+		// another process reads while publisher writes
+		pid_t pid;
+		int status;
+
+		pub = smSharedTelemetryCreate(name, 1, 256);
+		assert(smSharedTelemetryAddSlot(pub, 1, SMP_ACTUAL_POSITION_FB) == 0);
+		pid = fork();
+		assert(pid >= 0);
+		if (pid == 0)
+			_exit(child_reader());
+
+		for (i = 0; i < 100; i++) {
+			assert(smSharedTelemetryWriteSamples(pub, 1, SMP_ACTUAL_POSITION_FB, &values[i], 1) == SM_OK);
+			if (i == 50) {
+				sample.value = 1234;
+				sample.status = SM_OK;
+				sample.updates = 1;
+				sample.timestampNs = smGetMonotonicTimeNs();
+				assert(smSharedTelemetryWrite(pub, 0, &sample) == SM_OK);
+			}
+			smSleepUs(100);
+		}
+		assert(waitpid(pid, &status, 0) == pid);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		smSharedTelemetryClose(pub);
+	}
+
+	return 0;
+}
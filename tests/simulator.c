@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../bufferedmotion.h"
+#include "../drivers/simulator/smsimulator.h"
+
+static smbus open_simulator(const char *name) {
+	return smOpenBusWithCallbacks(name, simulatorPortOpen, simulatorPortClose, simulatorPortRead, simulatorPortWrite, simulatorPortMiscOperation);
+}
+
+int main(void) {
+	smbus h = open_simulator("SIM:2");
+	assert(h >= 0);
+
+	{
+		smint32 version = 0, address = 0;
+		assert(smRead2Parameters(h, 2, SMP_SM_VERSION, &version, SMP_NODE_ADDRSS, &address) == SM_OK);
+		assert(version == 28);
+		assert(address == 2);
+	}
+
+	{
+		// parameter store, min/max attributes and range checking
+		smint32 value = 0;
+		assert(smSetParameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, 1234) == SM_OK);
+		assert(smRead1Parameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 1234);
+		assert(smRead1Parameter(h, 1, SMP_TRAJ_PLANNER_ACCEL | SMP_MAX_VALUE_MASK, &value) == SM_OK);
+		assert(value == 32767);
+
+		assert(smSetParameter(h, 1, SMP_CUMULATIVE_STATUS, 0) == SM_OK);
+		assert(smSetParameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, 40000) == SM_OK);
+		assert(smRead1Parameter(h, 1, SMP_CUMULATIVE_STATUS, &value) == SM_OK);
+		assert(value == SMP_CMD_STATUS_VALUE_TOO_HIGH);
+		assert(smRead1Parameter(h, 1, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 1234);
+
+		// unsupported parameter returns SMP_CMD_STATUS_INVALID_ADDR
+		assert(smRead1Parameter(h, 1, 4321, &value) == SM_OK);
+		assert(value == SMP_CMD_STATUS_INVALID_ADDR);
+		assert(smRead1Parameter(h, 1, 4321 | SMP_PROPERTIES_MASK, &value) == SM_OK);
+		assert(value == 0);
+	}
+
+	{
+		// broadcast write reaches all nodes
+		smint32 flags1 = 0, flags2 = 0;
+		assert(smSetParameter(h, 0, SMP_DRIVE_FLAGS, 5) == SM_OK);
+		assert(smRead1Parameter(h, 1, SMP_DRIVE_FLAGS, &flags1) == SM_OK);
+		assert(smRead1Parameter(h, 2, SMP_DRIVE_FLAGS, &flags2) == SM_OK);
+		assert(flags1 == 5 && flags2 == 5);
+	}
+
+	{
+		// no reply from non-existing node
+		smint32 value;
+		assert(smRead1Parameter(h, 3, SMP_SM_VERSION, &value) != SM_OK);
+		resetCumulativeStatus(h);
+	}
+
+	{
+		smuint16 read1 = 0, read2 = 0;
+		assert(smFastUpdateCycle(h, 2, 1000, 0, &read1, &read2) == SM_OK);
+		assert(read1 == 1000);
+		assert(read2 & STAT_SERVO_READY);
+	}
+
+	{
+		// buffered motion is executed at SMP_BUFFERED_CMD_PERIOD pace and returns position feedback of each setpoint
+		BufferedMotionAxis axis;
+		smint32 fill[10], received[40], numReceived = 0, bytesFilled, i, iterations;
+
+		assert(smBufferedInit(&axis, h, 1, 2500, SMP_ACTUAL_POSITION_FB, SMPRET_32B) == SM_OK);
+		assert(smBufferedRunAndSyncClocks(&axis) == SM_OK);
+		for (i = 0; i < 10; i++)
+			fill[i] = i * 100 - 300;
+		assert(smBufferedFillAndReceive(&axis, 10, fill, &i, received, &bytesFilled) == SM_OK);
+		numReceived += i;
+		for (iterations = 0; iterations < 1000 && numReceived < 10; iterations++) {
+			smSleepMs(1);
+			assert(smBufferedFillAndReceive(&axis, 0, fill, &i, received + numReceived, &bytesFilled) == SM_OK);
+			numReceived += i;
+		}
+		assert(numReceived == 10);
+		assert(memcmp(fill, received, sizeof(fill)) == 0);
+		assert(smBufferedDeinit(&axis) == SM_OK);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+
+	{
+		// wire delay and turnaround latency
+		smbus timed;
+		smint32 value;
+		smuint64 start;
+
+		smSetSimulatorTiming(smtrue, 500);
+		timed = open_simulator("SIM");
+		assert(timed >= 0);
+		start = smGetMonotonicTimeNs();
+		assert(smRead1Parameter(timed, 1, SMP_SM_VERSION, &value) == SM_OK);
+		// 15 bytes out and 9 bytes back at 460800 bps, plus latency
+		assert(smGetMonotonicTimeNs() - start >= 500000 + 24 * 10 * 1000000000ULL / 460800);
+		assert(smCloseBus(timed) == SM_OK);
+		smSetSimulatorTiming(smfalse, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../telemetry.h"
+#include "../drivers/simulator/smsimulator.h"
+#include "countingwrite.h"
+
+int main(void) {
+	SM_TELEMETRY_SAMPLE sample;
+	SMTelemetry *t;
+	smuint32 nextDueMs;
+	int items[20], i;
+	smbus h = smOpenBusWithCallbacks("SIM:2", simulatorPortOpen, simulatorPortClose, simulatorPortRead, counting_write, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 1000) == SM_OK);
+	assert(smSetParameter(h, 2, SMP_ABSOLUTE_SETPOINT, -2000) == SM_OK);
+
+	{
+		// invalid items
+		t = smTelemetryCreate(h);
+		assert(t != NULL);
+		assert(smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 0) == -1);
+		assert(smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 60001) == -1);
+		assert(smTelemetryAddItem(t, 0, SMP_ACTUAL_POSITION_FB, 10) == -1);
+		assert(smTelemetryRead(t, 0, &sample) == SM_ERR_PARAMETER);
+		for (i = 0; i < SM_TELEMETRY_MAX_RATE_GROUPS; i++)
+			assert(smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, i + 1) == i);
+		assert(smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 100) == -1);
+		assert(smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 1) == SM_TELEMETRY_MAX_RATE_GROUPS);
+		smTelemetryDestroy(t);
+	}
+
+	{
+		// due items of one node are read with one frame, rate groups are polled on their own period
+		t = smTelemetryCreate(h);
+		items[0] = smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 10);
+		items[1] = smTelemetryAddItem(t, 2, SMP_ACTUAL_POSITION_FB, 10);
+		items[2] = smTelemetryAddItem(t, 1, SMP_ABSOLUTE_SETPOINT, 1000);
+		items[3] = smTelemetryAddItem(t, 2, SMP_ABSOLUTE_SETPOINT, 1000);
+		items[4] = smTelemetryAddItem(t, 1, SMP_STATUS, 1000);
+		assert(smTelemetryRead(t, items[0], &sample) == SM_OK);
+		assert(sample.updates == 0 && sample.timestampNs == 0);
+
+		frames = 0;
+		assert(smTelemetryPoll(t, &nextDueMs) == SM_OK);
+		assert(frames == 2);
+		assert(nextDueMs >= 1 && nextDueMs <= 10);
+		assert(smTelemetryRead(t, items[0], &sample) == SM_OK);
+		assert(sample.value == 1000 && sample.status == SM_OK && sample.updates == 1 && sample.timestampNs != 0);
+		assert(smTelemetryRead(t, items[1], &sample) == SM_OK);
+		assert(sample.value == -2000);
+		assert(smTelemetryRead(t, items[3], &sample) == SM_OK);
+		assert(sample.value == -2000 && sample.updates == 1);
+
+		// nothing due right after poll
+		frames = 0;
+		assert(smTelemetryPoll(t, NULL) == SM_OK);
+		assert(frames == 0);
+
+		// only the fast group is due
+		assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 1500) == SM_OK);
+		smSleepMs(15);
+		frames = 0;
+		assert(smTelemetryPoll(t, NULL) == SM_OK);
+		assert(frames == 2);
+		assert(smTelemetryRead(t, items[0], &sample) == SM_OK);
+		assert(sample.value == 1500 && sample.updates == 2);
+		assert(smTelemetryRead(t, items[2], &sample) == SM_OK);
+		assert(sample.value == 1000 && sample.updates == 1);
+		smTelemetryDestroy(t);
+	}
+
+	{
+		// items that don't fit in one frame are split
+		t = smTelemetryCreate(h);
+		for (i = 0; i < 20; i++)
+			items[i] = smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 50);
+		frames = 0;
+		assert(smTelemetryPoll(t, NULL) == SM_OK);
+		assert(frames == 2);
+		for (i = 0; i < 20; i++) {
+			assert(smTelemetryRead(t, items[i], &sample) == SM_OK);
+			assert(sample.value == 1500 && sample.updates == 1);
+		}
+		smTelemetryDestroy(t);
+	}
+
+	{
+		// failed read keeps the previous value
+		t = smTelemetryCreate(h);
+		items[0] = smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 1);
+		items[1] = smTelemetryAddItem(t, 5, SMP_ACTUAL_POSITION_FB, 1);
+		assert(smTelemetryPoll(t, NULL) != SM_OK);
+		assert(smTelemetryRead(t, items[0], &sample) == SM_OK);
+		assert(sample.status == SM_OK && sample.updates == 1);
+		assert(smTelemetryRead(t, items[1], &sample) == SM_OK);
+		assert(sample.status != SM_OK && sample.updates == 0);
+		resetCumulativeStatus(h);
+		smTelemetryDestroy(t);
+	}
+
+	{
+		// worker thread polls in the background while application uses the bus
+		smint32 value;
+
+		t = smTelemetryCreate(h);
+		items[0] = smTelemetryAddItem(t, 1, SMP_ACTUAL_POSITION_FB, 2);
+		assert(smTelemetryStart(t) == SM_OK);
+		assert(smTelemetryStart(t) == SM_ERR_PARAMETER);
+		assert(smTelemetryAddItem(t, 1, SMP_STATUS, 2) == -1);
+
+		smTelemetryLockBus(t);
+		assert(smSetParameter(h, 1, SMP_ABSOLUTE_SETPOINT, 3000) == SM_OK);
+		assert(smRead1Parameter(h, 1, SMP_ACTUAL_POSITION_FB, &value) == SM_OK);
+		assert(value == 3000);
+		smTelemetryUnlockBus(t);
+
+		for (i = 0; i < 1000; i++) {
+			assert(smTelemetryRead(t, items[0], &sample) == SM_OK);
+			if (sample.value == 3000 && sample.updates >= 5)
+				break;
+			smSleepMs(1);
+		}
+		assert(sample.value == 3000 && sample.updates >= 5);
+		assert(smTelemetryStop(t) == SM_OK);
+		assert(smTelemetryStop(t) == SM_OK);
+		smTelemetryDestroy(t);
+	}
+
+	assert(getCumulativeStatus(h) == SM_OK);
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../transactiontemplate.h"
+#include "../drivers/simulator/smsimulator.h"
+
+// simulator wrapper that keeps copy of the last transmitted frame
+static unsigned char last_frame[256];
+static int last_frame_len;
+
+static smint32 recording_write(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	memcpy(last_frame, buf, size);
+	last_frame_len = size;
+	return simulatorPortWrite(busdevicePointer, buf, size);
+}
+
+typedef struct {
+	smint32 setpoint;
+	smint32 position;
+	smint32 accel;
+} Feedback;
+
+int main(void) {
+	SM_TRANSACTION_TEMPLATE tpl;
+	Feedback fb;
+	smint32 value;
+	int setpoint, accel, i;
+	smbus h = smOpenBusWithCallbacks("SIM", simulatorPortOpen, simulatorPortClose, simulatorPortRead, recording_write, simulatorPortMiscOperation);
+	assert(h >= 0);
+
+	{
+		// writes are encoded exactly like with command queue
+		unsigned char queued[256];
+		int queued_len;
+
+		assert(smAppendSetParamCommandToQueue(h, SMP_ABSOLUTE_SETPOINT, -123456) == SM_OK);
+		assert(smAppendSetParamCommandToQueue(h, SMP_TRAJ_PLANNER_ACCEL, 200) == SM_OK);
+		assert(smAppendGetParamCommandToQueue(h, SMP_ACTUAL_POSITION_FB) == SM_OK);
+		assert(smExecuteCommandQueue(h, 1) == SM_OK);
+		memcpy(queued, last_frame, last_frame_len);
+		queued_len = last_frame_len;
+
+		smTemplateInit(&tpl);
+		setpoint = smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, 0);
+		accel = smTemplateAppendSetParam(&tpl, SMP_TRAJ_PLANNER_ACCEL, 200);
+		assert(setpoint == 0 && accel == 1);
+		assert(smTemplateAppendGetParam(&tpl, SMP_ACTUAL_POSITION_FB, offsetof(Feedback, position)) == 0);
+		smTemplateSetValue(&tpl, setpoint, -123456);
+		assert(smTemplateExecute(h, 1, &tpl, &fb) == SM_OK);
+		assert(last_frame_len == queued_len);
+		assert(memcmp(last_frame, queued, queued_len) == 0);
+		assert(fb.position == -123456);
+	}
+
+	{
+		// values are patched and read values are delivered to struct on every cycle
+		smTemplateInit(&tpl);
+		setpoint = smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, 0);
+		smTemplateAppendGetParam(&tpl, SMP_ABSOLUTE_SETPOINT, offsetof(Feedback, setpoint));
+		smTemplateAppendGetParam(&tpl, SMP_ACTUAL_POSITION_FB, offsetof(Feedback, position));
+		smTemplateAppendGetParam(&tpl, SMP_TRAJ_PLANNER_ACCEL, offsetof(Feedback, accel));
+		for (i = -3; i <= 3; i++) {
+			memset(&fb, 0, sizeof(fb));
+			smTemplateSetValue(&tpl, setpoint, i * 100000);
+			assert(smTemplateExecute(h, 1, &tpl, &fb) == SM_OK);
+			assert(fb.setpoint == i * 100000);
+			assert(fb.position == i * 100000);
+			assert(fb.accel == 200);
+		}
+		assert(smRead1Parameter(h, 1, SMP_ABSOLUTE_SETPOINT, &value) == SM_OK);
+		assert(value == 300000);
+
+		// result struct is optional
+		assert(smTemplateExecute(h, 1, &tpl, NULL) == SM_OK);
+		assert(getCumulativeStatus(h) == SM_OK);
+	}
+
+	{
+		// template has room for one frame
+		smTemplateInit(&tpl);
+		for (i = 0; i < SM_TEMPLATE_MAX_ITEMS; i++)
+			assert(smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, i) == i);
+		assert(smTemplateAppendSetParam(&tpl, SMP_ABSOLUTE_SETPOINT, i) == -1);
+		assert(tpl.payloadLength <= 120);
+
+		smTemplateInit(&tpl);
+		for (i = 0; i < SM_TEMPLATE_MAX_READS; i++)
+			assert(smTemplateAppendGetParam(&tpl, SMP_STATUS, 0) == i);
+		assert(smTemplateAppendGetParam(&tpl, SMP_STATUS, 0) == -1);
+		assert(tpl.payloadLength <= 120);
+		assert(smTemplateExecute(h, 1, &tpl, &fb) == SM_OK);
+	}
+
+	{
+		// missing node
+		assert(smSetTimeout(50) == SM_OK);
+		assert(smTemplateExecute(h, 2, &tpl, &fb) != SM_OK);
+		resetCumulativeStatus(h);
+		assert(smTemplateExecute(77, 1, &tpl, &fb) == SM_ERR_NODEVICE);
+	}
+
+	assert(smCloseBus(h) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,198 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../simplemotion.h"
+#include "../simplemotion_private.h"
+#include "../drivers/uring/smuring.h"
+#include "../drivers/tcpip/tcpclient.h"
+
+#define THREADS 8
+#define ROUNDS 200
+
+// thread writes to its own socket pair through the ring and reads it back from the other end
+static void *pingpong_thread(void *arg) {
+	int fds[2], i;
+	smuint8 out[4], in[4];
+	(void)arg;
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0 || !smUringAttach(fds[0]) || !smUringAttach(fds[1]))
+		return (void *)1;
+	for (i = 0; i < ROUNDS; i++) {
+		memcpy(out, &i, sizeof(i));
+		if (smUringWrite(fds[0], out, sizeof(out)) != sizeof(out))
+			return (void *)2;
+		if (smUringRead(fds[1], in, sizeof(in), 1000) != sizeof(in) || memcmp(in, out, sizeof(in)) != 0)
+			return (void *)3;
+	}
+	smUringDetach(fds[0]);
+	smUringDetach(fds[1]);
+	close(fds[0]);
+	close(fds[1]);
+	return NULL;
+}
+
+static void *echo_thread(void *arg) {
+	int listener = (int)(intptr_t)arg, fd, n;
+	char buf[64];
+	fd = accept(listener, NULL, NULL);
+	assert(fd >= 0);
+	while ((n = (int)recv(fd, buf, sizeof(buf), 0)) > 0)
+		assert(send(fd, buf, n, 0) == n);
+	close(fd);
+	return NULL;
+}
+
+// open TCP/IP driver to an echo server and check that frames come back
+static void tcp_echo(smbool uring) {
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	char name[32];
+	pthread_t thread;
+	smBusdevicePointer port;
+	smbool success;
+	smuint8 buf[8];
+	smuint64 start;
+	int listener = socket(AF_INET, SOCK_STREAM, 0), i, j;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(listener, 1) == 0);
+	assert(getsockname(listener, (struct sockaddr *)&addr, &len) == 0);
+	assert(pthread_create(&thread, NULL, echo_thread, (void *)(intptr_t)listener) == 0);
+
+	snprintf(name, sizeof(name), "127.0.0.1:%d", ntohs(addr.sin_port));
+	port = tcpipPortOpen(name, SM_BAUDRATE, &success);
+	assert(success == smtrue);
+	assert(smUringAttached((int)(intptr_t)port) == uring);
+	for (i = 0; i < 10; i++) {
+		smuint8 frame[6] = {1, 2, 3, 4, 5, (smuint8)i};
+		assert(tcpipPortWrite(port, frame, sizeof(frame)) == sizeof(frame));
+		for (j = 0; j < 6; j++) {
+			assert(tcpipPortRead(port, buf, 1) == 1);
+			assert(buf[0] == frame[j]);
+		}
+	}
+
+	// missing reply times out
+	assert(smSetTimeout(20) == SM_OK);
+	start = smGetMonotonicTimeNs();
+	assert(tcpipPortRead(port, buf, 1) == -1);
+	assert(smGetMonotonicTimeNs() - start >= 15000000ULL);
+	assert(smSetTimeout(SM_READ_TIMEOUT) == SM_OK);
+
+	assert(tcpipMiscOperation(port, MiscOperationFlushTX) == smtrue);
+	assert(tcpipMiscOperation(port, MiscOperationPurgeRX) == smtrue);
+	tcpipPortClose(port);
+	assert(pthread_join(thread, NULL) == 0);
+	close(listener);
+}
+
+int main(void) {
+	smuint8 buf[16];
+	int fds[2], pair[2], i;
+	smbool available;
+
+	// write to a closed socket fails instead of killing the test
+	signal(SIGPIPE, SIG_IGN);
+	assert(smUringAttach(-1) == smfalse);
+	assert(smUringAttach(SM_URING_MAX_FDS) == smfalse);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	available = smUringAttach(fds[0]) && smUringAttach(fds[1]) ? smtrue : smfalse;
+	if (available) {
+		{
+			// reply is fetched at once and served byte by byte from buffer
+			assert(smUringAttached(fds[0]) && smUringAttached(fds[1]));
+			assert(smUringWrite(fds[0], (const smuint8 *)"hello", 5) == 5);
+			for (i = 0; i < 5; i++) {
+				assert(smUringRead(fds[1], buf, 1, 1000) == 1);
+				assert(buf[0] == "hello"[i]);
+			}
+		}
+
+		{
+			// nothing to read times out
+			smuint64 start = smGetMonotonicTimeNs();
+			assert(smUringRead(fds[1], buf, sizeof(buf), 20) == 0);
+			assert(smGetMonotonicTimeNs() - start >= 15000000ULL);
+		}
+
+		{
+			// discarded bytes are not returned
+			assert(smUringWrite(fds[0], (const smuint8 *)"abc", 3) == 3);
+			assert(smUringRead(fds[1], buf, 1, 1000) == 1 && buf[0] == 'a');
+			smUringDiscardRX(fds[1]);
+			assert(smUringWrite(fds[0], (const smuint8 *)"d", 1) == 1);
+			assert(smUringRead(fds[1], buf, sizeof(buf), 1000) == 1 && buf[0] == 'd');
+		}
+
+		{
+			// long write is written whole, failed write returns error right away
+			smuint8 out[2000], in[2000];
+			int received = 0, n;
+			for (i = 0; i < (int)sizeof(out); i++)
+				out[i] = (smuint8)(i * 7);
+			assert(smUringWrite(fds[0], out, sizeof(out)) == sizeof(out));
+			while (received < (int)sizeof(in) && (n = smUringRead(fds[1], in + received, sizeof(in) - received, 1000)) > 0)
+				received += n;
+			assert(received == sizeof(in) && memcmp(in, out, sizeof(in)) == 0);
+
+			assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+			assert(smUringAttach(pair[0]) == smtrue);
+			close(pair[1]);
+			assert(smUringWrite(pair[0], out, 1) == -1);
+			smUringDetach(pair[0]);
+			close(pair[0]);
+		}
+
+		{
+			// detached descriptors use plain I/O
+			for (i = 0; i < 2; i++) {
+				smUringDetach(fds[i]);
+				assert(smUringAttached(fds[i]) == smfalse);
+				assert(smUringRead(fds[i], buf, 1, 0) == -1);
+				close(fds[i]);
+			}
+		}
+
+		{
+			// threads share the ring
+			pthread_t threads[THREADS];
+			void *result;
+			for (i = 0; i < THREADS; i++)
+				assert(pthread_create(&threads[i], NULL, pingpong_thread, NULL) == 0);
+			for (i = 0; i < THREADS; i++) {
+				assert(pthread_join(threads[i], &result) == 0);
+				assert(result == NULL);
+			}
+		}
+	} else {
+		printf("uring: io_uring not available, testing plain I/O only\n");
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	{
+		// TCP/IP driver reads reply byte by byte
+		tcp_echo(available);
+	}
+
+	{
+		// busy-poll mode spins before blocking wait
+		assert(smSetBusyPoll(100001) == SM_ERR_PARAMETER);
+		assert(smSetBusyPoll(2000) == SM_OK);
+		tcp_echo(available);
+		assert(smSetBusyPoll(0) == SM_OK);
+	}
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+//Precompiled SM transactions, see transactiontemplate.h
+//Copyright (c) Granite Devices Oy
+
+#include "transactiontemplate.h"
+#include "simplemotion_private.h"
+#include "sm485.h"
+#include <string.h>
+
+//appends subpacket to payload and returns its offset. caller checks that it fits
+static int smTemplateAppendSubpacket( SM_TRANSACTION_TEMPLATE *tpl, int type, smint32 value )
+{
+    int offset=tpl->payloadLength;
+
+    tpl->payloadLength+=smEncodeSubpacket(&tpl->payload[offset],type,value);
+    tpl->numSubpackets++;
+    return offset;
+}
+
+LIB void smTemplateInit( SM_TRANSACTION_TEMPLATE *tpl )
+{
+    memset(tpl,0,sizeof(SM_TRANSACTION_TEMPLATE));
+    tpl->returnLengthSet=smfalse;
+    tpl->invalidatesNodeInfo=smfalse;
+}
+
+LIB int smTemplateAppendSetParam( SM_TRANSACTION_TEMPLATE *tpl, smint16 paramAddress, smint32 value )
+{
+    if(tpl->numSubpackets+2>SM_TEMPLATE_MAX_SUBPACKETS || tpl->payloadLength+2+4>SM_TEMPLATE_MAX_PAYLOAD_BYTES)
+        return -1;
+
+    smTemplateAppendSubpacket(tpl,SM_SET_WRITE_ADDRESS,paramAddress);
+    tpl->valueOffset[tpl->numValues]=(smuint8)smTemplateAppendSubpacket(tpl,SM_WRITE_VALUE_32B,value);
+
+    //following reads must set return length again
+    if(paramAddress==SMP_RETURN_PARAM_LEN)
+        tpl->returnLengthSet=smfalse;
+    //restart and firmware upload may change identification of device
+    if((paramAddress==SMP_SYSTEM_CONTROL && (value==SMP_SYSTEM_CONTROL_RESTART || value==SMP_SYSTEM_CONTROL_RESTART_TO_DFU_MODE))
+            || paramAddress==SMP_BOOTLOADER_FUNCTION)
+        tpl->invalidatesNodeInfo=smtrue;
+
+    return tpl->numValues++;
+}
+
+LIB int smTemplateAppendGetParam( SM_TRANSACTION_TEMPLATE *tpl, smint16 paramAddress, size_t resultOffset )
+{
+    int subpackets=tpl->returnLengthSet==smtrue ? 2 : 4;
+
+    if(tpl->numSubpackets+subpackets>SM_TEMPLATE_MAX_SUBPACKETS || tpl->payloadLength+subpackets*5/2>SM_TEMPLATE_MAX_PAYLOAD_BYTES)
+        return -1;
+
+    //unlike smAppendGetParamCommandToQueue, return length is set only once per template
+    if(tpl->returnLengthSet==smfalse)
+    {
+        smTemplateAppendSubpacket(tpl,SM_SET_WRITE_ADDRESS,SMP_RETURN_PARAM_LEN);
+        smTemplateAppendSubpacket(tpl,SM_WRITE_VALUE_24B,SMPRET_32B);
+        tpl->returnLengthSet=smtrue;
+    }
+    smTemplateAppendSubpacket(tpl,SM_SET_WRITE_ADDRESS,SMP_RETURN_PARAM_ADDR);
+    smTemplateAppendSubpacket(tpl,SM_WRITE_VALUE_24B,paramAddress);
+
+    //value is returned by the subpacket that sets return address
+    tpl->resultSubpacket[tpl->numResults]=tpl->numSubpackets-1;
+    tpl->resultOffset[tpl->numResults]=resultOffset;
+    return tpl->numResults++;
+}
+
+LIB void smTemplateSetValue( SM_TRANSACTION_TEMPLATE *tpl, int valueIndex, smint32 value )
+{
+    smEncodeSubpacket(&tpl->payload[tpl->valueOffset[valueIndex]],SM_WRITE_VALUE_32B,value);
+}
+
+//store read values of template from received reply to results
+static SM_STATUS smTemplateDecodeReply( const smbus handle, const SM_TRANSACTION_TEMPLATE *tpl, void *results )
+{
+    const smuint8 *reply;
+    smint16 replyLen;
+    int subpacket, pos=0, result=0;
+
+    replyLen=smGetReceivedPayload(handle,&reply);
+    for(subpacket=0;subpacket<tpl->numSubpackets && result<tpl->numResults;subpacket++)
+    {
+        smint32 value;
+        int len=smDecodeReturnValue(&reply[pos],replyLen-pos,&value);
+
+        if(len==0)
+            break;
+
+        if(tpl->resultSubpacket[result]==subpacket)
+        {
+            if(results!=NULL)
+                memcpy((char*)results+tpl->resultOffset[result],&value,sizeof(value));
+            result++;
+        }
+        pos+=len;
+    }
+
+    if(result<tpl->numResults)
+    {
+        smDebug(handle,SMDebugLow,"smTemplateExecute: reply has too few return values\n");
+        return SM_ERR_LENGTH;
+    }
+    return SM_OK;
+}
+
+LIB SM_STATUS smTemplateExecute( const smbus handle, const smaddr nodeAddress, const SM_TRANSACTION_TEMPLATE *tpl, void *results )
+{
+    SM_STATUS stat;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    if(tpl->invalidatesNodeInfo==smtrue)
+        smInvalidateNodeInfo(handle,nodeAddress);
+
+    stat=smTransmitReceiveFrame(handle,nodeAddress,SMCMD_INSTANT_CMD,tpl->payloadLength,(smuint8*)tpl->payload);
+    if(stat!=SM_OK || nodeAddress==0)
+        return recordStatus(handle,stat);
+
+    return recordStatus(handle,smTemplateDecodeReply(handle,tpl,results));
+}
+
+//batch being executed by smTemplateExecuteBatch
+typedef struct
+{
+    smbus handle;
+    SM_TEMPLATE_TRANSACTION *transactions;
+    int count;
+} SM_TEMPLATE_BATCH;
+
+static smbool smTemplateBatchNextFrame( void *context, int index, smaddr *address, smuint8 *cmdid, smuint8 *payloadLen, smuint8 **payload )
+{
+    SM_TEMPLATE_BATCH *batch=(SM_TEMPLATE_BATCH*)context;
+    SM_TEMPLATE_TRANSACTION *transaction=&batch->transactions[index];
+
+    if(index>=batch->count)
+        return smfalse;
+
+    if(transaction->tpl->invalidatesNodeInfo==smtrue)
+        smInvalidateNodeInfo(batch->handle,transaction->nodeAddress);
+
+    *address=transaction->nodeAddress;
+    *cmdid=SMCMD_INSTANT_CMD;
+    *payloadLen=transaction->tpl->payloadLength;
+    *payload=(smuint8*)transaction->tpl->payload;
+    return smtrue;
+}
+
+static SM_STATUS smTemplateBatchReply( void *context, int index, SM_STATUS stat )
+{
+    SM_TEMPLATE_BATCH *batch=(SM_TEMPLATE_BATCH*)context;
+    SM_TEMPLATE_TRANSACTION *transaction=&batch->transactions[index];
+
+    if(stat==SM_OK && transaction->nodeAddress!=0)
+        stat=smTemplateDecodeReply(batch->handle,transaction->tpl,transaction->results);
+    transaction->status=stat;
+    return stat;
+}
+
+LIB SM_STATUS smTemplateExecuteBatch( const smbus handle, SM_TEMPLATE_TRANSACTION *transactions, int count )
+{
+    SM_TEMPLATE_BATCH batch;
+    int i;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    if(count<0) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    //transactions that are not sent due to errors keep this
+    for(i=0;i<count;i++)
+        transactions[i].status=SM_NONE;
+
+    batch.handle=handle;
+    batch.transactions=transactions;
+    batch.count=count;
+    return recordStatus(handle,smTransmitReceivePipelined(handle,smTemplateBatchNextFrame,smTemplateBatchReply,&batch,smfalse));
+}
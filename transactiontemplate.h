@@ -0,0 +1,106 @@
+//Precompiled SM transactions for cyclic command sequences
+//Copyright (c) Granite Devices Oy
+
+#ifndef TRANSACTIONTEMPLATE_H
+#define TRANSACTIONTEMPLATE_H
+
+#include <stddef.h>
+#include "simplemotion.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* Transaction template is an alternative to building the same command queue with smAppendGetParamCommandToQueue and
+ * smAppendSetParamCommandToQueue on every cycle of a polling loop. Template is built once, subpackets are encoded to
+ * payload bytes at that time. On each cycle only changed values are patched to the payload with smTemplateSetValue and
+ * smTemplateExecute sends it and decodes the read values directly to a user struct.
+ *
+ * I.e.:
+ *  typedef struct { smint32 position, status; } Feedback;
+ *  SM_TRANSACTION_TEMPLATE tpl;
+ *  Feedback fb;
+ *  int setpoint;
+ *
+ *  smTemplateInit(&tpl);
+ *  setpoint=smTemplateAppendSetParam(&tpl,SMP_ABSOLUTE_SETPOINT,0);
+ *  smTemplateAppendGetParam(&tpl,SMP_ACTUAL_POSITION_FB,offsetof(Feedback,position));
+ *  smTemplateAppendGetParam(&tpl,SMP_STATUS,offsetof(Feedback,status));
+ *
+ *  while(running)
+ *  {
+ *      smTemplateSetValue(&tpl,setpoint,nextSetpoint());
+ *      smTemplateExecute(handle,nodeAddress,&tpl,&fb);
+ *  }
+ *
+ * Template doesn't depend on bus or node, the same template may be executed on many nodes.
+ */
+
+#define SM_TEMPLATE_MAX_PAYLOAD_BYTES 120
+//device returns up to 4 bytes for each subpacket and reply must also fit in SM_TEMPLATE_MAX_PAYLOAD_BYTES
+#define SM_TEMPLATE_MAX_SUBPACKETS (SM_TEMPLATE_MAX_PAYLOAD_BYTES/4)
+//max number of writes (2 subpackets each) or reads (2 subpackets each plus 2 for setting return length)
+#define SM_TEMPLATE_MAX_ITEMS (SM_TEMPLATE_MAX_SUBPACKETS/2)
+//max number of reads in a template that has only reads, one subpacket pair is used for setting return length
+#define SM_TEMPLATE_MAX_READS (SM_TEMPLATE_MAX_ITEMS-1)
+
+typedef struct
+{
+    smuint8 payload[SM_TEMPLATE_MAX_PAYLOAD_BYTES];//encoded subpackets
+    smuint8 payloadLength;
+    smuint8 numSubpackets;//number of subpackets in payload, device returns one subpacket for each
+    smuint8 numValues;
+    smuint8 valueOffset[SM_TEMPLATE_MAX_ITEMS];//payload offset of value subpacket of each smTemplateAppendSetParam
+    smuint8 numResults;
+    smuint8 resultSubpacket[SM_TEMPLATE_MAX_ITEMS];//index of return subpacket that carries value of each smTemplateAppendGetParam
+    size_t resultOffset[SM_TEMPLATE_MAX_ITEMS];//where value of each smTemplateAppendGetParam is stored in result struct
+    smbool returnLengthSet;//SMP_RETURN_PARAM_LEN has been set to 32 bits by earlier subpacket
+    smbool invalidatesNodeInfo;//template restarts device, see smGetNodeInfo
+} SM_TRANSACTION_TEMPLATE;
+
+/** Initialize empty template */
+LIB void smTemplateInit( SM_TRANSACTION_TEMPLATE *tpl );
+
+/** Append write of parameter to template. Template may contain up to SM_TEMPLATE_MAX_ITEMS writes or up to
+ * SM_TEMPLATE_MAX_READS reads, each write takes space of one read.
+  -return value: index of value to be used with smTemplateSetValue, -1 if template is full
+*/
+LIB int smTemplateAppendSetParam( SM_TRANSACTION_TEMPLATE *tpl, smint16 paramAddress, smint32 value );
+
+/** Append read of parameter to template. Value is stored as smint32 at resultOffset bytes from the start of result struct
+ * given to smTemplateExecute, use offsetof() to get it.
+  -return value: index of read value in template, -1 if template is full
+*/
+LIB int smTemplateAppendGetParam( SM_TRANSACTION_TEMPLATE *tpl, smint16 paramAddress, size_t resultOffset );
+
+/** Change value written by template. valueIndex is return value of smTemplateAppendSetParam, it's not checked. */
+LIB void smTemplateSetValue( SM_TRANSACTION_TEMPLATE *tpl, int valueIndex, smint32 value );
+
+/** Send template to node as one instant command and store read values to results (may be NULL if template has no reads).
+  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
+*/
+LIB SM_STATUS smTemplateExecute( const smbus handle, const smaddr nodeAddress, const SM_TRANSACTION_TEMPLATE *tpl, void *results );
+
+//one transaction of smTemplateExecuteBatch
+typedef struct
+{
+    smaddr nodeAddress;
+    const SM_TRANSACTION_TEMPLATE *tpl;
+    void *results;//may be NULL if template has no reads
+    SM_STATUS status;//set by smTemplateExecuteBatch
+} SM_TEMPLATE_TRANSACTION;
+
+/** Execute several templates like smTemplateExecute, i.e. polling all nodes of a bus. On buses that have a send window
+ * for pipelining (see smSetPipelineWindow) frames to different nodes are sent without waiting for replies of the earlier
+ * ones, so a batch through a TCP/IP gateway takes about one network round trip per transaction to the same node instead
+ * of one per transaction. Failure of a transaction
+ * doesn't stop the others, status of each one is stored to its status field.
+  -return value: SM_OK if all transactions succeeded, otherwise error bits of the failed ones
+*/
+LIB SM_STATUS smTemplateExecuteBatch( const smbus handle, SM_TEMPLATE_TRANSACTION *transactions, int count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRANSACTIONTEMPLATE_H
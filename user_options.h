@@ -9,9 +9,19 @@
 // Commenting out this will also disable smDescribe* functions.
 #define ENABLE_DEBUG_PRINTS
 
-//max number of simultaneously opened buses. change this and recompiple SMlib if
-//necessary (to increase channels or reduce to save memory)
-#define SM_MAX_BUSES 10
+//max number of simultaneously opened buses. memory for bus state is allocated only for opened buses,
+//this limits only the size of handle table (one pointer per 16 buses)
+#define SM_MAX_BUSES 1024
+
+//comment out to use only the basic byte-wise CRC tables. fast CRC uses slicing-by-8 tables and
+//carry-less multiply instructions when available (x86 PCLMULQDQ, ARMv8 PMULL) for long buffers
+//at cost of 6 kB additional constant data
+#define ENABLE_FAST_CRC
+
+//uncomment to do I/O of serial and TCP/IP drivers through io_uring on Linux instead of plain read/write/poll. io_uring
+//lets all buses share one ring and needs one system call per write and usually one per reply instead of several per
+//reply byte. it's used only if the kernel supports it, which is checked at runtime
+//#define ENABLE_IO_URING
 
 
 #endif // USER_OPTIONS_H